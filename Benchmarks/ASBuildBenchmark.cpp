@@ -0,0 +1,333 @@
+#include "BenchmarkContext.h"
+
+namespace vr::Bench
+{
+    using BuildFlags = vk::BuildAccelerationStructureFlagBitsKHR;
+
+    // Procedural height field, the index buffer is split into equal ranges, one per geometry
+    struct ProceduralMesh
+    {
+        AllocatedBuffer VertexBuffer = {};
+        AllocatedBuffer IndexBuffer = {};
+        uint32_t VertexCount = 0;
+        uint32_t TriangleCount = 0;
+    };
+
+    static ProceduralMesh CreateGridMesh(BenchmarkContext& context, uint32_t triangleCount)
+    {
+        const uint32_t resolution = std::max((uint32_t)std::ceil(std::sqrt(triangleCount / 2.0)), 1u);
+
+        std::vector<float> vertices;
+        vertices.reserve((size_t)(resolution + 1) * (resolution + 1) * 3);
+        for (uint32_t y = 0; y <= resolution; y++)
+        {
+            for (uint32_t x = 0; x <= resolution; x++)
+            {
+                const float u = (float)x / resolution;
+                const float v = (float)y / resolution;
+                vertices.insert(vertices.end(), {u, 0.1f * std::sin(u * 40.0f) * std::cos(v * 40.0f), v});
+            }
+        }
+
+        std::vector<uint32_t> indices;
+        indices.reserve((size_t)triangleCount * 3);
+        for (uint32_t t = 0; t < triangleCount; t++)
+        {
+            const uint32_t quad = (t / 2) % (resolution * resolution);
+            const uint32_t v0 = (quad / resolution) * (resolution + 1) + quad % resolution;
+            const uint32_t v1 = v0 + 1;
+            const uint32_t v2 = v0 + resolution + 1;
+            const uint32_t v3 = v2 + 1;
+
+            if (t % 2 == 0)
+                indices.insert(indices.end(), {v0, v2, v1});
+            else
+                indices.insert(indices.end(), {v1, v2, v3});
+        }
+
+        ProceduralMesh outMesh = {};
+        outMesh.VertexCount = (uint32_t)vertices.size() / 3;
+        outMesh.TriangleCount = triangleCount;
+        outMesh.VertexBuffer = context.CreateInputBuffer(vertices.data(), vertices.size() * sizeof(float));
+        outMesh.IndexBuffer = context.CreateInputBuffer(indices.data(), indices.size() * sizeof(uint32_t));
+        return outMesh;
+    }
+
+    static BLASCreateInfo GetBLASCreateInfo(const ProceduralMesh& mesh, uint32_t geometryCount,
+                                            vk::BuildAccelerationStructureFlagsKHR flags)
+    {
+        BLASCreateInfo outInfo = {};
+        outInfo.Flags = flags;
+
+        const uint32_t trianglesPerGeometry = mesh.TriangleCount / geometryCount;
+        for (uint32_t g = 0; g < geometryCount; g++)
+        {
+            GeometryData geom = {};
+            geom.DataAddresses.VertexDevAddress = mesh.VertexBuffer.DevAddress;
+            geom.DataAddresses.IndexDevAddress =
+                mesh.IndexBuffer.DevAddress + (vk::DeviceSize)g * trianglesPerGeometry * 3 * sizeof(uint32_t);
+            geom.Stride = 3 * sizeof(float);
+            geom.PrimitiveCount = trianglesPerGeometry;
+            geom.MaxVertex = mesh.VertexCount - 1;
+            outInfo.Geometries.push_back(geom);
+        }
+        return outInfo;
+    }
+
+    static std::string FlagsToString(vk::BuildAccelerationStructureFlagsKHR flags)
+    {
+        std::string outStr;
+        auto add = [&](BuildFlags flag, const char* name)
+        {
+            if (flags & flag)
+                outStr += (outStr.empty() ? "" : "|") + std::string(name);
+        };
+        add(BuildFlags::ePreferFastTrace, "FastTrace");
+        add(BuildFlags::ePreferFastBuild, "FastBuild");
+        add(BuildFlags::eAllowCompaction, "Compaction");
+        add(BuildFlags::eAllowUpdate, "Update");
+        return outStr;
+    }
+
+    static void AddTimingColumns(ReportRow& row, const std::vector<double>& timings)
+    {
+        const auto result = SummarizeTimings(timings);
+        row.Set("time_ms_min", result.MinMs);
+        row.Set("time_ms_median", result.MedianMs);
+    }
+
+    static void BenchmarkBLAS(BenchmarkContext& context, const BenchmarkSettings& settings, Report& report,
+                              const ProceduralMesh& mesh, uint32_t geometryCount,
+                              vk::BuildAccelerationStructureFlagsKHR flags)
+    {
+        auto device = context.GetDevice();
+
+        auto [blas, buildInfo] = device->CreateBLAS(GetBLASCreateInfo(mesh, geometryCount, flags));
+        std::vector<BLASBuildInfo> buildInfos = {buildInfo};
+        auto scratchBuffer = device->CreateScratchBufferFromBuildInfos(buildInfos);
+
+        auto addRow = [&](const char* operation) -> ReportRow&
+        {
+            auto& row = report.AddRow("as_build");
+            row.Set("operation", std::string(operation));
+            row.Set("flags", FlagsToString(flags));
+            row.Set("triangles", (uint64_t)mesh.TriangleCount);
+            row.Set("geometries", (uint64_t)geometryCount);
+            return row;
+        };
+
+        // Full builds, every iteration rebuilds the same acceleration structure
+        std::vector<double> timings;
+        for (uint32_t i = 0; i < settings.Iterations; i++)
+        {
+            auto cmdBuf = context.BeginCommands();
+            const uint32_t begin = context.WriteTimestamp(cmdBuf);
+            device->BuildBLAS(buildInfos, cmdBuf);
+            const uint32_t end = context.WriteTimestamp(cmdBuf);
+            context.SubmitAndWait(cmdBuf);
+            timings.push_back(context.GetElapsedMs(begin, end));
+        }
+
+        ReportRow& buildRow = addRow("BuildBLAS");
+        AddTimingColumns(buildRow, timings);
+        buildRow.Set("as_size", (uint64_t)buildInfo.BuildSizes.accelerationStructureSize);
+        buildRow.Set("scratch_size", (uint64_t)buildInfo.BuildSizes.buildScratchSize);
+
+        if (flags & BuildFlags::eAllowUpdate)
+        {
+            BLASUpdateInfo updateInfo = {};
+            updateInfo.SourceBLAS = &blas;
+            updateInfo.SourceBuildInfo = buildInfo;
+
+            std::vector<BLASBuildInfo> updateInfos = {device->UpdateBLAS(updateInfo)};
+            auto updateScratch = device->CreateScratchBufferFromBuildInfo(updateInfos[0]);
+
+            timings.clear();
+            for (uint32_t i = 0; i < settings.Iterations; i++)
+            {
+                auto cmdBuf = context.BeginCommands();
+                const uint32_t begin = context.WriteTimestamp(cmdBuf);
+                device->BuildBLAS(updateInfos, cmdBuf);
+                const uint32_t end = context.WriteTimestamp(cmdBuf);
+                context.SubmitAndWait(cmdBuf);
+                timings.push_back(context.GetElapsedMs(begin, end));
+            }
+
+            ReportRow& updateRow = addRow("UpdateBLAS");
+            AddTimingColumns(updateRow, timings);
+            updateRow.Set("as_size", (uint64_t)buildInfo.BuildSizes.accelerationStructureSize);
+            updateRow.Set("scratch_size", (uint64_t)updateInfos[0].BuildSizes.updateScratchSize);
+
+            device->DestroyBuffer(updateScratch);
+        }
+
+        if (flags & BuildFlags::eAllowCompaction)
+        {
+            // Every iteration compacts the same source BLAS into a new one
+            timings.clear();
+            uint64_t compactedSize = 0;
+            for (uint32_t i = 0; i < settings.Iterations; i++)
+            {
+                auto request = device->RequestCompaction({&blas});
+
+                auto cmdBuf = context.BeginCommands();
+                (void)device->GetCompactionSizes(request, cmdBuf); // records the size query
+                context.SubmitAndWait(cmdBuf);
+
+                cmdBuf = context.BeginCommands();
+                auto sizes = device->GetCompactionSizes(request, cmdBuf);
+                if (sizes.empty())
+                {
+                    VULRAY_LOG_ERROR("as_build: Compaction size query failed");
+                    context.SubmitAndWait(cmdBuf);
+                    break;
+                }
+                compactedSize = sizes[0];
+
+                const uint32_t begin = context.WriteTimestamp(cmdBuf);
+                auto compacted = device->CompactBLAS(request, sizes, cmdBuf);
+                const uint32_t end = context.WriteTimestamp(cmdBuf);
+                context.SubmitAndWait(cmdBuf);
+                timings.push_back(context.GetElapsedMs(begin, end));
+
+                device->DestroyBLAS(compacted);
+            }
+
+            const vk::DeviceSize asSize = buildInfo.BuildSizes.accelerationStructureSize;
+
+            ReportRow& compactRow = addRow("CompactBLAS");
+            AddTimingColumns(compactRow, timings);
+            compactRow.Set("as_size", (uint64_t)asSize);
+            compactRow.Set("compacted_size", compactedSize);
+            compactRow.Set("compaction_ratio", asSize > 0 ? (double)compactedSize / asSize : 0.0);
+        }
+
+        device->DestroyBuffer(scratchBuffer);
+        device->DestroyBLAS(blas);
+    }
+
+    static void BenchmarkTLAS(BenchmarkContext& context, const BenchmarkSettings& settings, Report& report,
+                              const BLASHandle& blas, uint32_t instanceCount,
+                              vk::BuildAccelerationStructureFlagsKHR flags)
+    {
+        auto device = context.GetDevice();
+
+        // Instances on a grid, so the TLAS has real spatial structure
+        std::vector<vk::AccelerationStructureInstanceKHR> instances(instanceCount);
+        const uint32_t gridSize = std::max((uint32_t)std::ceil(std::cbrt((double)instanceCount)), 1u);
+        for (uint32_t i = 0; i < instanceCount; i++)
+        {
+            vk::TransformMatrixKHR transform = {};
+            transform.matrix[0][0] = transform.matrix[1][1] = transform.matrix[2][2] = 1.0f;
+            transform.matrix[0][3] = (float)(i % gridSize) * 1.5f;
+            transform.matrix[1][3] = (float)((i / gridSize) % gridSize) * 1.5f;
+            transform.matrix[2][3] = (float)(i / (gridSize * gridSize)) * 1.5f;
+
+            instances[i]
+                .setTransform(transform)
+                .setInstanceCustomIndex(i)
+                .setMask(0xFF)
+                .setAccelerationStructureReference(blas.Buffer.DevAddress);
+        }
+
+        auto instanceBuffer = device->CreateInstanceBuffer(instanceCount);
+        device->UpdateBuffer(instanceBuffer, instances.data(),
+                             instances.size() * sizeof(vk::AccelerationStructureInstanceKHR));
+
+        TLASCreateInfo createInfo = {};
+        createInfo.MaxInstanceCount = instanceCount;
+        createInfo.InstanceDevAddress = instanceBuffer.DevAddress;
+        createInfo.Flags = flags;
+
+        auto [tlas, buildInfo] = device->CreateTLAS(createInfo);
+        auto scratchBuffer = device->CreateScratchBufferFromBuildInfo(buildInfo);
+
+        std::vector<double> timings;
+        for (uint32_t i = 0; i < settings.Iterations; i++)
+        {
+            auto cmdBuf = context.BeginCommands();
+            const uint32_t begin = context.WriteTimestamp(cmdBuf);
+            device->BuildTLAS(buildInfo, instanceBuffer, instanceCount, cmdBuf);
+            const uint32_t end = context.WriteTimestamp(cmdBuf);
+            context.SubmitAndWait(cmdBuf);
+            timings.push_back(context.GetElapsedMs(begin, end));
+        }
+
+        auto& row = report.AddRow("as_build");
+        row.Set("operation", std::string("BuildTLAS"));
+        row.Set("flags", FlagsToString(flags));
+        row.Set("instances", (uint64_t)instanceCount);
+        AddTimingColumns(row, timings);
+        row.Set("as_size", (uint64_t)buildInfo.BuildSizes.accelerationStructureSize);
+        row.Set("scratch_size", (uint64_t)buildInfo.BuildSizes.buildScratchSize);
+
+        device->DestroyBuffer(scratchBuffer);
+        device->DestroyBuffer(instanceBuffer);
+        device->DestroyTLAS(tlas);
+    }
+
+    void RunASBuildBenchmark(BenchmarkContext& context, const BenchmarkSettings& settings, Report& report)
+    {
+        auto device = context.GetDevice();
+
+        const std::vector<uint32_t> triangleCounts =
+            settings.Quick ? std::vector<uint32_t>{1024, 16 * 1024}
+                           : std::vector<uint32_t>{1024, 16 * 1024, 256 * 1024, 1024 * 1024};
+        const std::vector<uint32_t> geometryCounts = {1, 16};
+        const std::vector<vk::BuildAccelerationStructureFlagsKHR> flagCombinations = {
+            BuildFlags::ePreferFastTrace,
+            BuildFlags::ePreferFastBuild,
+            BuildFlags::ePreferFastTrace | BuildFlags::eAllowCompaction,
+            BuildFlags::ePreferFastBuild | BuildFlags::eAllowCompaction,
+            BuildFlags::ePreferFastTrace | BuildFlags::eAllowUpdate,
+            BuildFlags::ePreferFastBuild | BuildFlags::eAllowUpdate,
+        };
+
+        for (uint32_t triangleCount : triangleCounts)
+        {
+            auto mesh = CreateGridMesh(context, triangleCount);
+
+            for (uint32_t geometryCount : geometryCounts)
+            {
+                for (auto flags : flagCombinations)
+                {
+                    VULRAY_FLOG_INFO("as_build: BLAS %u triangles, %u geometries, %s", triangleCount, geometryCount,
+                                     FlagsToString(flags).c_str());
+                    BenchmarkBLAS(context, settings, report, mesh, geometryCount, flags);
+                }
+            }
+
+            device->DestroyBuffer(mesh.VertexBuffer);
+            device->DestroyBuffer(mesh.IndexBuffer);
+        }
+
+        // TLAS builds over instances of one small BLAS
+        auto mesh = CreateGridMesh(context, 512);
+        auto [blas, blasBuildInfo] = device->CreateBLAS(GetBLASCreateInfo(mesh, 1, BuildFlags::ePreferFastTrace));
+        std::vector<BLASBuildInfo> blasBuildInfos = {blasBuildInfo};
+        auto blasScratch = device->CreateScratchBufferFromBuildInfos(blasBuildInfos);
+
+        auto cmdBuf = context.BeginCommands();
+        device->BuildBLAS(blasBuildInfos, cmdBuf);
+        context.SubmitAndWait(cmdBuf);
+
+        const std::vector<uint32_t> instanceCounts =
+            settings.Quick ? std::vector<uint32_t>{64, 1024} : std::vector<uint32_t>{64, 1024, 16 * 1024, 128 * 1024};
+
+        for (uint32_t instanceCount : instanceCounts)
+        {
+            for (auto flags : {vk::BuildAccelerationStructureFlagsKHR(BuildFlags::ePreferFastTrace),
+                               vk::BuildAccelerationStructureFlagsKHR(BuildFlags::ePreferFastBuild)})
+            {
+                VULRAY_FLOG_INFO("as_build: TLAS %u instances, %s", instanceCount, FlagsToString(flags).c_str());
+                BenchmarkTLAS(context, settings, report, blas, instanceCount, flags);
+            }
+        }
+
+        device->DestroyBuffer(blasScratch);
+        device->DestroyBLAS(blas);
+        device->DestroyBuffer(mesh.VertexBuffer);
+        device->DestroyBuffer(mesh.IndexBuffer);
+    }
+
+} // namespace vr::Bench
@@ -0,0 +1,267 @@
+#include "BenchmarkContext.h"
+
+namespace vr::Bench
+{
+    void ReportRow::Set(const std::string& name, const std::string& value)
+    {
+        for (auto& column : Columns)
+        {
+            if (column.first == name)
+            {
+                column.second = value;
+                return;
+            }
+        }
+        Columns.emplace_back(name, value);
+    }
+
+    void ReportRow::Set(const std::string& name, double value)
+    {
+        char buffer[64];
+        std::snprintf(buffer, sizeof(buffer), "%.6f", value);
+        Set(name, std::string(buffer));
+    }
+
+    void ReportRow::Set(const std::string& name, uint64_t value) { Set(name, std::to_string(value)); }
+
+    ReportRow& Report::AddRow(const std::string& suite)
+    {
+        auto& row = mRows.emplace_back();
+        row.Set("suite", suite);
+        return row;
+    }
+
+    static std::vector<std::string> GetColumnNames(const std::vector<ReportRow>& rows)
+    {
+        std::vector<std::string> names;
+        for (const auto& row : rows)
+        {
+            for (const auto& column : row.Columns)
+            {
+                if (std::find(names.begin(), names.end(), column.first) == names.end())
+                    names.push_back(column.first);
+            }
+        }
+        return names;
+    }
+
+    static const std::string* FindColumn(const ReportRow& row, const std::string& name)
+    {
+        for (const auto& column : row.Columns)
+        {
+            if (column.first == name)
+                return &column.second;
+        }
+        return nullptr;
+    }
+
+    bool Report::WriteCSV(const std::filesystem::path& path) const
+    {
+        std::ofstream file(path);
+        if (!file)
+        {
+            VULRAY_FLOG_ERROR("Failed to open %s", path.string().c_str());
+            return false;
+        }
+
+        const auto names = GetColumnNames(mRows);
+        for (size_t i = 0; i < names.size(); i++) file << (i ? "," : "") << names[i];
+        file << "\n";
+
+        // None of the values contain commas or quotes, so they are written as they are
+        for (const auto& row : mRows)
+        {
+            for (size_t i = 0; i < names.size(); i++)
+            {
+                const std::string* value = FindColumn(row, names[i]);
+                file << (i ? "," : "") << (value ? *value : "");
+            }
+            file << "\n";
+        }
+        return true;
+    }
+
+    static std::string EscapeJSON(const std::string& str)
+    {
+        std::string outStr;
+        for (char c : str)
+        {
+            if (c == '"' || c == '\\')
+                outStr += '\\';
+            outStr += c;
+        }
+        return outStr;
+    }
+
+    static bool IsNumber(const std::string& str)
+    {
+        if (str.empty())
+            return false;
+        char* end = nullptr;
+        std::strtod(str.c_str(), &end);
+        return *end == '\0';
+    }
+
+    bool Report::WriteJSON(const std::filesystem::path& path, const std::string& deviceName) const
+    {
+        std::ofstream file(path);
+        if (!file)
+        {
+            VULRAY_FLOG_ERROR("Failed to open %s", path.string().c_str());
+            return false;
+        }
+
+        file << "{\n  \"device\": \"" << EscapeJSON(deviceName) << "\",\n  \"results\": [\n";
+        for (size_t r = 0; r < mRows.size(); r++)
+        {
+            file << "    {";
+            const auto& columns = mRows[r].Columns;
+            for (size_t i = 0; i < columns.size(); i++)
+            {
+                file << (i ? ", " : "") << "\"" << EscapeJSON(columns[i].first) << "\": ";
+                if (IsNumber(columns[i].second))
+                    file << columns[i].second;
+                else
+                    file << "\"" << EscapeJSON(columns[i].second) << "\"";
+            }
+            file << "}" << (r + 1 < mRows.size() ? "," : "") << "\n";
+        }
+        file << "  ]\n}\n";
+        return true;
+    }
+
+    BenchmarkContext::BenchmarkContext(bool enableValidation)
+    {
+        mBuilder.EnableDebug = enableValidation;
+        mBuilder.Headless = true;
+
+        // The sbt suite writes its output through a 64-bit device address
+        mBuilder.PhysicalDeviceFeatures10.shaderInt64 = VK_TRUE;
+
+        mInstance = mBuilder.CreateInstance();
+        mPhysicalDevice = mBuilder.PickPhysicalDevice(nullptr);
+        mDevice = mBuilder.CreateDevice();
+        mQueues = mBuilder.GetQueues();
+
+        mVulrayDevice = std::make_unique<vr::VulrayDevice>(mInstance.InstanceHandle, mDevice, mPhysicalDevice);
+
+        const auto properties = mVulrayDevice->GetProperties();
+        mDeviceName = properties.deviceName.data();
+        mTimestampPeriod = properties.limits.timestampPeriod;
+
+        const uint32_t validBits =
+            mPhysicalDevice.getQueueFamilyProperties()[mQueues.GraphicsIndex].timestampValidBits;
+        mTimestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+        if (validBits == 0)
+            VULRAY_LOG_WARNING("The queue doesn't support timestamps, all the GPU times will be 0");
+
+        mCommandPool = mDevice.createCommandPool(vk::CommandPoolCreateInfo()
+                                                     .setFlags(vk::CommandPoolCreateFlagBits::eResetCommandBuffer)
+                                                     .setQueueFamilyIndex(mQueues.GraphicsIndex));
+        mCommandBuffer = mDevice
+                             .allocateCommandBuffers(vk::CommandBufferAllocateInfo()
+                                                         .setCommandPool(mCommandPool)
+                                                         .setLevel(vk::CommandBufferLevel::ePrimary)
+                                                         .setCommandBufferCount(1))
+                             .front();
+        mFence = mDevice.createFence(vk::FenceCreateInfo());
+
+        VULRAY_FLOG_INFO("Benchmarking on %s", mDeviceName.c_str());
+    }
+
+    BenchmarkContext::~BenchmarkContext()
+    {
+        mDevice.waitIdle();
+
+        mVulrayDevice->FreeQueries(mTimestampQueries);
+        mDevice.destroyFence(mFence);
+        mDevice.destroyCommandPool(mCommandPool);
+
+        mVulrayDevice.reset();
+
+        mDevice.destroy();
+        InstanceWrapper::DestroyInstance(mInstance);
+    }
+
+    vk::CommandBuffer BenchmarkContext::BeginCommands()
+    {
+        mCommandBuffer.reset();
+        mCommandBuffer.begin(vk::CommandBufferBeginInfo().setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+
+        // The previous submission was waited for, so its timestamps can be recycled
+        mVulrayDevice->FreeQueries(mTimestampQueries);
+        mTimestampQueries = mVulrayDevice->AllocateQueries(vk::QueryType::eTimestamp, MAX_TIMESTAMPS, mCommandBuffer);
+        mTimestampCount = 0;
+
+        // Makes everything the previous submission wrote visible, e.g. the BLAS that is updated or compacted
+        auto barrier = vk::MemoryBarrier()
+                           .setSrcAccessMask(vk::AccessFlagBits::eMemoryWrite)
+                           .setDstAccessMask(vk::AccessFlagBits::eMemoryRead | vk::AccessFlagBits::eMemoryWrite);
+        mCommandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands,
+                                       vk::PipelineStageFlagBits::eAllCommands, (vk::DependencyFlagBits)0, 1, &barrier,
+                                       0, nullptr, 0, nullptr);
+
+        return mCommandBuffer;
+    }
+
+    void BenchmarkContext::SubmitAndWait(vk::CommandBuffer cmdBuf)
+    {
+        cmdBuf.end();
+
+        mQueues.GraphicsQueue.submit(vk::SubmitInfo().setCommandBuffers(cmdBuf), mFence);
+        (void)mDevice.waitForFences(mFence, true, UINT64_MAX);
+        mDevice.resetFences(mFence);
+
+        mTimestamps.assign(mTimestampCount, 0);
+        if (mTimestampCount > 0 && HasTimestamps())
+        {
+            // The fence was waited for, so the results are available
+            auto results = mVulrayDevice->GetQueryResults(mTimestampQueries, mTimestampCount);
+            if (results.size() == mTimestampCount)
+                mTimestamps = results;
+        }
+    }
+
+    uint32_t BenchmarkContext::WriteTimestamp(vk::CommandBuffer cmdBuf)
+    {
+        if (mTimestampCount >= MAX_TIMESTAMPS)
+        {
+            VULRAY_LOG_ERROR("Too many timestamps in one submission");
+            return MAX_TIMESTAMPS - 1;
+        }
+        if (!mTimestampQueries.IsValid())
+            return 0;
+
+        cmdBuf.writeTimestamp(vk::PipelineStageFlagBits::eAllCommands, mTimestampQueries.Pool,
+                              mTimestampQueries.FirstQuery + mTimestampCount);
+        return mTimestampCount++;
+    }
+
+    double BenchmarkContext::GetElapsedMs(uint32_t begin, uint32_t end) const
+    {
+        if (begin >= mTimestamps.size() || end >= mTimestamps.size())
+            return 0.0;
+
+        const uint64_t ticks = (mTimestamps[end] - mTimestamps[begin]) & mTimestampMask;
+        return (double)ticks * mTimestampPeriod * 1e-6;
+    }
+
+    AllocatedBuffer BenchmarkContext::CreateInputBuffer(const void* data, vk::DeviceSize size)
+    {
+        auto outBuffer =
+            mVulrayDevice->CreateBuffer(size, vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR,
+                                        VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
+        mVulrayDevice->UpdateBuffer(outBuffer, (void*)data, size);
+        return outBuffer;
+    }
+
+    TimingResult SummarizeTimings(std::vector<double> timings)
+    {
+        if (timings.empty())
+            return {};
+
+        std::sort(timings.begin(), timings.end());
+        return {timings.front(), timings[timings.size() / 2]};
+    }
+
+} // namespace vr::Bench
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "Vulray/Vulray.h"
+#include "Vulray/VulkanBuilder/VulkanBuilder.h"
+
+namespace vr::Bench
+{
+    /// @brief One measurement, the columns are kept in insertion order
+    struct ReportRow
+    {
+        std::vector<std::pair<std::string, std::string>> Columns = {};
+
+        void Set(const std::string& name, const std::string& value);
+        void Set(const std::string& name, double value);
+        void Set(const std::string& name, uint64_t value);
+    };
+
+    /// @brief Collects the measurements of all suites and writes them as CSV or JSON
+    class Report
+    {
+      public:
+        /// @brief Adds a row, that has the suite as its first column
+        ReportRow& AddRow(const std::string& suite);
+
+        /// @brief Writes the rows as CSV, the header is the union of all the columns in the order they first appear
+        bool WriteCSV(const std::filesystem::path& path) const;
+
+        /// @brief Writes the rows as a JSON object with the device name and an array of rows
+        bool WriteJSON(const std::filesystem::path& path, const std::string& deviceName) const;
+
+      private:
+        std::vector<ReportRow> mRows = {};
+    };
+
+    /// @brief Headless Vulkan device with one queue and one command buffer, that records GPU timestamps
+    class BenchmarkContext
+    {
+      public:
+        /// @param enableValidation Enables the validation layers
+        BenchmarkContext(bool enableValidation);
+        ~BenchmarkContext();
+
+        BenchmarkContext(const BenchmarkContext&) = delete;
+
+        vr::VulrayDevice* GetDevice() { return mVulrayDevice.get(); }
+
+        const std::string& GetDeviceName() const { return mDeviceName; }
+
+        /// @brief Returns false if the queue doesn't support timestamps, the times are 0 then
+        bool HasTimestamps() const { return mTimestampMask != 0; }
+
+        /// @brief Resets the command buffer and the timestamps and begins recording, with a barrier on everything the
+        /// previous submission wrote
+        vk::CommandBuffer BeginCommands();
+
+        /// @brief Ends the command buffer, submits it, waits for it and reads the timestamps
+        void SubmitAndWait(vk::CommandBuffer cmdBuf);
+
+        /// @brief Records a timestamp after all previous commands
+        /// @return The index of the timestamp, to be used with GetElapsedMs(...)
+        uint32_t WriteTimestamp(vk::CommandBuffer cmdBuf);
+
+        /// @brief Returns the milliseconds between two timestamps of the last SubmitAndWait(...)
+        double GetElapsedMs(uint32_t begin, uint32_t end) const;
+
+        /// @brief Creates a host visible buffer that is used as acceleration structure build input and fills it
+        [[nodiscard]] AllocatedBuffer CreateInputBuffer(const void* data, vk::DeviceSize size);
+
+      private:
+        static constexpr uint32_t MAX_TIMESTAMPS = 256;
+
+        VulkanBuilder mBuilder = {};
+        InstanceWrapper mInstance = {};
+        vk::PhysicalDevice mPhysicalDevice = nullptr;
+        vk::Device mDevice = nullptr;
+        CommandQueues mQueues = {};
+
+        vk::CommandPool mCommandPool = nullptr;
+        vk::CommandBuffer mCommandBuffer = nullptr;
+        vk::Fence mFence = nullptr;
+
+        std::unique_ptr<vr::VulrayDevice> mVulrayDevice = nullptr;
+
+        std::string mDeviceName = {};
+
+        vr::QueryRange mTimestampQueries = {};
+        uint32_t mTimestampCount = 0;
+        std::vector<uint64_t> mTimestamps = {};
+
+        // Nanoseconds per timestamp tick and the valid bits of the timestamps
+        double mTimestampPeriod = 1.0;
+        uint64_t mTimestampMask = 0;
+    };
+
+    /// @brief Settings shared by all suites
+    struct BenchmarkSettings
+    {
+        /// @brief Runs smaller problem sizes, for CI and software drivers
+        bool Quick = false;
+
+        /// @brief How often every measurement is repeated, the minimum and the median are reported
+        uint32_t Iterations = 5;
+    };
+
+    /// @brief Minimum and median of the measurements
+    struct TimingResult
+    {
+        double MinMs = 0.0;
+        double MedianMs = 0.0;
+    };
+
+    TimingResult SummarizeTimings(std::vector<double> timings);
+
+    /// @brief Runs BuildBLAS, UpdateBLAS, CompactBLAS and BuildTLAS over procedural meshes
+    void RunASBuildBenchmark(BenchmarkContext& context, const BenchmarkSettings& settings, Report& report);
+
+    /// @brief Compares DispatchRays with a host visible and a device local SBT over callable records
+    void RunSBTBenchmark(BenchmarkContext& context, const BenchmarkSettings& settings, Report& report);
+
+    /// @brief Checks the scratch sizing and build scheduling math on synthetic multi-GB batches, CPU only
+    /// @return False if a check failed
+    bool RunScratchSizingCheck(const BenchmarkSettings& settings, Report& report);
+
+} // namespace vr::Bench
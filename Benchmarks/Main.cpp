@@ -0,0 +1,70 @@
+#include "BenchmarkContext.h"
+
+using namespace vr::Bench;
+
+static void PrintUsage()
+{
+    std::cout << "Usage: VulrayBenchmarks [options]\n"
+                 "  --suite <name>      Runs only the suite: as_build, sbt, scratch_sizing\n"
+                 "  --quick             Smaller problem sizes, for CI and software drivers like lavapipe\n"
+                 "  --iterations <n>    Repetitions of every measurement, default 5\n"
+                 "  --csv <file>        Writes the results as CSV, default VulrayBenchmarks.csv\n"
+                 "  --json <file>       Writes the results as JSON, default VulrayBenchmarks.json\n"
+                 "  --validation        Enables the Vulkan validation layers\n";
+}
+
+int main(int argc, char** argv)
+{
+    BenchmarkSettings settings = {};
+    std::string suite = {};
+    std::filesystem::path csvPath = "VulrayBenchmarks.csv";
+    std::filesystem::path jsonPath = "VulrayBenchmarks.json";
+    bool validation = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+
+        if (arg == "--quick")
+            settings.Quick = true;
+        else if (arg == "--validation")
+            validation = true;
+        else if (arg == "--suite" && hasValue)
+            suite = argv[++i];
+        else if (arg == "--iterations" && hasValue)
+            settings.Iterations = std::max(std::atoi(argv[++i]), 1);
+        else if (arg == "--csv" && hasValue)
+            csvPath = argv[++i];
+        else if (arg == "--json" && hasValue)
+            jsonPath = argv[++i];
+        else
+        {
+            PrintUsage();
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    Report report = {};
+
+    // The scratch sizing check is CPU only, so it runs without a device
+    bool passed = true;
+    if (suite.empty() || suite == "scratch_sizing")
+        passed = RunScratchSizingCheck(settings, report);
+
+    std::string deviceName = "CPU";
+    if (suite != "scratch_sizing")
+    {
+        BenchmarkContext context(validation);
+
+        if (suite.empty() || suite == "as_build")
+            RunASBuildBenchmark(context, settings, report);
+        if (suite.empty() || suite == "sbt")
+            RunSBTBenchmark(context, settings, report);
+
+        deviceName = context.GetDeviceName();
+    }
+
+    const bool written = report.WriteCSV(csvPath) && report.WriteJSON(jsonPath, deviceName);
+    return written && passed ? 0 : 1;
+}
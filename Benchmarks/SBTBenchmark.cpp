@@ -0,0 +1,174 @@
+#include "BenchmarkContext.h"
+
+#include "SBTBenchmark.spv.h"
+
+namespace vr::Bench
+{
+    // Must match the shader
+    struct SBTPushConstants
+    {
+        uint64_t OutputAddress = 0;
+        uint32_t CallableCount = 0;
+        uint32_t Width = 0;
+    };
+    static constexpr uint32_t CALLABLE_RECORD_SIZE = 64;
+
+    // Pipeline with one ray gen and one callable group, every callable record of the SBT points to the same group
+    struct SBTBenchmarkPipeline
+    {
+        Shader RayGenShader = {};
+        Shader CallableShader = {};
+        vk::PipelineLayout Layout = nullptr;
+        vk::Pipeline Pipeline = nullptr;
+        SBTInfo Info = {};
+    };
+
+    static SBTBenchmarkPipeline CreateSBTBenchmarkPipeline(BenchmarkContext& context)
+    {
+        auto device = context.GetDevice();
+
+        SBTBenchmarkPipeline outPipeline = {};
+
+        // Spirv always has a size that is a multiple of 4
+        std::vector<uint32_t> spv(sizeof(g_SBTBenchmark) / sizeof(uint32_t));
+        std::memcpy(spv.data(), g_SBTBenchmark, spv.size() * sizeof(uint32_t));
+
+        outPipeline.RayGenShader = device->CreateShaderFromSPV(spv);
+        outPipeline.RayGenShader.EntryPoint = "SBTBenchmark_raygen";
+        outPipeline.CallableShader.Module = outPipeline.RayGenShader.Module;
+        outPipeline.CallableShader.EntryPoint = "SBTBenchmark_callable";
+
+        auto pushConstantRange = vk::PushConstantRange()
+                                     .setStageFlags(vk::ShaderStageFlagBits::eRaygenKHR)
+                                     .setOffset(0)
+                                     .setSize(sizeof(SBTPushConstants));
+        outPipeline.Layout = device->GetDevice().createPipelineLayout(
+            vk::PipelineLayoutCreateInfo().setPPushConstantRanges(&pushConstantRange).setPushConstantRangeCount(1));
+
+        RayTracingShaderCollection collection = {};
+        collection.RayGenShaders.push_back(outPipeline.RayGenShader);
+        collection.CallableShaders.push_back(outPipeline.CallableShader);
+
+        PipelineSettings pipelineSettings = {};
+        pipelineSettings.PipelineLayout = outPipeline.Layout;
+        pipelineSettings.MaxPayloadSize = 16;
+
+        // No descriptors, the output is written through its device address
+        auto [pipeline, sbtInfo] =
+            device->CreateRayTracingPipeline(collection, pipelineSettings, vk::PipelineCreateFlags());
+        outPipeline.Pipeline = pipeline;
+        outPipeline.Info = sbtInfo;
+        outPipeline.Info.CallableShaderRecordSize = CALLABLE_RECORD_SIZE;
+        return outPipeline;
+    }
+
+    static void DestroySBTBenchmarkPipeline(BenchmarkContext& context, SBTBenchmarkPipeline& pipeline)
+    {
+        auto device = context.GetDevice();
+        device->DestroyRayTracingPipeline(pipeline.Pipeline);
+        device->GetDevice().destroyPipelineLayout(pipeline.Layout);
+        device->GetDevice().destroyShaderModule(pipeline.RayGenShader.Module);
+    }
+
+    static void BenchmarkSBT(BenchmarkContext& context, const BenchmarkSettings& settings, Report& report,
+                             const SBTBenchmarkPipeline& pipeline, const AllocatedBuffer& output, uint32_t width,
+                             uint32_t height, uint32_t callableCount, bool deviceLocal)
+    {
+        auto device = context.GetDevice();
+
+        // Both variants are packed, so they only differ in where the SBT lives
+        SBTInfo sbtInfo = pipeline.Info;
+        sbtInfo.PackRegions = true;
+        sbtInfo.DeviceLocal = deviceLocal;
+        sbtInfo.CallableIndices.assign(callableCount, pipeline.Info.CallableIndices[0]);
+
+        const auto createStart = std::chrono::high_resolution_clock::now();
+        auto sbt = device->CreateSBT(pipeline.Pipeline, sbtInfo);
+        const auto createEnd = std::chrono::high_resolution_clock::now();
+
+        // Every record gets different values, so the reads can't be shared between records
+        float record[CALLABLE_RECORD_SIZE / sizeof(float)];
+        for (uint32_t i = 0; i < callableCount; i++)
+        {
+            for (uint32_t v = 0; v < std::size(record); v++) record[v] = (float)(i + v) * 0.001f;
+            device->WriteToSBT(sbt, ShaderGroup::Callable, i, record, sizeof(record));
+        }
+
+        // The upload of the device local SBT is timed on its own, the dispatches read the SBT where it lives
+        auto cmdBuf = context.BeginCommands();
+        const uint32_t uploadBegin = context.WriteTimestamp(cmdBuf);
+        device->RecordSBTUpload(sbt, cmdBuf);
+        const uint32_t uploadEnd = context.WriteTimestamp(cmdBuf);
+        context.SubmitAndWait(cmdBuf);
+        const double uploadMs = context.GetElapsedMs(uploadBegin, uploadEnd);
+
+        SBTPushConstants pushConstants = {};
+        pushConstants.OutputAddress = output.DevAddress;
+        pushConstants.CallableCount = callableCount;
+        pushConstants.Width = width;
+
+        std::vector<double> timings;
+        for (uint32_t i = 0; i < settings.Iterations; i++)
+        {
+            cmdBuf = context.BeginCommands();
+            cmdBuf.pushConstants(pipeline.Layout, vk::ShaderStageFlagBits::eRaygenKHR, 0, sizeof(pushConstants),
+                                 &pushConstants);
+            const uint32_t begin = context.WriteTimestamp(cmdBuf);
+            device->DispatchRays(pipeline.Pipeline, sbt, width, height, 1, cmdBuf);
+            const uint32_t end = context.WriteTimestamp(cmdBuf);
+            context.SubmitAndWait(cmdBuf);
+            timings.push_back(context.GetElapsedMs(begin, end));
+        }
+
+        const auto result = SummarizeTimings(timings);
+
+        auto& row = report.AddRow("sbt");
+        row.Set("operation", std::string("DispatchRays"));
+        row.Set("sbt_memory", std::string(deviceLocal ? "device_local" : "host_visible"));
+        row.Set("callable_records", (uint64_t)callableCount);
+        row.Set("pixels", (uint64_t)width * height);
+        row.Set("time_ms_min", result.MinMs);
+        row.Set("time_ms_median", result.MedianMs);
+        row.Set("create_ms", std::chrono::duration<double, std::milli>(createEnd - createStart).count());
+        row.Set("upload_ms", uploadMs);
+        row.Set("sbt_size", (uint64_t)sbt.PackedBuffer.Size);
+
+        device->DestroySBTBuffer(sbt);
+    }
+
+    void RunSBTBenchmark(BenchmarkContext& context, const BenchmarkSettings& settings, Report& report)
+    {
+        auto device = context.GetDevice();
+
+        const uint32_t width = settings.Quick ? 256 : 1920;
+        const uint32_t height = settings.Quick ? 256 : 1080;
+        const std::vector<uint32_t> callableCounts =
+            settings.Quick ? std::vector<uint32_t>{16, 4096} : std::vector<uint32_t>{16, 1024, 16 * 1024, 64 * 1024};
+
+        auto pipeline = CreateSBTBenchmarkPipeline(context);
+        if (!pipeline.Pipeline)
+        {
+            VULRAY_LOG_ERROR("sbt: Failed to create the benchmark pipeline");
+            DestroySBTBenchmarkPipeline(context, pipeline);
+            return;
+        }
+
+        // One float4 per pixel, device local
+        auto output =
+            device->CreateBuffer((vk::DeviceSize)width * height * 16, vk::BufferUsageFlagBits::eStorageBuffer);
+
+        for (uint32_t callableCount : callableCounts)
+        {
+            for (bool deviceLocal : {false, true})
+            {
+                VULRAY_FLOG_INFO("sbt: %u callable records, %s", callableCount,
+                                 deviceLocal ? "device local" : "host visible");
+                BenchmarkSBT(context, settings, report, pipeline, output, width, height, callableCount, deviceLocal);
+            }
+        }
+
+        device->DestroyBuffer(output);
+        DestroySBTBenchmarkPipeline(context, pipeline);
+    }
+
+} // namespace vr::Bench
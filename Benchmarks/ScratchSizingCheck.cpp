@@ -0,0 +1,145 @@
+#include "BenchmarkContext.h"
+
+namespace vr::Bench
+{
+    static constexpr vk::DeviceSize GiB = 1024ull * 1024 * 1024;
+    static constexpr vk::DeviceSize SCRATCH_ALIGNMENT = 128;
+
+    // Build infos that only carry scratch sizes, the sizing and scheduling math never looks at the geometries
+    static std::vector<BLASBuildInfo> CreateSyntheticBuildInfos(uint32_t count, vk::DeviceSize scratchSize)
+    {
+        std::vector<BLASBuildInfo> outBuildInfos(count);
+        for (auto& info : outBuildInfos)
+        {
+            info.BuildGeometryInfo.setMode(vk::BuildAccelerationStructureModeKHR::eBuild);
+            info.BuildSizes.setBuildScratchSize(scratchSize);
+        }
+        return outBuildInfos;
+    }
+
+    // Checks that the batches are contiguous, cover every build info, fit the budget unless a single build info is
+    // bigger, and that their sizes add up to the expected total
+    static bool IsScheduleValid(const BLASBuildSchedule& schedule, const std::vector<BLASBuildInfo>& buildInfos,
+                                vk::DeviceSize budget, vk::DeviceSize expectedTotal)
+    {
+        uint32_t nextBuildInfo = 0;
+        vk::DeviceSize total = 0;
+        vk::DeviceSize maxBatch = 0;
+        for (auto& batch : schedule.Batches)
+        {
+            if (batch.FirstBuildInfo != nextBuildInfo || batch.BuildInfoCount == 0)
+                return false;
+            if (batch.ScratchSize > budget && batch.BuildInfoCount > 1)
+                return false;
+
+            vk::DeviceSize batchSize = 0;
+            for (uint32_t i = batch.FirstBuildInfo; i < batch.FirstBuildInfo + batch.BuildInfoCount; i++)
+            {
+                const auto size = GetAlignedScratchSize(buildInfos[i].BuildGeometryInfo, buildInfos[i].BuildSizes,
+                                                        SCRATCH_ALIGNMENT);
+                if (!CheckedAdd(batchSize, size, batchSize))
+                    return false;
+            }
+            if (batchSize != batch.ScratchSize || !CheckedAdd(total, batchSize, total))
+                return false;
+
+            maxBatch = std::max(maxBatch, batch.ScratchSize);
+            nextBuildInfo += batch.BuildInfoCount;
+        }
+
+        return nextBuildInfo == buildInfos.size() && total == expectedTotal && schedule.ScratchSize == maxBatch;
+    }
+
+    static void AddCheckRow(Report& report, const char* name, uint32_t buildInfoCount, vk::DeviceSize totalScratch,
+                            const BLASBuildSchedule& schedule, double timeMs, bool passed)
+    {
+        auto& row = report.AddRow("scratch_sizing");
+        row.Set("operation", std::string(name));
+        row.Set("build_infos", (uint64_t)buildInfoCount);
+        row.Set("total_scratch", (uint64_t)totalScratch);
+        row.Set("batches", (uint64_t)schedule.Batches.size());
+        row.Set("time_ms_min", timeMs);
+        row.Set("passed", (uint64_t)(passed ? 1 : 0));
+
+        if (passed)
+        {
+            VULRAY_FLOG_INFO("scratch_sizing: %s passed", name);
+        }
+        else
+        {
+            VULRAY_FLOG_ERROR("scratch_sizing: %s failed", name);
+        }
+    }
+
+    bool RunScratchSizingCheck(const BenchmarkSettings& settings, Report& report)
+    {
+        bool allPassed = true;
+
+        // Many builds whose scratch sizes add up to far more than 4 GiB, so any 32-bit truncation shows up. The sizes
+        // are not aligned, so every build is padded
+        {
+            const uint32_t count = settings.Quick ? 16 * 1024 : 256 * 1024;
+            const vk::DeviceSize scratchSize = 96 * 1024 * 1024 + 1;
+            const vk::DeviceSize alignedSize = AlignUp(scratchSize, SCRATCH_ALIGNMENT);
+            const vk::DeviceSize budget = 4 * GiB;
+            auto buildInfos = CreateSyntheticBuildInfos(count, scratchSize);
+
+            std::vector<double> timings;
+            BLASBuildSchedule schedule = {};
+            for (uint32_t i = 0; i < settings.Iterations; i++)
+            {
+                const auto start = std::chrono::high_resolution_clock::now();
+                schedule = ScheduleBLASBuilds(buildInfos, budget, SCRATCH_ALIGNMENT);
+                const auto end = std::chrono::high_resolution_clock::now();
+                timings.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+            }
+
+            const vk::DeviceSize expectedTotal = alignedSize * count;
+            const uint64_t buildsPerBatch = budget / alignedSize;
+            const uint64_t expectedBatches = (count + buildsPerBatch - 1) / buildsPerBatch;
+
+            const bool passed = GetScratchBufferSize(buildInfos, SCRATCH_ALIGNMENT) == expectedTotal &&
+                                schedule.Batches.size() == expectedBatches &&
+                                IsScheduleValid(schedule, buildInfos, budget, expectedTotal);
+            AddCheckRow(report, "ScheduleBLASBuilds multi-GB", count, expectedTotal, schedule,
+                        SummarizeTimings(timings).MinMs, passed);
+            allPassed &= passed;
+        }
+
+        // Builds that are bigger than the budget on their own get a batch each
+        {
+            const vk::DeviceSize scratchSize = 6 * GiB + 3;
+            const vk::DeviceSize budget = 2 * GiB;
+            auto buildInfos = CreateSyntheticBuildInfos(8, scratchSize);
+
+            const auto schedule = ScheduleBLASBuilds(buildInfos, budget, SCRATCH_ALIGNMENT);
+            const vk::DeviceSize expectedTotal = AlignUp(scratchSize, SCRATCH_ALIGNMENT) * buildInfos.size();
+
+            const bool passed = schedule.Batches.size() == buildInfos.size() &&
+                                schedule.ScratchSize == AlignUp(scratchSize, SCRATCH_ALIGNMENT) &&
+                                IsScheduleValid(schedule, buildInfos, budget, expectedTotal);
+            AddCheckRow(report, "ScheduleBLASBuilds over budget", (uint32_t)buildInfos.size(), expectedTotal,
+                        schedule, 0.0, passed);
+            allPassed &= passed;
+        }
+
+        // Sizes that don't fit in 64 bits saturate instead of wrapping around
+        {
+            auto buildInfos = CreateSyntheticBuildInfos(3, std::numeric_limits<vk::DeviceSize>::max() / 2);
+
+            vk::DeviceSize sum = 0;
+            const bool passed =
+                GetScratchBufferSize(buildInfos, SCRATCH_ALIGNMENT) == std::numeric_limits<vk::DeviceSize>::max() &&
+                GetAlignedScratchSize(buildInfos[0].BuildGeometryInfo, buildInfos[0].BuildSizes, SCRATCH_ALIGNMENT) >
+                    buildInfos[0].BuildSizes.buildScratchSize &&
+                !CheckedAdd(std::numeric_limits<vk::DeviceSize>::max(), 1, sum) &&
+                sum == std::numeric_limits<vk::DeviceSize>::max();
+            AddCheckRow(report, "GetScratchBufferSize overflow", (uint32_t)buildInfos.size(),
+                        std::numeric_limits<vk::DeviceSize>::max(), {}, 0.0, passed);
+            allPassed &= passed;
+        }
+
+        return allPassed;
+    }
+
+} // namespace vr::Bench
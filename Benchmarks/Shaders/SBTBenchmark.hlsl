@@ -0,0 +1,46 @@
+// Ray tracing shaders of the sbt benchmark suite. Every pixel calls a few of the callable records, so the dispatch
+// time is dominated by the shader record reads and shows where the SBT lives
+
+struct PushConstants
+{
+    uint64_t OutputAddress;
+    uint CallableCount;
+    uint Width;
+};
+
+[[vk::push_constant]] PushConstants Push;
+
+// 64 bytes, must match CALLABLE_RECORD_SIZE of SBTBenchmark.cpp
+struct CallableRecord
+{
+    float4 Values[4];
+};
+
+[[vk::shader_record_ext]] ConstantBuffer<CallableRecord> Record;
+
+struct CallData
+{
+    float4 Value;
+};
+
+[shader("callable")]
+void SBTBenchmark_callable(inout CallData data)
+{
+    data.Value += Record.Values[0] * Record.Values[1] + Record.Values[2] * Record.Values[3];
+}
+
+[shader("raygeneration")]
+void SBTBenchmark_raygen()
+{
+    const uint2 pixel = DispatchRaysIndex().xy;
+    const uint index = pixel.y * Push.Width + pixel.x;
+
+    CallData data;
+    data.Value = float4(0.0f, 0.0f, 0.0f, 0.0f);
+
+    // Neighbouring pixels call scattered records, so every wave reads many different records
+    for (uint i = 0; i < 4; i++)
+        CallShader(((index * 4 + i) * 2654435761u) % Push.CallableCount, data);
+
+    vk::RawBufferStore<float4>(Push.OutputAddress + index * 16, data.Value, 16);
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "Vulray/Buffer.h"
+
+namespace vr
+{
+    struct ASArenaCreateInfo
+    {
+        /// @brief Size of a single buffer of the arena. Acceleration structures that are bigger than this get a buffer
+        /// of their own, which is released as soon as the acceleration structure is destroyed.
+        vk::DeviceSize BlockSize = 64 * 1024 * 1024;
+    };
+
+    /// @brief Placement of an acceleration structure inside an arena buffer
+    struct ASArenaAllocation
+    {
+        /// @brief Index of the arena buffer, ~0U if the acceleration structure has a buffer of its own
+        uint32_t BlockIndex = ~0U;
+
+        /// @brief Virtual allocation inside the arena buffer
+        VmaVirtualAllocation Allocation = nullptr;
+
+        /// @brief Offset of the acceleration structure in the arena buffer, always a multiple of 256
+        vk::DeviceSize Offset = 0;
+
+        /// @brief Returns true if the acceleration structure lives in an arena buffer
+        bool IsValid() const { return BlockIndex != ~0U; }
+    };
+
+    struct ASArenaStatistics
+    {
+        /// @brief Number of buffers owned by the arena
+        uint32_t BlockCount = 0;
+
+        /// @brief Number of acceleration structures placed in the arena
+        uint32_t AllocationCount = 0;
+
+        /// @brief Total size of all the arena buffers in bytes
+        vk::DeviceSize BlockBytes = 0;
+
+        /// @brief Bytes used by acceleration structures, including alignment padding
+        vk::DeviceSize AllocatedBytes = 0;
+
+        /// @brief Size of the biggest free range in any of the arena buffers
+        vk::DeviceSize LargestFreeRange = 0;
+
+        /// @brief AllocatedBytes / BlockBytes, 0 if the arena is empty
+        float Occupancy = 0.0f;
+    };
+
+    namespace detail
+    {
+        struct ASArenaBlock
+        {
+            AllocatedBuffer Buffer = {};
+
+            VmaVirtualBlock VirtualBlock = nullptr;
+
+            /// @brief Dedicated blocks hold a single acceleration structure or a packed set of them. They are never
+            /// used for new allocations and are released when their last acceleration structure is destroyed
+            bool Dedicated = false;
+        };
+
+        struct ASArena
+        {
+            ASArenaCreateInfo Info = {};
+
+            /// @brief If false, CreateBLAS(...) and CompactBLAS(...) create a buffer per acceleration structure
+            bool Enabled = false;
+
+            /// @brief Blocks of the arena, released blocks leave an empty slot so indices stay valid
+            std::vector<ASArenaBlock> Blocks = {};
+        };
+    } // namespace detail
+
+} // namespace vr
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "Vulray/AccelStruct.h"
+#include "Vulray/Sync.h"
+
+namespace vr
+{
+    class VulrayDevice;
+
+    struct ASCacheStatistics
+    {
+        /// @brief Number of BLASes that were loaded from the cache
+        uint32_t Hits = 0;
+
+        /// @brief Number of Load(...) calls without a cache file
+        uint32_t Misses = 0;
+
+        /// @brief Number of cache files that were rejected, because of a different version, device or driver
+        uint32_t Rejected = 0;
+
+        /// @brief Number of BLASes that were written to the cache
+        uint32_t Stored = 0;
+
+        vk::DeviceSize BytesRead = 0;
+        vk::DeviceSize BytesWritten = 0;
+    };
+
+    /// @brief On-disk cache of serialized BLASes, so later runs can skip building them.
+    ///
+    /// Each BLAS is stored in its own file named after its key, the key should be a hash of everything that affects
+    /// the BLAS, e.g. HashData(...) of the vertex and index data combined with the build flags. The file header
+    /// contains the device and driver UUIDs, files from another device or driver are ignored.
+    ///
+    /// Usage:
+    /// 1. Call Load(...) for every BLAS, if it returns false, build the BLAS normally and call Store(...) after the
+    /// build with the same command buffer
+    /// 2. Call Submit(...) with the sync point of the submission that contains the command buffer
+    /// 3. Call Update(...) once per frame, it records the serialization copies and writes the finished files
+    class ASCache
+    {
+      public:
+        /// @param device The device that owns the BLASes
+        /// @param directory The directory of the cache files, created if it doesn't exist
+        ASCache(vr::VulrayDevice* device, const std::string& directory);
+        ~ASCache();
+
+        ASCache() = delete;
+        ASCache(const ASCache&) = delete;
+
+        /// @brief Hashes data for cache keys
+        /// @param data The data, e.g. vertices or indices
+        /// @param size The size of the data in bytes
+        /// @param seed Previous hash, to combine multiple buffers into one key
+        [[nodiscard]] static uint64_t HashData(const void* data, size_t size, uint64_t seed = 0);
+
+        /// @brief Loads the BLAS from the cache and records its deserialization
+        /// @param key The key of the BLAS
+        /// @param outBLAS The loaded BLAS, usable after the command buffer execution
+        /// @param cmdBuf The command buffer that will be used to record the deserialization
+        /// @return False if the BLAS is not in the cache or the cache file is not compatible with this device, the
+        /// BLAS must be built with CreateBLAS(...) and BuildBLAS(...) then
+        /// @note Call AddAccelerationBuildBarrier(...) after the last load, before TLASes are built
+        [[nodiscard]] bool Load(uint64_t key, BLASHandle& outBLAS, vk::CommandBuffer cmdBuf);
+
+        /// @brief Queues the BLAS to be written to the cache
+        /// @param key The key of the BLAS
+        /// @param blas The BLAS, it must stay alive until the file is written by Update(...)
+        /// @param cmdBuf The command buffer that built the BLAS, the serialization size query is recorded after the
+        /// build
+        void Store(uint64_t key, const BLASHandle& blas, vk::CommandBuffer cmdBuf);
+
+        /// @brief Sets the sync point of everything that was recorded by Load(...), Store(...) and Update(...) since
+        /// the last call to Submit(...)
+        void Submit(const SyncPoint& syncPoint);
+
+        /// @brief Records the serialization of BLASes whose sizes are available, writes the finished cache files and
+        /// releases upload buffers of finished loads
+        /// @param cmdBuf The command buffer that will be used to record the serialization copies
+        /// @note This function never waits on the GPU
+        void Update(vk::CommandBuffer cmdBuf);
+
+        /// @brief Returns true if no stores or loads are in flight, the BLASes given to Store(...) can be destroyed
+        [[nodiscard]] bool IsIdle() const { return mPendingStores.empty() && mPendingUploads.empty(); }
+
+        [[nodiscard]] ASCacheStatistics GetStatistics() const { return mStats; }
+
+      private:
+        struct PendingStore
+        {
+            uint64_t Key = 0;
+            vk::AccelerationStructureKHR BLAS = nullptr;
+
+            // Query for the serialization size, freed when the readback buffer is created
+            QueryRange Queries = {};
+
+            // Host visible buffer that receives the serialized BLAS
+            AllocatedBuffer Readback = {};
+
+            SyncPoint Sync = {};
+            bool Submitted = false;
+        };
+
+        struct PendingUpload
+        {
+            AllocatedBuffer Staging = {};
+            SyncPoint Sync = {};
+            bool Submitted = false;
+        };
+
+        std::string GetFilePath(uint64_t key) const;
+
+        bool WriteFile(uint64_t key, const uint8_t* data, vk::DeviceSize size);
+
+        vr::VulrayDevice* mDevice;
+
+        std::string mDirectory;
+
+        std::vector<PendingStore> mPendingStores = {};
+        std::vector<PendingUpload> mPendingUploads = {};
+
+        ASCacheStatistics mStats = {};
+    };
+
+} // namespace vr
@@ -1,6 +1,8 @@
 #pragma once
 
+#include "Vulray/ASArena.h"
 #include "Vulray/Buffer.h"
+#include "Vulray/QueryPoolAllocator.h"
 
 namespace vr
 {
@@ -26,6 +28,20 @@ namespace vr
         vk::DeviceAddress TransformDevAddress = {};
     };
 
+    /// @brief Host pointers to the geometry data, only read by the CPU backend (CPUBLAS), the GPU builds ignore them
+    /// @note The data has the same layout as the device data, the offsets of GeometryData apply to it as well
+    struct GeometryHostData
+    {
+        /// @brief The vertices for triangles, vk::AabbPositionsKHR with GeometryData::Stride for AABBs
+        const void* VertexOrAABBData = nullptr;
+
+        /// @brief The indices, only used for triangles with an index format
+        const void* IndexData = nullptr;
+
+        /// @brief A row-major 3x4 float matrix like vk::TransformMatrixKHR, if null, the identity matrix is used
+        const void* TransformData = nullptr;
+    };
+
     struct GeometryData
     {
         /// @brief Type of geometry, either triangles or AABBs
@@ -34,6 +50,9 @@ namespace vr
         /// @brief Buffer containing the vertices, only used for triangles
         GeometryDeviceAddress DataAddresses = {};
 
+        /// @brief Host copies of the data, only needed to build a CPUBLAS from the same geometry
+        GeometryHostData HostData = {};
+
         /// @brief Format of the index buffer, only used for triangles
         vk::IndexType IndexFormat = vk::IndexType::eUint32;
 
@@ -46,6 +65,23 @@ namespace vr
         /// @brief Number of primitives in the geometry, such as triangles or AABBs
         uint32_t PrimitiveCount = 0;
 
+        /// @brief The highest index in the index buffer, only used for triangles
+        /// @note If 0, FirstVertex + PrimitiveCount * 3 is assumed, which can overestimate the vertex range.
+        /// PreprocessMesh(...) computes the exact value
+        uint32_t MaxVertex = 0;
+
+        /// @brief Byte offset of the first primitive, into the index buffer for indexed triangles, else into the
+        /// vertex or AABB buffer. Lets many geometries share one buffer address, see GeometryMegabuffer
+        /// @note Must be a multiple of the index size for indexed triangles, of the vertex component size for
+        /// non-indexed triangles and of 8 for AABBs
+        uint32_t PrimitiveOffset = 0;
+
+        /// @brief Added to every index, so the indices of a mesh can stay relative to its own first vertex
+        uint32_t FirstVertex = 0;
+
+        /// @brief Byte offset into the transform buffer, must be a multiple of 16
+        uint32_t TransformOffset = 0;
+
         ///@brief Flags for the geometry, Default is eOpaque
         vk::GeometryFlagsKHR Flags = vk::GeometryFlagBitsKHR::eOpaque;
     };
@@ -94,7 +130,12 @@ namespace vr
         vk::AccelerationStructureKHR AccelerationStructure = nullptr;
 
         /// @brief Buffer containing the acceleration structure
+        /// @note If the acceleration structure lives in the AS arena, this is the shared arena buffer without an
+        /// allocation, and Size is the size of the acceleration structure
         AllocatedBuffer Buffer = {};
+
+        /// @brief Placement of the acceleration structure in the AS arena, invalid if the BLAS has its own buffer
+        ASArenaAllocation ArenaAllocation = {};
     };
 
     struct BLASUpdateInfo
@@ -110,22 +151,73 @@ namespace vr
         /// @note This field can be null if the updated geometries are in the same buffers as the source BLAS
         ///       The size of the vector must be the same as the number of geometries in @c SourceBuildInfo
         ///       Transform buffer must be provided if the source BLAS had a transform buffer, else it must be null
+        ///       The offsets of the source geometries (PrimitiveOffset, FirstVertex, TransformOffset) are kept and
+        ///       apply to the new addresses
         std::vector<GeometryDeviceAddress> NewGeometryAddresses = {};
     };
 
     struct CompactionRequest
     {
-        /// @brief Query pool that will be used to get the compacted size
-        vk::QueryPool CompactionQueryPool = nullptr;
+        /// @brief Queries of the compacted sizes, allocated by GetCompactionSizes(...) and freed when the sizes are
+        /// read
+        QueryRange CompactionQueries = {};
 
         /// @brief All the BLASes that will be compacted
         std::vector<vk::AccelerationStructureKHR> SourceBLAS = {};
     };
 
+    struct BLASBuildBatch
+    {
+        /// @brief Index of the first build info in the batch
+        uint32_t FirstBuildInfo = 0;
+
+        /// @brief Number of consecutive build infos in the batch
+        uint32_t BuildInfoCount = 0;
+
+        /// @brief Scratch memory required by all the build infos in the batch, including alignment
+        vk::DeviceSize ScratchSize = 0;
+    };
+
+    struct BLASBuildSchedule
+    {
+        /// @brief Batches of build infos, that are built one after another reusing the same scratch memory
+        std::vector<BLASBuildBatch> Batches = {};
+
+        /// @brief Size of the scratch buffer needed to build all the batches, which is the size of the biggest batch
+        /// @note This can be bigger than the requested budget, if a single build info needs more scratch memory than
+        /// the budget allows
+        vk::DeviceSize ScratchSize = 0;
+    };
+
+    struct BLASBuildStats
+    {
+        /// @brief Number of buildAccelerationStructuresKHR calls that were recorded
+        uint32_t BatchCount = 0;
+
+        /// @brief Number of barriers that were recorded between the batches
+        uint32_t BarrierCount = 0;
+    };
+
     //--------------------------------------------------------------------------------------
     // TLAS STRUCTUES
     //--------------------------------------------------------------------------------------
 
+    /// @brief How UpdateTLAS(...) prepares the TLAS for the next BuildTLAS(...)
+    enum class TLASUpdateMode : uint32_t
+    {
+        /// @brief Creates a new acceleration structure handle over the same buffer and builds it from scratch
+        Recreate,
+
+        /// @brief Keeps the acceleration structure handle and builds it from scratch
+        Rebuild,
+
+        /// @brief Keeps the acceleration structure handle and refits it in place (eUpdate), the fastest mode for frames
+        /// where only the transforms move
+        /// @note Requires eAllowUpdate in TLASCreateInfo::Flags and the same instance count as the previous build,
+        /// otherwise falls back to Rebuild
+        Refit,
+    };
+
     struct TLASCreateInfo
     {
         /// @brief Contains the geometries that will be added to the TLAS
@@ -135,6 +227,7 @@ namespace vr
         vk::DeviceAddress InstanceDevAddress = {};
 
         /// @brief Flags for the acceleration structure, Default is ePreferFastTrace
+        /// @note Add eAllowUpdate to use TLASUpdateMode::Refit
         vk::BuildAccelerationStructureFlagsKHR Flags = vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace;
     };
 
@@ -167,4 +260,55 @@ namespace vr
 
     vk::AccelerationStructureGeometryDataKHR ConvertToVulkanGeometry(const GeometryData& geom);
 
+    //--------------------------------------------------------------------------------------
+    // SCRATCH SIZING
+    //--------------------------------------------------------------------------------------
+
+    // These functions only do CPU math on the build sizes, so they can be used without a device.
+    // All the sizes are 64-bit and additions are checked, a result that doesn't fit in 64 bits is UINT64_MAX.
+
+    /// @brief Adds two sizes and checks for overflow
+    /// @param a The first size
+    /// @param b The second size
+    /// @param outSum The sum, UINT64_MAX if the addition overflows
+    /// @return False if the addition overflows
+    bool CheckedAdd(vk::DeviceSize a, vk::DeviceSize b, vk::DeviceSize& outSum);
+
+    /// @brief Returns the scratch size of the build, depending on the build mode, aligned to the scratch alignment
+    /// @param buildGeometryInfo The build geometry info, the mode decides if the build or update scratch size is used
+    /// @param buildSizes The build sizes of the acceleration structure
+    /// @param scratchAlignment The scratch alignment, minAccelerationStructureScratchOffsetAlignment of the device
+    /// @return The aligned scratch size, UINT64_MAX if aligning overflows
+    vk::DeviceSize GetAlignedScratchSize(const vk::AccelerationStructureBuildGeometryInfoKHR& buildGeometryInfo,
+                                         const vk::AccelerationStructureBuildSizesInfoKHR& buildSizes,
+                                         vk::DeviceSize scratchAlignment);
+
+    /// @brief Returns the size of the scratch buffer required to build all the acceleration structures
+    /// @tparam T BLASBuildInfo or TLASBuildInfo
+    /// @param buildInfos The build infos that will be built with one scratch buffer
+    /// @param scratchAlignment The scratch alignment, minAccelerationStructureScratchOffsetAlignment of the device
+    /// @return The scratch size, UINT64_MAX if the size overflows
+    template <typename T>
+    vk::DeviceSize GetScratchBufferSize(const std::vector<T>& buildInfos, vk::DeviceSize scratchAlignment)
+    {
+        vk::DeviceSize scratchSize = 0;
+        for (auto& info : buildInfos)
+        {
+            if (!CheckedAdd(scratchSize,
+                            GetAlignedScratchSize(info.BuildGeometryInfo, info.BuildSizes, scratchAlignment),
+                            scratchSize))
+                break;
+        }
+        return scratchSize;
+    }
+
+    /// @brief Splits the build infos into batches, so that the scratch memory of a single batch fits in the budget
+    /// @param buildInfos The build infos that will be built
+    /// @param scratchBudget The maximum amount of scratch memory in bytes that a batch can use
+    /// @param scratchAlignment The scratch alignment, minAccelerationStructureScratchOffsetAlignment of the device
+    /// @return The schedule of the builds
+    /// @note See VulrayDevice::ScheduleBLASBuilds(...)
+    BLASBuildSchedule ScheduleBLASBuilds(const std::vector<BLASBuildInfo>& buildInfos, vk::DeviceSize scratchBudget,
+                                         vk::DeviceSize scratchAlignment);
+
 } // namespace vr
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "Vulray/AccelStruct.h"
+
+namespace vr
+{
+    struct MeshPartitionInput
+    {
+        /// @brief Geometry of the mesh
+        /// @note To merge meshes that are not in world space, DataAddresses.TransformDevAddress must point to the
+        /// vk::TransformMatrixKHR that places the mesh in the space of the BLAS
+        GeometryData Geometry = {};
+
+        /// @brief If false, the mesh is never merged with others, e.g. because it moves on its own
+        bool AllowMerge = true;
+    };
+
+    struct BLASPartitionSettings
+    {
+        /// @brief Meshes with this many primitives or fewer are merged into shared BLASes
+        uint32_t MergeThreshold = 4096;
+
+        /// @brief Maximum number of primitives in a BLAS made of merged meshes
+        uint32_t MaxMergedPrimitives = 256 * 1024;
+
+        /// @brief Maximum number of geometries in a BLAS made of merged meshes
+        uint32_t MaxMergedGeometries = 1024;
+
+        /// @brief Meshes with more primitives than this are split into chunks, each chunk gets its own BLAS
+        uint32_t SplitThreshold = 2 * 1024 * 1024;
+
+        /// @brief Number of primitives in a chunk of a split mesh
+        uint32_t ChunkPrimitives = 512 * 1024;
+
+        /// @brief Flags of the created BLASes
+        vk::BuildAccelerationStructureFlagsKHR Flags = vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace;
+    };
+
+    /// @brief Where a part of a mesh ended up
+    struct MeshPartitionPart
+    {
+        /// @brief Index into BLASPartition::BLASInfos
+        uint32_t BLASIndex = 0;
+
+        /// @brief Index of the geometry in the BLAS, the geometry index seen in hit shaders
+        uint32_t GeometryIndex = 0;
+
+        /// @brief The primitive index in the original mesh of the first primitive of the part, add it to the
+        /// primitive index seen in hit shaders to get the primitive index in the mesh
+        uint32_t FirstPrimitive = 0;
+
+        uint32_t PrimitiveCount = 0;
+    };
+
+    struct BLASPartition
+    {
+        /// @brief Create infos of the BLASes, to be used with CreateBLAS(...)
+        std::vector<BLASCreateInfo> BLASInfos = {};
+
+        /// @brief The parts of every input mesh, index matches the input. Merged and unchanged meshes have one part,
+        /// split meshes have one part per chunk
+        std::vector<std::vector<MeshPartitionPart>> MeshParts = {};
+    };
+
+    /// @brief Groups meshes into BLASes: small meshes are merged into shared BLASes and oversized meshes are split
+    /// into chunks of contiguous primitives
+    /// @param meshes The meshes, each one would be a BLAS of its own otherwise
+    /// @param settings The thresholds of the partitioning
+    /// @return The BLAS create infos and the mapping from the meshes to the BLASes and geometries
+    /// @note Chunks are spatially coherent if the primitives of the mesh are spatially sorted, e.g. by
+    /// PreprocessMesh(...) with ReorderTriangles
+    [[nodiscard]] BLASPartition PartitionBLAS(const std::vector<MeshPartitionInput>& meshes,
+                                              const BLASPartitionSettings& settings = {});
+
+} // namespace vr
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "Vulray/AccelStruct.h"
+
+namespace vr
+{
+    class VulrayDevice;
+
+    enum class BLASUpdateDecision : uint32_t
+    {
+        /// @brief The BLAS is refitted (eUpdate), fast but the BVH quality degrades with every refit
+        Refit,
+
+        /// @brief The BLAS is rebuilt from scratch into the same acceleration structure, restoring the BVH quality
+        Rebuild,
+    };
+
+    struct BLASUpdatePolicySettings
+    {
+        /// @brief A BLAS is rebuilt after this many refits in a row, 0 disables the limit
+        uint32_t MaxRefits = 32;
+
+        /// @brief A BLAS is rebuilt once the deformation accumulated since its last rebuild exceeds this value,
+        /// 0 disables the threshold
+        float DeformationThreshold = 1.0f;
+
+        /// @brief Maximum number of rebuilds per frame, 0 means unlimited
+        uint32_t MaxRebuildsPerFrame = 0;
+
+        /// @brief Maximum number of primitives rebuilt per frame, a proxy for the GPU time of the rebuilds,
+        /// 0 means unlimited
+        uint64_t MaxRebuildPrimitivesPerFrame = 0;
+    };
+
+    struct BLASUpdatePolicyStatistics
+    {
+        uint32_t Refits = 0;
+        uint32_t Rebuilds = 0;
+
+        /// @brief Rebuilds because the refit count reached MaxRefits
+        uint32_t RebuildsByRefitCount = 0;
+
+        /// @brief Rebuilds because the accumulated deformation reached DeformationThreshold
+        uint32_t RebuildsByDeformation = 0;
+
+        /// @brief Rebuilds that were due, but were refitted instead because the frame budget was used up
+        uint32_t DeferredRebuilds = 0;
+
+        /// @brief Rebuilds because the BLAS wasn't built with eAllowUpdate and can't be refitted
+        uint32_t RebuildsWithoutAllowUpdate = 0;
+    };
+
+    /// @brief One BLAS that is updated this frame
+    struct BLASUpdateRequest
+    {
+        /// @brief The update info of the BLAS. A BLAS that wasn't built with eAllowUpdate is always rebuilt
+        BLASUpdateInfo* UpdateInfo = nullptr;
+
+        /// @brief How much the geometry deformed since the last update, e.g. the maximum vertex displacement divided
+        /// by the radius of the mesh. The policy accumulates it since the last rebuild
+        float Deformation = 0.0f;
+    };
+
+    /// @brief Decides per frame which dynamic BLASes are refitted and which are rebuilt.
+    ///
+    /// Every BLAS is refitted until it reached MaxRefits refits or DeformationThreshold accumulated deformation.
+    /// Rebuilds that are due are granted in the order of urgency until the frame budget is used up, the rest is
+    /// refitted and tried again the next frame.
+    class BLASUpdatePolicy
+    {
+      public:
+        BLASUpdatePolicy(const BLASUpdatePolicySettings& settings = {});
+
+        /// @brief Decides the updates of one frame
+        /// @param requests The BLASes that are updated this frame
+        /// @return The decision for every request, index matches requests
+        [[nodiscard]] std::vector<BLASUpdateDecision> Decide(const std::vector<BLASUpdateRequest>& requests);
+
+        /// @brief Decides the updates of one frame and creates the build infos for them
+        /// @param device The device that owns the BLASes
+        /// @param requests The BLASes that are updated this frame
+        /// @return The build infos, index matches requests. Build them with BuildBLAS(...), after binding a scratch
+        /// buffer of GetScratchBufferSize(...) bytes, rebuilds need more scratch memory than refits
+        [[nodiscard]] std::vector<BLASBuildInfo> PrepareUpdates(vr::VulrayDevice* device,
+                                                                const std::vector<BLASUpdateRequest>& requests);
+
+        /// @brief Stops tracking the BLAS, must be called when the BLAS is destroyed
+        void Forget(const BLASHandle& blas);
+
+        /// @brief Returns the counters since the policy was created
+        [[nodiscard]] BLASUpdatePolicyStatistics GetStatistics() const { return mTotalStats; }
+
+        /// @brief Returns the counters of the last Decide(...) or PrepareUpdates(...) call
+        [[nodiscard]] BLASUpdatePolicyStatistics GetFrameStatistics() const { return mFrameStats; }
+
+        BLASUpdatePolicySettings Settings = {};
+
+      private:
+        struct BLASState
+        {
+            uint32_t RefitCount = 0;
+            float Deformation = 0.0f;
+        };
+
+        std::unordered_map<VkAccelerationStructureKHR, BLASState> mStates = {};
+
+        BLASUpdatePolicyStatistics mTotalStats = {};
+        BLASUpdatePolicyStatistics mFrameStats = {};
+    };
+
+} // namespace vr
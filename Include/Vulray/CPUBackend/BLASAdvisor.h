@@ -0,0 +1,131 @@
+#pragma once
+
+#include "Vulray/BLASPartitioner.h"
+#include "Vulray/CPUBackend/CPUBVH.h"
+
+namespace vr
+{
+    class ThreadPool;
+
+    /// @brief How often the geometry of a BLAS changes after it was built
+    enum class MeshChangeFrequency : uint32_t
+    {
+        /// @brief Never changes, e.g. level geometry
+        Static,
+
+        /// @brief Deforms now and then with the same topology, e.g. a door or a destructible prop
+        Occasional,
+
+        /// @brief Deforms every frame with the same topology, e.g. a skinned character
+        EveryFrame,
+
+        /// @brief Built from new geometry every frame, so it can't be refitted, e.g. particles or procedural meshes
+        TopologyChanges,
+    };
+
+    struct BLASAdvisorSettings
+    {
+        /// @brief Settings of the reference BVH, the SAH costs and the overlap score are measured on it
+        CPUBVHBuildSettings BVHSettings = {};
+
+        /// @brief Meshes with fewer primitives are not worth the compaction query and copy
+        uint32_t MinCompactionPrimitives = 1024;
+
+        /// @brief If the SAH cost of the fast build estimate is this many times the reference cost, the mesh is
+        /// considered hard to build well and ePreferFastTrace is recommended even for meshes that deform every frame
+        float HardSAHRatio = 1.25f;
+
+        /// @brief Overlap score above which the mesh is considered to have a high overlap, see BLASAdvice::OverlapScore
+        float HighOverlapScore = 0.5f;
+
+        /// @brief Triangles with a larger aspect ratio are counted as slivers
+        float SliverAspectRatio = 10.0f;
+
+        /// @brief Meshes with more primitives than this are split into chunks of ChunkPrimitives, like in
+        /// BLASPartitionSettings
+        uint32_t SplitThreshold = 2 * 1024 * 1024;
+        uint32_t ChunkPrimitives = 512 * 1024;
+
+        /// @brief Meshes with at least this many primitives are split into their spatial clusters, if the bounds of
+        /// the clusters cover at most ClusterAreaRatio of the surface area of the mesh bounds
+        uint32_t MinClusterSplitPrimitives = 64 * 1024;
+        float ClusterAreaRatio = 0.25f;
+    };
+
+    /// @brief Distribution of a per primitive value
+    struct BLASAdvisorDistribution
+    {
+        float Min = 0.0f;
+        float Max = 0.0f;
+        float Mean = 0.0f;
+        float Median = 0.0f;
+        float Percentile90 = 0.0f;
+
+        /// @brief Standard deviation divided by the mean, 0 if all the values are the same
+        float CoefficientOfVariation = 0.0f;
+    };
+
+    /// @brief Report of AdviseBLAS(...), the measured quality metrics of the mesh and the recommended build
+    struct BLASAdvice
+    {
+        /// @brief False if the geometry couldn't be read, nothing else is filled in then
+        bool Valid = false;
+
+        uint32_t PrimitiveCount = 0;
+
+        /// @brief SAH cost of the reference BVH, relative to the surface area of the mesh bounds
+        float SAHCost = 0.0f;
+
+        /// @brief SAH cost of a BVH built with 4 bins, an estimate of what a fast build achieves
+        float FastBuildSAHCost = 0.0f;
+
+        /// @brief Surface area of the pairwise overlaps of sibling nodes divided by the surface area of the nodes,
+        /// summed over the reference BVH. 0 if siblings never overlap, high for interpenetrating geometry
+        float OverlapScore = 0.0f;
+
+        /// @brief Triangle areas, or the surface areas of the boxes for AABB geometry
+        BLASAdvisorDistribution PrimitiveArea = {};
+
+        /// @brief Longest edge divided by the height on it, 1.15 for equilateral triangles. For AABB geometry the
+        /// longest extent divided by the shortest
+        BLASAdvisorDistribution AspectRatio = {};
+
+        /// @brief Primitives with zero area, they can never be hit
+        uint32_t DegenerateCount = 0;
+
+        /// @brief Fraction of the primitives with an aspect ratio above BLASAdvisorSettings::SliverAspectRatio
+        float SliverFraction = 0.0f;
+
+        /// @brief Recommended BLASCreateInfo::Flags
+        vk::BuildAccelerationStructureFlagsKHR Flags = vk::BuildAccelerationStructureFlagBitsKHR::ePreferFastTrace;
+
+        /// @brief Recommended number of primitives per BLAS, 0 if the mesh should stay in one BLAS
+        /// @note The chunks are contiguous primitive ranges, they follow the spatial clusters only if the primitives
+        /// are spatially sorted, e.g. by PreprocessMesh(...) with ReorderTriangles
+        uint32_t SplitChunkPrimitives = 0;
+
+        /// @brief One sentence per recommendation, why it was made
+        std::vector<std::string> Reasons = {};
+
+        /// @brief Applies the advice to the create info of the mesh
+        /// @param info The create info that was analyzed
+        /// @return The create infos to pass to CreateBLAS(...) and where the geometries ended up. Without a split,
+        /// this is info with the recommended flags and every geometry keeps its index, else every geometry is split
+        /// into BLASes of its own
+        [[nodiscard]] BLASPartition Apply(const BLASCreateInfo& info) const;
+    };
+
+    /// @brief Analyzes the geometry of a BLAS on the CPU and recommends its build flags and whether it is split.
+    ///
+    /// A reference BVH is built over the primitives to measure the SAH cost and the overlap, a second one with few
+    /// bins estimates what a fast build achieves. Together with how often the mesh changes, this chooses between
+    /// ePreferFastTrace and ePreferFastBuild, and whether eAllowUpdate and eAllowCompaction are set.
+    /// @param info The create info of the BLAS, every geometry needs its GeometryData::HostData
+    /// @param changes How often the geometry changes after the build
+    /// @param settings Thresholds of the advisor
+    /// @param threadPool Pool to split the analysis across, if null, it runs on the calling thread
+    /// @return The report, BLASAdvice::Valid is false if the geometry couldn't be read
+    [[nodiscard]] BLASAdvice AdviseBLAS(const BLASCreateInfo& info, MeshChangeFrequency changes,
+                                        const BLASAdvisorSettings& settings = {}, ThreadPool* threadPool = nullptr);
+
+} // namespace vr
@@ -0,0 +1,183 @@
+#pragma once
+
+#include "Vulray/AccelStruct.h"
+#include "Vulray/CPUBackend/CPUBVH.h"
+
+namespace vr
+{
+    class ThreadPool;
+
+    struct CPURay
+    {
+        float Origin[3] = {0.0f, 0.0f, 0.0f};
+        float TMin = 0.0f;
+
+        /// @brief Direction of the ray, doesn't have to be normalized, the hit distance is in units of its length
+        float Direction[3] = {0.0f, 0.0f, 1.0f};
+        float TMax = FLT_MAX;
+    };
+
+    struct CPUHit
+    {
+        /// @brief Distance along the ray, FLT_MAX if nothing was hit
+        float T = FLT_MAX;
+
+        /// @brief Barycentrics of the hit, like the attributes of a triangle hit in a hit shader. 0 for AABBs
+        float U = 0.0f;
+        float V = 0.0f;
+
+        /// @brief Index of the primitive in its geometry, like PrimitiveIndex() in shaders
+        uint32_t PrimitiveIndex = ~0U;
+
+        /// @brief Index of the geometry in BLASCreateInfo::Geometries, like GeometryIndex() in shaders
+        uint32_t GeometryIndex = ~0U;
+
+        /// @brief Index of the instance in the TLAS, ~0U for hits of a CPUBLAS traced on its own
+        uint32_t InstanceIndex = ~0U;
+
+        uint32_t InstanceCustomIndex = ~0U;
+
+        [[nodiscard]] bool IsHit() const { return PrimitiveIndex != ~0U; }
+    };
+
+    enum class CPUTraceMode : uint32_t
+    {
+        /// @brief Finds the closest hit of every ray
+        ClosestHit,
+
+        /// @brief Stops at the first hit that is found, which isn't necessarily the closest, e.g. for shadow rays
+        AnyHit,
+    };
+
+    /// @brief Reads the vertices of a triangle through GeometryData::HostData the way the GPU build reads them, with
+    /// the primitive offset, first vertex and transform applied
+    /// @param geom The geometry, its host data must be valid as described in CPUBLAS::Build(...)
+    /// @param primitive Index of the triangle in the geometry
+    /// @param outVertices Receives the 3 vertex positions
+    void ReadHostTriangle(const GeometryData& geom, uint32_t primitive, float outVertices[3][3]);
+
+    /// @brief Reads an AABB through GeometryData::HostData the way the GPU build reads it
+    void ReadHostAABB(const GeometryData& geom, uint32_t primitive, CPUBVHBounds& outBounds);
+
+    /// @brief Bottom level acceleration structure of the CPU backend, built from the same BLASCreateInfo as the GPU
+    /// BLAS, reading the geometry through GeometryData::HostData.
+    ///
+    /// Triangles are intersected with the Moller-Trumbore test and are never culled by facing. There are no
+    /// intersection shaders on the CPU, so AABB geometries report a hit where the ray enters the box.
+    class CPUBLAS
+    {
+      public:
+        /// @brief Builds the BLAS, replacing the previous one
+        /// @param info The geometries, every geometry needs its HostData. Vertex positions must be 3 floats at the
+        /// start of a vertex (eR32G32B32Sfloat or eR32G32B32A32Sfloat)
+        /// @param settings The BVH build settings
+        /// @param threadPool Pool to split the build across, if null, the BLAS is built on the calling thread
+        /// @return False if the geometries can't be read
+        bool Build(const BLASCreateInfo& info, const CPUBVHBuildSettings& settings = {},
+                   ThreadPool* threadPool = nullptr);
+
+        /// @brief Returns the closest hit along the ray
+        [[nodiscard]] CPUHit TraceClosest(const CPURay& ray) const;
+
+        /// @brief Returns the first hit found along the ray, which isn't necessarily the closest
+        [[nodiscard]] CPUHit TraceAny(const CPURay& ray) const;
+
+        [[nodiscard]] const CPUBVH& GetBVH() const { return mBVH; }
+
+      private:
+        friend class CPUTLAS;
+
+        // Intersects the ray in object space, shrinks tMax and fills the hit if a closer hit is found
+        template <bool AnyHit>
+        bool Intersect(const float* origin, const float* direction, float tMin, float& tMax, CPUHit& hit) const;
+
+        // Triangles are stored in leaf order as a vertex and two edges, which is what the intersection test needs
+        struct Triangle
+        {
+            float V0[3];
+            float E1[3];
+            float E2[3];
+            uint32_t GeometryIndex;
+            uint32_t PrimitiveIndex;
+        };
+
+        struct Box
+        {
+            float Min[3];
+            float Max[3];
+            uint32_t GeometryIndex;
+            uint32_t PrimitiveIndex;
+        };
+
+        CPUBVH mBVH = {};
+
+        std::vector<Triangle> mTriangles = {};
+        std::vector<Box> mBoxes = {};
+    };
+
+    /// @brief Instance of a CPUBLAS in a CPUTLAS
+    struct CPUInstance
+    {
+        const CPUBLAS* BLAS = nullptr;
+
+        /// @brief Object to world transform, row-major like vk::TransformMatrixKHR
+        float Transform[3][4] = {{1.0f, 0.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f, 0.0f}};
+
+        /// @brief Reported in CPUHit::InstanceCustomIndex
+        uint32_t CustomIndex = 0;
+
+        /// @brief The instance is only hit by rays whose cull mask shares a bit with the mask
+        uint8_t Mask = 0xFF;
+    };
+
+    /// @brief Top level acceleration structure of the CPU backend, a BVH over instances of CPUBLASes
+    class CPUTLAS
+    {
+      public:
+        /// @brief Builds the TLAS, replacing the previous one
+        /// @param instances The instances, the BLASes must outlive the TLAS. Instances with a null BLAS or a
+        /// transform that can't be inverted are skipped
+        /// @param settings The BVH build settings
+        /// @param threadPool Pool to split the build across, if null, the TLAS is built on the calling thread
+        void Build(const std::vector<CPUInstance>& instances, const CPUBVHBuildSettings& settings = {},
+                   ThreadPool* threadPool = nullptr);
+
+        /// @brief Returns the closest hit along the ray
+        /// @param ray The ray in world space
+        /// @param cullMask Only instances whose mask shares a bit with cullMask are hit
+        [[nodiscard]] CPUHit TraceClosest(const CPURay& ray, uint8_t cullMask = 0xFF) const;
+
+        /// @brief Returns the first hit found along the ray, which isn't necessarily the closest
+        [[nodiscard]] CPUHit TraceAny(const CPURay& ray, uint8_t cullMask = 0xFF) const;
+
+        /// @brief Traces a buffer of rays, the CPU counterpart of vkCmdTraceRaysKHR without shaders
+        /// @param rays The rays in world space
+        /// @param hits Receives the hit of every ray
+        /// @param rayCount Number of rays
+        /// @param mode Whether the closest or any hit is returned
+        /// @param cullMask Only instances whose mask shares a bit with cullMask are hit
+        /// @param threadPool Pool to split the rays across, if null, the rays are traced on the calling thread
+        void DispatchRays(const CPURay* rays, CPUHit* hits, uint32_t rayCount, CPUTraceMode mode,
+                          uint8_t cullMask = 0xFF, ThreadPool* threadPool = nullptr) const;
+
+        [[nodiscard]] const CPUBVH& GetBVH() const { return mBVH; }
+
+      private:
+        template <bool AnyHit> CPUHit Trace(const CPURay& ray, uint8_t cullMask) const;
+
+        // Instances in leaf order, with the world to object transform for the rays
+        struct Instance
+        {
+            const CPUBLAS* BLAS;
+            float WorldToObject[3][4];
+            uint32_t Index;
+            uint32_t CustomIndex;
+            uint8_t Mask;
+        };
+
+        CPUBVH mBVH = {};
+
+        std::vector<Instance> mInstances = {};
+    };
+
+} // namespace vr
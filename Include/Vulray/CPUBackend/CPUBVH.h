@@ -0,0 +1,105 @@
+#pragma once
+
+namespace vr
+{
+    class ThreadPool;
+
+    /// @brief Axis aligned bounding box of a primitive of the CPU backend
+    struct CPUBVHBounds
+    {
+        float Min[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+        float Max[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    };
+
+    struct CPUBVHBuildSettings
+    {
+        /// @brief Primitives are only put into a leaf together if there are at most this many, at most 16
+        uint32_t MaxLeafSize = 4;
+
+        /// @brief Number of SAH bins per axis, at most 32
+        uint32_t BinCount = 16;
+
+        /// @brief SAH cost of traversing a node, relative to IntersectionCost
+        float TraversalCost = 1.0f;
+
+        /// @brief SAH cost of intersecting a primitive
+        float IntersectionCost = 1.0f;
+    };
+
+    /// @brief Node of a 4-wide BVH, the bounds of the 4 children are stored in SoA layout for SSE
+    struct alignas(16) CPUBVHNode
+    {
+        float MinX[4];
+        float MinY[4];
+        float MinZ[4];
+        float MaxX[4];
+        float MaxY[4];
+        float MaxZ[4];
+
+        /// @brief Index of the child node, or of the first primitive if the child is a leaf. ~0U for empty slots
+        uint32_t Children[4];
+
+        /// @brief Number of primitives if the child is a leaf, 0 for inner nodes and empty slots
+        uint32_t Counts[4];
+    };
+    static_assert(sizeof(CPUBVHNode) == 128, "CPUBVHNode should fill exactly two cache lines");
+
+    struct CPUBVHStatistics
+    {
+        uint32_t PrimitiveCount = 0;
+
+        /// @brief Number of 4-wide nodes
+        uint32_t NodeCount = 0;
+
+        uint32_t LeafCount = 0;
+
+        /// @brief Depth of the deepest leaf, in 4-wide nodes
+        uint32_t MaxDepth = 0;
+
+        /// @brief Average number of occupied child slots per node, at most 4
+        float AverageChildCount = 0.0f;
+
+        /// @brief SAH cost of the tree, relative to the surface area of the root bounds
+        float SAHCost = 0.0f;
+
+        float BuildTimeMs = 0.0f;
+    };
+
+    /// @brief 4-wide bounding volume hierarchy over a set of primitive bounds, the acceleration structure of the CPU
+    /// backend.
+    ///
+    /// The builder bins the primitive centroids to find SAH splits. Nodes with many primitives are binned in parallel
+    /// on the thread pool until the tree is split into enough subtrees, which are then built in parallel. The binary
+    /// tree is collapsed into 4-wide nodes, so a ray tests 4 boxes at once with SSE.
+    class CPUBVH
+    {
+      public:
+        /// @brief Builds the BVH, replacing the previous one
+        /// @param primitiveBounds Bounds of the primitives
+        /// @param settings The build settings
+        /// @param threadPool Pool to split the build across, if null, the BVH is built on the calling thread
+        void Build(const std::vector<CPUBVHBounds>& primitiveBounds, const CPUBVHBuildSettings& settings = {},
+                   ThreadPool* threadPool = nullptr);
+
+        /// @brief Returns the nodes, the root is the first node. Empty if there are no primitives
+        [[nodiscard]] const std::vector<CPUBVHNode>& GetNodes() const { return mNodes; }
+
+        /// @brief Returns the primitive indices in leaf order, leaves refer to ranges of this array
+        [[nodiscard]] const std::vector<uint32_t>& GetPrimitiveIndices() const { return mPrimitiveIndices; }
+
+        /// @brief Returns the bounds of all primitives
+        [[nodiscard]] const CPUBVHBounds& GetBounds() const { return mBounds; }
+
+        [[nodiscard]] const CPUBVHStatistics& GetStatistics() const { return mStats; }
+
+      private:
+        std::vector<CPUBVHNode> mNodes = {};
+
+        std::vector<uint32_t> mPrimitiveIndices = {};
+
+        CPUBVHBounds mBounds = {};
+
+        CPUBVHStatistics mStats = {};
+    };
+
+} // namespace vr
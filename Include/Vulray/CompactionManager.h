@@ -0,0 +1,114 @@
+#pragma once
+
+#include "Vulray/AccelStruct.h"
+#include "Vulray/Sync.h"
+
+namespace vr
+{
+    class VulrayDevice;
+
+    struct CompactionStatistics
+    {
+        /// @brief Number of BLASes waiting for their compacted size
+        uint32_t PendingCount = 0;
+
+        /// @brief Number of BLASes that were compacted by the manager
+        uint32_t CompactedCount = 0;
+
+        /// @brief Number of BLASes that were not compacted, because compaction wouldn't make them smaller or the
+        /// storage of the compacted copy couldn't be created
+        uint32_t SkippedCount = 0;
+
+        /// @brief Number of original BLASes waiting to be destroyed
+        uint32_t RetiredCount = 0;
+
+        /// @brief Size of the compacted BLASes before compaction
+        vk::DeviceSize BytesBeforeCompaction = 0;
+
+        /// @brief Size of the compacted BLASes after compaction
+        vk::DeviceSize BytesAfterCompaction = 0;
+    };
+
+    /// @brief Compacts BLASes in the background, without stalling the CPU.
+    ///
+    /// Usage per frame:
+    /// 1. Build BLASes with eAllowCompaction and call Enqueue(...) with the same command buffer after the build
+    /// 2. Call Update(...) with a command buffer of the frame to record the compaction of finished BLASes
+    /// 3. Call Submit(...) with the sync point of the submission that contains the command buffers of 1. and 2.
+    ///
+    /// Update(...) replaces the BLAS handles in place and returns the handles that changed, so instance buffers that
+    /// reference them can be updated. The original BLASes are destroyed when the submission that compacted them is
+    /// finished.
+    class CompactionManager
+    {
+      public:
+        /// @param device The device that owns the BLASes
+        /// @param packed If true, the BLASes of each Enqueue(...) call are compacted into a single buffer with
+        /// CompactBLASPacked(...), which keeps the BLAS heap contiguous when geometry is streamed in and out
+        CompactionManager(vr::VulrayDevice* device, bool packed = false);
+        ~CompactionManager();
+
+        CompactionManager() = delete;
+        CompactionManager(const CompactionManager&) = delete;
+
+        /// @brief Queues BLASes for compaction and records the queries for their compacted sizes
+        /// @param blas The BLASes that were built
+        /// @param buildInfos The build infos that were used to build the BLASes, index matches blas
+        /// @param cmdBuf The command buffer that built the BLASes, the queries are recorded after the builds
+        /// @note BLASes that were not built with eAllowCompaction are ignored
+        /// @warning The BLAS handles must stay valid until Update(...) compacts them or Cancel(...) is called
+        void Enqueue(const std::vector<BLASHandle*>& blas, const std::vector<BLASBuildInfo>& buildInfos,
+                     vk::CommandBuffer cmdBuf);
+
+        /// @brief Removes the BLAS from the pending compactions, must be called before destroying a queued BLAS
+        void Cancel(const BLASHandle* blas);
+
+        /// @brief Sets the sync point of everything that was recorded by Enqueue(...) and Update(...) since the last
+        /// call to Submit(...)
+        /// @param syncPoint The sync point that is reached when the submission is finished
+        void Submit(const SyncPoint& syncPoint);
+
+        /// @brief Records the compaction of BLASes whose sizes are available and destroys original BLASes that are no
+        /// longer used by the GPU
+        /// @param cmdBuf The command buffer that will be used to record the compaction copies
+        /// @return The BLAS handles that were replaced by compacted ones, their device addresses have changed
+        /// @note This function never waits on the GPU
+        /// @warning The instances referencing the returned BLASes must be updated and the TLAS rebuilt in the same
+        /// submission, because the original BLASes are destroyed when it is finished
+        [[nodiscard]] std::vector<BLASHandle*> Update(vk::CommandBuffer cmdBuf);
+
+        /// @brief Returns the statistics of the manager
+        [[nodiscard]] CompactionStatistics GetStatistics() const;
+
+      private:
+        // BLASes whose compacted sizes are queried in the same query range
+        struct PendingBatch
+        {
+            QueryRange Queries = {};
+            std::vector<BLASHandle*> Handles = {};
+            std::vector<vk::AccelerationStructureKHR> SourceBLAS = {};
+            SyncPoint Sync = {};
+            bool Submitted = false;
+        };
+
+        // Original BLASes that are destroyed after the compaction copy is finished
+        struct RetiredBLAS
+        {
+            BLASHandle Handle = {};
+            SyncPoint Sync = {};
+            bool Submitted = false;
+        };
+
+        void DestroyFinishedBLAS();
+
+        vr::VulrayDevice* mDevice;
+
+        bool mPacked = false;
+
+        std::vector<PendingBatch> mPendingBatches = {};
+        std::vector<RetiredBLAS> mRetiredBLAS = {};
+
+        CompactionStatistics mStats = {};
+    };
+
+} // namespace vr
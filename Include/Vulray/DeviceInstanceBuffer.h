@@ -0,0 +1,129 @@
+#pragma once
+
+#include "Vulray/Buffer.h"
+#include "Vulray/Sync.h"
+
+namespace vr
+{
+    class VulrayDevice;
+
+    struct DeviceInstanceBufferCreateInfo
+    {
+        /// @brief Number of instances the device local buffer holds
+        uint32_t MaxInstanceCount = 0;
+
+        /// @brief Number of frames whose uploads can be in flight at once, the staging ring holds a full upload of
+        /// MaxInstanceCount instances for every frame
+        uint32_t FramesInFlight = 2;
+    };
+
+    struct DeviceInstanceBufferStatistics
+    {
+        /// @brief Bytes copied by the last RecordUpload(...)
+        vk::DeviceSize UploadedBytes = 0;
+
+        /// @brief Copy regions recorded by the last RecordUpload(...), after adjacent ranges were merged
+        uint32_t CopyRegionCount = 0;
+
+        /// @brief Size of the staging ring
+        vk::DeviceSize RingSize = 0;
+
+        /// @brief Bytes of the staging ring that belong to uploads which haven't finished yet
+        vk::DeviceSize RingUsedBytes = 0;
+
+        /// @brief Number of times Stage(...) failed because the ring was full
+        uint32_t RingFullCount = 0;
+    };
+
+    /// @brief Instance buffer in device local memory for BuildTLAS(...), fed from a persistently mapped staging ring.
+    ///
+    /// On discrete GPUs the builder reads the instances of CreateInstanceBuffer(...) across the bus on every build.
+    /// Here only the instances that changed are staged, and RecordUpload(...) copies just those ranges into the device
+    /// local buffer, so scenes with mostly static instances upload a fraction of the instance data every frame.
+    ///
+    /// Usage every frame:
+    /// 1. Update() to recycle the ring space of finished uploads
+    /// 2. Stage(...) or Upload(...) the instances that changed, all instances on the first frame
+    /// 3. RecordUpload(...) before BuildTLAS(...) with GetBuffer() in the same command buffer
+    /// 4. Submit(...) with the sync point of the submission
+    class DeviceInstanceBuffer
+    {
+      public:
+        DeviceInstanceBuffer(vr::VulrayDevice* device, const DeviceInstanceBufferCreateInfo& info);
+        ~DeviceInstanceBuffer();
+
+        DeviceInstanceBuffer() = delete;
+        DeviceInstanceBuffer(const DeviceInstanceBuffer&) = delete;
+
+        /// @brief Reserves staging memory for the instances [firstInstance, firstInstance + count), they are copied to
+        /// the device local buffer by the next RecordUpload(...)
+        /// @param firstInstance Index of the first instance in the device local buffer
+        /// @param count Number of instances
+        /// @return Mapped memory for count instances, e.g. for TLASInstanceWriter::Write(...). Null if the range is
+        /// out of bounds or the ring is full
+        /// @note The memory is write-combined, it should be written sequentially and never read
+        /// @warning Ranges staged before the same RecordUpload(...) should not overlap, overlapping ranges are copied
+        /// one at a time in the order they were staged
+        [[nodiscard]] vk::AccelerationStructureInstanceKHR* Stage(uint32_t firstInstance, uint32_t count);
+
+        /// @brief Copies the instances into the staging ring, same as Stage(...) followed by a memcpy
+        /// @return False if the range is out of bounds or the ring is full
+        bool Upload(uint32_t firstInstance, const vk::AccelerationStructureInstanceKHR* instances, uint32_t count);
+
+        /// @brief Records the copies of the staged ranges and the barriers around them, ends the frame
+        /// @param cmdBuf The command buffer, BuildTLAS(...) must be recorded after this call
+        void RecordUpload(vk::CommandBuffer cmdBuf);
+
+        /// @brief Sets the sync point of the uploads recorded by RecordUpload(...) since the last call to Submit(...)
+        void Submit(const SyncPoint& syncPoint);
+
+        /// @brief Recycles the ring space of finished uploads, never waits on the GPU
+        void Update();
+
+        /// @brief Returns the device local instance buffer for BuildTLAS(...)
+        [[nodiscard]] const AllocatedBuffer& GetBuffer() const { return mBuffer; }
+
+        [[nodiscard]] uint32_t GetMaxInstanceCount() const { return mInfo.MaxInstanceCount; }
+
+        [[nodiscard]] DeviceInstanceBufferStatistics GetStatistics() const;
+
+      private:
+        // Ring space of the uploads recorded by one RecordUpload(...)
+        struct InFlightUpload
+        {
+            // Ring offset after the last byte of the upload, the ring tail moves there when the upload finishes
+            vk::DeviceSize End = 0;
+
+            // Bytes of the ring used by the upload, including the bytes skipped when the ring wrapped around
+            vk::DeviceSize Bytes = 0;
+
+            SyncPoint Sync = {};
+            bool Submitted = false;
+        };
+
+        // Reserves contiguous ring space, wraps around to the start of the ring if the end is too small
+        bool ReserveRing(vk::DeviceSize size, vk::DeviceSize& outOffset);
+
+        vr::VulrayDevice* mDevice;
+
+        DeviceInstanceBufferCreateInfo mInfo = {};
+
+        AllocatedBuffer mBuffer = {};
+
+        AllocatedBuffer mStagingRing = {};
+        uint8_t* mMappedRing = nullptr;
+
+        vk::DeviceSize mRingHead = 0;
+        vk::DeviceSize mRingTail = 0;
+        vk::DeviceSize mRingUsed = 0;
+
+        // Ring bytes and copy regions of the ranges staged since the last RecordUpload(...)
+        vk::DeviceSize mFrameBytes = 0;
+        std::vector<vk::BufferCopy> mFrameRegions = {};
+
+        std::vector<InFlightUpload> mInFlightUploads = {};
+
+        DeviceInstanceBufferStatistics mStats = {};
+    };
+
+} // namespace vr
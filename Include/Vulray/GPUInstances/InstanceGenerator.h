@@ -0,0 +1,134 @@
+#pragma once
+
+#include "Vulray/Descriptors.h"
+
+namespace vr
+{
+    class VulrayDevice;
+
+    /// @brief Compact GPU-resident instance, expanded to a vk::AccelerationStructureInstanceKHR by the generator
+    struct GPUInstance
+    {
+        /// @brief Written to instanceCustomIndex, only the lower 24 bits are used
+        uint32_t ObjectID = 0;
+
+        /// @brief Index into the transform buffer
+        uint32_t TransformIndex = 0;
+
+        /// @brief Index into the BLAS table
+        uint32_t BLASIndex = 0;
+
+        /// @brief Visibility mask of the instance, before mask assignment
+        uint8_t Mask = 0xFF;
+
+        /// @brief vk::GeometryInstanceFlagsKHR of the instance
+        uint8_t Flags = 0;
+
+        uint16_t Padding = 0;
+    };
+    static_assert(sizeof(GPUInstance) == 16, "GPUInstance must match the layout in InstanceGenerator.hlsl");
+
+    /// @brief Entry of the BLAS table that GPUInstance::BLASIndex refers to
+    struct GPUBLASEntry
+    {
+        /// @brief Device address of the BLAS, BLASHandle::Buffer.DevAddress
+        vk::DeviceAddress Address = 0;
+
+        /// @brief Written to instanceShaderBindingTableRecordOffset, only the lower 24 bits are used
+        uint32_t SBTOffset = 0;
+
+        uint32_t Padding = 0;
+
+        /// @brief Bounding sphere of the BLAS in object space, center xyz and radius w, used for culling
+        float BoundingSphere[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    };
+    static_assert(sizeof(GPUBLASEntry) == 32, "GPUBLASEntry must match the layout in InstanceGenerator.hlsl");
+
+    /// @brief Culling and mask assignment settings of one InstanceGenerator::Generate(...)
+    struct InstanceGenerateSettings
+    {
+        /// @brief Culls instances whose bounding sphere is outside of FrustumPlanes
+        bool FrustumCulling = false;
+
+        /// @brief World space planes (normal xyz, distance w), normals point inside the frustum
+        float FrustumPlanes[6][4] = {};
+
+        /// @brief Culls instances whose bounding sphere is farther away from CameraPosition than MaxDistance
+        bool DistanceCulling = false;
+
+        float CameraPosition[3] = {0.0f, 0.0f, 0.0f};
+        float MaxDistance = 0.0f;
+
+        /// @brief The mask of instances farther away than MaskDistance is ANDed with FarMask, e.g. to remove far
+        /// instances from shadow rays. 0 disables mask assignment
+        float MaskDistance = 0.0f;
+        uint8_t FarMask = 0xFF;
+    };
+
+    /// @brief Compute pass that expands a GPU-resident GPUInstance list into a vk::AccelerationStructureInstanceKHR
+    /// buffer for BuildTLAS(...), culling and assigning masks in the same dispatch, so the CPU writes no instances.
+    ///
+    /// Culled instances keep their slot, but get a null acceleration structure reference and a zero mask, which
+    /// makes them inactive, so the instance count of the TLAS build doesn't depend on the culling result.
+    class InstanceGenerator
+    {
+      public:
+        /// @brief Creates the pipeline and the descriptor buffer
+        /// @param device The device
+        /// @param setCount Number of buffer sets, e.g. one per frame in flight, so SetBuffers(...) doesn't overwrite
+        /// descriptors that the GPU still uses
+        InstanceGenerator(vr::VulrayDevice* device, uint32_t setCount = 1);
+        ~InstanceGenerator();
+
+        InstanceGenerator() = delete;
+        InstanceGenerator(const InstanceGenerator&) = delete;
+
+        /// @brief Creates a device local buffer that the generator can write instanceCount instances to
+        [[nodiscard]] AllocatedBuffer CreateOutputBuffer(uint32_t instanceCount);
+
+        /// @brief Sets the buffers of a buffer set
+        /// @param instances GPUInstance list, storage buffer
+        /// @param transforms Row major 3x4 float matrices, storage buffer
+        /// @param blasTable GPUBLASEntry table, storage buffer
+        /// @param outInstances Output, from CreateOutputBuffer(...)
+        /// @param setIndex The buffer set
+        /// @warning The set must not be in use by the GPU
+        void SetBuffers(const AllocatedBuffer& instances, const AllocatedBuffer& transforms,
+                        const AllocatedBuffer& blasTable, const AllocatedBuffer& outInstances, uint32_t setIndex = 0);
+
+        /// @brief Records the dispatch and a barrier that makes the output visible to acceleration structure builds
+        /// @param instanceCount The number of instances in the instance list
+        /// @param settings Culling and mask assignment
+        /// @param cmdBuf The command buffer, the compute pipeline and descriptor buffer bindings are changed
+        /// @param setIndex The buffer set
+        void Generate(uint32_t instanceCount, const InstanceGenerateSettings& settings, vk::CommandBuffer cmdBuf,
+                      uint32_t setIndex = 0);
+
+      private:
+        void Init(uint32_t setCount);
+
+        vr::VulrayDevice* mDevice = nullptr;
+
+        AllocatedBuffer mBuffers[4] = {};
+        std::vector<DescriptorItem> mDescriptorItems = {};
+        vk::DescriptorSetLayout mDescriptorSetLayout = nullptr;
+        DescriptorBuffer mDescriptorBuffer = {};
+
+        vk::Pipeline mPipeline = nullptr;
+        vk::PipelineLayout mPipelineLayout = nullptr;
+
+        vk::ShaderModule mShaderModule = nullptr;
+
+        // Data for the push constants, matches the shader
+        struct PushConstantData
+        {
+            float FrustumPlanes[6][4];
+            float CameraPositionAndMaxDistance[4];
+            uint32_t InstanceCount;
+            uint32_t CullFlags;
+            uint32_t FarMask;
+            float MaskDistance;
+        };
+        static_assert(sizeof(PushConstantData) <= 128, "Push constants must fit in the guaranteed 128 bytes");
+    };
+} // namespace vr
@@ -0,0 +1,157 @@
+#pragma once
+
+#include "Vulray/AccelStruct.h"
+#include "Vulray/Sync.h"
+
+namespace vr
+{
+    class VulrayDevice;
+
+    struct GeometryMegabufferCreateInfo
+    {
+        /// @brief Size of a single buffer of the megabuffer. Meshes that are bigger than this get a buffer of their
+        /// own. At most 4 GiB, because the offsets of the geometries in a block are 32-bit
+        vk::DeviceSize BlockSize = 64 * 1024 * 1024;
+
+        /// @brief Usage in addition to acceleration structure build input and transfer dst, e.g. eStorageBuffer to
+        /// read the vertices in hit shaders
+        vk::BufferUsageFlags ExtraUsage = {};
+    };
+
+    /// @brief Placement of the vertices and indices of a mesh inside a megabuffer block
+    struct GeometryMegabufferAllocation
+    {
+        /// @brief Index of the block, ~0U if the allocation failed
+        uint32_t BlockIndex = ~0U;
+
+        /// @brief Byte offset of the vertices in the block, always a multiple of the vertex stride
+        vk::DeviceSize VertexOffset = 0;
+        uint32_t VertexCount = 0;
+        uint32_t VertexStride = 0;
+
+        /// @brief Byte offset of the indices in the block, always a multiple of the index size
+        vk::DeviceSize IndexOffset = 0;
+        uint32_t IndexCount = 0;
+        vk::IndexType IndexFormat = vk::IndexType::eNoneKHR;
+
+        bool IsValid() const { return BlockIndex != ~0U; }
+    };
+
+    struct GeometryMegabufferStatistics
+    {
+        /// @brief Number of buffers owned by the megabuffer
+        uint32_t BlockCount = 0;
+
+        /// @brief Number of meshes appended
+        uint32_t AllocationCount = 0;
+
+        /// @brief Total size of all the blocks in bytes
+        vk::DeviceSize BlockBytes = 0;
+
+        /// @brief Bytes used by meshes, including alignment padding
+        vk::DeviceSize UsedBytes = 0;
+
+        /// @brief Bytes appended since the last Flush(...)
+        vk::DeviceSize PendingUploadBytes = 0;
+
+        /// @brief Number of staging buffers waiting for their upload to finish
+        uint32_t StagingBufferCount = 0;
+    };
+
+    /// @brief Packs the vertices and indices of many meshes into a few large device local buffers.
+    ///
+    /// All the geometries in a block share the block's device address and are told apart by
+    /// GeometryData::PrimitiveOffset and GeometryData::FirstVertex, so thousands of meshes need only a few
+    /// allocations, and all the data appended between two Flush(...) calls is uploaded with one staging buffer and one
+    /// copy per block.
+    ///
+    /// Usage:
+    /// 1. Append(...) the meshes and create the BLASes with GetGeometryData(...)
+    /// 2. Flush(...) before the BLAS builds in the same command buffer
+    /// 3. Submit(...) with the sync point of the submission, Update() in later frames releases the staging buffers
+    class GeometryMegabuffer
+    {
+      public:
+        GeometryMegabuffer(vr::VulrayDevice* device, const GeometryMegabufferCreateInfo& info = {});
+        ~GeometryMegabuffer();
+
+        GeometryMegabuffer() = delete;
+        GeometryMegabuffer(const GeometryMegabuffer&) = delete;
+
+        /// @brief Appends a mesh, the data is copied and uploaded with the next Flush(...)
+        /// @param vertices The vertices, vertexCount * vertexStride bytes
+        /// @param vertexCount Number of vertices
+        /// @param vertexStride Size of a vertex in bytes
+        /// @param indices The indices, can be null for non-indexed meshes
+        /// @param indexCount Number of indices
+        /// @param indexFormat eUint16 or eUint32
+        /// @return The placement of the mesh, invalid if the mesh couldn't be placed or its vertices are 4 GiB or more
+        [[nodiscard]] GeometryMegabufferAllocation Append(const void* vertices, uint32_t vertexCount,
+                                                          uint32_t vertexStride, const void* indices = nullptr,
+                                                          uint32_t indexCount = 0,
+                                                          vk::IndexType indexFormat = vk::IndexType::eUint32);
+
+        /// @brief Returns the geometry data of an appended mesh for BLASCreateInfo
+        /// @param allocation The return value of Append(...)
+        /// @param vertexFormat The format of the position, the position must be at the start of a vertex
+        [[nodiscard]] GeometryData GetGeometryData(const GeometryMegabufferAllocation& allocation,
+                                                   vk::Format vertexFormat = vk::Format::eR32G32B32Sfloat) const;
+
+        /// @brief Records the upload of everything appended since the last call and a barrier that makes it visible
+        /// to acceleration structure builds and shaders
+        /// @param cmdBuf The command buffer, must be executed before the BLAS builds that use the meshes
+        void Flush(vk::CommandBuffer cmdBuf);
+
+        /// @brief Sets the sync point of the uploads recorded by Flush(...) since the last call to Submit(...)
+        void Submit(const SyncPoint& syncPoint);
+
+        /// @brief Releases the staging buffers of finished uploads, never waits on the GPU
+        void Update();
+
+        /// @brief Returns the buffer of a block, e.g. to bind it in shaders
+        [[nodiscard]] const AllocatedBuffer& GetBlockBuffer(uint32_t blockIndex) const
+        {
+            return mBlocks[blockIndex].Buffer;
+        }
+
+        [[nodiscard]] uint32_t GetBlockCount() const { return (uint32_t)mBlocks.size(); }
+
+        [[nodiscard]] GeometryMegabufferStatistics GetStatistics() const;
+
+      private:
+        struct Block
+        {
+            AllocatedBuffer Buffer = {};
+            vk::DeviceSize Capacity = 0;
+            vk::DeviceSize UsedSize = 0;
+
+            // Everything from FlushedSize to UsedSize is waiting in PendingData for the next Flush(...)
+            vk::DeviceSize FlushedSize = 0;
+            std::vector<uint8_t> PendingData = {};
+        };
+
+        struct StagingBuffer
+        {
+            AllocatedBuffer Buffer = {};
+            SyncPoint Sync = {};
+            bool Submitted = false;
+        };
+
+        /// @brief Creates a block and returns its index, ~0U if the buffer couldn't be created
+        uint32_t CreateBlock(vk::DeviceSize capacity);
+
+        vr::VulrayDevice* mDevice;
+
+        GeometryMegabufferCreateInfo mInfo = {};
+
+        std::vector<Block> mBlocks = {};
+
+        // The block that receives new meshes, blocks before it are full
+        uint32_t mCurrentBlock = ~0U;
+
+        std::vector<StagingBuffer> mStagingBuffers = {};
+
+        uint32_t mAllocationCount = 0;
+    };
+
+} // namespace vr
@@ -0,0 +1,140 @@
+#pragma once
+
+#include "Vulray/TLASInstanceWriter.h"
+
+namespace vr
+{
+    class VulrayDevice;
+
+    /// @brief Layout of the world space bounds in InstanceBounds
+    enum class InstanceBoundsType : uint32_t
+    {
+        /// @brief 4 floats per instance, center xyz and radius
+        Spheres,
+
+        /// @brief 6 floats per instance, min xyz and max xyz
+        AABBs,
+    };
+
+    /// @brief World space bounds of the instances, one per instance of the culled TLASInstanceData
+    struct InstanceBounds
+    {
+        InstanceBoundsType Type = InstanceBoundsType::Spheres;
+        const float* Data = nullptr;
+    };
+
+    /// @brief Culling settings of one InstanceCuller::Cull(...)
+    /// @note Rays can hit geometry that the camera doesn't see, e.g. in reflections and shadows, so the frustum
+    /// margin and the thresholds should be chosen with the ray tracing effects in mind
+    struct InstanceCullSettings
+    {
+        float CameraPosition[3] = {0.0f, 0.0f, 0.0f};
+
+        /// @brief Culls instances whose bounding sphere is farther away from CameraPosition than MaxDistance
+        bool DistanceCulling = false;
+        float MaxDistance = 0.0f;
+
+        /// @brief Culls instances whose bounding sphere is farther outside of FrustumPlanes than FrustumMargin
+        bool FrustumCulling = false;
+
+        /// @brief World space planes (normal xyz, distance w), normals point inside the frustum
+        float FrustumPlanes[6][4] = {};
+
+        /// @brief Distance in world units that the bounding spheres are grown by before the frustum test
+        float FrustumMargin = 0.0f;
+
+        /// @brief Culls instances whose bounding sphere covers less than MinSolidAngle steradians seen from
+        /// CameraPosition. Instances that contain the camera are never culled
+        bool SolidAngleCulling = false;
+        float MinSolidAngle = 0.0f;
+    };
+
+    /// @brief Results of the last InstanceCuller::Cull(...), every culled instance is counted by the first test that
+    /// rejected it, in the order distance, frustum, solid angle
+    struct InstanceCullStatistics
+    {
+        uint32_t InstanceCount = 0;
+        uint32_t VisibleCount = 0;
+        uint32_t CulledByDistance = 0;
+        uint32_t CulledByFrustum = 0;
+        uint32_t CulledBySolidAngle = 0;
+    };
+
+    /// @brief Rejects instances that contribute little to the image before they are written to the instance buffer,
+    /// so the TLAS build and the traversal only see the visible instances.
+    ///
+    /// The tests run 4 instances at a time with SSE when available, split across a thread pool, and the visible
+    /// instances are compacted to the front of the instance buffer. Pass the returned count to BuildTLAS(...).
+    class InstanceCuller
+    {
+      public:
+        /// @param device The device that owns the instance buffers
+        /// @param threadPool Pool to split the work across, e.g. TLASInstanceWriter::GetThreadPool(). If null,
+        /// everything runs on the calling thread
+        InstanceCuller(vr::VulrayDevice* device, ThreadPool* threadPool = nullptr);
+
+        InstanceCuller() = delete;
+        InstanceCuller(const InstanceCuller&) = delete;
+
+        /// @brief Culls the instances, the indices of the visible instances are available with GetVisibleIndices()
+        /// @param instanceCount Number of instances
+        /// @param bounds World space bounds of the instances
+        /// @param settings The culling settings
+        /// @return Number of visible instances
+        uint32_t Cull(uint32_t instanceCount, const InstanceBounds& bounds, const InstanceCullSettings& settings);
+
+        /// @brief Culls the instances and writes the visible ones, compacted, into the instance buffer
+        /// @param data The instance data
+        /// @param bounds World space bounds of the instances
+        /// @param settings The culling settings
+        /// @param instanceBuffer Host visible buffer, e.g. from CreateInstanceBuffer(...)
+        /// @param firstInstance Index of the instance in the buffer where the first visible instance is written
+        /// @return Number of instances written, the instance count for BuildTLAS(...)
+        uint32_t CullAndWrite(const TLASInstanceData& data, const InstanceBounds& bounds,
+                              const InstanceCullSettings& settings, AllocatedBuffer& instanceBuffer,
+                              uint32_t firstInstance = 0);
+
+        /// @brief Culls the instances and writes the visible ones, compacted, into already mapped memory
+        /// @param dst Destination for up to data.InstanceCount instances
+        /// @return Number of instances written
+        uint32_t CullAndWrite(const TLASInstanceData& data, const InstanceBounds& bounds,
+                              const InstanceCullSettings& settings, vk::AccelerationStructureInstanceKHR* dst);
+
+        /// @brief Returns the indices of the visible instances of the last cull in ascending order, there are
+        /// GetFrameStatistics().VisibleCount of them
+        [[nodiscard]] const uint32_t* GetVisibleIndices() const { return mVisibleIndices.data(); }
+
+        /// @brief Returns the statistics of the last cull
+        [[nodiscard]] const InstanceCullStatistics& GetFrameStatistics() const { return mFrameStats; }
+
+      private:
+        // Results of a chunk of instances, the visible indices of a chunk are written at the chunk's start
+        struct ChunkResult
+        {
+            uint32_t VisibleCount = 0;
+            uint32_t OutputOffset = 0;
+            uint32_t CulledByDistance = 0;
+            uint32_t CulledByFrustum = 0;
+            uint32_t CulledBySolidAngle = 0;
+        };
+
+        // Runs the tests and leaves every chunk's visible indices at the chunk's start, returns the visible count
+        uint32_t CullChunks(uint32_t instanceCount, const InstanceBounds& bounds, const InstanceCullSettings& settings);
+
+        // Moves the visible indices of all chunks to the front of mVisibleIndices
+        void CompactIndices();
+
+        void ParallelFor(uint32_t count, const std::function<void(uint32_t, uint32_t)>& func);
+
+        vr::VulrayDevice* mDevice;
+
+        ThreadPool* mThreadPool;
+
+        std::vector<uint32_t> mVisibleIndices = {};
+
+        std::vector<ChunkResult> mChunks = {};
+
+        InstanceCullStatistics mFrameStats = {};
+    };
+
+} // namespace vr
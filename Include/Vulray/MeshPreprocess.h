@@ -0,0 +1,104 @@
+#pragma once
+
+#include "Vulray/AccelStruct.h"
+
+namespace vr
+{
+    class ThreadPool;
+
+    /// @brief Triangle mesh in host memory that will be preprocessed before it is uploaded
+    struct MeshPreprocessInput
+    {
+        /// @brief Interleaved vertices, the position must be 3 floats
+        const void* Vertices = nullptr;
+        uint32_t VertexCount = 0;
+        uint32_t VertexStride = 0;
+
+        /// @brief Byte offset of the position inside a vertex
+        uint32_t PositionOffset = 0;
+
+        /// @brief Triangle list indices, if null, every 3 consecutive vertices form a triangle
+        const void* Indices = nullptr;
+        uint32_t IndexCount = 0;
+
+        /// @brief Format of Indices, eUint16 or eUint32
+        vk::IndexType IndexFormat = vk::IndexType::eUint32;
+    };
+
+    struct MeshPreprocessSettings
+    {
+        /// @brief Merges vertices whose bytes are identical
+        bool DeduplicateVertices = true;
+
+        /// @brief Removes triangles that use the same vertex more than once, they can never be hit
+        bool RemoveDegenerateTriangles = true;
+
+        /// @brief Sorts the triangles along a Morton curve of their centroids, so triangles that are close in space
+        /// are close in memory. The vertices are reordered by first use after that.
+        bool ReorderTriangles = true;
+
+        /// @brief Outputs 16 bit indices if all the vertices can be addressed with them
+        bool AllowUint16Indices = true;
+    };
+
+    /// @brief Sizes of a mesh before and after preprocessing
+    struct MeshPreprocessStats
+    {
+        uint32_t VertexCountBefore = 0;
+        uint32_t VertexCountAfter = 0;
+
+        vk::DeviceSize VertexBytesBefore = 0;
+        vk::DeviceSize VertexBytesAfter = 0;
+
+        vk::DeviceSize IndexBytesBefore = 0;
+        vk::DeviceSize IndexBytesAfter = 0;
+
+        /// @brief Number of degenerate triangles that were removed, triangles that use the same vertex twice
+        uint32_t RemovedTriangles = 0;
+    };
+
+    struct PreprocessedMesh
+    {
+        /// @brief Vertices in the same layout as the input
+        std::vector<uint8_t> Vertices = {};
+        uint32_t VertexCount = 0;
+        uint32_t VertexStride = 0;
+
+        /// @brief Indices in IndexFormat
+        std::vector<uint8_t> Indices = {};
+        vk::IndexType IndexFormat = vk::IndexType::eUint32;
+        uint32_t TriangleCount = 0;
+
+        /// @brief The highest vertex index used by the indices
+        uint32_t MaxVertex = 0;
+
+        /// @brief Index of the input triangle of every output triangle, to remap per primitive data, because
+        /// reordering and removing triangles changes the primitive index seen in the shaders
+        std::vector<uint32_t> OriginalTriangles = {};
+
+        MeshPreprocessStats Stats = {};
+
+        /// @brief Returns the geometry data for BLASCreateInfo, after Vertices and Indices are uploaded
+        /// @param addresses The device addresses of the uploaded vertices and indices
+        /// @param vertexFormat The format of the position in a vertex
+        [[nodiscard]] GeometryData GetGeometryData(const GeometryDeviceAddress& addresses,
+                                                   vk::Format vertexFormat = vk::Format::eR32G32B32Sfloat) const;
+    };
+
+    /// @brief Prepares a triangle mesh for BLAS creation on the CPU: deduplicates vertices, removes degenerate
+    /// triangles, reorders triangles for spatial locality, narrows the indices and computes the true max vertex
+    /// @param input The mesh
+    /// @param settings Which steps are done
+    /// @return The preprocessed mesh, with the sizes before and after in Stats
+    [[nodiscard]] PreprocessedMesh PreprocessMesh(const MeshPreprocessInput& input,
+                                                  const MeshPreprocessSettings& settings = {});
+
+    /// @brief Returns the 30 bit Morton code of a point, the coordinates must be normalized to [0, 1]
+    [[nodiscard]] uint32_t MortonCode3D(float x, float y, float z);
+
+    /// @brief Preprocesses multiple meshes, in parallel if a thread pool is given
+    [[nodiscard]] std::vector<PreprocessedMesh> PreprocessMeshes(const std::vector<MeshPreprocessInput>& inputs,
+                                                                 const MeshPreprocessSettings& settings = {},
+                                                                 ThreadPool* threadPool = nullptr);
+
+} // namespace vr
@@ -0,0 +1,79 @@
+#pragma once
+
+namespace vr
+{
+    struct QueryPoolAllocatorCreateInfo
+    {
+        /// @brief Number of queries in a single pool. Ranges that are bigger than this get a pool of their own, which
+        /// is destroyed as soon as the range is freed.
+        uint32_t QueriesPerPool = 1024;
+    };
+
+    /// @brief Range of queries inside a pool of the query pool allocator
+    struct QueryRange
+    {
+        /// @brief The pool that contains the range, shared with other ranges of the same query type
+        vk::QueryPool Pool = nullptr;
+
+        vk::QueryType Type = vk::QueryType::eTimestamp;
+
+        /// @brief Index of the first query of the range in the pool, pass it to the commands that write the queries
+        uint32_t FirstQuery = 0;
+
+        uint32_t QueryCount = 0;
+
+        /// @brief Index of the pool in the allocator, ~0U if the range is not allocated
+        uint32_t PoolIndex = ~0U;
+
+        /// @brief Virtual allocation of the range inside the pool
+        VmaVirtualAllocation Allocation = nullptr;
+
+        /// @brief Returns true if the range is allocated
+        bool IsValid() const { return PoolIndex != ~0U; }
+    };
+
+    struct QueryPoolStatistics
+    {
+        /// @brief Number of query pools owned by the allocator
+        uint32_t PoolCount = 0;
+
+        /// @brief Number of queries in all the pools
+        uint32_t TotalQueries = 0;
+
+        /// @brief Number of queries handed out in ranges that were not freed yet
+        uint32_t AllocatedQueries = 0;
+
+        /// @brief Number of query pools that were created since the creation of the allocator, if this doesn't grow
+        /// between frames, the allocator doesn't create any pools
+        uint32_t TotalPoolCreations = 0;
+    };
+
+    namespace detail
+    {
+        struct QueryPoolBlock
+        {
+            vk::QueryPool Pool = nullptr;
+
+            vk::QueryType Type = vk::QueryType::eTimestamp;
+
+            /// @brief Tracks the free ranges of the pool, one unit is one query
+            VmaVirtualBlock VirtualBlock = nullptr;
+
+            uint32_t QueryCount = 0;
+
+            /// @brief Dedicated pools hold a single oversized range and are destroyed when it is freed
+            bool Dedicated = false;
+        };
+
+        struct QueryPoolAllocator
+        {
+            QueryPoolAllocatorCreateInfo Info = {};
+
+            /// @brief Pools of all query types, destroyed pools leave an empty slot so indices stay valid
+            std::vector<QueryPoolBlock> Pools = {};
+
+            uint32_t TotalPoolCreations = 0;
+        };
+    } // namespace detail
+
+} // namespace vr
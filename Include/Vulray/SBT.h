@@ -38,6 +38,20 @@ namespace vr
         vk::StridedDeviceAddressRegionKHR MissRegion = {};
         vk::StridedDeviceAddressRegionKHR HitGroupRegion = {};
         vk::StridedDeviceAddressRegionKHR CallableRegion = {};
+
+        /// @brief Owns the memory of all four regions if the SBT was created with SBTInfo::PackRegions. The region
+        /// buffers are views into it then, they have no allocation of their own
+        AllocatedBuffer PackedBuffer = {};
+
+        /// @brief Host visible mirror of PackedBuffer if the SBT was created with SBTInfo::DeviceLocal. All the writes
+        /// of the SBT functions go here, RecordSBTUpload(...) copies them to PackedBuffer
+        AllocatedBuffer StagingBuffer = {};
+
+        /// @brief Returns true if all four regions live in PackedBuffer
+        bool IsPacked() const { return PackedBuffer.Allocation != nullptr; }
+
+        /// @brief Returns true if PackedBuffer is device local and written through StagingBuffer
+        bool IsDeviceLocal() const { return StagingBuffer.Allocation != nullptr; }
     };
 
     /// @brief Pipeline library input structure
@@ -101,6 +115,15 @@ namespace vr
         uint32_t ReserveHitGroups = 0;
         uint32_t ReserveCallableGroups = 0;
 
+        /// @brief Packs all four regions into a single buffer, every region starts at a shaderGroupBaseAlignment
+        /// boundary. The SBT is then created with one allocation and written with a single map
+        bool PackRegions = false;
+
+        /// @brief Keeps the regions in device local memory, so vkCmdTraceRaysKHR doesn't read the records across the
+        /// bus on discrete GPUs. The SBT is always packed then and written through a host visible staging mirror, so
+        /// RecordSBTUpload(...) must be recorded before dispatching rays after any write to the SBT
+        bool DeviceLocal = false;
+
         /// Graph of how the shaders might be mixed in a full pipeline.
         /// The shaders can be mixed in any way, but this is just an example
 
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "Vulray/SBT.h"
+
+namespace vr
+{
+    /// @brief Hit group records that must stay consecutive in the SBT, usually one record per geometry of the BLAS of
+    /// an instance. The instance SBT offset points at the first record of the block
+    struct SBTHitRecordBlock
+    {
+        /// @brief Where the hit groups of the records live in the pipeline
+        std::vector<uint32_t> GroupIndices = {};
+
+        /// @brief Size of the data of every record in bytes, without the opaque handle. Index matches GroupIndices
+        std::vector<uint32_t> RecordSizes = {};
+    };
+
+    enum class SBTLayoutMode : uint32_t
+    {
+        /// @brief All hit records share the stride of the largest record, one hit table for every dispatch
+        SharedStride,
+
+        /// @brief Blocks are split by stride into hit sub-tables, a dispatch can only use the hit table of one of them
+        Partitioned,
+
+        /// @brief Partitioned if it saves at least SBTLayoutSettings::MinSavings of the hit table, else SharedStride
+        Auto,
+    };
+
+    struct SBTLayoutSettings
+    {
+        SBTLayoutMode Mode = SBTLayoutMode::Auto;
+
+        /// @brief Maximum number of hit sub-tables of a partitioned layout
+        uint32_t MaxSubTables = 4;
+
+        /// @brief Fraction of the hit table bytes that partitioning has to save in SBTLayoutMode::Auto
+        float MinSavings = 0.25f;
+    };
+
+    /// @brief Result of CompileSBTLayout(...)
+    struct SBTLayout
+    {
+        /// @brief False if a block has a different number of group indices and record sizes, or if a record is larger
+        /// than maxShaderGroupStride allows. Nothing else is filled in then
+        bool Valid = false;
+
+        /// @brief The mode that was chosen, never SBTLayoutMode::Auto. SharedStride whenever there is a single
+        /// sub-table, also if partitioning was requested but splitting the blocks saves nothing
+        SBTLayoutMode Mode = SBTLayoutMode::SharedStride;
+
+        /// @brief One SBT info per hit sub-table, to be used with CreateSBT(...). They keep the ray gen, miss and
+        /// callable groups of the input, the hit groups are the records of the sub-table in order.
+        /// The HitGroupRegion of the created SBT is the StridedDeviceAddressRegionKHR of the sub-table
+        std::vector<SBTInfo> SubTables = {};
+
+        /// @brief Index into SubTables for every block, index matches the input blocks
+        std::vector<uint32_t> BlockSubTables = {};
+
+        /// @brief VkAccelerationStructureInstanceKHR::instanceShaderBindingTableRecordOffset of the instances of every
+        /// block, relative to the hit table of its sub-table. Index matches the input blocks
+        std::vector<uint32_t> InstanceSBTOffsets = {};
+
+        /// @brief Bytes of the hit records of all sub-tables
+        vk::DeviceSize HitTableSize = 0;
+
+        /// @brief Bytes the hit records would take with a single shared stride, for comparison
+        vk::DeviceSize SharedStrideHitTableSize = 0;
+    };
+
+    /// @brief Lays out hit group records of different sizes.
+    ///
+    /// A hit table has a single stride, so with one SBTInfo::HitGroupRecordSize a single large material record
+    /// raises the stride of every record. The compiler computes the stride every block needs and either keeps one
+    /// table with the smallest stride that fits all of them, or splits the blocks into at most
+    /// SBTLayoutSettings::MaxSubTables tables of similar strides. The split is chosen to minimize the bytes of the hit
+    /// tables, which also packs more records into every cache line during traversal.
+    /// @param info The SBT info, its ray gen, miss and callable groups and record sizes are copied into every
+    /// sub-table. Its hit groups are ignored, they are described by the blocks
+    /// @param blocks The hit records, blocks are never split across sub-tables
+    /// @param properties The ray tracing properties of the device, see VulrayDevice::GetRayTracingProperties()
+    /// @param settings The mode and the limits of the partitioning
+    /// @return The SBT infos of the sub-tables and the instance SBT offsets of the blocks
+    /// @note Instances of a partitioned layout can only be traced with the SBT of their sub-table, e.g. by building
+    /// a TLAS per sub-table, or by using sub-tables for passes that trace different instances
+    [[nodiscard]] SBTLayout CompileSBTLayout(const SBTInfo& info, const std::vector<SBTHitRecordBlock>& blocks,
+                                             const vk::PhysicalDeviceRayTracingPipelinePropertiesKHR& properties,
+                                             const SBTLayoutSettings& settings = {});
+
+} // namespace vr
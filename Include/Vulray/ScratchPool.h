@@ -0,0 +1,74 @@
+#pragma once
+
+#include "Vulray/Buffer.h"
+#include "Vulray/Sync.h"
+
+namespace vr
+{
+    struct ScratchPoolCreateInfo
+    {
+        /// @brief Size of a single block of scratch memory in the pool. Allocations that are bigger than this get a
+        /// block of their own.
+        vk::DeviceSize BlockSize = 32 * 1024 * 1024;
+
+        /// @brief Number of frames that can be in flight at the same time, one block per frame is allocated up front
+        uint32_t FramesInFlight = 2;
+    };
+
+    struct ScratchPoolStatistics
+    {
+        /// @brief Number of blocks owned by the pool
+        uint32_t BlockCount = 0;
+
+        /// @brief Total size of all the blocks in bytes
+        vk::DeviceSize BlockBytes = 0;
+
+        /// @brief Bytes handed out in the current frame
+        vk::DeviceSize CurrentFrameBytes = 0;
+
+        /// @brief Number of blocks that were allocated since the creation of the pool, if this doesn't grow between
+        /// frames, the pool doesn't do any allocations
+        uint32_t TotalBlockAllocations = 0;
+    };
+
+    namespace detail
+    {
+        struct ScratchBlock
+        {
+            AllocatedBuffer Buffer = {};
+
+            /// @brief Offset to the first free byte of the block
+            vk::DeviceSize Head = 0;
+        };
+
+        struct ScratchFrame
+        {
+            /// @brief Indices of the blocks that were used by the frame
+            std::vector<uint32_t> Blocks = {};
+
+            /// @brief Sync point that tells when the blocks can be reused
+            SyncPoint Sync = {};
+        };
+
+        struct ScratchPool
+        {
+            ScratchPoolCreateInfo Info = {};
+
+            std::vector<ScratchBlock> Blocks = {};
+
+            /// @brief Blocks that are not used by any frame
+            std::vector<uint32_t> FreeBlocks = {};
+
+            /// @brief Ring of frames in flight, the frame at FrameIndex is the one being recorded
+            std::vector<ScratchFrame> Frames = {};
+
+            /// @brief Frames that were still in use by the GPU when their slot in the ring was needed again
+            std::vector<ScratchFrame> RetiredFrames = {};
+
+            uint32_t FrameIndex = 0;
+
+            uint32_t TotalBlockAllocations = 0;
+        };
+    } // namespace detail
+
+} // namespace vr
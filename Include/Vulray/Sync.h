@@ -0,0 +1,30 @@
+#pragma once
+
+namespace vr
+{
+    /// @brief Describes a point on the GPU timeline, used by Vulray to know when resources used by submitted command
+    /// buffers can be recycled or destroyed
+    /// @note Either the fence or the timeline semaphore should be set. If both are null, the sync point is considered
+    /// to be reached.
+    struct SyncPoint
+    {
+        SyncPoint() = default;
+        SyncPoint(vk::Fence fence) : Fence(fence) {}
+        SyncPoint(vk::Semaphore timelineSemaphore, uint64_t timelineValue)
+            : TimelineSemaphore(timelineSemaphore), TimelineValue(timelineValue)
+        {
+        }
+
+        /// @brief Fence that is signaled when the submission is finished
+        /// @warning The fence must not be reset before Vulray has seen it signaled, otherwise the resources waiting on
+        /// the sync point are held until the fence is signaled again
+        vk::Fence Fence = nullptr;
+
+        /// @brief Timeline semaphore that reaches TimelineValue when the submission is finished
+        vk::Semaphore TimelineSemaphore = nullptr;
+
+        /// @brief The value of the timeline semaphore that marks the end of the submission
+        uint64_t TimelineValue = 0;
+    };
+
+} // namespace vr
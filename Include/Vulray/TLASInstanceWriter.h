@@ -0,0 +1,92 @@
+#pragma once
+
+#include "Vulray/Buffer.h"
+#include "Vulray/ThreadPool.h"
+
+namespace vr
+{
+    class VulrayDevice;
+
+    /// @brief Memory layout of the transforms in TLASInstanceData
+    enum class TransformLayout : uint32_t
+    {
+        /// @brief 12 floats per instance, same as vk::TransformMatrixKHR
+        RowMajor3x4,
+
+        /// @brief 16 floats per instance, the last row is ignored
+        RowMajor4x4,
+
+        /// @brief 16 floats per instance, e.g. glm::mat4. The matrix is transposed and the last row is ignored
+        ColumnMajor4x4,
+    };
+
+    /// @brief Instance data in structure of arrays layout, every array has InstanceCount elements
+    /// @note Optional arrays can be null, the default value is used for every instance then
+    struct TLASInstanceData
+    {
+        uint32_t InstanceCount = 0;
+
+        /// @brief Transforms of the instances, required
+        const float* Transforms = nullptr;
+
+        TransformLayout Layout = TransformLayout::ColumnMajor4x4;
+
+        /// @brief Device addresses of the BLASes (BLASHandle::Buffer.DevAddress), required
+        const vk::DeviceAddress* BLASAddresses = nullptr;
+
+        /// @brief Custom indices of the instances, only the lower 24 bits are used. Default is the instance index
+        const uint32_t* CustomIndices = nullptr;
+
+        /// @brief Visibility masks of the instances. Default is 0xFF
+        const uint8_t* Masks = nullptr;
+
+        /// @brief SBT record offsets of the instances, only the lower 24 bits are used. Default is 0
+        const uint32_t* SBTOffsets = nullptr;
+
+        /// @brief vk::GeometryInstanceFlagBitsKHR of the instances. Default is 0
+        const uint8_t* Flags = nullptr;
+    };
+
+    /// @brief Writes vk::AccelerationStructureInstanceKHR from SoA data straight into a mapped instance buffer, split
+    /// across a thread pool
+    class TLASInstanceWriter
+    {
+      public:
+        /// @param device The device that owns the instance buffers
+        /// @param threadCount Number of worker threads, if 0, one less than the number of hardware threads is used
+        TLASInstanceWriter(vr::VulrayDevice* device, uint32_t threadCount = 0);
+
+        TLASInstanceWriter() = delete;
+        TLASInstanceWriter(const TLASInstanceWriter&) = delete;
+
+        /// @brief Writes the instances into the instance buffer
+        /// @param data The instance data
+        /// @param instanceBuffer Host visible buffer, e.g. from CreateInstanceBuffer(...)
+        /// @param firstInstance Index of the instance in the buffer where the first instance is written
+        void Write(const TLASInstanceData& data, AllocatedBuffer& instanceBuffer, uint32_t firstInstance = 0);
+
+        /// @brief Writes the instances into already mapped memory
+        /// @param data The instance data
+        /// @param dst Destination for data.InstanceCount instances
+        void Write(const TLASInstanceData& data, vk::AccelerationStructureInstanceKHR* dst);
+
+        /// @brief Returns the thread pool of the writer, so other CPU work can share the threads
+        ThreadPool& GetThreadPool() { return mThreadPool; }
+
+      private:
+        vr::VulrayDevice* mDevice;
+
+        ThreadPool mThreadPool;
+    };
+
+    /// @brief Writes the instances [begin, end) of data to dst[begin, end) on the calling thread
+    /// @note Uses SSE and non-temporal stores when available, dst is usually write-combined memory that is never read
+    void WriteTLASInstances(const TLASInstanceData& data, uint32_t begin, uint32_t end,
+                            vk::AccelerationStructureInstanceKHR* dst);
+
+    /// @brief Writes the instances indices[0, count) of data to dst[0, count) on the calling thread, e.g. the visible
+    /// instances of InstanceCuller. The default custom index is still the index of the instance in data
+    void WriteTLASInstances(const TLASInstanceData& data, const uint32_t* indices, uint32_t count,
+                            vk::AccelerationStructureInstanceKHR* dst);
+
+} // namespace vr
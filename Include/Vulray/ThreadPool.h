@@ -0,0 +1,58 @@
+#pragma once
+
+namespace vr
+{
+    /// @brief Minimal fork-join thread pool used by the CPU side helpers of Vulray
+    /// @note The thread that calls ParallelFor(...) works on the range as well, so a pool with 0 worker threads runs
+    /// everything on the calling thread
+    class ThreadPool
+    {
+      public:
+        /// @brief Creates the pool and starts the worker threads
+        /// @param threadCount Number of worker threads, if 0, one less than the number of hardware threads is used
+        ThreadPool(uint32_t threadCount = 0);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        /// @brief Splits [0, count) into ranges of at least minRangeSize elements and calls func for every range on the
+        /// worker threads, returns when all ranges are finished
+        /// @param count Number of elements
+        /// @param minRangeSize Minimum number of elements in a range, so threads don't fight over tiny ranges
+        /// @param func Function called with [begin, end) of a range, called from multiple threads at once
+        /// @warning Not reentrant, func must not call ParallelFor(...) of the same pool
+        void ParallelFor(uint32_t count, uint32_t minRangeSize, const std::function<void(uint32_t, uint32_t)>& func);
+
+        /// @brief Returns the number of worker threads, without the calling thread
+        uint32_t GetThreadCount() const { return (uint32_t)mThreads.size(); }
+
+      private:
+        void WorkerLoop();
+
+        // Takes ranges of the job until there are none left
+        void RunRanges(const std::function<void(uint32_t, uint32_t)>& func, uint32_t count, uint32_t rangeSize,
+                       uint32_t rangeCount);
+
+        std::vector<std::thread> mThreads = {};
+
+        std::mutex mMutex;
+        std::condition_variable mWorkCondition;
+        std::condition_variable mDoneCondition;
+
+        // Current job, written under the mutex before mJobGeneration is incremented
+        const std::function<void(uint32_t, uint32_t)>* mJobFunc = nullptr;
+        uint32_t mJobCount = 0;
+        uint32_t mJobRangeSize = 0;
+        uint32_t mJobRangeCount = 0;
+        uint64_t mJobGeneration = 0;
+
+        std::atomic<uint32_t> mNextRange = 0;
+        std::atomic<uint32_t> mFinishedRanges = 0;
+
+        // Number of workers that are inside RunRanges(...)
+        uint32_t mActiveWorkers = 0;
+        bool mStop = false;
+    };
+
+} // namespace vr
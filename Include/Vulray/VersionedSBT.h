@@ -0,0 +1,150 @@
+#pragma once
+
+#include "Vulray/SBT.h"
+#include "Vulray/Sync.h"
+
+namespace vr
+{
+    class VulrayDevice;
+
+    struct VersionedSBTCreateInfo
+    {
+        /// @brief Number of copies of the SBT, one for every frame that can be in flight at once. At most 32
+        uint32_t FramesInFlight = 2;
+    };
+
+    struct VersionedSBTStatistics
+    {
+        /// @brief Records rewritten by the last Flush(...)
+        uint32_t FlushedRecords = 0;
+
+        /// @brief Bytes rewritten by the last Flush(...)
+        vk::DeviceSize FlushedBytes = 0;
+
+        /// @brief Copy regions recorded by the last Flush(...) of a device local SBT, after adjacent records were
+        /// merged
+        uint32_t CopyRegionCount = 0;
+
+        /// @brief Records that are still dirty in at least one version
+        uint32_t DirtyRecords = 0;
+
+        /// @brief Number of times Flush(...) failed because the next version was still in use by the GPU
+        uint32_t BusyVersionCount = 0;
+    };
+
+    /// @brief SBT with a copy for every frame in flight, so records can change while earlier frames still read them.
+    ///
+    /// Write(...) only changes a CPU copy of the records and marks the record dirty in every version. Flush(...)
+    /// moves to the next version and rewrites just the records that are dirty in it, so updating a few materials costs
+    /// O(changed records) and never stalls the GPU. For SBTInfo::DeviceLocal the records are copied from the staging
+    /// mirror of the version with recorded copies.
+    ///
+    /// Usage every frame:
+    /// 1. Update() to release the versions of finished frames
+    /// 2. Write(...) the records that changed
+    /// 3. Flush(...) and DispatchRays(...) with the returned SBT, in the same command buffer
+    /// 4. Submit(...) with the sync point of the submission
+    class VersionedSBT
+    {
+      public:
+        /// @param device The device
+        /// @param pipeline The pipeline of the SBT
+        /// @param info The SBT info, every version is created with SBTInfo::PackRegions
+        /// @param createInfo The number of versions
+        VersionedSBT(vr::VulrayDevice* device, vk::Pipeline pipeline, const SBTInfo& info,
+                     const VersionedSBTCreateInfo& createInfo = {});
+        ~VersionedSBT();
+
+        VersionedSBT() = delete;
+        VersionedSBT(const VersionedSBT&) = delete;
+
+        /// @brief Writes data to a shader record, the record is rewritten in every version by the next Flush(...) of
+        /// the version
+        /// @param group The shader group of the record
+        /// @param groupIndex The index of the record in its region
+        /// @param data The data that will be written after the opaque handle of the record
+        /// @param dataSize The size of the data in bytes
+        /// @param offset Offset in bytes into the data of the record, to change only a part of it
+        /// @return False if the record or the data is out of bounds
+        bool Write(ShaderGroup group, uint32_t groupIndex, const void* data, uint32_t dataSize, uint32_t offset = 0);
+
+        /// @brief Moves to the next version and rewrites the records that are dirty in it
+        /// @param cmdBuf The command buffer, the copies of a device local SBT are recorded into it. DispatchRays(...)
+        /// with the returned SBT must be recorded after this call
+        /// @return The SBT to dispatch rays with, null if the version is still in use by the GPU, then Update() or
+        /// more versions are needed
+        [[nodiscard]] const SBTBuffer* Flush(vk::CommandBuffer cmdBuf);
+
+        /// @brief Sets the sync point of the versions flushed since the last call to Submit(...)
+        void Submit(const SyncPoint& syncPoint);
+
+        /// @brief Releases the versions of finished frames, never waits on the GPU
+        void Update();
+
+        /// @brief Rewrites the opaque handles of all records for a new pipeline, e.g. after shaders were hot swapped
+        /// @param pipeline The new pipeline
+        /// @param info The SBT info of the new pipeline, the shader record sizes must not change
+        /// @return False if the record sizes changed or the records don't fit the reserved space, then a new
+        /// VersionedSBT is needed
+        /// @note The data of the records is kept, every record is marked dirty in every version
+        bool Rebuild(vk::Pipeline pipeline, const SBTInfo& info);
+
+        [[nodiscard]] uint32_t GetFramesInFlight() const { return mInfo.FramesInFlight; }
+
+        [[nodiscard]] VersionedSBTStatistics GetStatistics() const;
+
+      private:
+        // Layout of a region, the same in every version and in the CPU copy
+        struct Region
+        {
+            vk::DeviceSize Offset = 0;
+            uint32_t Stride = 0;
+            uint32_t RecordCount = 0;
+            uint32_t RecordCapacity = 0;
+
+            // Index of the first record of the region in the dirty masks
+            uint32_t FirstRecord = 0;
+        };
+
+        struct Version
+        {
+            SBTBuffer Buffer = {};
+
+            // The host buffer of the version, mapped for its lifetime
+            uint8_t* MappedData = nullptr;
+
+            SyncPoint Sync = {};
+            bool InFlight = false;
+            bool Submitted = false;
+        };
+
+        // Writes the opaque handles of the records of the SBT info into the CPU copy and marks them dirty
+        bool WriteHandles(vk::Pipeline pipeline, const SBTInfo& info);
+
+        // Marks a record dirty in every version
+        void MarkDirty(uint32_t record);
+
+        vr::VulrayDevice* mDevice;
+
+        VersionedSBTCreateInfo mInfo = {};
+
+        SBTInfo mSBTInfo = {};
+
+        Region mRegions[4] = {};
+
+        std::vector<Version> mVersions = {};
+        uint32_t mNextVersion = 0;
+
+        // CPU copy of the records including their opaque handles, laid out like the packed buffer of a version
+        std::vector<uint8_t> mRecords = {};
+
+        // Bit v is set if the record has to be rewritten in version v
+        std::vector<uint32_t> mDirtyMasks = {};
+
+        // Records whose mask is not 0, so Flush(...) doesn't look at clean records
+        std::vector<uint32_t> mDirtyRecords = {};
+
+        VersionedSBTStatistics mStats = {};
+    };
+
+} // namespace vr
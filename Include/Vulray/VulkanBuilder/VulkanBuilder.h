@@ -64,6 +64,10 @@ namespace vr
         // Enables validation layers
         bool EnableDebug = false;
 
+        // Creates the instance and device without presentation support, PickPhysicalDevice() then accepts a null
+        // surface. Needed for offscreen tools and software drivers like lavapipe
+        bool Headless = false;
+
         // Enables raytracing extensions
         std::vector<vk::ValidationFeatureEnableEXT> ValidationFeatures;
 
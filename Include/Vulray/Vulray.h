@@ -1,18 +1,49 @@
 ﻿#pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cfloat>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <numeric>
 #include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 #include <vk_mem_alloc.h>
 #include <vulkan/vulkan.hpp>
 
+#include "Vulray/ASArena.h"
+#include "Vulray/ASCache.h"
 #include "Vulray/AccelStruct.h"
+#include "Vulray/BLASPartitioner.h"
+#include "Vulray/BLASUpdatePolicy.h"
 #include "Vulray/Buffer.h"
+#include "Vulray/CompactionManager.h"
 #include "Vulray/Descriptors.h"
+#include "Vulray/DeviceInstanceBuffer.h"
+#include "Vulray/GeometryMegabuffer.h"
+#include "Vulray/InstanceCuller.h"
+#include "Vulray/MeshPreprocess.h"
+#include "Vulray/QueryPoolAllocator.h"
 #include "Vulray/SBT.h"
+#include "Vulray/SBTLayout.h"
+#include "Vulray/ScratchPool.h"
 #include "Vulray/Shader.h"
+#include "Vulray/Sync.h"
+#include "Vulray/TLASInstanceWriter.h"
+#include "Vulray/ThreadPool.h"
+#include "Vulray/VersionedSBT.h"
 #include "Vulray/VulrayDevice.h"
 
 #define VULRAY_LOG_STREAM std::cerr
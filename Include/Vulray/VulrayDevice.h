@@ -3,6 +3,7 @@
 #include "Vulray/AccelStruct.h"
 #include "Vulray/Descriptors.h"
 #include "Vulray/SBT.h"
+#include "Vulray/ScratchPool.h"
 #include "Vulray/Shader.h"
 
 #ifdef VULRAY_BUILD_DENOISERS
@@ -46,6 +47,14 @@ namespace vr
         /// @warning If the pool is not created with the correct flags / memory types, then the allocations will fail.
         void SetVmaPool(VmaPool pool) { mCurrentPool = pool; }
 
+        /// @brief Keeps the shader group handles of every pipeline that SBTs are created for, so later SBTs of the
+        /// same pipeline don't ask the driver again. Off by default, the handles are fetched for every SBT then
+        /// @param enable Enables the cache, disabling it drops all cached handles
+        /// @warning With the cache enabled, ray tracing pipelines must be destroyed with DestroyRayTracingPipeline(...)
+        /// or InvalidateShaderGroupHandles(...) must be called before vkDestroyPipeline. Otherwise a new pipeline that
+        /// gets the same handle value is written with the stale shader group handles of the old one
+        void SetShaderGroupHandleCaching(bool enable);
+
         // @@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@
         // @@@@@@@@@@@@@@@@@@@@@@@@@@ Getter Functions @@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@
         // @@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@
@@ -83,6 +92,12 @@ namespace vr
             return mDescriptorBufferProperties;
         }
 
+        /// @brief Get the Maintenance4 properties of the physical device, which contain the max buffer size
+        vk::PhysicalDeviceMaintenance4Properties GetMaintenance4Properties() const { return mMaintenance4Properties; }
+
+        /// @brief Get the ID properties of the physical device, which contain the device and driver UUIDs
+        vk::PhysicalDeviceIDProperties GetIDProperties() const { return mIDProperties; }
+
         // @@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@
         // @@@@@@@@@@@@@@@@@@@@@@@ Command Buffer Functions @@@@@@@@@@@@@@@@@@@@@@@@@@@
         // @@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@
@@ -100,6 +115,11 @@ namespace vr
                                    vk::PipelineStageFlags srcStage = vk::PipelineStageFlagBits::eAllGraphics,
                                    vk::PipelineStageFlags dstStage = vk::PipelineStageFlagBits::eAllCommands);
 
+        /// @brief Checks if the GPU has reached the sync point, without waiting
+        /// @param syncPoint The sync point that will be checked
+        /// @return True if the fence is signaled or the timeline semaphore has reached the value
+        [[nodiscard]] bool IsSyncPointReached(const SyncPoint& syncPoint);
+
         // @@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@
         // @@@@@@@@@@@@@@@ Acceleration Structure Functions @@@@@@@@@@@@@@@@@@@@@@@@@@@
         // @@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@
@@ -115,6 +135,31 @@ namespace vr
         /// @param cmdBuf The command buffer that will be used to record the build
         void BuildBLAS(const std::vector<BLASBuildInfo>& buildInfos, vk::CommandBuffer cmdBuf);
 
+        /// @brief Splits the build infos into batches, so that the scratch memory of a single batch fits in the budget
+        /// @param buildInfos The build infos that will be built, this should be the return value of CreateBLAS(...) or
+        /// UpdateBLAS(...)
+        /// @param scratchBudget The maximum amount of scratch memory in bytes that a batch can use
+        /// @return The schedule, which can be given to BuildBLAS(...) with a scratch buffer of
+        /// BLASBuildSchedule::ScratchSize bytes
+        /// @note The order of the build infos is kept, so the batches are ranges of consecutive build infos.
+        /// A build info that alone needs more scratch memory than the budget gets a batch of its own.
+        /// The budget is clamped to the max buffer size of the device.
+        [[nodiscard]] BLASBuildSchedule ScheduleBLASBuilds(const std::vector<BLASBuildInfo>& buildInfos,
+                                                           vk::DeviceSize scratchBudget);
+
+        /// @brief Builds the acceleration structures in batches and records the builds to the command buffer.
+        /// All the batches share the same scratch memory, so a barrier is recorded between the batches.
+        /// @param buildInfos The build infos that will be built, the scratch addresses of the build infos are
+        /// overwritten
+        /// @param schedule The schedule that splits the build infos into batches, this should be the return value of
+        /// ScheduleBLASBuilds(...)
+        /// @param scratchBuffer The scratch buffer that is reused for all the batches, must be at least
+        /// BLASBuildSchedule::ScratchSize bytes
+        /// @param cmdBuf The command buffer that will be used to record the builds
+        /// @return The number of batches and barriers that were recorded
+        BLASBuildStats BuildBLAS(std::vector<BLASBuildInfo>& buildInfos, const BLASBuildSchedule& schedule,
+                                 const AllocatedBuffer& scratchBuffer, vk::CommandBuffer cmdBuf);
+
         /// @brief Updates the acceleration structure and returns the scratch buffer for building
         /// @param updateInfo The information that will be used to update the acceleration structure
         /// @return The build info that will be used to build the acceleration structure
@@ -150,9 +195,24 @@ namespace vr
         [[nodiscard]] std::pair<TLASHandle, TLASBuildInfo> UpdateTLAS(TLASHandle& oldTLAS, TLASBuildInfo& oldBuildInfo,
                                                                       bool destroyOld = true);
 
+        /// @brief Prepares the TLAS for the next BuildTLAS(...) with instanceCount instances, in place
+        /// @param tlas The acceleration structure, replaced if it has to be recreated
+        /// @param buildInfo The build info of the acceleration structure, updated for the next build
+        /// @param instanceCount The number of instances of the next build
+        /// @param mode How the acceleration structure is updated
+        /// @return The TLAS that was replaced, it should be destroyed with DestroyTLAS(...) after the command buffers
+        /// using it finished execution. Null if the TLAS was not replaced
+        /// @note If instanceCount is bigger than the MaxInstanceCount, the capacity is doubled (at least to
+        /// instanceCount) and a new buffer and acceleration structure are created, the build is a full build then.
+        /// The scratch size in buildInfo.BuildSizes grows with the capacity, so scratch buffers should be sized with
+        /// GetScratchBufferSize(...) after this call
+        [[nodiscard]] TLASHandle UpdateTLAS(TLASHandle& tlas, TLASBuildInfo& buildInfo, uint32_t instanceCount,
+                                            TLASUpdateMode mode);
+
         /// @brief Creates a compaction request for the given BLASes
         /// @param sourceBLAS The pointer to the BLASes that will be compacted supplied in a vector
         /// @return The compaction request handle to call GetCompactionSizes(...) and CompactBLAS(...)
+        /// @note CompactionManager runs this flow automatically and destroys the original BLASes
         [[nodiscard]] CompactionRequest RequestCompaction(const std::vector<BLASHandle*>& sourceBLAS);
 
         /// @brief Returns the sizes required for compaction
@@ -161,8 +221,10 @@ namespace vr
         /// @return The sizes required for compaction
         /// @note 1. If the vector is not empty, then the query succeeded and the vector contains the compacted sizes
         /// 2. After this function succesfully returns the sizes, the user should call CompactBLAS(...)
-        /// @warning 1. If the vector is empty, then the query failed and GetCompactionSizes(...) should be called again
-        /// after command buffer execution
+        /// 3. The queries come from the query pool allocator of the device and are freed when the sizes are returned
+        /// @warning 1. If the vector is empty, then the sizes are not available yet and GetCompactionSizes(...) should
+        /// be called again after command buffer execution. The first call always returns an empty vector, it records
+        /// the queries after the builds in cmdBuf
         /// 2. This function cannot be called again with the same CompactionRequest to get the sizes again after it
         /// succesfully returns the values,
         [[nodiscard]] std::vector<uint64_t> GetCompactionSizes(CompactionRequest& request, vk::CommandBuffer cmdBuf);
@@ -193,10 +255,61 @@ namespace vr
                                                           const std::vector<uint64_t>& sizes,
                                                           std::vector<BLASHandle*> oldBLAS, vk::CommandBuffer cmdBuf);
 
+        /// @brief Compacts the BLASes into a single buffer and returns the compacted BLASes
+        /// @param request The compaction request that will be used to compact the BLASes, this should be the return
+        /// value of RequestCompaction(...)
+        /// @param sizes The sizes that will be used to compact the BLASes, this should be the return value of
+        /// GetCompactionSizes(...)
+        /// @param cmdBuf The command buffer that will be used to record the compaction
+        /// @return The compacted BLASes, all of them share the same buffer at different offsets
+        /// @note The buffer is owned by the AS arena and is released when the last of the BLASes is destroyed.
+        /// The source BLASes should be destroyed AFTER the command buffer execution
+        [[nodiscard]] std::vector<BLASHandle> CompactBLASPacked(CompactionRequest& request,
+                                                                const std::vector<uint64_t>& sizes,
+                                                                vk::CommandBuffer cmdBuf);
+
+        /// @brief Compacts the BLASes into a single buffer and returns the old BLASes to be destroyed
+        /// @param request The compaction request that will be used to compact the BLASes, this should be the return
+        /// value of RequestCompaction(...)
+        /// @param sizes The sizes that will be used to compact the BLASes, this should be the return value of
+        /// GetCompactionSizes(...)
+        /// @param oldBLAS The old BLASes that will be replaced with the compacted BLASes
+        /// @param cmdBuf The command buffer that will be used to record the compaction
+        /// @return The old BLASes that should be destroyed after the command buffer execution
+        /// @note The buffer is owned by the AS arena and is released when the last of the BLASes is destroyed
+        [[nodiscard]] std::vector<BLASHandle> CompactBLASPacked(CompactionRequest& request,
+                                                                const std::vector<uint64_t>& sizes,
+                                                                std::vector<BLASHandle*> oldBLAS,
+                                                                vk::CommandBuffer cmdBuf);
+
+        /// @brief Records the serialization of the BLAS into the buffer
+        /// @param blas The BLAS that will be serialized, it must be built before the command buffer executes
+        /// @param dst The buffer that receives the serialized data, must be at least as big as the
+        /// eAccelerationStructureSerializationSizeKHR query of the BLAS and its address must be 256 byte aligned
+        /// @param cmdBuf The command buffer that will be used to record the copy
+        /// @note The first 2 * VK_UUID_SIZE bytes of the serialized data are the version data that can be checked with
+        /// IsSerializedASCompatible(...)
+        void SerializeBLAS(const BLASHandle& blas, const AllocatedBuffer& dst, vk::CommandBuffer cmdBuf);
+
+        /// @brief Creates a BLAS and records its deserialization from the buffer
+        /// @param src The buffer that contains the serialized data, its address must be 256 byte aligned. It needs the
+        /// eShaderDeviceAddress and eAccelerationStructureBuildInputReadOnlyKHR usages
+        /// @param deserializedSize The size of the BLAS, stored in the header of the serialized data
+        /// @param cmdBuf The command buffer that will be used to record the copy
+        /// @return The BLAS, which is usable after the command buffer execution
+        /// @note The BLAS can be destroyed with DestroyBLAS(...), the source buffer is not needed after the execution
+        [[nodiscard]] BLASHandle DeserializeBLAS(const AllocatedBuffer& src, vk::DeviceSize deserializedSize,
+                                                 vk::CommandBuffer cmdBuf);
+
+        /// @brief Checks if serialized acceleration structure data can be deserialized on this device
+        /// @param versionData The first 2 * VK_UUID_SIZE bytes of the serialized data
+        /// @return True if the data is compatible
+        [[nodiscard]] bool IsSerializedASCompatible(const uint8_t* versionData);
+
         /// @brief Creates a SINGLE scratch buffer for building acceleration structures and binds the scratch buffer to
         /// the build infos
         /// @param buildInfos The build infos that will be used to create the scratch buffer
-        /// @return The scratch buffer
+        /// @return The scratch buffer, empty if the scratch size overflows or exceeds maxBufferSize
         /// @note This function creates a single scratch buffer for ALL the BLASes in the build infos.
         /// If the BLAS is updated regularly, it is recommended to create a separate scratch buffer for the updating
         /// BLAS and use the scratch buffer for the updating.
@@ -210,7 +323,7 @@ namespace vr
         /// @brief Creates a SINGLE scratch buffer for building acceleration structure, and binds the scratch buffer to
         /// the build info
         /// @param buildInfo The build info that will be used to create the scratch buffer
-        /// @return The scratch buffer
+        /// @return The scratch buffer, empty if the scratch size overflows or exceeds maxBufferSize
         [[nodiscard]] AllocatedBuffer CreateScratchBufferFromBuildInfos(std::vector<TLASBuildInfo>& buildInfo);
 
         /// @brief Binds the scratch buffer to the build info
@@ -250,19 +363,125 @@ namespace vr
 
         /// @brief Returns the size of the scratch buffer required to build all the acceleration structures.
         /// @param infos The build infos that will be used to get the size of the scratch buffer
-        /// @return The size of the scratch buffer required to build all the acceleration structures
-        [[nodiscard]] uint32_t GetScratchBufferSize(const std::vector<BLASBuildInfo>& buildInfos);
+        /// @return The size of the scratch buffer required to build all the acceleration structures, UINT64_MAX if the
+        /// size overflows
+        /// @note An error is logged if the size is bigger than the max buffer size of the device, in that case the
+        /// builds should be split with ScheduleBLASBuilds(...)
+        [[nodiscard]] vk::DeviceSize GetScratchBufferSize(const std::vector<BLASBuildInfo>& buildInfos);
 
         /// @brief Returns the size of the scratch buffer required to build all the acceleration structures.
         /// @param infos The build infos that will be used to get the size of the scratch buffer
-        /// @return The size of the scratch buffer required to build all the acceleration structures
-        [[nodiscard]] uint32_t GetScratchBufferSize(const std::vector<TLASBuildInfo>& buildInfos);
+        /// @return The size of the scratch buffer required to build all the acceleration structures, UINT64_MAX if the
+        /// size overflows
+        [[nodiscard]] vk::DeviceSize GetScratchBufferSize(const std::vector<TLASBuildInfo>& buildInfos);
 
         /// @brief Adds barrier to the command buffer to ensure the acceleration structure is built before other
         /// acceleration structures are built
         /// @param cmdBuf The command buffer that will be used to record the barrier
         void AddAccelerationBuildBarrier(vk::CommandBuffer cmdBuf);
 
+        /// @brief Creates the scratch pool of the device, which hands out scratch memory without allocating in the
+        /// steady state. Scratch memory allocated from the pool is recycled once the frame it was used in is finished
+        /// on the GPU.
+        /// @param info The information that will be used to create the pool
+        /// @note If the pool already exists, it is destroyed and created again
+        void CreateScratchPool(const ScratchPoolCreateInfo& info = {});
+
+        /// @brief Destroys the scratch pool and all the scratch memory it owns
+        /// @warning The GPU must not use any scratch memory from the pool anymore
+        void DestroyScratchPool();
+
+        /// @brief Allocates scratch memory from the scratch pool for the current frame
+        /// @param size The size of the scratch memory in bytes
+        /// @return A buffer that views into a block of the pool. The buffer has no allocation and DevAddress and Size
+        /// point to the allocated range.
+        /// @warning The returned buffer must not be destroyed with DestroyBuffer(...), it is owned by the pool
+        [[nodiscard]] AllocatedBuffer AllocateScratch(vk::DeviceSize size);
+
+        /// @brief Allocates scratch memory from the scratch pool for all the build infos and binds it to them
+        /// @param buildInfos The build infos that will be bound to the scratch memory
+        /// @return The scratch memory view, which must not be destroyed. Empty if the scratch size is too big
+        [[nodiscard]] AllocatedBuffer AllocateScratchFromBuildInfos(std::vector<BLASBuildInfo>& buildInfos);
+
+        /// @brief Allocates scratch memory from the scratch pool for the build info and binds it to the build info
+        /// @param buildInfo The build info that will be bound to the scratch memory
+        /// @return The scratch memory view, which must not be destroyed
+        [[nodiscard]] AllocatedBuffer AllocateScratchFromBuildInfo(BLASBuildInfo& buildInfo);
+
+        /// @brief Allocates scratch memory from the scratch pool for all the build infos and binds it to them
+        /// @param buildInfos The build infos that will be bound to the scratch memory
+        /// @return The scratch memory view, which must not be destroyed. Empty if the scratch size is too big
+        [[nodiscard]] AllocatedBuffer AllocateScratchFromBuildInfos(std::vector<TLASBuildInfo>& buildInfos);
+
+        /// @brief Allocates scratch memory from the scratch pool for the build info and binds it to the build info
+        /// @param buildInfo The build info that will be bound to the scratch memory
+        /// @return The scratch memory view, which must not be destroyed
+        [[nodiscard]] AllocatedBuffer AllocateScratchFromBuildInfo(TLASBuildInfo& buildInfo);
+
+        /// @brief Ends the current frame of the scratch pool and moves to the next frame in flight.
+        /// @param frameSync The sync point of the submission that uses the scratch memory of the current frame
+        /// @note Frames are expected to finish in the order they were submitted. Memory of finished frames is recycled
+        /// when this function is called.
+        void AdvanceScratchPool(const SyncPoint& frameSync);
+
+        /// @brief Returns the statistics of the scratch pool
+        [[nodiscard]] ScratchPoolStatistics GetScratchPoolStatistics() const;
+
+        /// @brief Creates the AS arena of the device. While the arena exists, CreateBLAS(...) and CompactBLAS(...)
+        /// place the acceleration structures inside a few big buffers instead of creating a buffer per acceleration
+        /// structure. Space of destroyed BLASes is reused by new ones.
+        /// @param info The information that will be used to create the arena
+        /// @note BLASes that were created before the arena keep their own buffers and can be destroyed as usual
+        void CreateASArena(const ASArenaCreateInfo& info = {});
+
+        /// @brief Destroys the AS arena and all its buffers
+        /// @warning All the BLASes in the arena must have been destroyed before calling this function
+        void DestroyASArena();
+
+        /// @brief Releases the arena buffers that don't contain any acceleration structures
+        void TrimASArena();
+
+        /// @brief Returns the occupancy statistics of the AS arena
+        [[nodiscard]] ASArenaStatistics GetASArenaStatistics() const;
+
+        /// @brief Creates the query pool allocator of the device, which hands out ranges of queries from a few big
+        /// query pools per query type, so compaction, serialization and timestamp queries don't create and destroy a
+        /// query pool every time. Freed ranges are reused by later allocations.
+        /// @param info The information that will be used to create the allocator
+        /// @note The allocator is created with the default settings on the first AllocateQueries(...) call, call this
+        /// before that to change the settings
+        void CreateQueryPoolAllocator(const QueryPoolAllocatorCreateInfo& info = {});
+
+        /// @brief Destroys the query pool allocator and all its query pools
+        /// @warning All the query ranges must have been freed and must not be used by the GPU anymore
+        void DestroyQueryPoolAllocator();
+
+        /// @brief Allocates a range of queries and records its reset
+        /// @param type The type of the queries, e.g. eAccelerationStructureCompactedSizeKHR,
+        /// eAccelerationStructureSerializationSizeKHR or eTimestamp. Pipeline statistics queries are not supported
+        /// @param count The number of queries
+        /// @param cmdBuf The command buffer that records the reset, the queries must be written after it
+        /// @return The range, invalid if the allocation failed
+        [[nodiscard]] QueryRange AllocateQueries(vk::QueryType type, uint32_t count, vk::CommandBuffer cmdBuf);
+
+        /// @brief Returns the range to the allocator, so it can be handed out again
+        /// @param range The range, it is reset to an invalid range
+        /// @warning The GPU must have finished writing the queries, e.g. after their results were read
+        void FreeQueries(QueryRange& range);
+
+        /// @brief Reads the results of the queries as 64 bit values without waiting
+        /// @param range The range of the queries
+        /// @param queryCount The number of queries to read from the start of the range, if only a part of the range
+        /// was written
+        /// @return The results, empty if they are not available yet
+        [[nodiscard]] std::vector<uint64_t> GetQueryResults(const QueryRange& range, uint32_t queryCount = ~0U);
+
+        /// @brief Destroys the query pools that don't contain any allocated ranges
+        void TrimQueryPools();
+
+        /// @brief Returns the statistics of the query pool allocator
+        [[nodiscard]] QueryPoolStatistics GetQueryPoolStatistics() const;
+
         /// @brief Destroys the acceleration structure
         /// @param accel The acceleration structures that will be destroyed
         void DestroyBLAS(std::vector<BLASHandle>& blas);
@@ -313,14 +532,14 @@ namespace vr
         /// @param instanceCount The number of instances that will be stored in the buffer (not byte size)
         /// @return The created buffer
         /// @note The buffer is created with the VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT flag, so it is
-        /// host writable. If you want it in device local memory, you should create a buffer with CreateBuffer(...) and
-        /// copy the instance data to the device local buffer.
+        /// host writable. For device local memory, DeviceInstanceBuffer uploads the instances through a staging ring.
+        /// TLASInstanceWriter can fill the buffer from SoA data.
         [[nodiscard]] AllocatedBuffer CreateInstanceBuffer(uint32_t instanceCount);
 
         /// @brief Creates a buffer for storing the scratch data and uses correct alignment / flags
         /// @param size The size of the buffer
         /// @return The created buffer
-        [[nodiscard]] AllocatedBuffer CreateScratchBuffer(uint32_t size);
+        [[nodiscard]] AllocatedBuffer CreateScratchBuffer(vk::DeviceSize size);
 
         /// @brief Creates a buffer for storing the descriptor sets
         /// @param layout The descriptor set layout that will be used to create the buffer
@@ -353,7 +572,7 @@ namespace vr
         /// inefficient to call this function many times
         /// @warning Segfault if pointer and size are not valid / out of bounds.
         /// VMA assertion if the buffer is not mappable.
-        void UpdateBuffer(AllocatedBuffer alloc, void* data, const vk::DeviceSize size, uint32_t offset = 0);
+        void UpdateBuffer(AllocatedBuffer alloc, void* data, const vk::DeviceSize size, vk::DeviceSize offset = 0);
 
         /// @brief Maps the buffer and returns the mapped data
         /// @param buffer The buffer that will be mapped
@@ -439,6 +658,7 @@ namespace vr
         /// @brief Convenience function that calls CreateRayTracingPipeline(...) and then copies the shader record sizes
         /// to the shader binding table info from the old shader binding table info to the new shader binding table
         /// info, so you don't have to set the shader record sizes again when creating the shader binding table.
+        /// SBTInfo::PackRegions and SBTInfo::DeviceLocal are copied as well.
         /// @param shaderCollection The shader collection that will be used to create the pipeline.
         /// many pipelines together, it is just creating one pipeline.
         /// @param settings The settings that will be used to create the pipeline
@@ -597,17 +817,25 @@ namespace vr
         /// @param data The data that will be written to the shader record
         /// @param dataSize The size of the data in bytes that will be written to the shader record
         /// @param mappedData The pointer to the mapped data of the SBT buffer, if it is null, the buffer will be mapped
-        /// and unmapped, default is nullptr
+        /// and unmapped, default is nullptr. For a packed SBT this is the mapped SBTBuffer::PackedBuffer, the offset of
+        /// the region is applied by this function. For a device local SBT it is the mapped SBTBuffer::StagingBuffer
+        /// @note The write to a device local SBT is visible to the GPU after the next RecordSBTUpload(...)
         /// @warning Segfault if any of the pointers are not valid or the data size if out of bounds
-        void WriteToSBT(SBTBuffer sbtBuf, ShaderGroup group, uint32_t groupIndex, void* data, uint32_t dataSize,
+        /// @note Records may still be read by frames in flight, VersionedSBT updates records without that hazard
+        void WriteToSBT(const SBTBuffer& sbtBuf, ShaderGroup group, uint32_t groupIndex, void* data, uint32_t dataSize,
                         void* mappedData = nullptr);
 
-        /// @brief Creates a buffer for each shader type in the shader binding table
+        /// @brief Creates a buffer for each shader type in the shader binding table, or a single buffer for all of them
+        /// if SBTInfo::PackRegions is set
         /// @param pipeline The pipeline that will be used to create the SBT buffer
         /// @param sbt The information about the shader binding table, must contain the indices of the shader groups in
         /// the pipeline
         /// @return The SBT buffer object, which has buffers and vk::StridedDeviceAddressRegionKHR for each shader type
         /// in the shader binding table ready to be used in dispatching rays.
+        /// @note With SetShaderGroupHandleCaching(true) the shader group handles of the pipeline are fetched once and
+        /// cached for later SBTs, then the pipeline must be destroyed with DestroyRayTracingPipeline(...)
+        /// @note With SBTInfo::DeviceLocal the handles are only in the staging mirror, record RecordSBTUpload(...)
+        /// before the first dispatch
         [[nodiscard]] SBTBuffer CreateSBT(vk::Pipeline pipeline, const SBTInfo& sbt);
 
         /// @brief Rebuilds the SBT buffer with the new shader binding table info
@@ -619,13 +847,15 @@ namespace vr
         /// enough to fit all the shaders in the shader binding table info, then the user should call CreateSBT(...) to
         /// create a new SBT buffer and reserve more space for the shaders.
         /// @note This function doesn't reallocate the SBT buffer, it just rewrites the new opaque handles to the
-        /// buffer. So you don't have to WriteToSBT(...) again after rebuilding the SBT buffer.
+        /// buffer. So you don't have to WriteToSBT(...) again after rebuilding the SBT buffer. A device local SBT needs
+        /// RecordSBTUpload(...) afterwards.
         bool RebuildSBT(vk::Pipeline pipeline, SBTBuffer& buffer, const SBTInfo& sbt);
 
         /// @brief Copies the whole SBT from a buffer to another, including the opaque handles.
         /// @param dst The SBT buffer that will be copied to
         /// @param src The SBT buffer that will be copied from
-        /// @note dst must have the same or bigger size than src for all the SBT buffers.
+        /// @note dst must have the same or bigger size than src for all the SBT buffers. Packed and unpacked SBTs can
+        /// be copied into each other, a packed SBT is mapped only once.
         /// @example SBT too small, so create a new SBT buffer with bigger size and copy the old SBT to the new one.
         /// Then call RebuildSBT(...) to rewrite the opaque handles to the new SBT buffer, because SBT won't function
         /// with the old opaque handles. You would want to do this, because it copies the shader records, so you don't
@@ -639,8 +869,38 @@ namespace vr
         /// false otherwise
         bool CanSBTFitShaders(SBTBuffer& buffer, const SBTInfo& sbtInfo);
 
+        /// @brief Records the copy of the staging mirror of a device local SBT into its device local buffer
+        /// @param buffer The SBT buffer, nothing is recorded if it isn't device local
+        /// @param cmdBuf The command buffer, DispatchRays(...) must be recorded after this call
+        /// @note Records a barrier against earlier ray tracing shaders that read the SBT and one that makes the copy
+        /// visible to the ray tracing shaders. Only the used part of every region is copied
+        /// @warning The staging mirror must not be written until the copy finished on the GPU
+        void RecordSBTUpload(const SBTBuffer& buffer, vk::CommandBuffer cmdBuf);
+
+        /// @brief Returns the opaque handles of the first groupCount groups of the pipeline, packed at
+        /// shaderGroupHandleSize. All of them are fetched with a single call, unless the handle cache already holds
+        /// them
+        /// @param pipeline The pipeline of the shader groups
+        /// @param groupCount The number of groups that are needed, starting at the first group of the pipeline
+        /// @return Null if groupCount is 0 or the handles couldn't be fetched
+        /// @note Without the handle cache the pointer is valid until the next call. With it, until the handles of the
+        /// pipeline are invalidated, more groups are requested or the cache is disabled
+        [[nodiscard]] const uint8_t* GetShaderGroupHandles(vk::Pipeline pipeline, uint32_t groupCount);
+
+        /// @brief Drops the cached shader group handles of the pipeline
+        /// @param pipeline The pipeline whose handles were used by CreateSBT(...) or RebuildSBT(...)
+        /// @note With the handle cache enabled, this must be called before vkDestroyPipeline destroys the pipeline,
+        /// a new pipeline could get the same handle and the SBTs would be written with stale shader group handles
+        void InvalidateShaderGroupHandles(vk::Pipeline pipeline);
+
+        /// @brief Destroys a ray tracing pipeline and drops its cached shader group handles
+        /// @param pipeline The pipeline that will be destroyed
+        void DestroyRayTracingPipeline(vk::Pipeline pipeline);
+
         /// @brief Destroys the SBT buffer
         /// @param buffer The SBT buffer that will be destroyed
+        /// @note For a packed SBT only SBTBuffer::PackedBuffer owns memory, the region buffers are views into it. The
+        /// staging mirror of a device local SBT is destroyed as well
         void DestroySBTBuffer(SBTBuffer& buffer);
 
         /// @brief Dispatches the rays
@@ -672,6 +932,65 @@ namespace vr
 #endif
 
       private:
+        /// @brief Records a single build command for a range of BLAS build infos
+        void RecordBLASBuilds(const BLASBuildInfo* buildInfos, uint32_t count, vk::CommandBuffer cmdBuf);
+
+        /// @brief Creates the buffer and acceleration structure of a TLAS that can hold maxInstanceCount instances
+        /// and updates the build sizes and destination of buildInfo
+        void CreateTLASStorage(uint32_t maxInstanceCount, TLASHandle& outAccel, TLASBuildInfo& buildInfo);
+
+        /// @brief Creates the storage for an acceleration structure, either in the AS arena or as a buffer of its own
+        /// @param size The size of the acceleration structure
+        /// @param outAllocation The placement in the arena, invalid if the storage is a buffer of its own
+        /// @return The buffer of the acceleration structure, the acceleration structure is at outAllocation.Offset
+        AllocatedBuffer CreateASStorage(vk::DeviceSize size, ASArenaAllocation& outAllocation);
+
+        /// @brief Creates the storage for multiple acceleration structures packed in a single dedicated arena buffer
+        /// @param sizes The sizes of the acceleration structures, entries with a size of 0 get no storage
+        /// @param outAllocations The placements in the arena, index matches sizes
+        /// @return The buffers of the acceleration structures, all of them are views of the same arena buffer
+        std::vector<AllocatedBuffer> CreatePackedASStorage(const std::vector<uint64_t>& sizes,
+                                                           std::vector<ASArenaAllocation>& outAllocations);
+
+        /// @brief Releases the storage that was created by CreateASStorage(...) or CreatePackedASStorage(...)
+        void DestroyASStorage(AllocatedBuffer& buffer, ASArenaAllocation& allocation);
+
+        /// @brief Creates a new buffer in the AS arena and returns its index
+        uint32_t CreateASArenaBlock(vk::DeviceSize size, bool dedicated, VmaVirtualBlockCreateFlags flags = 0);
+
+        /// @brief Creates a compacted copy of the BLAS in the given storage and records the copy
+        BLASHandle RecordCompactionCopy(vk::AccelerationStructureKHR sourceBLAS, vk::DeviceSize size,
+                                        const AllocatedBuffer& buffer, const ASArenaAllocation& allocation,
+                                        vk::CommandBuffer cmdBuf);
+
+        /// @brief Destroys the buffer of the AS arena at the index
+        void DestroyASArenaBlock(uint32_t blockIndex);
+
+        /// @brief Maps the region buffers of the SBT, a packed SBT is mapped once for all of its regions. For a device
+        /// local SBT the staging mirror is mapped
+        /// @return The mapped data of each region indexed by ShaderGroup, null for regions without a buffer
+        std::array<uint8_t*, 4> MapSBT(SBTBuffer& buffer);
+
+        /// @brief Unmaps the buffers that were mapped by MapSBT(...)
+        void UnmapSBT(SBTBuffer& buffer);
+
+        /// @brief Scatters the cached handles of the shader groups into consecutive records of a mapped region
+        void WriteSBTHandles(const uint8_t* handles, const std::vector<uint32_t>& groupIndices, uint32_t stride,
+                             uint8_t* data);
+
+        /// @brief Creates a new query pool in the query pool allocator and returns its index
+        uint32_t CreateQueryPoolBlock(vk::QueryType type, uint32_t queryCount, bool dedicated);
+
+        /// @brief Destroys the query pool of the query pool allocator at the index
+        void DestroyQueryPoolBlock(uint32_t poolIndex);
+
+        /// @brief Releases the blocks of the scratch pool frames that are finished on the GPU
+        void RecycleScratchPool();
+
+        /// @brief Returns the index of a free block in the scratch pool that can hold size bytes, allocates a new
+        /// block if none of the free blocks fit
+        uint32_t AcquireScratchBlock(vk::DeviceSize size);
+
         vk::DispatchLoaderDynamic mDynLoader;
 
         vk::Instance mInstance;
@@ -682,11 +1001,27 @@ namespace vr
         vk::PhysicalDeviceRayTracingPipelinePropertiesKHR mRayTracingProperties;
         vk::PhysicalDeviceAccelerationStructurePropertiesKHR mAccelProperties;
         vk::PhysicalDeviceDescriptorBufferPropertiesEXT mDescriptorBufferProperties;
+        vk::PhysicalDeviceMaintenance4Properties mMaintenance4Properties;
+        vk::PhysicalDeviceIDProperties mIDProperties;
 
         VmaAllocator mVMAllocator;
         bool mUserSuppliedAllocator = false;
 
         VmaPool mCurrentPool = nullptr;
+
+        std::unique_ptr<detail::ScratchPool> mScratchPool = nullptr;
+
+        std::unique_ptr<detail::ASArena> mASArena = nullptr;
+
+        std::unique_ptr<detail::QueryPoolAllocator> mQueryPools = nullptr;
+
+        /// @brief Opaque handles of all the shader groups of the pipelines that SBTs were created for, only filled
+        /// with SetShaderGroupHandleCaching(true)
+        std::unordered_map<VkPipeline, std::vector<uint8_t>> mShaderGroupHandles;
+        bool mCacheShaderGroupHandles = false;
+
+        /// @brief Handles of the last GetShaderGroupHandles(...) call while the cache is disabled
+        std::vector<uint8_t> mFetchedShaderGroupHandles;
     };
 
 } // namespace vr
@@ -0,0 +1,99 @@
+// Expands a compact instance list into VkAccelerationStructureInstanceKHR, with culling and mask assignment
+
+struct GPUInstance
+{
+    uint ObjectID;
+    uint TransformIndex;
+    uint BLASIndex;
+    uint MaskAndFlags; // mask in bits 0-7, VkGeometryInstanceFlagsKHR in bits 8-15
+};
+
+struct Transform
+{
+    float4 Rows[3]; // row major 3x4
+};
+
+struct BLASEntry
+{
+    uint2 Address;
+    uint SBTOffset;
+    uint Padding;
+    float4 BoundingSphere; // object space center and radius
+};
+
+struct ASInstance
+{
+    float4 Rows[3];
+    uint CustomIndexAndMask;
+    uint SBTOffsetAndFlags;
+    uint2 Reference;
+};
+
+[[vk::binding(0, 0)]] StructuredBuffer<GPUInstance> instances;
+[[vk::binding(1, 0)]] StructuredBuffer<Transform> transforms;
+[[vk::binding(2, 0)]] StructuredBuffer<BLASEntry> blasEntries;
+[[vk::binding(3, 0)]] RWStructuredBuffer<ASInstance> outInstances;
+
+static const uint CULL_FRUSTUM = 0x1;
+static const uint CULL_DISTANCE = 0x2;
+
+struct Settings
+{
+    float4 FrustumPlanes[6]; // world space, normals point inside
+    float4 CameraPositionAndMaxDistance;
+    uint InstanceCount;
+    uint CullFlags;
+    uint FarMask;
+    float MaskDistance;
+};
+
+[[vk::push_constant]] Settings settings;
+
+[numthreads(64, 1, 1)]
+void InstanceGenerator_main(uint3 threadID : SV_DispatchThreadID)
+{
+    const uint index = threadID.x;
+    if (index >= settings.InstanceCount)
+        return;
+
+    const GPUInstance instance = instances[index];
+    const Transform transform = transforms[instance.TransformIndex];
+    const BLASEntry blas = blasEntries[instance.BLASIndex];
+
+    // Bounding sphere to world space, the radius is scaled by the largest axis scale
+    const float3 center = float3(dot(transform.Rows[0], float4(blas.BoundingSphere.xyz, 1.0f)),
+                                 dot(transform.Rows[1], float4(blas.BoundingSphere.xyz, 1.0f)),
+                                 dot(transform.Rows[2], float4(blas.BoundingSphere.xyz, 1.0f)));
+
+    const float3 col0 = float3(transform.Rows[0].x, transform.Rows[1].x, transform.Rows[2].x);
+    const float3 col1 = float3(transform.Rows[0].y, transform.Rows[1].y, transform.Rows[2].y);
+    const float3 col2 = float3(transform.Rows[0].z, transform.Rows[1].z, transform.Rows[2].z);
+    const float radius = blas.BoundingSphere.w * sqrt(max(dot(col0, col0), max(dot(col1, col1), dot(col2, col2))));
+
+    const float distance = length(center - settings.CameraPositionAndMaxDistance.xyz) - radius;
+
+    bool visible = true;
+    if (settings.CullFlags & CULL_FRUSTUM)
+    {
+        for (uint i = 0; i < 6; i++)
+            visible = visible && dot(settings.FrustumPlanes[i].xyz, center) + settings.FrustumPlanes[i].w >= -radius;
+    }
+    if (settings.CullFlags & CULL_DISTANCE)
+        visible = visible && distance <= settings.CameraPositionAndMaxDistance.w;
+
+    uint mask = instance.MaskAndFlags & 0xFF;
+    if (settings.MaskDistance > 0.0f && distance > settings.MaskDistance)
+        mask &= settings.FarMask;
+
+    ASInstance outInstance;
+    outInstance.Rows = transform.Rows;
+    outInstance.CustomIndexAndMask = (instance.ObjectID & 0xFFFFFF) | (mask << 24);
+    outInstance.SBTOffsetAndFlags = (blas.SBTOffset & 0xFFFFFF) | (((instance.MaskAndFlags >> 8) & 0xFF) << 24);
+
+    // Instances with a null acceleration structure reference are inactive, so the instance count stays the same
+    outInstance.Reference = visible ? blas.Address : uint2(0, 0);
+    if (!visible)
+        outInstance.CustomIndexAndMask &= 0xFFFFFF;
+
+    outInstances[index] = outInstance;
+}
@@ -0,0 +1,280 @@
+#include "Vulray/ASArena.h"
+
+#include "Vulray/VulrayDevice.h"
+
+namespace vr
+{
+
+    // Acceleration structures must be placed at offsets that are a multiple of 256 in their buffer
+    static constexpr vk::DeviceSize ASOffsetAlignment = 256;
+
+    void VulrayDevice::CreateASArena(const ASArenaCreateInfo& info)
+    {
+        if (!mASArena)
+            mASArena = std::make_unique<detail::ASArena>();
+
+        mASArena->Info = info;
+        mASArena->Info.BlockSize = AlignUp(std::max(info.BlockSize, ASOffsetAlignment), ASOffsetAlignment);
+        mASArena->Enabled = true;
+    }
+
+    void VulrayDevice::DestroyASArena()
+    {
+        if (!mASArena)
+            return;
+
+        for (uint32_t i = 0; i < mASArena->Blocks.size(); i++)
+        {
+            if (!mASArena->Blocks[i].VirtualBlock)
+                continue;
+
+            if (!vmaIsVirtualBlockEmpty(mASArena->Blocks[i].VirtualBlock))
+                VULRAY_LOG_WARNING("DestroyASArena: Arena still contains acceleration structures");
+
+            DestroyASArenaBlock(i);
+        }
+
+        mASArena.reset();
+    }
+
+    void VulrayDevice::TrimASArena()
+    {
+        if (!mASArena)
+            return;
+
+        for (uint32_t i = 0; i < mASArena->Blocks.size(); i++)
+        {
+            auto& block = mASArena->Blocks[i];
+            if (block.VirtualBlock && vmaIsVirtualBlockEmpty(block.VirtualBlock))
+                DestroyASArenaBlock(i);
+        }
+
+        // Drop the empty slots at the end, the indices of the remaining blocks don't change
+        while (!mASArena->Blocks.empty() && !mASArena->Blocks.back().VirtualBlock) mASArena->Blocks.pop_back();
+    }
+
+    ASArenaStatistics VulrayDevice::GetASArenaStatistics() const
+    {
+        ASArenaStatistics outStats = {};
+        if (!mASArena)
+            return outStats;
+
+        for (const auto& block : mASArena->Blocks)
+        {
+            if (!block.VirtualBlock)
+                continue;
+
+            VmaDetailedStatistics stats = {};
+            vmaCalculateVirtualBlockStatistics(block.VirtualBlock, &stats);
+
+            outStats.BlockCount++;
+            outStats.AllocationCount += stats.statistics.allocationCount;
+            outStats.BlockBytes += stats.statistics.blockBytes;
+            outStats.AllocatedBytes += stats.statistics.allocationBytes;
+            if (stats.unusedRangeCount > 0)
+                outStats.LargestFreeRange = std::max(outStats.LargestFreeRange, stats.unusedRangeSizeMax);
+        }
+
+        if (outStats.BlockBytes > 0)
+            outStats.Occupancy = (float)((double)outStats.AllocatedBytes / (double)outStats.BlockBytes);
+
+        return outStats;
+    }
+
+    AllocatedBuffer VulrayDevice::CreateASStorage(vk::DeviceSize size, ASArenaAllocation& outAllocation)
+    {
+        outAllocation = {};
+
+        if (!mASArena || !mASArena->Enabled)
+            return CreateBuffer(size, vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR, 0);
+
+        VmaVirtualAllocationCreateInfo allocInfo = {};
+        allocInfo.size = size;
+        allocInfo.alignment = ASOffsetAlignment;
+
+        // Acceleration structures that don't fit into a regular block get a dedicated one
+        const bool dedicated = size > mASArena->Info.BlockSize;
+
+        if (!dedicated)
+        {
+            for (uint32_t i = 0; i < mASArena->Blocks.size(); i++)
+            {
+                auto& block = mASArena->Blocks[i];
+                if (!block.VirtualBlock || block.Dedicated)
+                    continue;
+
+                if (vmaVirtualAllocate(block.VirtualBlock, &allocInfo, &outAllocation.Allocation,
+                                       &outAllocation.Offset) == VK_SUCCESS)
+                {
+                    outAllocation.BlockIndex = i;
+                    break;
+                }
+            }
+        }
+
+        if (!outAllocation.IsValid())
+        {
+            uint32_t blockIndex = CreateASArenaBlock(dedicated ? size : mASArena->Info.BlockSize, dedicated);
+            if (blockIndex == ~0U)
+                return AllocatedBuffer();
+
+            auto result = (vk::Result)vmaVirtualAllocate(mASArena->Blocks[blockIndex].VirtualBlock, &allocInfo,
+                                                         &outAllocation.Allocation, &outAllocation.Offset);
+            if (result != vk::Result::eSuccess)
+            {
+                VULRAY_FLOG_ERROR("Failed to allocate acceleration structure in the AS arena: %s",
+                                  vk::to_string(result).c_str());
+                outAllocation = {};
+                return AllocatedBuffer();
+            }
+            outAllocation.BlockIndex = blockIndex;
+        }
+
+        // The returned buffer is a view into the arena buffer, it doesn't own any memory
+        const auto& blockBuffer = mASArena->Blocks[outAllocation.BlockIndex].Buffer;
+
+        AllocatedBuffer outBuffer = {};
+        outBuffer.Buffer = blockBuffer.Buffer;
+        outBuffer.DevAddress = blockBuffer.DevAddress + outAllocation.Offset;
+        outBuffer.Size = size;
+        return outBuffer;
+    }
+
+    std::vector<AllocatedBuffer> VulrayDevice::CreatePackedASStorage(const std::vector<uint64_t>& sizes,
+                                                                     std::vector<ASArenaAllocation>& outAllocations)
+    {
+        std::vector<AllocatedBuffer> outBuffers(sizes.size());
+        outAllocations.assign(sizes.size(), ASArenaAllocation());
+
+        vk::DeviceSize packedSize = 0;
+        for (auto size : sizes)
+        {
+            if (size != 0 && !CheckedAdd(packedSize, AlignUp(size, ASOffsetAlignment), packedSize))
+            {
+                VULRAY_LOG_ERROR("CreatePackedASStorage: Packed size overflows");
+                return outBuffers;
+            }
+        }
+
+        if (packedSize == 0)
+            return outBuffers;
+
+        // Packed blocks live in the arena even if suballocation is disabled, the arena keeps track of when the last
+        // acceleration structure in the block is destroyed
+        if (!mASArena)
+            mASArena = std::make_unique<detail::ASArena>();
+
+        // The linear algorithm places the allocations back to back, so they always fit in the exact packed size
+        uint32_t blockIndex = CreateASArenaBlock(packedSize, true, VMA_VIRTUAL_BLOCK_CREATE_LINEAR_ALGORITHM_BIT);
+        if (blockIndex == ~0U)
+            return outBuffers;
+
+        const auto& block = mASArena->Blocks[blockIndex];
+
+        VmaVirtualAllocationCreateInfo allocInfo = {};
+        allocInfo.alignment = ASOffsetAlignment;
+
+        for (size_t i = 0; i < sizes.size(); i++)
+        {
+            if (sizes[i] == 0)
+                continue;
+
+            allocInfo.size = sizes[i];
+            auto result = (vk::Result)vmaVirtualAllocate(block.VirtualBlock, &allocInfo, &outAllocations[i].Allocation,
+                                                         &outAllocations[i].Offset);
+            if (result != vk::Result::eSuccess)
+            {
+                VULRAY_FLOG_ERROR("CreatePackedASStorage: Failed to allocate acceleration structure %zu in the packed "
+                                  "block: %s",
+                                  i, vk::to_string(result).c_str());
+
+                // Nothing was handed out yet, so the whole block can go
+                DestroyASArenaBlock(blockIndex);
+                outBuffers.assign(sizes.size(), AllocatedBuffer());
+                outAllocations.assign(sizes.size(), ASArenaAllocation());
+                return outBuffers;
+            }
+            outAllocations[i].BlockIndex = blockIndex;
+
+            outBuffers[i].Buffer = block.Buffer.Buffer;
+            outBuffers[i].DevAddress = block.Buffer.DevAddress + outAllocations[i].Offset;
+            outBuffers[i].Size = sizes[i];
+        }
+
+        return outBuffers;
+    }
+
+    void VulrayDevice::DestroyASStorage(AllocatedBuffer& buffer, ASArenaAllocation& allocation)
+    {
+        if (!allocation.IsValid())
+        {
+            DestroyBuffer(buffer);
+            return;
+        }
+
+        if (!mASArena || allocation.BlockIndex >= mASArena->Blocks.size() ||
+            !mASArena->Blocks[allocation.BlockIndex].VirtualBlock)
+        {
+            VULRAY_LOG_ERROR("DestroyASStorage: Acceleration structure doesn't belong to the AS arena");
+            return;
+        }
+
+        auto& block = mASArena->Blocks[allocation.BlockIndex];
+        vmaVirtualFree(block.VirtualBlock, allocation.Allocation);
+
+        // Dedicated blocks are never reused, so release them as soon as they are empty
+        if (block.Dedicated && vmaIsVirtualBlockEmpty(block.VirtualBlock))
+            DestroyASArenaBlock(allocation.BlockIndex);
+
+        buffer = {};
+        allocation = {};
+    }
+
+    uint32_t VulrayDevice::CreateASArenaBlock(vk::DeviceSize size, bool dedicated, VmaVirtualBlockCreateFlags flags)
+    {
+        detail::ASArenaBlock block = {};
+        block.Dedicated = dedicated;
+        block.Buffer = CreateBuffer(size, vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR, 0,
+                                    (uint32_t)ASOffsetAlignment);
+        if (!block.Buffer.Buffer)
+            return ~0U;
+
+        VmaVirtualBlockCreateInfo blockInfo = {};
+        blockInfo.size = size;
+        blockInfo.flags = flags;
+
+        auto result = (vk::Result)vmaCreateVirtualBlock(&blockInfo, &block.VirtualBlock);
+        if (result != vk::Result::eSuccess)
+        {
+            VULRAY_FLOG_ERROR("Failed to create AS arena block: %s", vk::to_string(result).c_str());
+            DestroyBuffer(block.Buffer);
+            return ~0U;
+        }
+
+        // Reuse the slot of a released block if there is one
+        for (uint32_t i = 0; i < mASArena->Blocks.size(); i++)
+        {
+            if (!mASArena->Blocks[i].VirtualBlock)
+            {
+                mASArena->Blocks[i] = block;
+                return i;
+            }
+        }
+
+        mASArena->Blocks.push_back(block);
+        return (uint32_t)mASArena->Blocks.size() - 1;
+    }
+
+    void VulrayDevice::DestroyASArenaBlock(uint32_t blockIndex)
+    {
+        auto& block = mASArena->Blocks[blockIndex];
+
+        // VMA asserts when a virtual block with allocations is destroyed, so free the leftovers first
+        vmaClearVirtualBlock(block.VirtualBlock);
+        vmaDestroyVirtualBlock(block.VirtualBlock);
+        DestroyBuffer(block.Buffer);
+
+        block = {};
+    }
+
+} // namespace vr
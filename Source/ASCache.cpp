@@ -0,0 +1,349 @@
+#include "Vulray/ASCache.h"
+
+#include "Vulray/VulrayDevice.h"
+
+namespace vr
+{
+    namespace detail
+    {
+        // Header of a cache file, followed by DataSize bytes of serialized acceleration structure
+        struct ASCacheFileHeader
+        {
+            uint32_t Magic = 0;
+            uint32_t Version = 0;
+            uint64_t Key = 0;
+            uint8_t DeviceUUID[VK_UUID_SIZE] = {};
+            uint8_t DriverUUID[VK_UUID_SIZE] = {};
+            uint64_t DataSize = 0;
+            uint64_t DataHash = 0;
+        };
+    } // namespace detail
+
+    static constexpr uint32_t ASCacheMagic = 0x53415256; // "VRAS"
+
+    // Increment when the file layout changes, older files are rejected then
+    static constexpr uint32_t ASCacheVersion = 1;
+
+    // The serialized data starts with the driver and compatibility UUIDs, followed by the serialized size, the
+    // deserialized size and the handle count
+    static constexpr size_t SerializedVersionDataSize = 2 * VK_UUID_SIZE;
+    static constexpr size_t SerializedHeaderSize = SerializedVersionDataSize + 3 * sizeof(uint64_t);
+
+    // Serialization source and destination addresses must be 256 byte aligned
+    static constexpr uint32_t SerializedDataAlignment = 256;
+
+    ASCache::ASCache(vr::VulrayDevice* device, const std::string& directory) : mDevice(device), mDirectory(directory)
+    {
+        std::error_code error;
+        std::filesystem::create_directories(mDirectory, error);
+        if (error)
+        {
+            VULRAY_FLOG_ERROR("ASCache: Failed to create the cache directory %s: %s", mDirectory.c_str(),
+                              error.message().c_str());
+        }
+    }
+
+    ASCache::~ASCache()
+    {
+        // The GPU is expected to be idle when the cache is destroyed, unfinished stores are dropped
+        for (auto& store : mPendingStores)
+        {
+            mDevice->FreeQueries(store.Queries);
+            if (store.Readback.Buffer)
+                mDevice->DestroyBuffer(store.Readback);
+        }
+
+        for (auto& upload : mPendingUploads) mDevice->DestroyBuffer(upload.Staging);
+    }
+
+    uint64_t ASCache::HashData(const void* data, size_t size, uint64_t seed)
+    {
+        constexpr uint64_t prime = 0x9E3779B97F4A7C15ull;
+
+        // splitmix64 finalizer
+        auto mix = [](uint64_t x)
+        {
+            x ^= x >> 30;
+            x *= 0xBF58476D1CE4E5B9ull;
+            x ^= x >> 27;
+            x *= 0x94D049BB133111EBull;
+            x ^= x >> 31;
+            return x;
+        };
+
+        const uint8_t* bytes = (const uint8_t*)data;
+        uint64_t hash = seed ^ (size * prime);
+
+        // 8 bytes at a time, geometry buffers can be hundreds of megabytes
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+        {
+            uint64_t word;
+            memcpy(&word, bytes + i, sizeof(uint64_t));
+            hash = (hash ^ mix(word)) * prime;
+        }
+
+        if (i < size)
+        {
+            uint64_t word = 0;
+            memcpy(&word, bytes + i, size - i);
+            hash = (hash ^ mix(word)) * prime;
+        }
+
+        return mix(hash);
+    }
+
+    bool ASCache::Load(uint64_t key, BLASHandle& outBLAS, vk::CommandBuffer cmdBuf)
+    {
+        std::ifstream file(GetFilePath(key), std::ios::binary);
+        if (!file)
+        {
+            mStats.Misses++;
+            return false;
+        }
+
+        detail::ASCacheFileHeader header = {};
+        file.read((char*)&header, sizeof(header));
+
+        const auto idProperties = mDevice->GetIDProperties();
+
+        if (!file || header.Magic != ASCacheMagic || header.Version != ASCacheVersion || header.Key != key ||
+            header.DataSize < SerializedHeaderSize ||
+            memcmp(header.DeviceUUID, idProperties.deviceUUID.data(), VK_UUID_SIZE) != 0 ||
+            memcmp(header.DriverUUID, idProperties.driverUUID.data(), VK_UUID_SIZE) != 0)
+        {
+            mStats.Rejected++;
+            return false;
+        }
+
+        // The header can't be trusted before the hash is checked, so never allocate more than the file holds
+        const std::streampos dataBegin = file.tellg();
+        file.seekg(0, std::ios::end);
+        const std::streampos fileEnd = file.tellg();
+        file.seekg(dataBegin);
+        if (!file || dataBegin < 0 || fileEnd < dataBegin || header.DataSize > (uint64_t)(fileEnd - dataBegin))
+        {
+            VULRAY_FLOG_WARNING("ASCache: Cache file of key %016llx is truncated", (unsigned long long)key);
+            mStats.Rejected++;
+            return false;
+        }
+
+        // Read into system memory first, the upload buffer is write-combined and slow to read for the hash
+        std::vector<uint8_t> data(header.DataSize);
+        file.read((char*)data.data(), (std::streamsize)header.DataSize);
+
+        if (!file || HashData(data.data(), data.size()) != header.DataHash)
+        {
+            VULRAY_FLOG_WARNING("ASCache: Cache file of key %016llx is corrupted", (unsigned long long)key);
+            mStats.Rejected++;
+            return false;
+        }
+
+        if (!mDevice->IsSerializedASCompatible(data.data()))
+        {
+            mStats.Rejected++;
+            return false;
+        }
+
+        uint64_t deserializedSize = 0;
+        memcpy(&deserializedSize, data.data() + SerializedVersionDataSize + sizeof(uint64_t), sizeof(uint64_t));
+
+        PendingUpload upload = {};
+        // vkCmdCopyMemoryToAccelerationStructureKHR reads the serialized data through its device address
+        upload.Staging = mDevice->CreateBuffer(header.DataSize,
+                                               vk::BufferUsageFlagBits::eShaderDeviceAddress |
+                                                   vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR,
+                                               VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
+                                               SerializedDataAlignment);
+        if (!upload.Staging.Buffer)
+            return false;
+
+        mDevice->UpdateBuffer(upload.Staging, data.data(), header.DataSize);
+
+        outBLAS = mDevice->DeserializeBLAS(upload.Staging, deserializedSize, cmdBuf);
+
+        mPendingUploads.push_back(upload);
+
+        mStats.Hits++;
+        mStats.BytesRead += header.DataSize;
+        return true;
+    }
+
+    void ASCache::Store(uint64_t key, const BLASHandle& blas, vk::CommandBuffer cmdBuf)
+    {
+        PendingStore store = {};
+        store.Key = key;
+        store.BLAS = blas.AccelerationStructure;
+        store.Queries = mDevice->AllocateQueries(vk::QueryType::eAccelerationStructureSerializationSizeKHR, 1, cmdBuf);
+        if (!store.Queries.IsValid())
+            return;
+
+        // The build has to be finished before the serialization size can be queried
+        auto barrier = vk::MemoryBarrier()
+                           .setSrcAccessMask(vk::AccessFlagBits::eAccelerationStructureWriteKHR)
+                           .setDstAccessMask(vk::AccessFlagBits::eAccelerationStructureReadKHR);
+
+        cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
+                               vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR, (vk::DependencyFlagBits)0, 1,
+                               &barrier, 0, nullptr, 0, nullptr);
+
+        cmdBuf.writeAccelerationStructuresPropertiesKHR(store.BLAS,
+                                                        vk::QueryType::eAccelerationStructureSerializationSizeKHR,
+                                                        store.Queries.Pool, store.Queries.FirstQuery,
+                                                        mDevice->GetDynamicLoader());
+
+        mPendingStores.push_back(store);
+    }
+
+    void ASCache::Submit(const SyncPoint& syncPoint)
+    {
+        for (auto& store : mPendingStores)
+        {
+            if (store.Submitted)
+                continue;
+            store.Sync = syncPoint;
+            store.Submitted = true;
+        }
+
+        for (auto& upload : mPendingUploads)
+        {
+            if (upload.Submitted)
+                continue;
+            upload.Sync = syncPoint;
+            upload.Submitted = true;
+        }
+    }
+
+    void ASCache::Update(vk::CommandBuffer cmdBuf)
+    {
+        for (auto it = mPendingUploads.begin(); it != mPendingUploads.end();)
+        {
+            if (it->Submitted && mDevice->IsSyncPointReached(it->Sync))
+            {
+                mDevice->DestroyBuffer(it->Staging);
+                it = mPendingUploads.erase(it);
+            }
+            else
+                ++it;
+        }
+
+        bool recordedCopies = false;
+
+        for (auto it = mPendingStores.begin(); it != mPendingStores.end();)
+        {
+            if (!it->Submitted || !mDevice->IsSyncPointReached(it->Sync))
+            {
+                ++it;
+                continue;
+            }
+
+            // The size is available, record the serialization into a readback buffer
+            if (it->Queries.IsValid())
+            {
+                auto sizes = mDevice->GetQueryResults(it->Queries);
+                if (sizes.empty())
+                {
+                    ++it;
+                    continue;
+                }
+
+                mDevice->FreeQueries(it->Queries);
+
+                it->Readback = mDevice->CreateBuffer(sizes[0], vk::BufferUsageFlagBits::eStorageBuffer,
+                                                     VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT,
+                                                     SerializedDataAlignment);
+                if (!it->Readback.Buffer)
+                {
+                    it = mPendingStores.erase(it);
+                    continue;
+                }
+
+                BLASHandle blas = {};
+                blas.AccelerationStructure = it->BLAS;
+                mDevice->SerializeBLAS(blas, it->Readback, cmdBuf);
+
+                // Wait for the submission of the copy
+                it->Submitted = false;
+                recordedCopies = true;
+                ++it;
+                continue;
+            }
+
+            // The serialized data is in the readback buffer, write it to disk
+            auto data = (const uint8_t*)mDevice->MapBuffer(it->Readback);
+            vmaInvalidateAllocation(mDevice->GetAllocator(), it->Readback.Allocation, 0, VK_WHOLE_SIZE);
+
+            if (WriteFile(it->Key, data, it->Readback.Size))
+            {
+                mStats.Stored++;
+                mStats.BytesWritten += it->Readback.Size;
+            }
+
+            mDevice->UnmapBuffer(it->Readback);
+            mDevice->DestroyBuffer(it->Readback);
+            it = mPendingStores.erase(it);
+        }
+
+        if (recordedCopies)
+        {
+            // Make the serialized data visible to the host
+            auto barrier = vk::MemoryBarrier()
+                               .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite |
+                                                 vk::AccessFlagBits::eAccelerationStructureWriteKHR)
+                               .setDstAccessMask(vk::AccessFlagBits::eHostRead);
+
+            cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
+                                   vk::PipelineStageFlagBits::eHost, (vk::DependencyFlagBits)0, 1, &barrier, 0,
+                                   nullptr, 0, nullptr);
+        }
+    }
+
+    std::string ASCache::GetFilePath(uint64_t key) const
+    {
+        char fileName[32];
+        std::snprintf(fileName, sizeof(fileName), "%016llx.vras", (unsigned long long)key);
+
+        return (std::filesystem::path(mDirectory) / fileName).string();
+    }
+
+    bool ASCache::WriteFile(uint64_t key, const uint8_t* data, vk::DeviceSize size)
+    {
+        const auto idProperties = mDevice->GetIDProperties();
+
+        detail::ASCacheFileHeader header = {};
+        header.Magic = ASCacheMagic;
+        header.Version = ASCacheVersion;
+        header.Key = key;
+        memcpy(header.DeviceUUID, idProperties.deviceUUID.data(), VK_UUID_SIZE);
+        memcpy(header.DriverUUID, idProperties.driverUUID.data(), VK_UUID_SIZE);
+        header.DataSize = size;
+        header.DataHash = HashData(data, size);
+
+        // Write to a temporary file first, so a crash never leaves a truncated cache file behind
+        const std::string path = GetFilePath(key);
+        const std::string tempPath = path + ".tmp";
+
+        {
+            std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+            file.write((const char*)&header, sizeof(header));
+            file.write((const char*)data, size);
+
+            if (!file)
+            {
+                VULRAY_FLOG_ERROR("ASCache: Failed to write cache file %s", tempPath.c_str());
+                return false;
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(tempPath, path, error);
+        if (error)
+        {
+            VULRAY_FLOG_ERROR("ASCache: Failed to write cache file %s: %s", path.c_str(), error.message().c_str());
+            std::filesystem::remove(tempPath, error);
+            return false;
+        }
+        return true;
+    }
+
+} // namespace vr
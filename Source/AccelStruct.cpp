@@ -34,10 +34,10 @@ namespace vr
 
             // Fill in the range info
             outBuildInfo.Ranges[i] = vk::AccelerationStructureBuildRangeInfoKHR()
-                                         .setFirstVertex(0)
+                                         .setFirstVertex(info.Geometries[i].FirstVertex)
                                          .setPrimitiveCount(info.Geometries[i].PrimitiveCount)
-                                         .setPrimitiveOffset(0)
-                                         .setTransformOffset(0);
+                                         .setPrimitiveOffset(info.Geometries[i].PrimitiveOffset)
+                                         .setTransformOffset(info.Geometries[i].TransformOffset);
 
             maxPrimitiveCounts[i] = info.Geometries[i].PrimitiveCount;
         }
@@ -57,15 +57,14 @@ namespace vr
                                                       &outBuildInfo.BuildSizes,
                                                       mDynLoader); // This will fill in the size requirements
 
-        // Create the buffer for the acceleration structure
-        outAccel.Buffer = CreateBuffer(outBuildInfo.BuildSizes.accelerationStructureSize,
-                                       // no flags for VMA
-                                       vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR, 0);
+        // Create the storage for the acceleration structure, either in the AS arena or as its own buffer
+        outAccel.Buffer = CreateASStorage(outBuildInfo.BuildSizes.accelerationStructureSize, outAccel.ArenaAllocation);
 
         // Create the acceleration structure
         auto createInfo = vk::AccelerationStructureCreateInfoKHR()
                               .setType(vk::AccelerationStructureTypeKHR::eBottomLevel)
                               .setBuffer(outAccel.Buffer.Buffer)
+                              .setOffset(outAccel.ArenaAllocation.Offset)
                               .setSize(outBuildInfo.BuildSizes.accelerationStructureSize);
 
         outAccel.AccelerationStructure = mDevice.createAccelerationStructureKHR(createInfo, nullptr, mDynLoader);
@@ -82,26 +81,78 @@ namespace vr
     }
 
     void VulrayDevice::BuildBLAS(const std::vector<BLASBuildInfo>& buildInfos, vk::CommandBuffer cmdBuf)
+    {
+        RecordBLASBuilds(buildInfos.data(), buildInfos.size(), cmdBuf);
+    }
+
+    BLASBuildSchedule VulrayDevice::ScheduleBLASBuilds(const std::vector<BLASBuildInfo>& buildInfos,
+                                                       vk::DeviceSize scratchBudget)
+    {
+        // A batch can't be bigger than a single buffer
+        scratchBudget = std::min(scratchBudget, mMaintenance4Properties.maxBufferSize);
+
+        return vr::ScheduleBLASBuilds(buildInfos, scratchBudget,
+                                      mAccelProperties.minAccelerationStructureScratchOffsetAlignment);
+    }
+
+    BLASBuildStats VulrayDevice::BuildBLAS(std::vector<BLASBuildInfo>& buildInfos, const BLASBuildSchedule& schedule,
+                                           const AllocatedBuffer& scratchBuffer, vk::CommandBuffer cmdBuf)
+    {
+        BLASBuildStats outStats = {};
+
+        if (scratchBuffer.Size < schedule.ScratchSize)
+        {
+            VULRAY_LOG_ERROR("BuildBLAS: Scratch buffer is smaller than the scratch size of the schedule");
+            return outStats;
+        }
+
+        for (auto& batch : schedule.Batches)
+        {
+            // Every batch reuses the scratch memory from the start of the buffer, so the previous batch must be
+            // finished before the next one can start
+            if (outStats.BatchCount > 0)
+            {
+                AddAccelerationBuildBarrier(cmdBuf);
+                outStats.BarrierCount++;
+            }
+
+            vk::DeviceAddress scratchDataAddr = scratchBuffer.DevAddress;
+            for (uint32_t i = batch.FirstBuildInfo; i < batch.FirstBuildInfo + batch.BuildInfoCount; i++)
+            {
+                BindScratchAdressToBuildInfo(scratchDataAddr, buildInfos[i]);
+                scratchDataAddr +=
+                    GetAlignedScratchSize(buildInfos[i].BuildGeometryInfo, buildInfos[i].BuildSizes,
+                                          mAccelProperties.minAccelerationStructureScratchOffsetAlignment);
+            }
+
+            RecordBLASBuilds(buildInfos.data() + batch.FirstBuildInfo, batch.BuildInfoCount, cmdBuf);
+            outStats.BatchCount++;
+        }
+
+        return outStats;
+    }
+
+    void VulrayDevice::RecordBLASBuilds(const BLASBuildInfo* buildInfos, uint32_t count, vk::CommandBuffer cmdBuf)
     {
         std::vector<vk::AccelerationStructureBuildRangeInfoKHR*> pBuildRangeInfos;
         std::vector<vk::AccelerationStructureBuildGeometryInfoKHR> buildGeometryInfos;
-        pBuildRangeInfos.reserve(buildInfos.size());
-        buildGeometryInfos.reserve(buildInfos.size());
+        pBuildRangeInfos.reserve(count);
+        buildGeometryInfos.reserve(count);
 
-        for (uint32_t i = 0; i < buildInfos.size(); i++)
+        for (uint32_t i = 0; i < count; i++)
         {
             pBuildRangeInfos.push_back(buildInfos[i].Ranges.get());
             buildGeometryInfos.push_back(buildInfos[i].BuildGeometryInfo);
         }
 
         // Build the acceleration structures
-        cmdBuf.buildAccelerationStructuresKHR(buildInfos.size(), buildGeometryInfos.data(), pBuildRangeInfos.data(),
-                                              mDynLoader);
+        cmdBuf.buildAccelerationStructuresKHR(count, buildGeometryInfos.data(), pBuildRangeInfos.data(), mDynLoader);
     }
 
     BLASBuildInfo VulrayDevice::UpdateBLAS(BLASUpdateInfo& updateInfo)
     {
-        assert(updateInfo.NewGeometryAddresses.size() == updateInfo.SourceBuildInfo.GeometryCount &&
+        assert((updateInfo.NewGeometryAddresses.empty() ||
+                updateInfo.NewGeometryAddresses.size() == updateInfo.SourceBuildInfo.GeometryCount) &&
                "The number of new geometry addresses must match the number of geometries in the source build info");
 
         bool useSourceDeviceAddress = updateInfo.NewGeometryAddresses.size() == 0;
@@ -126,6 +177,8 @@ namespace vr
                         updateInfo.NewGeometryAddresses[i].VertexDevAddress;
                     outBuildInfo.Geometries[i].geometry.triangles.indexData =
                         updateInfo.NewGeometryAddresses[i].IndexDevAddress;
+                    outBuildInfo.Geometries[i].geometry.triangles.transformData =
+                        updateInfo.NewGeometryAddresses[i].TransformDevAddress;
                 }
                 else if (geomType == vk::GeometryTypeKHR::eAabbs)
                 {
@@ -134,9 +187,8 @@ namespace vr
                 }
             }
 
+            // The ranges of the source build are kept, geometries in a shared buffer depend on their offsets
             maxPrimitiveCounts[i] = updateInfo.SourceBuildInfo.Ranges[i].primitiveCount;
-            outBuildInfo.Ranges[i].primitiveOffset = 0;
-            outBuildInfo.Ranges[i].primitiveCount = updateInfo.SourceBuildInfo.Ranges[i].primitiveCount;
         }
 
         // Get the size requirements for the acceleration structure
@@ -155,11 +207,7 @@ namespace vr
     {
         CompactionRequest outRequest = {};
 
-        auto createInfo = vk::QueryPoolCreateInfo()
-                              .setQueryType(vk::QueryType::eAccelerationStructureCompactedSizeKHR)
-                              .setQueryCount(sourceBLAS.size());
         for (auto& blas : sourceBLAS) outRequest.SourceBLAS.push_back(blas->AccelerationStructure);
-        outRequest.CompactionQueryPool = mDevice.createQueryPool(createInfo);
 
         return outRequest;
     }
@@ -168,25 +216,28 @@ namespace vr
     {
         uint32_t blasCount = request.SourceBLAS.size();
 
-        auto [result, values] = mDevice.getQueryPoolResults<uint64_t>(request.CompactionQueryPool, 0, blasCount,
-                                                                      sizeof(uint64_t) * blasCount, sizeof(uint64_t));
-
-        if (result == vk::Result::eSuccess)
+        // The first call records the queries, the later calls read them
+        if (!request.CompactionQueries.IsValid())
         {
-            // Destroy the query pool, we don't need it anymore
-            mDevice.destroyQueryPool(request.CompactionQueryPool);
-            request.CompactionQueryPool = nullptr;
+            request.CompactionQueries =
+                AllocateQueries(vk::QueryType::eAccelerationStructureCompactedSizeKHR, blasCount, cmdBuf);
+            if (!request.CompactionQueries.IsValid())
+                return std::vector<uint64_t>();
+
+            cmdBuf.writeAccelerationStructuresPropertiesKHR(
+                request.SourceBLAS, vk::QueryType::eAccelerationStructureCompactedSizeKHR,
+                request.CompactionQueries.Pool, request.CompactionQueries.FirstQuery, mDynLoader);
 
-            return values;
+            return std::vector<uint64_t>(); // return empty vector
         }
 
-        cmdBuf.resetQueryPool(request.CompactionQueryPool, 0, blasCount);
+        auto values = GetQueryResults(request.CompactionQueries);
 
-        cmdBuf.writeAccelerationStructuresPropertiesKHR(request.SourceBLAS,
-                                                        vk::QueryType::eAccelerationStructureCompactedSizeKHR,
-                                                        request.CompactionQueryPool, 0, mDynLoader);
+        // Give the queries back to the allocator, we don't need them anymore
+        if (!values.empty())
+            FreeQueries(request.CompactionQueries);
 
-        return std::vector<uint64_t>(); // return empty vector
+        return values;
     }
 
     std::vector<BLASHandle> VulrayDevice::CompactBLAS(CompactionRequest& request, const std::vector<uint64_t>& sizes,
@@ -200,30 +251,12 @@ namespace vr
             if (sizes[i] == 0)
                 continue;
             // Create buffer
-            AllocatedBuffer compactBuffer =
-                CreateBuffer(sizes[i], vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR, 0);
-
-            // Create the compacted acceleration structure
-            auto createInfo = vk::AccelerationStructureCreateInfoKHR()
-                                  .setSize(sizes[i])
-                                  .setType(vk::AccelerationStructureTypeKHR::eBottomLevel)
-                                  .setBuffer(compactBuffer.Buffer);
-
-            auto compactAccel = mDevice.createAccelerationStructureKHR(createInfo, nullptr, mDynLoader);
-
-            auto copyInfo = vk::CopyAccelerationStructureInfoKHR()
-                                .setSrc(request.SourceBLAS[i])
-                                .setDst(compactAccel)
-                                .setMode(vk::CopyAccelerationStructureModeKHR::eCompact);
-
-            cmdBuf.copyAccelerationStructureKHR(copyInfo, mDynLoader);
+            ASArenaAllocation compactAllocation = {};
+            AllocatedBuffer compactBuffer = CreateASStorage(sizes[i], compactAllocation);
 
             // Set the new acceleration structure
-            newBLASToReturn[i].AccelerationStructure = compactAccel;
-            newBLASToReturn[i].Buffer = compactBuffer;
-            auto addressInfo = vk::AccelerationStructureDeviceAddressInfoKHR().setAccelerationStructure(
-                newBLASToReturn[i].AccelerationStructure);
-            newBLASToReturn[i].Buffer.DevAddress = mDevice.getAccelerationStructureAddressKHR(addressInfo, mDynLoader);
+            newBLASToReturn[i] =
+                RecordCompactionCopy(request.SourceBLAS[i], sizes[i], compactBuffer, compactAllocation, cmdBuf);
         }
         return newBLASToReturn;
     }
@@ -239,41 +272,145 @@ namespace vr
             if (sizes[i] == 0)
                 continue;
             // Create buffer
-            AllocatedBuffer compactBuffer =
-                CreateBuffer(sizes[i], vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR, 0);
-
-            // Create the compacted acceleration structure
-            auto createInfo = vk::AccelerationStructureCreateInfoKHR()
-                                  .setSize(sizes[i])
-                                  .setType(vk::AccelerationStructureTypeKHR::eBottomLevel)
-                                  .setBuffer(compactBuffer.Buffer);
-
-            auto compactAccel = mDevice.createAccelerationStructureKHR(createInfo, nullptr, mDynLoader);
-
-            auto copyInfo = vk::CopyAccelerationStructureInfoKHR()
-                                .setSrc(request.SourceBLAS[i])
-                                .setDst(compactAccel)
-                                .setMode(vk::CopyAccelerationStructureModeKHR::eCompact);
-
-            cmdBuf.copyAccelerationStructureKHR(copyInfo, mDynLoader);
-
-            // store the old acceleration structure
-            oldBLASToReturn[i].AccelerationStructure = oldBLAS[i]->AccelerationStructure;
-            oldBLASToReturn[i].Buffer = oldBLAS[i]->Buffer;
-            auto addressInfo = vk::AccelerationStructureDeviceAddressInfoKHR().setAccelerationStructure(
-                oldBLASToReturn[i].AccelerationStructure);
-            oldBLASToReturn[i].Buffer.DevAddress = mDevice.getAccelerationStructureAddressKHR(addressInfo, mDynLoader);
-
-            // replace
-            oldBLAS[i]->AccelerationStructure = compactAccel;
-            oldBLAS[i]->Buffer = compactBuffer;
+            ASArenaAllocation compactAllocation = {};
+            AllocatedBuffer compactBuffer = CreateASStorage(sizes[i], compactAllocation);
+
+            // store the old acceleration structure and replace it
+            oldBLASToReturn[i] = *oldBLAS[i];
+            *oldBLAS[i] =
+                RecordCompactionCopy(request.SourceBLAS[i], sizes[i], compactBuffer, compactAllocation, cmdBuf);
         }
         return oldBLASToReturn;
     }
 
+    std::vector<BLASHandle> VulrayDevice::CompactBLASPacked(CompactionRequest& request,
+                                                            const std::vector<uint64_t>& sizes,
+                                                            vk::CommandBuffer cmdBuf)
+    {
+        uint32_t blasCount = request.SourceBLAS.size();
+        std::vector<BLASHandle> newBLASToReturn(blasCount);
+
+        std::vector<ASArenaAllocation> compactAllocations;
+        auto compactBuffers = CreatePackedASStorage(sizes, compactAllocations);
+
+        for (uint32_t i = 0; i < blasCount; i++)
+        {
+            if (!compactAllocations[i].IsValid())
+                continue;
+
+            newBLASToReturn[i] = RecordCompactionCopy(request.SourceBLAS[i], sizes[i], compactBuffers[i],
+                                                      compactAllocations[i], cmdBuf);
+        }
+        return newBLASToReturn;
+    }
+
+    std::vector<BLASHandle> VulrayDevice::CompactBLASPacked(CompactionRequest& request,
+                                                            const std::vector<uint64_t>& sizes,
+                                                            std::vector<BLASHandle*> oldBLAS, vk::CommandBuffer cmdBuf)
+    {
+        uint32_t blasCount = request.SourceBLAS.size();
+        std::vector<BLASHandle> oldBLASToReturn(blasCount);
+
+        std::vector<ASArenaAllocation> compactAllocations;
+        auto compactBuffers = CreatePackedASStorage(sizes, compactAllocations);
+
+        for (uint32_t i = 0; i < blasCount; i++)
+        {
+            if (!compactAllocations[i].IsValid())
+                continue;
+
+            oldBLASToReturn[i] = *oldBLAS[i];
+            *oldBLAS[i] = RecordCompactionCopy(request.SourceBLAS[i], sizes[i], compactBuffers[i],
+                                               compactAllocations[i], cmdBuf);
+        }
+        return oldBLASToReturn;
+    }
+
+    BLASHandle VulrayDevice::RecordCompactionCopy(vk::AccelerationStructureKHR sourceBLAS, vk::DeviceSize size,
+                                                  const AllocatedBuffer& buffer, const ASArenaAllocation& allocation,
+                                                  vk::CommandBuffer cmdBuf)
+    {
+        BLASHandle outAccel = {};
+
+        // Create the compacted acceleration structure
+        auto createInfo = vk::AccelerationStructureCreateInfoKHR()
+                              .setSize(size)
+                              .setType(vk::AccelerationStructureTypeKHR::eBottomLevel)
+                              .setBuffer(buffer.Buffer)
+                              .setOffset(allocation.Offset);
+
+        outAccel.AccelerationStructure = mDevice.createAccelerationStructureKHR(createInfo, nullptr, mDynLoader);
+        outAccel.Buffer = buffer;
+        outAccel.ArenaAllocation = allocation;
+
+        auto copyInfo = vk::CopyAccelerationStructureInfoKHR()
+                            .setSrc(sourceBLAS)
+                            .setDst(outAccel.AccelerationStructure)
+                            .setMode(vk::CopyAccelerationStructureModeKHR::eCompact);
+
+        cmdBuf.copyAccelerationStructureKHR(copyInfo, mDynLoader);
+
+        auto addressInfo =
+            vk::AccelerationStructureDeviceAddressInfoKHR().setAccelerationStructure(outAccel.AccelerationStructure);
+        outAccel.Buffer.DevAddress = mDevice.getAccelerationStructureAddressKHR(addressInfo, mDynLoader);
+
+        return outAccel;
+    }
+
+    void VulrayDevice::SerializeBLAS(const BLASHandle& blas, const AllocatedBuffer& dst, vk::CommandBuffer cmdBuf)
+    {
+        auto copyInfo = vk::CopyAccelerationStructureToMemoryInfoKHR()
+                            .setSrc(blas.AccelerationStructure)
+                            .setDst(vk::DeviceOrHostAddressKHR().setDeviceAddress(dst.DevAddress))
+                            .setMode(vk::CopyAccelerationStructureModeKHR::eSerialize);
+
+        cmdBuf.copyAccelerationStructureToMemoryKHR(copyInfo, mDynLoader);
+    }
+
+    BLASHandle VulrayDevice::DeserializeBLAS(const AllocatedBuffer& src, vk::DeviceSize deserializedSize,
+                                             vk::CommandBuffer cmdBuf)
+    {
+        BLASHandle outAccel = {};
+        outAccel.Buffer = CreateASStorage(deserializedSize, outAccel.ArenaAllocation);
+
+        auto createInfo = vk::AccelerationStructureCreateInfoKHR()
+                              .setType(vk::AccelerationStructureTypeKHR::eBottomLevel)
+                              .setBuffer(outAccel.Buffer.Buffer)
+                              .setOffset(outAccel.ArenaAllocation.Offset)
+                              .setSize(deserializedSize);
+
+        outAccel.AccelerationStructure = mDevice.createAccelerationStructureKHR(createInfo, nullptr, mDynLoader);
+
+        outAccel.Buffer.DevAddress = mDevice.getAccelerationStructureAddressKHR(
+            vk::AccelerationStructureDeviceAddressInfoKHR().setAccelerationStructure(outAccel.AccelerationStructure),
+            mDynLoader);
+
+        auto copyInfo = vk::CopyMemoryToAccelerationStructureInfoKHR()
+                            .setSrc(vk::DeviceOrHostAddressConstKHR().setDeviceAddress(src.DevAddress))
+                            .setDst(outAccel.AccelerationStructure)
+                            .setMode(vk::CopyAccelerationStructureModeKHR::eDeserialize);
+
+        cmdBuf.copyMemoryToAccelerationStructureKHR(copyInfo, mDynLoader);
+
+        return outAccel;
+    }
+
+    bool VulrayDevice::IsSerializedASCompatible(const uint8_t* versionData)
+    {
+        auto versionInfo = vk::AccelerationStructureVersionInfoKHR().setPVersionData(versionData);
+
+        return mDevice.getAccelerationStructureCompatibilityKHR(versionInfo, mDynLoader) ==
+               vk::AccelerationStructureCompatibilityKHR::eCompatible;
+    }
+
     AllocatedBuffer VulrayDevice::CreateScratchBufferFromBuildInfos(std::vector<BLASBuildInfo>& buildInfos)
     {
-        uint32_t scratchSize = GetScratchBufferSize(buildInfos);
+        vk::DeviceSize scratchSize = GetScratchBufferSize(buildInfos);
+        if (scratchSize > mMaintenance4Properties.maxBufferSize)
+        {
+            VULRAY_LOG_ERROR("CreateScratchBufferFromBuildInfos: The scratch size is too big, no buffer was created");
+            return {};
+        }
 
         auto outScratchBuffer = CreateScratchBuffer(scratchSize);
 
@@ -284,9 +421,9 @@ namespace vr
 
     AllocatedBuffer VulrayDevice::CreateScratchBufferFromBuildInfo(BLASBuildInfo& buildInfo)
     {
-        uint32_t scratchSize = buildInfo.BuildGeometryInfo.mode == vk::BuildAccelerationStructureModeKHR::eBuild
-                                   ? buildInfo.BuildSizes.buildScratchSize
-                                   : buildInfo.BuildSizes.updateScratchSize;
+        vk::DeviceSize scratchSize = buildInfo.BuildGeometryInfo.mode == vk::BuildAccelerationStructureModeKHR::eBuild
+                                         ? buildInfo.BuildSizes.buildScratchSize
+                                         : buildInfo.BuildSizes.updateScratchSize;
 
         auto outScratchBuffer = CreateScratchBuffer(scratchSize);
 
@@ -301,21 +438,18 @@ namespace vr
             AlignUp(scratchAddr, (uint64_t)mAccelProperties.minAccelerationStructureScratchOffsetAlignment));
     }
 
-    uint32_t VulrayDevice::GetScratchBufferSize(const std::vector<BLASBuildInfo>& buildInfos)
+    vk::DeviceSize VulrayDevice::GetScratchBufferSize(const std::vector<BLASBuildInfo>& buildInfos)
     {
-        uint32_t scratchSize = 0;
-        for (auto& info : buildInfos)
+        vk::DeviceSize scratchSize =
+            vr::GetScratchBufferSize(buildInfos, mAccelProperties.minAccelerationStructureScratchOffsetAlignment);
+
+        if (scratchSize > mMaintenance4Properties.maxBufferSize)
         {
-            vk::BuildAccelerationStructureModeKHR mode = info.BuildGeometryInfo.mode;
-            if (mode == vk::BuildAccelerationStructureModeKHR::eBuild)
-                scratchSize += AlignUp(info.BuildSizes.buildScratchSize,
-                                       (uint64_t)mAccelProperties.minAccelerationStructureScratchOffsetAlignment);
-            else
-                scratchSize += AlignUp(info.BuildSizes.updateScratchSize,
-                                       (uint64_t)mAccelProperties.minAccelerationStructureScratchOffsetAlignment);
+            VULRAY_FLOG_ERROR("GetScratchBufferSize: Scratch size of %llu bytes is bigger than the max buffer size of "
+                              "%llu bytes, split the builds with ScheduleBLASBuilds(...)",
+                              (unsigned long long)scratchSize,
+                              (unsigned long long)mMaintenance4Properties.maxBufferSize);
         }
-
-        // Mode
         return scratchSize;
     }
 
@@ -325,14 +459,9 @@ namespace vr
         vk::DeviceAddress scratchDataAddr = buffer.DevAddress;
         for (auto& info : buildInfos)
         {
-            vk::BuildAccelerationStructureModeKHR mode = info.BuildGeometryInfo.mode;
             BindScratchAdressToBuildInfo(scratchDataAddr, info);
-            if (mode == vk::BuildAccelerationStructureModeKHR::eBuild)
-                scratchDataAddr += AlignUp(info.BuildSizes.buildScratchSize,
-                                           (uint64_t)mAccelProperties.minAccelerationStructureScratchOffsetAlignment);
-            else
-                scratchDataAddr += AlignUp(info.BuildSizes.updateScratchSize,
-                                           (uint64_t)mAccelProperties.minAccelerationStructureScratchOffsetAlignment);
+            scratchDataAddr += GetAlignedScratchSize(info.BuildGeometryInfo, info.BuildSizes,
+                                                     mAccelProperties.minAccelerationStructureScratchOffsetAlignment);
         }
     }
 
@@ -374,21 +503,100 @@ namespace vr
                 .setFirstVertex(0)
                 .setTransformOffset(0);
 
+        // Create the acceleration structure big enough for MaxInstanceCount instances
+        CreateTLASStorage(info.MaxInstanceCount, outAccel, outBuildInfo);
+
+        return std::make_pair(outAccel, outBuildInfo);
+    }
+
+    void VulrayDevice::BuildTLAS(TLASBuildInfo& buildInfo, const AllocatedBuffer& InstanceBuffer,
+                                 uint32_t instanceCount, vk::CommandBuffer cmdBuf)
+    {
+
+        buildInfo.RangeInfo.primitiveCount = instanceCount;
+
+        buildInfo.Geometry->geometry.instances.data = InstanceBuffer.DevAddress;
+
+        auto* pBuildRangeInfo = &buildInfo.RangeInfo;
+
+        // Build the acceleration structure
+        cmdBuf.buildAccelerationStructuresKHR(1, &buildInfo.BuildGeometryInfo, &pBuildRangeInfo, mDynLoader);
+    }
+
+    TLASHandle VulrayDevice::UpdateTLAS(TLASHandle& tlas, TLASBuildInfo& buildInfo, uint32_t instanceCount,
+                                        TLASUpdateMode mode)
+    {
+        TLASHandle retiredTLAS = {};
+
+        // Grow geometrically, so a slowly growing scene doesn't reallocate every frame
+        if (instanceCount > buildInfo.MaxInstanceCount)
+        {
+            retiredTLAS = tlas;
+
+            uint32_t newMaxInstanceCount = (uint32_t)std::min<uint64_t>(
+                std::max<uint64_t>(instanceCount, (uint64_t)buildInfo.MaxInstanceCount * 2), UINT32_MAX);
+
+            buildInfo.BuildGeometryInfo.setMode(vk::BuildAccelerationStructureModeKHR::eBuild)
+                .setSrcAccelerationStructure(nullptr);
+
+            CreateTLASStorage(newMaxInstanceCount, tlas, buildInfo);
+            return retiredTLAS;
+        }
+
+        if (mode == TLASUpdateMode::Refit)
+        {
+            if (!(buildInfo.BuildGeometryInfo.flags & vk::BuildAccelerationStructureFlagBitsKHR::eAllowUpdate))
+            {
+                VULRAY_LOG_WARNING("UpdateTLAS: TLAS was not created with eAllowUpdate, rebuilding instead");
+                mode = TLASUpdateMode::Rebuild;
+            }
+            // An update must use the same number of instances as the build it updates
+            else if (instanceCount != buildInfo.RangeInfo.primitiveCount)
+                mode = TLASUpdateMode::Rebuild;
+        }
+
+        switch (mode)
+        {
+        case TLASUpdateMode::Refit:
+            buildInfo.BuildGeometryInfo.setMode(vk::BuildAccelerationStructureModeKHR::eUpdate)
+                .setSrcAccelerationStructure(tlas.AccelerationStructure);
+            break;
+        case TLASUpdateMode::Rebuild:
+            buildInfo.BuildGeometryInfo.setMode(vk::BuildAccelerationStructureModeKHR::eBuild)
+                .setSrcAccelerationStructure(nullptr);
+            break;
+        case TLASUpdateMode::Recreate:
+        {
+            auto [newTLAS, newBuildInfo] = UpdateTLAS(tlas, buildInfo, false);
+            retiredTLAS.AccelerationStructure = tlas.AccelerationStructure;
+            tlas = newTLAS;
+            buildInfo = newBuildInfo;
+            buildInfo.BuildGeometryInfo.setMode(vk::BuildAccelerationStructureModeKHR::eBuild)
+                .setSrcAccelerationStructure(nullptr);
+            break;
+        }
+        }
+
+        return retiredTLAS;
+    }
+
+    void VulrayDevice::CreateTLASStorage(uint32_t maxInstanceCount, TLASHandle& outAccel, TLASBuildInfo& buildInfo)
+    {
         // Get the size requirements for the acceleration structure
-        mDevice.getAccelerationStructureBuildSizesKHR(
-            vk::AccelerationStructureBuildTypeKHR::eDevice, &outBuildInfo.BuildGeometryInfo,
-            &info.MaxInstanceCount, // max number of instances/primitives in the geometry
-            &outBuildInfo.BuildSizes, mDynLoader);
+        mDevice.getAccelerationStructureBuildSizesKHR(vk::AccelerationStructureBuildTypeKHR::eDevice,
+                                                      &buildInfo.BuildGeometryInfo,
+                                                      &maxInstanceCount, // max number of instances in the geometry
+                                                      &buildInfo.BuildSizes, mDynLoader);
 
         // Create the buffer for the acceleration structure
-        outAccel.Buffer = CreateBuffer(outBuildInfo.BuildSizes.accelerationStructureSize,
+        outAccel.Buffer = CreateBuffer(buildInfo.BuildSizes.accelerationStructureSize,
                                        vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR, 0);
 
         // Create the acceleration structure
         auto createInfo = vk::AccelerationStructureCreateInfoKHR()
                               .setType(vk::AccelerationStructureTypeKHR::eTopLevel)
                               .setBuffer(outAccel.Buffer.Buffer)
-                              .setSize(outBuildInfo.BuildSizes.accelerationStructureSize);
+                              .setSize(buildInfo.BuildSizes.accelerationStructureSize);
 
         outAccel.AccelerationStructure = mDevice.createAccelerationStructureKHR(createInfo, nullptr, mDynLoader);
 
@@ -397,26 +605,9 @@ namespace vr
             mDynLoader);
 
         // Fill in the build info with the acceleration structure
+        buildInfo.BuildGeometryInfo.setDstAccelerationStructure(outAccel.AccelerationStructure);
 
-        outBuildInfo.BuildGeometryInfo.setDstAccelerationStructure(outAccel.AccelerationStructure);
-
-        outBuildInfo.MaxInstanceCount = info.MaxInstanceCount;
-
-        return std::make_pair(outAccel, outBuildInfo);
-    }
-
-    void VulrayDevice::BuildTLAS(TLASBuildInfo& buildInfo, const AllocatedBuffer& InstanceBuffer,
-                                 uint32_t instanceCount, vk::CommandBuffer cmdBuf)
-    {
-
-        buildInfo.RangeInfo.primitiveCount = instanceCount;
-
-        buildInfo.Geometry->geometry.instances.data = InstanceBuffer.DevAddress;
-
-        auto* pBuildRangeInfo = &buildInfo.RangeInfo;
-
-        // Build the acceleration structure
-        cmdBuf.buildAccelerationStructuresKHR(1, &buildInfo.BuildGeometryInfo, &pBuildRangeInfo, mDynLoader);
+        buildInfo.MaxInstanceCount = maxInstanceCount;
     }
 
     std::pair<TLASHandle, TLASBuildInfo> VulrayDevice::UpdateTLAS(TLASHandle& oldTLAS, TLASBuildInfo& oldBuildInfo,
@@ -461,36 +652,35 @@ namespace vr
         vk::DeviceAddress scratchDataAddr = buffer.DevAddress;
         for (auto& info : buildInfos)
         {
-            vk::BuildAccelerationStructureModeKHR mode = info.BuildGeometryInfo.mode;
             BindScratchAdressToBuildInfo(scratchDataAddr, info);
-            if (mode == vk::BuildAccelerationStructureModeKHR::eBuild)
-                scratchDataAddr += AlignUp(info.BuildSizes.buildScratchSize,
-                                           (uint64_t)mAccelProperties.minAccelerationStructureScratchOffsetAlignment);
-            else
-                scratchDataAddr += AlignUp(info.BuildSizes.updateScratchSize,
-                                           (uint64_t)mAccelProperties.minAccelerationStructureScratchOffsetAlignment);
+            scratchDataAddr += GetAlignedScratchSize(info.BuildGeometryInfo, info.BuildSizes,
+                                                     mAccelProperties.minAccelerationStructureScratchOffsetAlignment);
         }
     }
 
-    uint32_t VulrayDevice::GetScratchBufferSize(const std::vector<TLASBuildInfo>& buildInfos)
+    vk::DeviceSize VulrayDevice::GetScratchBufferSize(const std::vector<TLASBuildInfo>& buildInfos)
     {
-        uint32_t scratchSize = 0;
-        for (auto& info : buildInfos)
+        vk::DeviceSize scratchSize =
+            vr::GetScratchBufferSize(buildInfos, mAccelProperties.minAccelerationStructureScratchOffsetAlignment);
+
+        if (scratchSize > mMaintenance4Properties.maxBufferSize)
         {
-            vk::BuildAccelerationStructureModeKHR mode = info.BuildGeometryInfo.mode;
-            if (mode == vk::BuildAccelerationStructureModeKHR::eBuild)
-                scratchSize += AlignUp(info.BuildSizes.buildScratchSize,
-                                       (uint64_t)mAccelProperties.minAccelerationStructureScratchOffsetAlignment);
-            else
-                scratchSize += AlignUp(info.BuildSizes.updateScratchSize,
-                                       (uint64_t)mAccelProperties.minAccelerationStructureScratchOffsetAlignment);
+            VULRAY_FLOG_ERROR("GetScratchBufferSize: Scratch size of %llu bytes is bigger than the max buffer size of "
+                              "%llu bytes",
+                              (unsigned long long)scratchSize,
+                              (unsigned long long)mMaintenance4Properties.maxBufferSize);
         }
         return scratchSize;
     }
 
     AllocatedBuffer VulrayDevice::CreateScratchBufferFromBuildInfos(std::vector<TLASBuildInfo>& buildInfos)
     {
-        uint32_t scratchSize = GetScratchBufferSize(buildInfos);
+        vk::DeviceSize scratchSize = GetScratchBufferSize(buildInfos);
+        if (scratchSize > mMaintenance4Properties.maxBufferSize)
+        {
+            VULRAY_LOG_ERROR("CreateScratchBufferFromBuildInfos: The scratch size is too big, no buffer was created");
+            return {};
+        }
 
         auto outScratchBuffer = CreateScratchBuffer(scratchSize);
 
@@ -501,9 +691,9 @@ namespace vr
 
     AllocatedBuffer VulrayDevice::CreateScratchBufferFromBuildInfo(TLASBuildInfo& buildInfo)
     {
-        uint32_t scratchSize = buildInfo.BuildGeometryInfo.mode == vk::BuildAccelerationStructureModeKHR::eBuild
-                                   ? buildInfo.BuildSizes.buildScratchSize
-                                   : buildInfo.BuildSizes.updateScratchSize;
+        vk::DeviceSize scratchSize = buildInfo.BuildGeometryInfo.mode == vk::BuildAccelerationStructureModeKHR::eBuild
+                                         ? buildInfo.BuildSizes.buildScratchSize
+                                         : buildInfo.BuildSizes.updateScratchSize;
 
         auto outScratchBuffer = CreateScratchBuffer(scratchSize);
 
@@ -514,10 +704,12 @@ namespace vr
 
     void VulrayDevice::AddAccelerationBuildBarrier(vk::CommandBuffer cmdBuf)
     {
-        // accel build barrier for for next build
+        // accel build barrier for for next build, the write access is needed when the next build reuses the scratch
+        // memory of the previous build
         auto barrier = vk::MemoryBarrier()
                            .setSrcAccessMask(vk::AccessFlagBits::eAccelerationStructureWriteKHR)
-                           .setDstAccessMask(vk::AccessFlagBits::eAccelerationStructureReadKHR);
+                           .setDstAccessMask(vk::AccessFlagBits::eAccelerationStructureReadKHR |
+                                             vk::AccessFlagBits::eAccelerationStructureWriteKHR);
 
         cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
                                vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR, (vk::DependencyFlagBits)0, 1,
@@ -529,14 +721,14 @@ namespace vr
         for (auto& b : blas)
         {
             mDevice.destroyAccelerationStructureKHR(b.AccelerationStructure, nullptr, mDynLoader);
-            DestroyBuffer(b.Buffer);
+            DestroyASStorage(b.Buffer, b.ArenaAllocation);
         }
     }
 
     void VulrayDevice::DestroyBLAS(BLASHandle& blas)
     {
         mDevice.destroyAccelerationStructureKHR(blas.AccelerationStructure, nullptr, mDynLoader);
-        DestroyBuffer(blas.Buffer);
+        DestroyASStorage(blas.Buffer, blas.ArenaAllocation);
     }
 
     void VulrayDevice::DestroyTLAS(TLASHandle& tlas)
@@ -550,6 +742,76 @@ namespace vr
         mDevice.destroyAccelerationStructureKHR(accel, nullptr, mDynLoader);
     }
 
+    bool CheckedAdd(vk::DeviceSize a, vk::DeviceSize b, vk::DeviceSize& outSum)
+    {
+        if (a > std::numeric_limits<vk::DeviceSize>::max() - b)
+        {
+            outSum = std::numeric_limits<vk::DeviceSize>::max();
+            return false;
+        }
+        outSum = a + b;
+        return true;
+    }
+
+    vk::DeviceSize GetAlignedScratchSize(const vk::AccelerationStructureBuildGeometryInfoKHR& buildGeometryInfo,
+                                         const vk::AccelerationStructureBuildSizesInfoKHR& buildSizes,
+                                         vk::DeviceSize scratchAlignment)
+    {
+        vk::DeviceSize scratchSize = buildGeometryInfo.mode == vk::BuildAccelerationStructureModeKHR::eBuild
+                                         ? buildSizes.buildScratchSize
+                                         : buildSizes.updateScratchSize;
+
+        // Make sure aligning up doesn't wrap around
+        vk::DeviceSize paddedSize = 0;
+        if (!CheckedAdd(scratchSize, scratchAlignment - 1, paddedSize))
+            return paddedSize;
+
+        return AlignUp(scratchSize, (uint64_t)scratchAlignment);
+    }
+
+    BLASBuildSchedule ScheduleBLASBuilds(const std::vector<BLASBuildInfo>& buildInfos, vk::DeviceSize scratchBudget,
+                                         vk::DeviceSize scratchAlignment)
+    {
+        BLASBuildSchedule outSchedule = {};
+
+        BLASBuildBatch currentBatch = {};
+
+        for (uint32_t i = 0; i < buildInfos.size(); i++)
+        {
+            vk::DeviceSize scratchSize =
+                GetAlignedScratchSize(buildInfos[i].BuildGeometryInfo, buildInfos[i].BuildSizes, scratchAlignment);
+
+            // Close the current batch if the build info doesn't fit in the budget anymore
+            vk::DeviceSize batchSize = 0;
+            bool fits = CheckedAdd(currentBatch.ScratchSize, scratchSize, batchSize) && batchSize <= scratchBudget;
+            if (currentBatch.BuildInfoCount > 0 && !fits)
+            {
+                outSchedule.ScratchSize = std::max(outSchedule.ScratchSize, currentBatch.ScratchSize);
+                outSchedule.Batches.push_back(currentBatch);
+                currentBatch = BLASBuildBatch();
+                currentBatch.FirstBuildInfo = i;
+            }
+
+            if (scratchSize > scratchBudget)
+            {
+                VULRAY_FLOG_WARNING("ScheduleBLASBuilds: Build info %u needs %llu bytes of scratch memory, which is "
+                                    "more than the budget of %llu bytes",
+                                    i, (unsigned long long)scratchSize, (unsigned long long)scratchBudget);
+            }
+
+            currentBatch.ScratchSize += scratchSize;
+            currentBatch.BuildInfoCount++;
+        }
+
+        if (currentBatch.BuildInfoCount > 0)
+        {
+            outSchedule.ScratchSize = std::max(outSchedule.ScratchSize, currentBatch.ScratchSize);
+            outSchedule.Batches.push_back(currentBatch);
+        }
+
+        return outSchedule;
+    }
+
     vk::AccelerationStructureGeometryDataKHR ConvertToVulkanGeometry(const GeometryData& geom)
     {
         vk::AccelerationStructureGeometryDataKHR outGeom = {};
@@ -562,7 +824,9 @@ namespace vr
                                             .setVertexFormat(geom.VertexFormat)
                                             .setVertexData(geom.DataAddresses.VertexDevAddress)
                                             .setVertexStride(geom.Stride)
-                                            .setMaxVertex(geom.PrimitiveCount * 3) // 3 vertices per triangle
+                                            // Without the exact value, assume 3 unique vertices per triangle
+                                            .setMaxVertex(geom.MaxVertex ? geom.MaxVertex
+                                                                         : geom.FirstVertex + geom.PrimitiveCount * 3)
                                             .setIndexType(geom.IndexFormat)
                                             .setIndexData(geom.DataAddresses.IndexDevAddress)
                                             .setTransformData(geom.DataAddresses.TransformDevAddress));
@@ -0,0 +1,117 @@
+#include "Vulray/BLASPartitioner.h"
+
+#include "Vulray/VulrayDevice.h"
+
+namespace vr
+{
+
+    static uint32_t GetIndexSize(vk::IndexType indexType)
+    {
+        switch (indexType)
+        {
+        case vk::IndexType::eUint16: return 2;
+        case vk::IndexType::eUint32: return 4;
+        case vk::IndexType::eUint8EXT: return 1;
+        default: return 0; // not indexed
+        }
+    }
+
+    // Returns the geometry of the primitives [first, first + count) of the mesh
+    static GeometryData GetGeometryRange(const GeometryData& geom, uint32_t first, uint32_t count)
+    {
+        GeometryData outGeom = geom;
+        outGeom.PrimitiveCount = count;
+
+        if (geom.Type == vk::GeometryTypeKHR::eAabbs)
+        {
+            outGeom.DataAddresses.AABBDevAddress += (vk::DeviceSize)first * geom.Stride;
+            if (geom.HostData.VertexOrAABBData)
+                outGeom.HostData.VertexOrAABBData =
+                    (const uint8_t*)geom.HostData.VertexOrAABBData + (size_t)first * geom.Stride;
+            return outGeom;
+        }
+
+        const uint32_t indexSize = GetIndexSize(geom.IndexFormat);
+        if (indexSize != 0)
+        {
+            // The vertices stay the same, so MaxVertex of the mesh is still valid
+            outGeom.DataAddresses.IndexDevAddress += (vk::DeviceSize)first * 3 * indexSize;
+            if (geom.HostData.IndexData)
+                outGeom.HostData.IndexData = (const uint8_t*)geom.HostData.IndexData + (size_t)first * 3 * indexSize;
+        }
+        else
+        {
+            outGeom.DataAddresses.VertexDevAddress += (vk::DeviceSize)first * 3 * geom.Stride;
+            if (geom.HostData.VertexOrAABBData)
+                outGeom.HostData.VertexOrAABBData =
+                    (const uint8_t*)geom.HostData.VertexOrAABBData + (size_t)first * 3 * geom.Stride;
+            outGeom.MaxVertex = geom.FirstVertex + count * 3 - 1;
+        }
+        return outGeom;
+    }
+
+    BLASPartition PartitionBLAS(const std::vector<MeshPartitionInput>& meshes, const BLASPartitionSettings& settings)
+    {
+        BLASPartition outPartition = {};
+        outPartition.MeshParts.resize(meshes.size());
+
+        auto addBLAS = [&]()
+        {
+            BLASCreateInfo info = {};
+            info.Flags = settings.Flags;
+            outPartition.BLASInfos.push_back(info);
+            return (uint32_t)outPartition.BLASInfos.size() - 1;
+        };
+
+        // BLAS that currently receives merged meshes, per geometry type because a BLAS can only hold one type
+        uint32_t mergeBLAS[2] = {~0U, ~0U};
+        uint32_t mergePrimitives[2] = {0, 0};
+
+        const uint32_t chunkPrimitives = std::max(settings.ChunkPrimitives, 1u);
+
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            const auto& geom = meshes[i].Geometry;
+            auto& parts = outPartition.MeshParts[i];
+
+            if (meshes[i].AllowMerge && geom.PrimitiveCount <= settings.MergeThreshold)
+            {
+                const uint32_t typeSlot = geom.Type == vk::GeometryTypeKHR::eAabbs ? 1 : 0;
+                uint32_t& blasIndex = mergeBLAS[typeSlot];
+
+                if (blasIndex == ~0U ||
+                    mergePrimitives[typeSlot] + geom.PrimitiveCount > settings.MaxMergedPrimitives ||
+                    outPartition.BLASInfos[blasIndex].Geometries.size() >= settings.MaxMergedGeometries)
+                {
+                    blasIndex = addBLAS();
+                    mergePrimitives[typeSlot] = 0;
+                }
+
+                auto& geometries = outPartition.BLASInfos[blasIndex].Geometries;
+                parts.push_back({blasIndex, (uint32_t)geometries.size(), 0, geom.PrimitiveCount});
+                geometries.push_back(geom);
+                mergePrimitives[typeSlot] += geom.PrimitiveCount;
+            }
+            else if (geom.PrimitiveCount > settings.SplitThreshold)
+            {
+                for (uint32_t first = 0; first < geom.PrimitiveCount; first += chunkPrimitives)
+                {
+                    const uint32_t count = std::min(chunkPrimitives, geom.PrimitiveCount - first);
+                    const uint32_t blasIndex = addBLAS();
+
+                    outPartition.BLASInfos[blasIndex].Geometries.push_back(GetGeometryRange(geom, first, count));
+                    parts.push_back({blasIndex, 0, first, count});
+                }
+            }
+            else
+            {
+                const uint32_t blasIndex = addBLAS();
+                outPartition.BLASInfos[blasIndex].Geometries.push_back(geom);
+                parts.push_back({blasIndex, 0, 0, geom.PrimitiveCount});
+            }
+        }
+
+        return outPartition;
+    }
+
+} // namespace vr
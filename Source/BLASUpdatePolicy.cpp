@@ -0,0 +1,148 @@
+#include "Vulray/BLASUpdatePolicy.h"
+
+#include "Vulray/VulrayDevice.h"
+
+namespace vr
+{
+
+    static uint64_t GetPrimitiveCount(const BLASBuildInfo& buildInfo)
+    {
+        uint64_t outPrimitives = 0;
+        for (uint32_t g = 0; g < buildInfo.RangesCount; g++) outPrimitives += buildInfo.Ranges[g].primitiveCount;
+        return outPrimitives;
+    }
+
+    BLASUpdatePolicy::BLASUpdatePolicy(const BLASUpdatePolicySettings& settings) : Settings(settings) {}
+
+    std::vector<BLASUpdateDecision> BLASUpdatePolicy::Decide(const std::vector<BLASUpdateRequest>& requests)
+    {
+        std::vector<BLASUpdateDecision> outDecisions(requests.size(), BLASUpdateDecision::Refit);
+        mFrameStats = {};
+
+        struct Candidate
+        {
+            uint32_t RequestIndex;
+            float Urgency;
+            bool ByRefitCount;
+        };
+        std::vector<Candidate> candidates;
+
+        uint32_t rebuilds = 0;
+        uint64_t rebuildPrimitives = 0;
+
+        for (uint32_t i = 0; i < requests.size(); i++)
+        {
+            const auto& request = requests[i];
+            if (!request.UpdateInfo || !request.UpdateInfo->SourceBLAS)
+            {
+                VULRAY_LOG_ERROR("BLASUpdatePolicy: Update request without a source BLAS");
+                continue;
+            }
+
+            // Refitting a BLAS that wasn't built with eAllowUpdate is invalid usage, so it can only be rebuilt. These
+            // rebuilds are never deferred, but they use up the frame budget
+            const auto& sourceBuildInfo = request.UpdateInfo->SourceBuildInfo;
+            if (!(sourceBuildInfo.BuildGeometryInfo.flags & vk::BuildAccelerationStructureFlagBitsKHR::eAllowUpdate))
+            {
+                outDecisions[i] = BLASUpdateDecision::Rebuild;
+                rebuilds++;
+                rebuildPrimitives += GetPrimitiveCount(sourceBuildInfo);
+                mFrameStats.RebuildsWithoutAllowUpdate++;
+                continue;
+            }
+
+            auto& state = mStates[request.UpdateInfo->SourceBLAS->AccelerationStructure];
+            state.Deformation += std::max(request.Deformation, 0.0f);
+
+            // How far the BLAS is past its limits, 1 means it just reached one of them
+            const float refitRatio = Settings.MaxRefits > 0 ? (float)state.RefitCount / Settings.MaxRefits : 0.0f;
+            const float deformRatio =
+                Settings.DeformationThreshold > 0.0f ? state.Deformation / Settings.DeformationThreshold : 0.0f;
+
+            if (refitRatio >= 1.0f || deformRatio >= 1.0f)
+                candidates.push_back({i, std::max(refitRatio, deformRatio), refitRatio >= deformRatio});
+        }
+
+        // The most degraded BLASes get the budget first
+        std::stable_sort(candidates.begin(), candidates.end(),
+                         [](const Candidate& a, const Candidate& b) { return a.Urgency > b.Urgency; });
+
+        for (const auto& candidate : candidates)
+        {
+            const uint64_t primitives = GetPrimitiveCount(requests[candidate.RequestIndex].UpdateInfo->SourceBuildInfo);
+
+            // The first rebuild is always granted, so a single huge BLAS can't be deferred forever
+            const bool overCount = Settings.MaxRebuildsPerFrame > 0 && rebuilds >= Settings.MaxRebuildsPerFrame;
+            const bool overPrimitives = Settings.MaxRebuildPrimitivesPerFrame > 0 && rebuilds > 0 &&
+                                        rebuildPrimitives + primitives > Settings.MaxRebuildPrimitivesPerFrame;
+            if (overCount || overPrimitives)
+            {
+                mFrameStats.DeferredRebuilds++;
+                continue;
+            }
+
+            outDecisions[candidate.RequestIndex] = BLASUpdateDecision::Rebuild;
+            rebuilds++;
+            rebuildPrimitives += primitives;
+
+            if (candidate.ByRefitCount)
+                mFrameStats.RebuildsByRefitCount++;
+            else
+                mFrameStats.RebuildsByDeformation++;
+        }
+
+        for (uint32_t i = 0; i < requests.size(); i++)
+        {
+            if (!requests[i].UpdateInfo || !requests[i].UpdateInfo->SourceBLAS)
+                continue;
+
+            auto& state = mStates[requests[i].UpdateInfo->SourceBLAS->AccelerationStructure];
+            if (outDecisions[i] == BLASUpdateDecision::Rebuild)
+            {
+                state = {};
+                mFrameStats.Rebuilds++;
+            }
+            else
+            {
+                state.RefitCount++;
+                mFrameStats.Refits++;
+            }
+        }
+
+        mTotalStats.Refits += mFrameStats.Refits;
+        mTotalStats.Rebuilds += mFrameStats.Rebuilds;
+        mTotalStats.RebuildsByRefitCount += mFrameStats.RebuildsByRefitCount;
+        mTotalStats.RebuildsByDeformation += mFrameStats.RebuildsByDeformation;
+        mTotalStats.DeferredRebuilds += mFrameStats.DeferredRebuilds;
+        mTotalStats.RebuildsWithoutAllowUpdate += mFrameStats.RebuildsWithoutAllowUpdate;
+
+        return outDecisions;
+    }
+
+    std::vector<BLASBuildInfo> BLASUpdatePolicy::PrepareUpdates(vr::VulrayDevice* device,
+                                                                 const std::vector<BLASUpdateRequest>& requests)
+    {
+        auto decisions = Decide(requests);
+
+        std::vector<BLASBuildInfo> outBuildInfos(requests.size());
+        for (uint32_t i = 0; i < requests.size(); i++)
+        {
+            if (!requests[i].UpdateInfo || !requests[i].UpdateInfo->SourceBLAS)
+                continue;
+
+            outBuildInfos[i] = device->UpdateBLAS(*requests[i].UpdateInfo);
+
+            if (decisions[i] == BLASUpdateDecision::Rebuild)
+            {
+                // Build from scratch into the same acceleration structure, the geometry counts didn't change, so
+                // the existing storage is big enough
+                outBuildInfos[i].BuildGeometryInfo.setMode(vk::BuildAccelerationStructureModeKHR::eBuild);
+                outBuildInfos[i].BuildGeometryInfo.setSrcAccelerationStructure(nullptr);
+            }
+        }
+        return outBuildInfos;
+    }
+
+    void BLASUpdatePolicy::Forget(const BLASHandle& blas) { mStates.erase(blas.AccelerationStructure); }
+
+} // namespace vr
@@ -69,12 +69,12 @@ namespace vr
 
     AllocatedBuffer VulrayDevice::CreateInstanceBuffer(uint32_t instanceCount)
     {
-        return CreateBuffer(instanceCount * sizeof(vk::AccelerationStructureInstanceKHR),
+        return CreateBuffer((vk::DeviceSize)instanceCount * sizeof(vk::AccelerationStructureInstanceKHR),
                             vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR,
                             VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
     }
 
-    AllocatedBuffer VulrayDevice::CreateScratchBuffer(uint32_t size)
+    AllocatedBuffer VulrayDevice::CreateScratchBuffer(vk::DeviceSize size)
     {
         return CreateBuffer(size, vk::BufferUsageFlagBits::eStorageBuffer, 0,
                             mAccelProperties.minAccelerationStructureScratchOffsetAlignment);
@@ -128,7 +128,8 @@ namespace vr
         img.Allocation = nullptr;
     }
 
-    void VulrayDevice::UpdateBuffer(AllocatedBuffer alloc, void* data, const vk::DeviceSize size, uint32_t offset)
+    void VulrayDevice::UpdateBuffer(AllocatedBuffer alloc, void* data, const vk::DeviceSize size,
+                                    vk::DeviceSize offset)
     {
         void* mappedData;
         vmaMapMemory(mVMAllocator, alloc.Allocation, &mappedData);
@@ -0,0 +1,374 @@
+#include "Vulray/CPUBackend/BLASAdvisor.h"
+
+#include "Vulray/CPUBackend/CPUAccelStruct.h"
+#include "Vulray/ThreadPool.h"
+
+namespace vr
+{
+    // Number of primitives a thread measures at least
+    static constexpr uint32_t MinPrimitivesPerRange = 4096;
+
+    // Bins of the BVH that estimates the quality of a fast build
+    static constexpr uint32_t FastBuildBinCount = 4;
+
+    static float HalfArea(const CPUBVHBounds& bounds)
+    {
+        const float dx = bounds.Max[0] - bounds.Min[0];
+        const float dy = bounds.Max[1] - bounds.Min[1];
+        const float dz = bounds.Max[2] - bounds.Min[2];
+        if (dx < 0.0f || dy < 0.0f || dz < 0.0f)
+            return 0.0f;
+        return dx * dy + dy * dz + dz * dx;
+    }
+
+    // Bounds of the child slot c of a node
+    static CPUBVHBounds GetChildBounds(const CPUBVHNode& node, uint32_t c)
+    {
+        CPUBVHBounds outBounds = {};
+        outBounds.Min[0] = node.MinX[c];
+        outBounds.Min[1] = node.MinY[c];
+        outBounds.Min[2] = node.MinZ[c];
+        outBounds.Max[0] = node.MaxX[c];
+        outBounds.Max[1] = node.MaxY[c];
+        outBounds.Max[2] = node.MaxZ[c];
+        return outBounds;
+    }
+
+    static float ComputeOverlapScore(const CPUBVH& bvh)
+    {
+        double overlapArea = 0.0;
+        double childArea = 0.0;
+        for (const auto& node : bvh.GetNodes())
+        {
+            for (uint32_t a = 0; a < 4; a++)
+            {
+                if (node.Children[a] == ~0U)
+                    continue;
+
+                const CPUBVHBounds boundsA = GetChildBounds(node, a);
+                childArea += HalfArea(boundsA);
+
+                for (uint32_t b = a + 1; b < 4; b++)
+                {
+                    if (node.Children[b] == ~0U)
+                        continue;
+
+                    const CPUBVHBounds boundsB = GetChildBounds(node, b);
+                    CPUBVHBounds overlap = {};
+                    for (uint32_t axis = 0; axis < 3; axis++)
+                    {
+                        overlap.Min[axis] = std::max(boundsA.Min[axis], boundsB.Min[axis]);
+                        overlap.Max[axis] = std::min(boundsA.Max[axis], boundsB.Max[axis]);
+                    }
+                    overlapArea += HalfArea(overlap);
+                }
+            }
+        }
+        return childArea > 0.0 ? (float)(overlapArea / childArea) : 0.0f;
+    }
+
+    // Reorders the values to find the median and the 90th percentile
+    static BLASAdvisorDistribution ComputeDistribution(std::vector<float>& values)
+    {
+        BLASAdvisorDistribution outDist = {};
+        if (values.empty())
+            return outDist;
+
+        double sum = 0.0;
+        double sumSquares = 0.0;
+        outDist.Min = FLT_MAX;
+        outDist.Max = -FLT_MAX;
+        for (const float value : values)
+        {
+            sum += value;
+            sumSquares += (double)value * value;
+            outDist.Min = std::min(outDist.Min, value);
+            outDist.Max = std::max(outDist.Max, value);
+        }
+
+        const double mean = sum / values.size();
+        const double variance = std::max(sumSquares / values.size() - mean * mean, 0.0);
+        outDist.Mean = (float)mean;
+        outDist.CoefficientOfVariation = mean > 0.0 ? (float)(std::sqrt(variance) / mean) : 0.0f;
+
+        auto median = values.begin() + values.size() / 2;
+        std::nth_element(values.begin(), median, values.end());
+        outDist.Median = *median;
+
+        auto percentile90 = values.begin() + std::min(values.size() * 9 / 10, values.size() - 1);
+        std::nth_element(median, percentile90, values.end());
+        outDist.Percentile90 = *percentile90;
+
+        return outDist;
+    }
+
+    // Area and aspect ratio of a primitive, the aspect ratio is 0 for degenerate primitives
+    static void MeasureTriangle(const float v[3][3], float& outArea, float& outAspectRatio)
+    {
+        float edges[3][3];
+        float longestSq = 0.0f;
+        for (uint32_t e = 0; e < 3; e++)
+        {
+            for (uint32_t a = 0; a < 3; a++) edges[e][a] = v[(e + 1) % 3][a] - v[e][a];
+            longestSq = std::max(longestSq, edges[e][0] * edges[e][0] + edges[e][1] * edges[e][1] +
+                                                edges[e][2] * edges[e][2]);
+        }
+
+        const float cx = edges[0][1] * edges[2][2] - edges[0][2] * edges[2][1];
+        const float cy = edges[0][2] * edges[2][0] - edges[0][0] * edges[2][2];
+        const float cz = edges[0][0] * edges[2][1] - edges[0][1] * edges[2][0];
+        outArea = 0.5f * std::sqrt(cx * cx + cy * cy + cz * cz);
+
+        // Longest edge over the height on it: L / (2A / L)
+        outAspectRatio = outArea > 0.0f ? longestSq / (2.0f * outArea) : 0.0f;
+    }
+
+    static void MeasureBox(const CPUBVHBounds& box, float& outArea, float& outAspectRatio)
+    {
+        const float extents[3] = {box.Max[0] - box.Min[0], box.Max[1] - box.Min[1], box.Max[2] - box.Min[2]};
+        const float shortest = std::min({extents[0], extents[1], extents[2]});
+        const float longest = std::max({extents[0], extents[1], extents[2]});
+
+        outArea = 2.0f * HalfArea(box);
+        outAspectRatio = shortest > 0.0f ? longest / shortest : 0.0f;
+    }
+
+    // Reasons without values are stored as they are, so they are never parsed as a format
+    static void AddReason(BLASAdvice& advice, const char* reason) { advice.Reasons.push_back(reason); }
+
+    template <typename... Args> static void AddReason(BLASAdvice& advice, const char* fmt, Args... args)
+    {
+        char buffer[256];
+        snprintf(buffer, sizeof(buffer), fmt, args...);
+        advice.Reasons.push_back(buffer);
+    }
+
+    static void RecommendFlags(BLASAdvice& advice, MeshChangeFrequency changes, const BLASAdvisorSettings& settings)
+    {
+        using Flags = vk::BuildAccelerationStructureFlagBitsKHR;
+
+        const float sahRatio = advice.SAHCost > 0.0f ? advice.FastBuildSAHCost / advice.SAHCost : 1.0f;
+        const bool hardToBuild = sahRatio >= settings.HardSAHRatio || advice.OverlapScore >= settings.HighOverlapScore;
+
+        switch (changes)
+        {
+        case MeshChangeFrequency::Static:
+            advice.Flags = Flags::ePreferFastTrace;
+            AddReason(advice, "ePreferFastTrace: the mesh is static, so the build cost is paid once");
+            if (advice.PrimitiveCount >= settings.MinCompactionPrimitives)
+            {
+                advice.Flags |= Flags::eAllowCompaction;
+                AddReason(advice, "eAllowCompaction: a static BLAS with %u primitives is worth compacting",
+                          advice.PrimitiveCount);
+            }
+            break;
+        case MeshChangeFrequency::Occasional:
+            advice.Flags = Flags::ePreferFastTrace | Flags::eAllowUpdate;
+            AddReason(advice, "ePreferFastTrace | eAllowUpdate: the mesh is traced far more often than it changes, "
+                              "changes are refitted and BLASUpdatePolicy rebuilds it when the refits add up");
+            break;
+        case MeshChangeFrequency::EveryFrame:
+            if (hardToBuild)
+            {
+                advice.Flags = Flags::ePreferFastTrace | Flags::eAllowUpdate;
+                AddReason(advice,
+                          "ePreferFastTrace | eAllowUpdate: the mesh is refitted every frame, and a fast build would "
+                          "cost %.2fx the SAH with an overlap score of %.2f, so the rare rebuilds should be good ones",
+                          sahRatio, advice.OverlapScore);
+            }
+            else
+            {
+                advice.Flags = Flags::ePreferFastBuild | Flags::eAllowUpdate;
+                AddReason(advice,
+                          "ePreferFastBuild | eAllowUpdate: the mesh is refitted every frame, and a fast build only "
+                          "costs %.2fx the SAH, so rebuilds should be cheap",
+                          sahRatio);
+            }
+            break;
+        case MeshChangeFrequency::TopologyChanges:
+            advice.Flags = Flags::ePreferFastBuild;
+            AddReason(advice, "ePreferFastBuild: the mesh is rebuilt every frame, it can't be refitted");
+            if (hardToBuild)
+            {
+                AddReason(advice,
+                          "The fast build costs %.2fx the SAH with an overlap score of %.2f, if the mesh is traced "
+                          "heavily, ePreferFastTrace may win despite the rebuilds",
+                          sahRatio, advice.OverlapScore);
+            }
+            break;
+        }
+
+        if (advice.SliverFraction > 0.1f)
+        {
+            AddReason(advice,
+                      "%.0f%% of the triangles are slivers, their boxes are mostly empty space. Splitting long "
+                      "triangles before the upload would make the BVH tighter",
+                      advice.SliverFraction * 100.0f);
+        }
+        if (advice.DegenerateCount > 0)
+        {
+            AddReason(advice, "%u primitives have zero area, PreprocessMesh(...) can remove degenerate triangles",
+                      advice.DegenerateCount);
+        }
+    }
+
+    static void RecommendSplit(BLASAdvice& advice, const CPUBVH& bvh, const BLASAdvisorSettings& settings)
+    {
+        if (advice.PrimitiveCount > settings.SplitThreshold && settings.ChunkPrimitives > 0)
+        {
+            advice.SplitChunkPrimitives = settings.ChunkPrimitives;
+            AddReason(advice, "Split into chunks of %u primitives: the mesh has %u primitives, more than %u",
+                      settings.ChunkPrimitives, advice.PrimitiveCount, settings.SplitThreshold);
+            return;
+        }
+        if (advice.PrimitiveCount < settings.MinClusterSplitPrimitives || bvh.GetNodes().empty())
+            return;
+
+        // The mesh is made of separate clusters, if the children of the root cover little of the root bounds
+        const CPUBVHNode& root = bvh.GetNodes()[0];
+        uint32_t clusterCount = 0;
+        float clusterArea = 0.0f;
+        for (uint32_t c = 0; c < 4; c++)
+        {
+            if (root.Children[c] == ~0U)
+                continue;
+            clusterCount++;
+            clusterArea += HalfArea(GetChildBounds(root, c));
+        }
+
+        const float rootArea = HalfArea(bvh.GetBounds());
+        if (clusterCount < 2 || rootArea <= 0.0f || clusterArea > settings.ClusterAreaRatio * rootArea)
+            return;
+
+        advice.SplitChunkPrimitives = (advice.PrimitiveCount + clusterCount - 1) / clusterCount;
+        AddReason(advice,
+                  "Split into %u BLASes: the mesh is made of %u clusters covering %.0f%% of the surface area of its "
+                  "bounds, separate instances let the TLAS skip the empty space between them",
+                  clusterCount, clusterCount, clusterArea / rootArea * 100.0f);
+    }
+
+    BLASAdvice AdviseBLAS(const BLASCreateInfo& info, MeshChangeFrequency changes, const BLASAdvisorSettings& settings,
+                          ThreadPool* threadPool)
+    {
+        BLASAdvice outAdvice = {};
+
+        // Validates the host data and builds the reference BVH
+        CPUBLAS reference = {};
+        if (!reference.Build(info, settings.BVHSettings, threadPool))
+        {
+            VULRAY_LOG_ERROR("AdviseBLAS: The geometry can't be read through its host data");
+            return outAdvice;
+        }
+
+        const vk::GeometryTypeKHR type =
+            info.Geometries.empty() ? vk::GeometryTypeKHR::eTriangles : info.Geometries[0].Type;
+
+        std::vector<uint32_t> firstPrimitives(info.Geometries.size() + 1, 0);
+        for (uint32_t g = 0; g < info.Geometries.size(); g++)
+            firstPrimitives[g + 1] = firstPrimitives[g] + info.Geometries[g].PrimitiveCount;
+
+        const uint32_t primitiveCount = firstPrimitives.back();
+        std::vector<CPUBVHBounds> bounds(primitiveCount);
+        std::vector<float> areas(primitiveCount);
+        std::vector<float> aspectRatios(primitiveCount);
+
+        auto measurePrimitives = [&](uint32_t begin, uint32_t end)
+        {
+            auto g = (uint32_t)(std::upper_bound(firstPrimitives.begin(), firstPrimitives.end(), begin) -
+                                firstPrimitives.begin() - 1);
+            for (uint32_t i = begin; i < end; i++)
+            {
+                while (i >= firstPrimitives[g + 1]) g++;
+
+                const GeometryData& geom = info.Geometries[g];
+                const uint32_t primitive = i - firstPrimitives[g];
+
+                if (type == vk::GeometryTypeKHR::eAabbs)
+                {
+                    ReadHostAABB(geom, primitive, bounds[i]);
+                    MeasureBox(bounds[i], areas[i], aspectRatios[i]);
+                    continue;
+                }
+
+                float v[3][3];
+                ReadHostTriangle(geom, primitive, v);
+                MeasureTriangle(v, areas[i], aspectRatios[i]);
+                for (uint32_t a = 0; a < 3; a++)
+                {
+                    bounds[i].Min[a] = std::min({v[0][a], v[1][a], v[2][a]});
+                    bounds[i].Max[a] = std::max({v[0][a], v[1][a], v[2][a]});
+                }
+            }
+        };
+
+        if (threadPool)
+            threadPool->ParallelFor(primitiveCount, MinPrimitivesPerRange, measurePrimitives);
+        else
+            measurePrimitives(0, primitiveCount);
+
+        CPUBVHBuildSettings fastSettings = settings.BVHSettings;
+        fastSettings.BinCount = FastBuildBinCount;
+        CPUBVH fastBuild = {};
+        fastBuild.Build(bounds, fastSettings, threadPool);
+
+        outAdvice.Valid = true;
+        outAdvice.PrimitiveCount = primitiveCount;
+        outAdvice.SAHCost = reference.GetBVH().GetStatistics().SAHCost;
+        outAdvice.FastBuildSAHCost = fastBuild.GetStatistics().SAHCost;
+        outAdvice.OverlapScore = ComputeOverlapScore(reference.GetBVH());
+
+        // Degenerate primitives have no aspect ratio, they are counted instead
+        std::vector<float> validAspectRatios = {};
+        validAspectRatios.reserve(primitiveCount);
+        uint32_t sliverCount = 0;
+        for (const float aspectRatio : aspectRatios)
+        {
+            if (aspectRatio <= 0.0f)
+            {
+                outAdvice.DegenerateCount++;
+                continue;
+            }
+            validAspectRatios.push_back(aspectRatio);
+            sliverCount += aspectRatio > settings.SliverAspectRatio ? 1 : 0;
+        }
+        outAdvice.SliverFraction = primitiveCount > 0 ? (float)sliverCount / primitiveCount : 0.0f;
+
+        // Flat boxes are valid AABBs, only boxes without any area are degenerate
+        if (type == vk::GeometryTypeKHR::eAabbs)
+            outAdvice.DegenerateCount = (uint32_t)std::count(areas.begin(), areas.end(), 0.0f);
+
+        outAdvice.PrimitiveArea = ComputeDistribution(areas);
+        outAdvice.AspectRatio = ComputeDistribution(validAspectRatios);
+
+        RecommendFlags(outAdvice, changes, settings);
+        RecommendSplit(outAdvice, reference.GetBVH(), settings);
+
+        return outAdvice;
+    }
+
+    BLASPartition BLASAdvice::Apply(const BLASCreateInfo& info) const
+    {
+        if (SplitChunkPrimitives == 0)
+        {
+            BLASPartition outPartition = {};
+
+            BLASCreateInfo outInfo = info;
+            outInfo.Flags = Flags;
+            outPartition.BLASInfos.push_back(outInfo);
+
+            for (uint32_t g = 0; g < info.Geometries.size(); g++)
+                outPartition.MeshParts.push_back({{0, g, 0, info.Geometries[g].PrimitiveCount}});
+            return outPartition;
+        }
+
+        std::vector<MeshPartitionInput> meshes = {};
+        for (const auto& geom : info.Geometries) meshes.push_back({geom, false});
+
+        BLASPartitionSettings partitionSettings = {};
+        partitionSettings.SplitThreshold = SplitChunkPrimitives;
+        partitionSettings.ChunkPrimitives = SplitChunkPrimitives;
+        partitionSettings.Flags = Flags;
+        return PartitionBLAS(meshes, partitionSettings);
+    }
+
+} // namespace vr
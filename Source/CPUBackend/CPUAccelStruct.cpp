@@ -0,0 +1,633 @@
+#include "Vulray/CPUBackend/CPUAccelStruct.h"
+
+#include "Vulray/ThreadPool.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VULRAY_CPU_BVH_SSE
+#include <emmintrin.h>
+#endif
+
+namespace vr
+{
+    // Stack entries that live on the call stack, deeper trees use a heap stack sized from their depth
+    static constexpr uint32_t TraversalStackSize = 256;
+
+    // Number of primitives or rays a thread processes at least
+    static constexpr uint32_t MinPrimitivesPerRange = 4096;
+    static constexpr uint32_t MinRaysPerRange = 256;
+
+    static void Cross(const float* a, const float* b, float* out)
+    {
+        out[0] = a[1] * b[2] - a[2] * b[1];
+        out[1] = a[2] * b[0] - a[0] * b[2];
+        out[2] = a[0] * b[1] - a[1] * b[0];
+    }
+
+    static float Dot(const float* a, const float* b)
+    {
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    }
+
+    // Applies a row-major 3x4 transform to a point (w = 1) or a direction (w = 0)
+    static void Transform(const float m[3][4], const float* v, float w, float* out)
+    {
+        for (uint32_t row = 0; row < 3; row++)
+            out[row] = m[row][0] * v[0] + m[row][1] * v[1] + m[row][2] * v[2] + m[row][3] * w;
+    }
+
+    static bool InvertTransform(const float m[3][4], float out[3][4])
+    {
+        // Inverse of the 3x3 part from the cofactors, the translation is moved back with it
+        const float c00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+        const float c01 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+        const float c02 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+
+        const float det = m[0][0] * c00 + m[0][1] * c01 + m[0][2] * c02;
+        if (std::fabs(det) < 1e-20f)
+            return false;
+
+        const float invDet = 1.0f / det;
+        out[0][0] = c00 * invDet;
+        out[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * invDet;
+        out[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * invDet;
+        out[1][0] = c01 * invDet;
+        out[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * invDet;
+        out[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * invDet;
+        out[2][0] = c02 * invDet;
+        out[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * invDet;
+        out[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * invDet;
+
+        for (uint32_t row = 0; row < 3; row++)
+            out[row][3] = -(out[row][0] * m[0][3] + out[row][1] * m[1][3] + out[row][2] * m[2][3]);
+        return true;
+    }
+
+    // Zero components are replaced with a tiny value, so the slab tests never compute 0 * inf
+    static void InvertDirection(const float* direction, float* outInvDir)
+    {
+        for (uint32_t a = 0; a < 3; a++)
+        {
+            const float d = direction[a];
+            outInvDir[a] = 1.0f / (std::fabs(d) > 1e-20f ? d : std::copysign(1e-20f, d));
+        }
+    }
+
+    static bool IntersectTriangle(const float* v0, const float* e1, const float* e2, const float* origin,
+                                  const float* direction, float tMin, float tMax, float& outT, float& outU,
+                                  float& outV)
+    {
+        float p[3];
+        Cross(direction, e2, p);
+        const float det = Dot(e1, p);
+        if (std::fabs(det) < 1e-20f)
+            return false;
+
+        const float invDet = 1.0f / det;
+        const float s[3] = {origin[0] - v0[0], origin[1] - v0[1], origin[2] - v0[2]};
+
+        const float u = Dot(s, p) * invDet;
+        if (u < 0.0f || u > 1.0f)
+            return false;
+
+        float q[3];
+        Cross(s, e1, q);
+        const float v = Dot(direction, q) * invDet;
+        if (v < 0.0f || u + v > 1.0f)
+            return false;
+
+        const float t = Dot(e2, q) * invDet;
+        if (t < tMin || t >= tMax)
+            return false;
+
+        outT = t;
+        outU = u;
+        outV = v;
+        return true;
+    }
+
+    static bool IntersectBox(const float* boxMin, const float* boxMax, const float* origin, const float* invDir,
+                             float tMin, float tMax, float& outT)
+    {
+        float tNear = tMin;
+        float tFar = tMax;
+        for (uint32_t a = 0; a < 3; a++)
+        {
+            const float t0 = (boxMin[a] - origin[a]) * invDir[a];
+            const float t1 = (boxMax[a] - origin[a]) * invDir[a];
+            tNear = std::max(tNear, std::min(t0, t1));
+            tFar = std::min(tFar, std::max(t0, t1));
+        }
+
+        if (tNear > tFar || tNear >= tMax)
+            return false;
+
+        outT = tNear;
+        return true;
+    }
+
+    // The ray as needed by the node tests
+    struct NodeRay
+    {
+        float Origin[3];
+        float InvDir[3];
+#ifdef VULRAY_CPU_BVH_SSE
+        __m128 OriginX, OriginY, OriginZ;
+        __m128 InvDirX, InvDirY, InvDirZ;
+#endif
+    };
+
+    // Tests the ray against the 4 child boxes, returns the bit mask of the hit children and their entry distances
+    static uint32_t IntersectNode(const CPUBVHNode& node, const NodeRay& ray, float tMin, float tMax, float* outTNear)
+    {
+#ifdef VULRAY_CPU_BVH_SSE
+        const __m128 tx0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.MinX), ray.OriginX), ray.InvDirX);
+        const __m128 tx1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.MaxX), ray.OriginX), ray.InvDirX);
+        const __m128 ty0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.MinY), ray.OriginY), ray.InvDirY);
+        const __m128 ty1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.MaxY), ray.OriginY), ray.InvDirY);
+        const __m128 tz0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.MinZ), ray.OriginZ), ray.InvDirZ);
+        const __m128 tz1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.MaxZ), ray.OriginZ), ray.InvDirZ);
+
+        const __m128 tNear = _mm_max_ps(_mm_max_ps(_mm_min_ps(tx0, tx1), _mm_min_ps(ty0, ty1)),
+                                        _mm_max_ps(_mm_min_ps(tz0, tz1), _mm_set1_ps(tMin)));
+        const __m128 tFar = _mm_min_ps(_mm_min_ps(_mm_max_ps(tx0, tx1), _mm_max_ps(ty0, ty1)),
+                                       _mm_min_ps(_mm_max_ps(tz0, tz1), _mm_set1_ps(tMax)));
+
+        _mm_storeu_ps(outTNear, tNear);
+        return (uint32_t)_mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+#else
+        const float* mins[3] = {node.MinX, node.MinY, node.MinZ};
+        const float* maxs[3] = {node.MaxX, node.MaxY, node.MaxZ};
+
+        uint32_t outMask = 0;
+        for (uint32_t c = 0; c < 4; c++)
+        {
+            float tNear = tMin;
+            float tFar = tMax;
+            for (uint32_t a = 0; a < 3; a++)
+            {
+                const float t0 = (mins[a][c] - ray.Origin[a]) * ray.InvDir[a];
+                const float t1 = (maxs[a][c] - ray.Origin[a]) * ray.InvDir[a];
+                tNear = std::max(tNear, std::min(t0, t1));
+                tFar = std::min(tFar, std::max(t0, t1));
+            }
+            outTNear[c] = tNear;
+            outMask |= (tNear <= tFar ? 1u : 0u) << c;
+        }
+        return outMask;
+#endif
+    }
+
+    // Walks the BVH front to back and calls intersectLeaf(first, count) for every leaf the ray enters. intersectLeaf
+    // shrinks tMax when it finds a closer hit and returns true if it found one
+    template <bool AnyHit, typename LeafFunc>
+    static bool TraverseBVH(const CPUBVH& bvh, const float* origin, const float* direction, float tMin, float& tMax,
+                            LeafFunc&& intersectLeaf)
+    {
+        const auto& nodes = bvh.GetNodes();
+        if (nodes.empty())
+            return false;
+
+        NodeRay ray = {};
+        memcpy(ray.Origin, origin, sizeof(ray.Origin));
+        InvertDirection(direction, ray.InvDir);
+#ifdef VULRAY_CPU_BVH_SSE
+        ray.OriginX = _mm_set1_ps(origin[0]);
+        ray.OriginY = _mm_set1_ps(origin[1]);
+        ray.OriginZ = _mm_set1_ps(origin[2]);
+        ray.InvDirX = _mm_set1_ps(ray.InvDir[0]);
+        ray.InvDirY = _mm_set1_ps(ray.InvDir[1]);
+        ray.InvDirZ = _mm_set1_ps(ray.InvDir[2]);
+#endif
+
+        struct StackEntry
+        {
+            uint32_t Node;
+            float TNear;
+        };
+
+        // Every pop pushes at most 4 children, so the stack grows by at most 3 entries per level. The SAH depth limit
+        // and the median fallback don't bound the depth, so the capacity comes from the depth of the built tree
+        const uint32_t stackCapacity = 3 * bvh.GetStatistics().MaxDepth + 4;
+        StackEntry localStack[TraversalStackSize];
+        std::vector<StackEntry> heapStack;
+        StackEntry* stack = localStack;
+        if (stackCapacity > TraversalStackSize)
+        {
+            heapStack.resize(stackCapacity);
+            stack = heapStack.data();
+        }
+
+        uint32_t stackSize = 0;
+        stack[stackSize++] = {0, tMin};
+
+        bool outHit = false;
+        while (stackSize > 0)
+        {
+            const StackEntry entry = stack[--stackSize];
+
+            // A closer hit was found after the node was pushed
+            if (entry.TNear > tMax)
+                continue;
+
+            const CPUBVHNode& node = nodes[entry.Node];
+
+            float tNear[4];
+            const uint32_t hitMask = IntersectNode(node, ray, tMin, tMax, tNear);
+
+            uint32_t innerChildren[4];
+            uint32_t innerCount = 0;
+            for (uint32_t c = 0; c < 4; c++)
+            {
+                if (!(hitMask & (1u << c)) || node.Children[c] == ~0U)
+                    continue;
+
+                if (node.Counts[c] == 0)
+                    innerChildren[innerCount++] = c;
+                else if (tNear[c] <= tMax && intersectLeaf(node.Children[c], node.Counts[c]))
+                {
+                    outHit = true;
+                    if constexpr (AnyHit)
+                        return true;
+                }
+            }
+
+            // Push far to near, so the nearest child is popped first
+            for (uint32_t i = 1; i < innerCount; i++)
+            {
+                for (uint32_t j = i; j > 0 && tNear[innerChildren[j]] > tNear[innerChildren[j - 1]]; j--)
+                    std::swap(innerChildren[j], innerChildren[j - 1]);
+            }
+            assert(stackSize + innerCount <= std::max(stackCapacity, TraversalStackSize) &&
+                   "TraverseBVH: The traversal stack is smaller than the depth of the BVH");
+            for (uint32_t i = 0; i < innerCount; i++)
+                stack[stackSize++] = {node.Children[innerChildren[i]], tNear[innerChildren[i]]};
+        }
+        return outHit;
+    }
+
+    void ReadHostTriangle(const GeometryData& geom, uint32_t primitive, float outVertices[3][3])
+    {
+        const auto* vertices = (const uint8_t*)geom.HostData.VertexOrAABBData;
+        const auto* indexData = (const uint8_t*)geom.HostData.IndexData;
+        if (indexData)
+            indexData += geom.PrimitiveOffset;
+
+        uint32_t indices[3];
+        for (uint32_t k = 0; k < 3; k++)
+        {
+            const uint32_t i = primitive * 3 + k;
+            if (geom.IndexFormat == vk::IndexType::eUint32)
+                indices[k] = ((const uint32_t*)indexData)[i] + geom.FirstVertex;
+            else if (geom.IndexFormat == vk::IndexType::eUint16)
+                indices[k] = ((const uint16_t*)indexData)[i] + geom.FirstVertex;
+            else
+                indices[k] = i + geom.FirstVertex;
+        }
+
+        // The primitive offset moves the vertices of non-indexed triangles
+        if (geom.IndexFormat == vk::IndexType::eNoneKHR)
+            vertices += geom.PrimitiveOffset;
+
+        for (uint32_t k = 0; k < 3; k++) memcpy(outVertices[k], vertices + (size_t)indices[k] * geom.Stride, 12);
+
+        if (geom.HostData.TransformData)
+        {
+            const auto* transform =
+                (const float(*)[4])((const uint8_t*)geom.HostData.TransformData + geom.TransformOffset);
+            for (uint32_t k = 0; k < 3; k++)
+            {
+                const float position[3] = {outVertices[k][0], outVertices[k][1], outVertices[k][2]};
+                Transform(transform, position, 1.0f, outVertices[k]);
+            }
+        }
+    }
+
+    void ReadHostAABB(const GeometryData& geom, uint32_t primitive, CPUBVHBounds& outBounds)
+    {
+        const auto* box = (const float*)((const uint8_t*)geom.HostData.VertexOrAABBData + geom.PrimitiveOffset +
+                                         (size_t)primitive * geom.Stride);
+        memcpy(outBounds.Min, box, sizeof(outBounds.Min));
+        memcpy(outBounds.Max, box + 3, sizeof(outBounds.Max));
+    }
+
+    static bool ValidateGeometry(const GeometryData& geom, vk::GeometryTypeKHR type, uint32_t index)
+    {
+        if (geom.Type != type)
+        {
+            VULRAY_FLOG_ERROR("CPUBLAS::Build: Geometry %u has a different type than the first geometry", index);
+            return false;
+        }
+        if (!geom.HostData.VertexOrAABBData || geom.Stride == 0)
+        {
+            VULRAY_FLOG_ERROR("CPUBLAS::Build: Geometry %u has no host data or no stride", index);
+            return false;
+        }
+        if (type == vk::GeometryTypeKHR::eAabbs)
+            return true;
+
+        if (geom.VertexFormat != vk::Format::eR32G32B32Sfloat && geom.VertexFormat != vk::Format::eR32G32B32A32Sfloat)
+        {
+            VULRAY_FLOG_ERROR("CPUBLAS::Build: Geometry %u has an unsupported vertex format", index);
+            return false;
+        }
+        if (geom.IndexFormat != vk::IndexType::eNoneKHR && !geom.HostData.IndexData)
+        {
+            VULRAY_FLOG_ERROR("CPUBLAS::Build: Geometry %u has an index format but no host index data", index);
+            return false;
+        }
+        if (geom.IndexFormat != vk::IndexType::eNoneKHR && geom.IndexFormat != vk::IndexType::eUint16 &&
+            geom.IndexFormat != vk::IndexType::eUint32)
+        {
+            VULRAY_FLOG_ERROR("CPUBLAS::Build: Geometry %u has an unsupported index format", index);
+            return false;
+        }
+        return true;
+    }
+
+    static void ParallelFor(ThreadPool* threadPool, uint32_t count, uint32_t minRangeSize,
+                            const std::function<void(uint32_t, uint32_t)>& func)
+    {
+        if (threadPool)
+            threadPool->ParallelFor(count, minRangeSize, func);
+        else
+            func(0, count);
+    }
+
+    bool CPUBLAS::Build(const BLASCreateInfo& info, const CPUBVHBuildSettings& settings, ThreadPool* threadPool)
+    {
+        mTriangles.clear();
+        mBoxes.clear();
+
+        const vk::GeometryTypeKHR type =
+            info.Geometries.empty() ? vk::GeometryTypeKHR::eTriangles : info.Geometries[0].Type;
+
+        // Index of the first primitive of every geometry, so the primitives can be split across threads
+        std::vector<uint32_t> firstPrimitives(info.Geometries.size() + 1, 0);
+        for (uint32_t g = 0; g < info.Geometries.size(); g++)
+        {
+            if (!ValidateGeometry(info.Geometries[g], type, g))
+            {
+                mBVH.Build({});
+                return false;
+            }
+            firstPrimitives[g + 1] = firstPrimitives[g] + info.Geometries[g].PrimitiveCount;
+        }
+
+        const uint32_t primitiveCount = firstPrimitives.back();
+        std::vector<CPUBVHBounds> bounds(primitiveCount);
+        std::vector<Triangle> triangles(type == vk::GeometryTypeKHR::eTriangles ? primitiveCount : 0);
+        std::vector<Box> boxes(type == vk::GeometryTypeKHR::eAabbs ? primitiveCount : 0);
+
+        auto readPrimitives = [&](uint32_t begin, uint32_t end)
+        {
+            auto g = (uint32_t)(std::upper_bound(firstPrimitives.begin(), firstPrimitives.end(), begin) -
+                                firstPrimitives.begin() - 1);
+            for (uint32_t i = begin; i < end; i++)
+            {
+                while (i >= firstPrimitives[g + 1]) g++;
+
+                const GeometryData& geom = info.Geometries[g];
+                const uint32_t primitive = i - firstPrimitives[g];
+
+                if (type == vk::GeometryTypeKHR::eAabbs)
+                {
+                    ReadHostAABB(geom, primitive, bounds[i]);
+
+                    Box& outBox = boxes[i];
+                    memcpy(outBox.Min, bounds[i].Min, sizeof(outBox.Min));
+                    memcpy(outBox.Max, bounds[i].Max, sizeof(outBox.Max));
+                    outBox.GeometryIndex = g;
+                    outBox.PrimitiveIndex = primitive;
+                    continue;
+                }
+
+                float v[3][3];
+                ReadHostTriangle(geom, primitive, v);
+
+                Triangle& outTriangle = triangles[i];
+                for (uint32_t a = 0; a < 3; a++)
+                {
+                    outTriangle.V0[a] = v[0][a];
+                    outTriangle.E1[a] = v[1][a] - v[0][a];
+                    outTriangle.E2[a] = v[2][a] - v[0][a];
+
+                    bounds[i].Min[a] = std::min({v[0][a], v[1][a], v[2][a]});
+                    bounds[i].Max[a] = std::max({v[0][a], v[1][a], v[2][a]});
+                }
+                outTriangle.GeometryIndex = g;
+                outTriangle.PrimitiveIndex = primitive;
+            }
+        };
+        ParallelFor(threadPool, primitiveCount, MinPrimitivesPerRange, readPrimitives);
+
+        mBVH.Build(bounds, settings, threadPool);
+
+        // Store the primitives in leaf order, so the leaves read consecutive memory
+        const auto& order = mBVH.GetPrimitiveIndices();
+        mTriangles.resize(triangles.size());
+        mBoxes.resize(boxes.size());
+        ParallelFor(threadPool, primitiveCount, MinPrimitivesPerRange,
+                    [&](uint32_t begin, uint32_t end)
+                    {
+                        for (uint32_t i = begin; i < end; i++)
+                        {
+                            if (type == vk::GeometryTypeKHR::eAabbs)
+                                mBoxes[i] = boxes[order[i]];
+                            else
+                                mTriangles[i] = triangles[order[i]];
+                        }
+                    });
+
+        return true;
+    }
+
+    template <bool AnyHit>
+    bool CPUBLAS::Intersect(const float* origin, const float* direction, float tMin, float& tMax, CPUHit& hit) const
+    {
+        float invDir[3];
+        if (!mBoxes.empty())
+            InvertDirection(direction, invDir);
+
+        return TraverseBVH<AnyHit>(
+            mBVH, origin, direction, tMin, tMax,
+            [&](uint32_t first, uint32_t count)
+            {
+                bool found = false;
+                for (uint32_t i = first; i < first + count; i++)
+                {
+                    float t, u = 0.0f, v = 0.0f;
+                    uint32_t geometryIndex, primitiveIndex;
+
+                    if (!mTriangles.empty())
+                    {
+                        const Triangle& tri = mTriangles[i];
+                        if (!IntersectTriangle(tri.V0, tri.E1, tri.E2, origin, direction, tMin, tMax, t, u, v))
+                            continue;
+                        geometryIndex = tri.GeometryIndex;
+                        primitiveIndex = tri.PrimitiveIndex;
+                    }
+                    else
+                    {
+                        const Box& box = mBoxes[i];
+                        if (!IntersectBox(box.Min, box.Max, origin, invDir, tMin, tMax, t))
+                            continue;
+                        geometryIndex = box.GeometryIndex;
+                        primitiveIndex = box.PrimitiveIndex;
+                    }
+
+                    tMax = t;
+                    hit.T = t;
+                    hit.U = u;
+                    hit.V = v;
+                    hit.GeometryIndex = geometryIndex;
+                    hit.PrimitiveIndex = primitiveIndex;
+                    found = true;
+
+                    if constexpr (AnyHit)
+                        return true;
+                }
+                return found;
+            });
+    }
+
+    CPUHit CPUBLAS::TraceClosest(const CPURay& ray) const
+    {
+        CPUHit outHit = {};
+        float tMax = std::min(ray.TMax, FLT_MAX);
+        Intersect<false>(ray.Origin, ray.Direction, ray.TMin, tMax, outHit);
+        return outHit;
+    }
+
+    CPUHit CPUBLAS::TraceAny(const CPURay& ray) const
+    {
+        CPUHit outHit = {};
+        float tMax = std::min(ray.TMax, FLT_MAX);
+        Intersect<true>(ray.Origin, ray.Direction, ray.TMin, tMax, outHit);
+        return outHit;
+    }
+
+    void CPUTLAS::Build(const std::vector<CPUInstance>& instances, const CPUBVHBuildSettings& settings,
+                        ThreadPool* threadPool)
+    {
+        mInstances.clear();
+
+        std::vector<Instance> validInstances = {};
+        std::vector<CPUBVHBounds> bounds = {};
+        validInstances.reserve(instances.size());
+        bounds.reserve(instances.size());
+
+        uint32_t skipped = 0;
+        for (uint32_t i = 0; i < instances.size(); i++)
+        {
+            const CPUInstance& instance = instances[i];
+
+            Instance outInstance = {};
+            if (!instance.BLAS || !InvertTransform(instance.Transform, outInstance.WorldToObject))
+            {
+                skipped++;
+                continue;
+            }
+
+            // Empty BLASes can never be hit
+            const CPUBVHBounds& blasBounds = instance.BLAS->GetBVH().GetBounds();
+            if (blasBounds.Min[0] > blasBounds.Max[0])
+                continue;
+
+            outInstance.BLAS = instance.BLAS;
+            outInstance.Index = i;
+            outInstance.CustomIndex = instance.CustomIndex;
+            outInstance.Mask = instance.Mask;
+            validInstances.push_back(outInstance);
+
+            // World bounds from the 8 transformed corners of the BLAS bounds
+            CPUBVHBounds worldBounds = {};
+            for (uint32_t corner = 0; corner < 8; corner++)
+            {
+                const float point[3] = {(corner & 1) ? blasBounds.Max[0] : blasBounds.Min[0],
+                                        (corner & 2) ? blasBounds.Max[1] : blasBounds.Min[1],
+                                        (corner & 4) ? blasBounds.Max[2] : blasBounds.Min[2]};
+                float worldPoint[3];
+                Transform(instance.Transform, point, 1.0f, worldPoint);
+                for (uint32_t a = 0; a < 3; a++)
+                {
+                    worldBounds.Min[a] = std::min(worldBounds.Min[a], worldPoint[a]);
+                    worldBounds.Max[a] = std::max(worldBounds.Max[a], worldPoint[a]);
+                }
+            }
+            bounds.push_back(worldBounds);
+        }
+
+        if (skipped > 0)
+        {
+            VULRAY_FLOG_WARNING("CPUTLAS::Build: Skipped %u instances without a BLAS or with a singular transform",
+                                skipped);
+        }
+
+        mBVH.Build(bounds, settings, threadPool);
+
+        const auto& order = mBVH.GetPrimitiveIndices();
+        mInstances.resize(validInstances.size());
+        for (size_t i = 0; i < order.size(); i++) mInstances[i] = validInstances[order[i]];
+    }
+
+    template <bool AnyHit> CPUHit CPUTLAS::Trace(const CPURay& ray, uint8_t cullMask) const
+    {
+        CPUHit outHit = {};
+        float tMax = std::min(ray.TMax, FLT_MAX);
+
+        TraverseBVH<AnyHit>(mBVH, ray.Origin, ray.Direction, ray.TMin, tMax,
+                            [&](uint32_t first, uint32_t count)
+                            {
+                                bool found = false;
+                                for (uint32_t i = first; i < first + count; i++)
+                                {
+                                    const Instance& instance = mInstances[i];
+                                    if (!(instance.Mask & cullMask))
+                                        continue;
+
+                                    // The direction isn't normalized, so distances are the same in both spaces
+                                    float origin[3], direction[3];
+                                    Transform(instance.WorldToObject, ray.Origin, 1.0f, origin);
+                                    Transform(instance.WorldToObject, ray.Direction, 0.0f, direction);
+
+                                    if (!instance.BLAS->Intersect<AnyHit>(origin, direction, ray.TMin, tMax, outHit))
+                                        continue;
+
+                                    outHit.InstanceIndex = instance.Index;
+                                    outHit.InstanceCustomIndex = instance.CustomIndex;
+                                    found = true;
+
+                                    if constexpr (AnyHit)
+                                        return true;
+                                }
+                                return found;
+                            });
+
+        return outHit;
+    }
+
+    CPUHit CPUTLAS::TraceClosest(const CPURay& ray, uint8_t cullMask) const
+    {
+        return Trace<false>(ray, cullMask);
+    }
+
+    CPUHit CPUTLAS::TraceAny(const CPURay& ray, uint8_t cullMask) const
+    {
+        return Trace<true>(ray, cullMask);
+    }
+
+    void CPUTLAS::DispatchRays(const CPURay* rays, CPUHit* hits, uint32_t rayCount, CPUTraceMode mode,
+                               uint8_t cullMask, ThreadPool* threadPool) const
+    {
+        ParallelFor(threadPool, rayCount, MinRaysPerRange,
+                    [&](uint32_t begin, uint32_t end)
+                    {
+                        for (uint32_t i = begin; i < end; i++)
+                        {
+                            hits[i] = mode == CPUTraceMode::AnyHit ? Trace<true>(rays[i], cullMask)
+                                                                   : Trace<false>(rays[i], cullMask);
+                        }
+                    });
+    }
+
+} // namespace vr
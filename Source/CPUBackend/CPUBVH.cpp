@@ -0,0 +1,471 @@
+#include "Vulray/CPUBackend/CPUBVH.h"
+
+#include "Vulray/ThreadPool.h"
+
+namespace vr
+{
+    static constexpr uint32_t MaxBinCount = 32;
+    static constexpr uint32_t MaxLeafSize = 16;
+
+    // Below this depth of the binary tree nodes are split with the SAH, deeper nodes at the object median, which
+    // bounds the depth of the tree for pathological inputs
+    static constexpr uint32_t MaxSAHDepth = 48;
+
+    // Nodes with at least this many primitives are binned in parallel, smaller ones are built as a whole by one thread
+    static constexpr uint32_t ParallelNodeSize = 16384;
+
+    // Number of primitives a thread bins at least
+    static constexpr uint32_t MinPrimitivesPerRange = 4096;
+
+    struct BVHBinaryNode
+    {
+        CPUBVHBounds Bounds = {};
+        uint32_t Begin = 0;
+        uint32_t Count = 0;
+
+        // Slot of the right child, the left child is always in the slot after the node
+        uint32_t Right = 0;
+        bool IsLeaf = false;
+    };
+
+    // A node to split, the subtree of a node with N primitives uses the 2N - 1 slots starting at Slot, so subtrees can
+    // be built in parallel without sharing an allocator
+    struct BVHBuildTask
+    {
+        uint32_t Slot = 0;
+        uint32_t Begin = 0;
+        uint32_t Count = 0;
+        uint32_t Depth = 0;
+    };
+
+    struct BVHBin
+    {
+        CPUBVHBounds Bounds = {};
+        uint32_t Count = 0;
+    };
+
+    static void Grow(CPUBVHBounds& bounds, const CPUBVHBounds& other)
+    {
+        for (uint32_t a = 0; a < 3; a++)
+        {
+            bounds.Min[a] = std::min(bounds.Min[a], other.Min[a]);
+            bounds.Max[a] = std::max(bounds.Max[a], other.Max[a]);
+        }
+    }
+
+    static void Grow(CPUBVHBounds& bounds, const float* point)
+    {
+        for (uint32_t a = 0; a < 3; a++)
+        {
+            bounds.Min[a] = std::min(bounds.Min[a], point[a]);
+            bounds.Max[a] = std::max(bounds.Max[a], point[a]);
+        }
+    }
+
+    // Half of the surface area, the SAH only compares ratios of areas
+    static float HalfArea(const CPUBVHBounds& bounds)
+    {
+        if (bounds.Min[0] > bounds.Max[0])
+            return 0.0f;
+
+        const float dx = bounds.Max[0] - bounds.Min[0];
+        const float dy = bounds.Max[1] - bounds.Min[1];
+        const float dz = bounds.Max[2] - bounds.Min[2];
+        return dx * dy + dy * dz + dz * dx;
+    }
+
+    class BVHBinaryBuilder
+    {
+      public:
+        BVHBinaryBuilder(const std::vector<CPUBVHBounds>& bounds, std::vector<uint32_t>& indices,
+                         const CPUBVHBuildSettings& settings, ThreadPool* threadPool)
+            : mBounds(bounds), mIndices(indices), mSettings(settings)
+        {
+            const uint32_t count = (uint32_t)bounds.size();
+
+            // Centroids are stored doubled (min + max), which doesn't change the binning
+            mCentroids.resize((size_t)count * 3);
+            ForRange(threadPool, 0, count,
+                     [&](uint32_t begin, uint32_t end)
+                     {
+                         for (uint32_t i = begin; i < end; i++)
+                             for (uint32_t a = 0; a < 3; a++)
+                                 mCentroids[(size_t)i * 3 + a] = bounds[i].Min[a] + bounds[i].Max[a];
+                     });
+
+            Nodes.resize((size_t)count * 2 - 1);
+        }
+
+        /// Writes the node of the task and partitions its primitives, returns false if the node is a leaf
+        bool SplitNode(const BVHBuildTask& task, ThreadPool* threadPool, BVHBuildTask& outLeft, BVHBuildTask& outRight)
+        {
+            const uint32_t begin = task.Begin;
+            const uint32_t end = task.Begin + task.Count;
+
+            CPUBVHBounds bounds = {};
+            CPUBVHBounds centroidBounds = {};
+            ForRange(threadPool, begin, task.Count,
+                     [&](uint32_t rangeBegin, uint32_t rangeEnd)
+                     {
+                         CPUBVHBounds localBounds = {};
+                         CPUBVHBounds localCentroids = {};
+                         for (uint32_t i = rangeBegin; i < rangeEnd; i++)
+                         {
+                             Grow(localBounds, mBounds[mIndices[i]]);
+                             Grow(localCentroids, &mCentroids[(size_t)mIndices[i] * 3]);
+                         }
+
+                         auto lock = LockIfParallel(threadPool, task.Count);
+                         Grow(bounds, localBounds);
+                         Grow(centroidBounds, localCentroids);
+                     });
+
+            BVHBinaryNode& node = Nodes[task.Slot];
+            node.Bounds = bounds;
+            node.Begin = begin;
+            node.Count = task.Count;
+            node.IsLeaf = true;
+
+            if (task.Count == 1)
+                return false;
+
+            uint32_t largestAxis = 0;
+            for (uint32_t a = 1; a < 3; a++)
+            {
+                if (centroidBounds.Max[a] - centroidBounds.Min[a] >
+                    centroidBounds.Max[largestAxis] - centroidBounds.Min[largestAxis])
+                    largestAxis = a;
+            }
+            const bool allCentroidsEqual = centroidBounds.Max[largestAxis] <= centroidBounds.Min[largestAxis];
+
+            uint32_t mid = begin;
+            if (task.Depth < MaxSAHDepth && !allCentroidsEqual)
+            {
+                uint32_t axis = 0;
+                uint32_t splitBin = 0;
+                const float splitCost = FindSAHSplit(task, centroidBounds, threadPool, axis, splitBin);
+
+                // SAH costs of the node as a leaf and as an inner node, relative to the node's area
+                const float leafCost = mSettings.IntersectionCost * task.Count;
+                const float area = HalfArea(bounds);
+                const float innerCost =
+                    area > 0.0f ? mSettings.TraversalCost + mSettings.IntersectionCost * splitCost / area : FLT_MAX;
+
+                if (task.Count <= mSettings.MaxLeafSize && leafCost <= innerCost)
+                    return false;
+
+                if (splitCost < FLT_MAX)
+                {
+                    const float scale = mSettings.BinCount / (centroidBounds.Max[axis] - centroidBounds.Min[axis]);
+                    const float minCentroid = centroidBounds.Min[axis];
+                    mid = (uint32_t)(std::partition(mIndices.begin() + begin, mIndices.begin() + end,
+                                                    [&](uint32_t prim) {
+                                                        return GetBin(mCentroids[(size_t)prim * 3 + axis], minCentroid,
+                                                                      scale) < splitBin;
+                                                    }) -
+                                     mIndices.begin());
+                }
+            }
+            else if (task.Count <= mSettings.MaxLeafSize)
+                return false;
+
+            // No SAH split, split at the object median of the largest axis
+            if (mid == begin || mid == end)
+            {
+                mid = begin + task.Count / 2;
+                std::nth_element(mIndices.begin() + begin, mIndices.begin() + mid, mIndices.begin() + end,
+                                 [&](uint32_t a, uint32_t b) {
+                                     return mCentroids[(size_t)a * 3 + largestAxis] <
+                                            mCentroids[(size_t)b * 3 + largestAxis];
+                                 });
+            }
+
+            const uint32_t leftCount = mid - begin;
+            node.IsLeaf = false;
+            node.Right = task.Slot + 2 * leftCount;
+
+            outLeft = {task.Slot + 1, begin, leftCount, task.Depth + 1};
+            outRight = {node.Right, mid, task.Count - leftCount, task.Depth + 1};
+            return true;
+        }
+
+        void BuildSubtree(const BVHBuildTask& task)
+        {
+            BVHBuildTask left, right;
+            if (SplitNode(task, nullptr, left, right))
+            {
+                BuildSubtree(left);
+                BuildSubtree(right);
+            }
+        }
+
+        std::vector<BVHBinaryNode> Nodes = {};
+
+      private:
+        template <typename Func> void ForRange(ThreadPool* threadPool, uint32_t begin, uint32_t count, Func&& func)
+        {
+            if (threadPool && count >= ParallelNodeSize)
+                threadPool->ParallelFor(count, MinPrimitivesPerRange,
+                                        [&](uint32_t rangeBegin, uint32_t rangeEnd)
+                                        { func(begin + rangeBegin, begin + rangeEnd); });
+            else
+                func(begin, begin + count);
+        }
+
+        // Ranges only run on several threads for large nodes, the subtrees built by one thread each don't lock
+        std::unique_lock<std::mutex> LockIfParallel(ThreadPool* threadPool, uint32_t count)
+        {
+            std::unique_lock<std::mutex> lock(mMergeMutex, std::defer_lock);
+            if (threadPool && count >= ParallelNodeSize)
+                lock.lock();
+            return lock;
+        }
+
+        uint32_t GetBin(float centroid, float minCentroid, float scale) const
+        {
+            return std::min((uint32_t)((centroid - minCentroid) * scale), mSettings.BinCount - 1);
+        }
+
+        // Bins the centroids on all axes and returns the cheapest split, the SAH cost is the sum of the children's
+        // areas times their primitive counts. FLT_MAX if there is no split with primitives on both sides
+        float FindSAHSplit(const BVHBuildTask& task, const CPUBVHBounds& centroidBounds, ThreadPool* threadPool,
+                           uint32_t& outAxis, uint32_t& outSplitBin)
+        {
+            const uint32_t binCount = mSettings.BinCount;
+            BVHBin bins[3][MaxBinCount] = {};
+
+            float scales[3];
+            for (uint32_t a = 0; a < 3; a++)
+            {
+                const float extent = centroidBounds.Max[a] - centroidBounds.Min[a];
+                scales[a] = extent > 0.0f ? binCount / extent : 0.0f;
+            }
+
+            ForRange(threadPool, task.Begin, task.Count,
+                     [&](uint32_t rangeBegin, uint32_t rangeEnd)
+                     {
+                         BVHBin localBins[3][MaxBinCount] = {};
+                         for (uint32_t i = rangeBegin; i < rangeEnd; i++)
+                         {
+                             const uint32_t prim = mIndices[i];
+                             for (uint32_t a = 0; a < 3; a++)
+                             {
+                                 auto& bin =
+                                     localBins[a][GetBin(mCentroids[(size_t)prim * 3 + a], centroidBounds.Min[a],
+                                                         scales[a])];
+                                 Grow(bin.Bounds, mBounds[prim]);
+                                 bin.Count++;
+                             }
+                         }
+
+                         auto lock = LockIfParallel(threadPool, task.Count);
+                         for (uint32_t a = 0; a < 3; a++)
+                         {
+                             for (uint32_t b = 0; b < binCount; b++)
+                             {
+                                 Grow(bins[a][b].Bounds, localBins[a][b].Bounds);
+                                 bins[a][b].Count += localBins[a][b].Count;
+                             }
+                         }
+                     });
+
+            float bestCost = FLT_MAX;
+            for (uint32_t a = 0; a < 3; a++)
+            {
+                if (scales[a] == 0.0f)
+                    continue;
+
+                // Sweep from the right, then from the left, the split i puts the bins [0, i) on the left
+                float rightCosts[MaxBinCount] = {};
+                CPUBVHBounds accumulated = {};
+                uint32_t count = 0;
+                for (uint32_t i = binCount - 1; i > 0; i--)
+                {
+                    Grow(accumulated, bins[a][i].Bounds);
+                    count += bins[a][i].Count;
+                    rightCosts[i] = HalfArea(accumulated) * count;
+                }
+
+                accumulated = {};
+                count = 0;
+                for (uint32_t i = 1; i < binCount; i++)
+                {
+                    Grow(accumulated, bins[a][i - 1].Bounds);
+                    count += bins[a][i - 1].Count;
+                    if (count == 0 || count == task.Count)
+                        continue;
+
+                    const float cost = HalfArea(accumulated) * count + rightCosts[i];
+                    if (cost < bestCost)
+                    {
+                        bestCost = cost;
+                        outAxis = a;
+                        outSplitBin = i;
+                    }
+                }
+            }
+            return bestCost;
+        }
+
+        const std::vector<CPUBVHBounds>& mBounds;
+        std::vector<uint32_t>& mIndices;
+        const CPUBVHBuildSettings& mSettings;
+
+        std::vector<float> mCentroids = {};
+
+        std::mutex mMergeMutex;
+    };
+
+    // Turns the binary subtree at slot into 4-wide nodes, by opening the inner child with the largest area until the
+    // node has 4 children. Returns the index of the 4-wide node
+    static uint32_t CollapseNode(const std::vector<BVHBinaryNode>& binary, uint32_t slot, uint32_t depth,
+                                 float rootArea, const CPUBVHBuildSettings& settings, std::vector<CPUBVHNode>& nodes,
+                                 CPUBVHStatistics& stats)
+    {
+        const uint32_t nodeIndex = (uint32_t)nodes.size();
+        nodes.emplace_back();
+
+        uint32_t children[4] = {};
+        uint32_t childCount = 0;
+
+        const BVHBinaryNode& root = binary[slot];
+        if (root.IsLeaf)
+            children[childCount++] = slot;
+        else
+        {
+            children[childCount++] = slot + 1;
+            children[childCount++] = root.Right;
+
+            while (childCount < 4)
+            {
+                uint32_t largest = ~0U;
+                float largestArea = -1.0f;
+                for (uint32_t c = 0; c < childCount; c++)
+                {
+                    const float area = HalfArea(binary[children[c]].Bounds);
+                    if (!binary[children[c]].IsLeaf && area > largestArea)
+                    {
+                        largest = c;
+                        largestArea = area;
+                    }
+                }
+                if (largest == ~0U)
+                    break;
+
+                const uint32_t opened = children[largest];
+                children[largest] = opened + 1;
+                children[childCount++] = binary[opened].Right;
+            }
+        }
+
+        stats.MaxDepth = std::max(stats.MaxDepth, depth);
+        stats.AverageChildCount += childCount;
+        if (rootArea > 0.0f)
+            stats.SAHCost += settings.TraversalCost * HalfArea(root.Bounds) / rootArea;
+
+        // Empty slots get boxes at infinity, which every ray misses without a special case in the traversal
+        const CPUBVHBounds emptyBounds = {{FLT_MAX, FLT_MAX, FLT_MAX}, {FLT_MAX, FLT_MAX, FLT_MAX}};
+
+        CPUBVHNode node = {};
+        for (uint32_t c = 0; c < 4; c++)
+        {
+            const CPUBVHBounds& bounds = c < childCount ? binary[children[c]].Bounds : emptyBounds;
+            node.MinX[c] = bounds.Min[0];
+            node.MinY[c] = bounds.Min[1];
+            node.MinZ[c] = bounds.Min[2];
+            node.MaxX[c] = bounds.Max[0];
+            node.MaxY[c] = bounds.Max[1];
+            node.MaxZ[c] = bounds.Max[2];
+            node.Children[c] = ~0U;
+            node.Counts[c] = 0;
+        }
+
+        for (uint32_t c = 0; c < childCount; c++)
+        {
+            const BVHBinaryNode& child = binary[children[c]];
+            if (child.IsLeaf)
+            {
+                node.Children[c] = child.Begin;
+                node.Counts[c] = child.Count;
+
+                stats.LeafCount++;
+                if (rootArea > 0.0f)
+                    stats.SAHCost += settings.IntersectionCost * child.Count * HalfArea(child.Bounds) / rootArea;
+            }
+            else
+                node.Children[c] = CollapseNode(binary, children[c], depth + 1, rootArea, settings, nodes, stats);
+        }
+
+        // The vector may have grown during the recursion, so the node is written at the end
+        nodes[nodeIndex] = node;
+        return nodeIndex;
+    }
+
+    void CPUBVH::Build(const std::vector<CPUBVHBounds>& primitiveBounds, const CPUBVHBuildSettings& settings,
+                       ThreadPool* threadPool)
+    {
+        const auto startTime = std::chrono::steady_clock::now();
+
+        mNodes.clear();
+        mPrimitiveIndices.clear();
+        mBounds = {};
+        mStats = {};
+
+        const uint32_t count = (uint32_t)primitiveBounds.size();
+        mStats.PrimitiveCount = count;
+        if (count == 0)
+            return;
+
+        CPUBVHBuildSettings clampedSettings = settings;
+        clampedSettings.MaxLeafSize = std::clamp(settings.MaxLeafSize, 1u, MaxLeafSize);
+        clampedSettings.BinCount = std::clamp(settings.BinCount, 2u, MaxBinCount);
+
+        mPrimitiveIndices.resize(count);
+        std::iota(mPrimitiveIndices.begin(), mPrimitiveIndices.end(), 0);
+
+        BVHBinaryBuilder builder(primitiveBounds, mPrimitiveIndices, clampedSettings, threadPool);
+
+        // Large nodes near the root are split one at a time with parallel binning, until the remaining subtrees are
+        // small enough to be built by one thread each
+        std::vector<BVHBuildTask> pending = {{0, 0, count, 0}};
+        std::vector<BVHBuildTask> subtrees = {};
+        while (!pending.empty())
+        {
+            const BVHBuildTask task = pending.back();
+            pending.pop_back();
+
+            BVHBuildTask left, right;
+            if (!threadPool || task.Count < ParallelNodeSize)
+                subtrees.push_back(task);
+            else if (builder.SplitNode(task, threadPool, left, right))
+            {
+                pending.push_back(left);
+                pending.push_back(right);
+            }
+        }
+
+        // Largest subtrees first, so the threads finish at about the same time
+        std::sort(subtrees.begin(), subtrees.end(),
+                  [](const BVHBuildTask& a, const BVHBuildTask& b) { return a.Count > b.Count; });
+
+        auto buildSubtrees = [&](uint32_t begin, uint32_t end)
+        {
+            for (uint32_t i = begin; i < end; i++) builder.BuildSubtree(subtrees[i]);
+        };
+
+        if (threadPool)
+            threadPool->ParallelFor((uint32_t)subtrees.size(), 1, buildSubtrees);
+        else
+            buildSubtrees(0, (uint32_t)subtrees.size());
+
+        mBounds = builder.Nodes[0].Bounds;
+
+        CollapseNode(builder.Nodes, 0, 1, HalfArea(mBounds), clampedSettings, mNodes, mStats);
+
+        mStats.NodeCount = (uint32_t)mNodes.size();
+        mStats.AverageChildCount /= mStats.NodeCount;
+        mStats.BuildTimeMs =
+            std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+    }
+
+} // namespace vr
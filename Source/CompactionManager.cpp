@@ -0,0 +1,209 @@
+#include "Vulray/CompactionManager.h"
+
+#include "Vulray/VulrayDevice.h"
+
+namespace vr
+{
+
+    CompactionManager::CompactionManager(vr::VulrayDevice* device, bool packed) : mDevice(device), mPacked(packed) {}
+
+    CompactionManager::~CompactionManager()
+    {
+        // The GPU is expected to be idle when the manager is destroyed
+        for (auto& batch : mPendingBatches) mDevice->FreeQueries(batch.Queries);
+
+        for (auto& retired : mRetiredBLAS) mDevice->DestroyBLAS(retired.Handle);
+    }
+
+    void CompactionManager::Enqueue(const std::vector<BLASHandle*>& blas, const std::vector<BLASBuildInfo>& buildInfos,
+                                    vk::CommandBuffer cmdBuf)
+    {
+        if (blas.size() != buildInfos.size())
+        {
+            VULRAY_LOG_ERROR("CompactionManager::Enqueue: BLAS count doesn't match the build info count");
+            return;
+        }
+
+        PendingBatch batch = {};
+        for (size_t i = 0; i < blas.size(); i++)
+        {
+            if (!(buildInfos[i].BuildGeometryInfo.flags & vk::BuildAccelerationStructureFlagBitsKHR::eAllowCompaction))
+                continue;
+
+            batch.Handles.push_back(blas[i]);
+            batch.SourceBLAS.push_back(blas[i]->AccelerationStructure);
+        }
+
+        if (batch.Handles.empty())
+            return;
+
+        const uint32_t queryCount = (uint32_t)batch.SourceBLAS.size();
+
+        batch.Queries = mDevice->AllocateQueries(vk::QueryType::eAccelerationStructureCompactedSizeKHR, queryCount,
+                                                 cmdBuf);
+        if (!batch.Queries.IsValid())
+            return;
+
+        // The builds have to be finished before their compacted size can be queried
+        auto barrier = vk::MemoryBarrier()
+                           .setSrcAccessMask(vk::AccessFlagBits::eAccelerationStructureWriteKHR)
+                           .setDstAccessMask(vk::AccessFlagBits::eAccelerationStructureReadKHR);
+
+        cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
+                               vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR, (vk::DependencyFlagBits)0, 1,
+                               &barrier, 0, nullptr, 0, nullptr);
+
+        cmdBuf.writeAccelerationStructuresPropertiesKHR(
+            batch.SourceBLAS, vk::QueryType::eAccelerationStructureCompactedSizeKHR, batch.Queries.Pool,
+            batch.Queries.FirstQuery, mDevice->GetDynamicLoader());
+
+        mStats.PendingCount += queryCount;
+        mPendingBatches.push_back(std::move(batch));
+    }
+
+    void CompactionManager::Cancel(const BLASHandle* blas)
+    {
+        for (auto& batch : mPendingBatches)
+        {
+            for (auto& handle : batch.Handles)
+            {
+                if (handle == blas)
+                {
+                    handle = nullptr;
+                    mStats.PendingCount--;
+                }
+            }
+        }
+    }
+
+    void CompactionManager::Submit(const SyncPoint& syncPoint)
+    {
+        for (auto& batch : mPendingBatches)
+        {
+            if (batch.Submitted)
+                continue;
+            batch.Sync = syncPoint;
+            batch.Submitted = true;
+        }
+
+        for (auto& retired : mRetiredBLAS)
+        {
+            if (retired.Submitted)
+                continue;
+            retired.Sync = syncPoint;
+            retired.Submitted = true;
+        }
+    }
+
+    std::vector<BLASHandle*> CompactionManager::Update(vk::CommandBuffer cmdBuf)
+    {
+        DestroyFinishedBLAS();
+
+        std::vector<BLASHandle*> outChanged;
+
+        for (auto it = mPendingBatches.begin(); it != mPendingBatches.end();)
+        {
+            if (!it->Submitted || !mDevice->IsSyncPointReached(it->Sync))
+            {
+                ++it;
+                continue;
+            }
+
+            const uint32_t queryCount = (uint32_t)it->SourceBLAS.size();
+
+            // The submission is finished, so the results are available and this doesn't wait
+            auto sizes = mDevice->GetQueryResults(it->Queries);
+
+            if (sizes.empty())
+            {
+                ++it;
+                continue;
+            }
+
+            for (uint32_t i = 0; i < queryCount; i++)
+            {
+                // A size of 0 makes CompactBLAS(...) skip the BLAS
+                if (!it->Handles[i])
+                {
+                    sizes[i] = 0;
+                    continue;
+                }
+
+                mStats.PendingCount--;
+
+                if (sizes[i] == 0 || sizes[i] >= it->Handles[i]->Buffer.Size)
+                {
+                    sizes[i] = 0;
+                    mStats.SkippedCount++;
+                    continue;
+                }
+            }
+
+            CompactionRequest request = {};
+            request.SourceBLAS = it->SourceBLAS;
+
+            auto oldBLAS = mPacked ? mDevice->CompactBLASPacked(request, sizes, it->Handles, cmdBuf)
+                                   : mDevice->CompactBLAS(request, sizes, it->Handles, cmdBuf);
+
+            // A BLAS was only compacted if its old handle came back, the storage of the compacted copy can fail,
+            // e.g. when the packed buffer can't be allocated, then the BLAS stays as it is
+            for (uint32_t i = 0; i < queryCount; i++)
+            {
+                if (sizes[i] == 0)
+                    continue;
+
+                if (!oldBLAS[i].AccelerationStructure)
+                {
+                    mStats.SkippedCount++;
+                    continue;
+                }
+
+                mStats.CompactedCount++;
+                mStats.BytesBeforeCompaction += oldBLAS[i].Buffer.Size;
+                mStats.BytesAfterCompaction += sizes[i];
+                outChanged.push_back(it->Handles[i]);
+
+                mRetiredBLAS.push_back({oldBLAS[i], {}, false});
+            }
+
+            mDevice->FreeQueries(it->Queries);
+            it = mPendingBatches.erase(it);
+        }
+
+        if (!outChanged.empty())
+        {
+            // Make the compacted BLASes visible to TLAS builds and ray tracing
+            auto barrier = vk::MemoryBarrier()
+                               .setSrcAccessMask(vk::AccessFlagBits::eAccelerationStructureWriteKHR)
+                               .setDstAccessMask(vk::AccessFlagBits::eAccelerationStructureReadKHR);
+
+            cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
+                                   vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR |
+                                       vk::PipelineStageFlagBits::eRayTracingShaderKHR,
+                                   (vk::DependencyFlagBits)0, 1, &barrier, 0, nullptr, 0, nullptr);
+        }
+
+        mStats.RetiredCount = (uint32_t)mRetiredBLAS.size();
+        return outChanged;
+    }
+
+    CompactionStatistics CompactionManager::GetStatistics() const
+    {
+        return mStats;
+    }
+
+    void CompactionManager::DestroyFinishedBLAS()
+    {
+        for (auto it = mRetiredBLAS.begin(); it != mRetiredBLAS.end();)
+        {
+            if (it->Submitted && mDevice->IsSyncPointReached(it->Sync))
+            {
+                mDevice->DestroyBLAS(it->Handle);
+                it = mRetiredBLAS.erase(it);
+            }
+            else
+                ++it;
+        }
+    }
+
+} // namespace vr
@@ -0,0 +1,224 @@
+#include "Vulray/DeviceInstanceBuffer.h"
+
+#include "Vulray/VulrayDevice.h"
+
+namespace vr
+{
+    static constexpr vk::DeviceSize InstanceSize = sizeof(vk::AccelerationStructureInstanceKHR);
+
+    DeviceInstanceBuffer::DeviceInstanceBuffer(vr::VulrayDevice* device, const DeviceInstanceBufferCreateInfo& info)
+        : mDevice(device), mInfo(info)
+    {
+        mInfo.FramesInFlight = std::max(mInfo.FramesInFlight, 1u);
+
+        const vk::DeviceSize bufferSize = mInfo.MaxInstanceCount * InstanceSize;
+
+        mBuffer = mDevice->CreateBuffer(bufferSize,
+                                        vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR |
+                                            vk::BufferUsageFlagBits::eTransferDst);
+
+        // Every allocation in the ring is a multiple of the instance size, so instances never straddle the ring end
+        mStagingRing = mDevice->CreateBuffer(bufferSize * mInfo.FramesInFlight, vk::BufferUsageFlagBits::eTransferSrc,
+                                             VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
+
+        if (!mBuffer.Buffer || !mStagingRing.Buffer)
+        {
+            VULRAY_LOG_ERROR("DeviceInstanceBuffer: Failed to create the instance buffer or the staging ring");
+            return;
+        }
+
+        // Mapped for the lifetime of the buffer
+        mMappedRing = (uint8_t*)mDevice->MapBuffer(mStagingRing);
+    }
+
+    DeviceInstanceBuffer::~DeviceInstanceBuffer()
+    {
+        // The GPU is expected to be idle when the buffer is destroyed
+        if (mMappedRing)
+            mDevice->UnmapBuffer(mStagingRing);
+        mDevice->DestroyBuffer(mStagingRing);
+        mDevice->DestroyBuffer(mBuffer);
+    }
+
+    bool DeviceInstanceBuffer::ReserveRing(vk::DeviceSize size, vk::DeviceSize& outOffset)
+    {
+        const vk::DeviceSize ringSize = mStagingRing.Size;
+
+        if (mRingUsed == 0)
+            mRingHead = mRingTail = 0;
+
+        // The live bytes are [tail, head) if they don't wrap around, else [tail, end) and [0, head)
+        const bool wrapped = mRingHead < mRingTail || (mRingHead == mRingTail && mRingUsed > 0);
+
+        vk::DeviceSize skipped = 0;
+        if (wrapped)
+        {
+            if (mRingTail - mRingHead < size)
+                return false;
+            outOffset = mRingHead;
+        }
+        else if (ringSize - mRingHead >= size)
+            outOffset = mRingHead;
+        else if (mRingTail >= size)
+        {
+            // The end of the ring is too small, it stays unused until the ring wraps around again
+            skipped = ringSize - mRingHead;
+            outOffset = 0;
+        }
+        else
+            return false;
+
+        mRingHead = outOffset + size;
+        mRingUsed += skipped + size;
+        mFrameBytes += skipped + size;
+        return true;
+    }
+
+    vk::AccelerationStructureInstanceKHR* DeviceInstanceBuffer::Stage(uint32_t firstInstance, uint32_t count)
+    {
+        if (!mMappedRing || count == 0 || (uint64_t)firstInstance + count > mInfo.MaxInstanceCount)
+        {
+            VULRAY_LOG_ERROR("DeviceInstanceBuffer::Stage: The range is empty or out of bounds");
+            return nullptr;
+        }
+
+        const vk::DeviceSize size = count * InstanceSize;
+
+        vk::DeviceSize ringOffset = 0;
+        if (!ReserveRing(size, ringOffset))
+        {
+            mStats.RingFullCount++;
+            VULRAY_LOG_WARNING("DeviceInstanceBuffer::Stage: The staging ring is full, call Update() every frame or "
+                               "increase FramesInFlight");
+            return nullptr;
+        }
+
+        mFrameRegions.push_back(vk::BufferCopy()
+                                    .setSrcOffset(ringOffset)
+                                    .setDstOffset(firstInstance * InstanceSize)
+                                    .setSize(size));
+
+        return (vk::AccelerationStructureInstanceKHR*)(mMappedRing + ringOffset);
+    }
+
+    bool DeviceInstanceBuffer::Upload(uint32_t firstInstance, const vk::AccelerationStructureInstanceKHR* instances,
+                                      uint32_t count)
+    {
+        auto dst = Stage(firstInstance, count);
+        if (!dst)
+            return false;
+
+        memcpy(dst, instances, count * InstanceSize);
+        return true;
+    }
+
+    void DeviceInstanceBuffer::RecordUpload(vk::CommandBuffer cmdBuf)
+    {
+        mStats.UploadedBytes = 0;
+        mStats.CopyRegionCount = 0;
+
+        if (mFrameRegions.empty())
+            return;
+
+        // Ranges staged one after another for consecutive instances become one region
+        std::vector<vk::BufferCopy> regions = {};
+        regions.reserve(mFrameRegions.size());
+        for (const auto& region : mFrameRegions)
+        {
+            if (!regions.empty() && regions.back().srcOffset + regions.back().size == region.srcOffset &&
+                regions.back().dstOffset + regions.back().size == region.dstOffset)
+                regions.back().size += region.size;
+            else
+                regions.push_back(region);
+
+            mStats.UploadedBytes += region.size;
+        }
+        mStats.CopyRegionCount = (uint32_t)regions.size();
+
+        // No-op for host coherent memory
+        for (const auto& region : regions)
+            vmaFlushAllocation(mDevice->GetAllocator(), mStagingRing.Allocation, region.srcOffset, region.size);
+
+        // The destination regions of a single copy must not overlap
+        auto sortedRegions = regions;
+        std::sort(sortedRegions.begin(), sortedRegions.end(),
+                  [](const vk::BufferCopy& a, const vk::BufferCopy& b) { return a.dstOffset < b.dstOffset; });
+        bool overlapping = false;
+        for (size_t i = 1; i < sortedRegions.size(); i++)
+            overlapping |= sortedRegions[i - 1].dstOffset + sortedRegions[i - 1].size > sortedRegions[i].dstOffset;
+
+        // Builds of earlier frames may still read the instances that are overwritten
+        cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR,
+                               vk::PipelineStageFlagBits::eTransfer, (vk::DependencyFlagBits)0, 0, nullptr, 0,
+                               nullptr, 0, nullptr);
+
+        if (!overlapping)
+            cmdBuf.copyBuffer(mStagingRing.Buffer, mBuffer.Buffer, regions);
+        else
+        {
+            // Copy in staging order, so the range staged last wins
+            auto transferBarrier = vk::MemoryBarrier()
+                                       .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+                                       .setDstAccessMask(vk::AccessFlagBits::eTransferWrite);
+            for (size_t i = 0; i < regions.size(); i++)
+            {
+                if (i > 0)
+                    cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer,
+                                           (vk::DependencyFlagBits)0, 1, &transferBarrier, 0, nullptr, 0, nullptr);
+                cmdBuf.copyBuffer(mStagingRing.Buffer, mBuffer.Buffer, regions[i]);
+            }
+        }
+
+        auto barrier = vk::MemoryBarrier()
+                           .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+                           .setDstAccessMask(vk::AccessFlagBits::eShaderRead);
+
+        cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                               vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR, (vk::DependencyFlagBits)0, 1,
+                               &barrier, 0, nullptr, 0, nullptr);
+
+        InFlightUpload upload = {};
+        upload.End = mRingHead;
+        upload.Bytes = mFrameBytes;
+        mInFlightUploads.push_back(upload);
+
+        mFrameBytes = 0;
+        mFrameRegions.clear();
+    }
+
+    void DeviceInstanceBuffer::Submit(const SyncPoint& syncPoint)
+    {
+        for (auto& upload : mInFlightUploads)
+        {
+            if (upload.Submitted)
+                continue;
+            upload.Sync = syncPoint;
+            upload.Submitted = true;
+        }
+    }
+
+    void DeviceInstanceBuffer::Update()
+    {
+        // The ring is freed in order, a finished upload behind an unfinished one waits for it
+        size_t finished = 0;
+        for (; finished < mInFlightUploads.size(); finished++)
+        {
+            const auto& upload = mInFlightUploads[finished];
+            if (!upload.Submitted || !mDevice->IsSyncPointReached(upload.Sync))
+                break;
+
+            mRingTail = upload.End;
+            mRingUsed -= upload.Bytes;
+        }
+        mInFlightUploads.erase(mInFlightUploads.begin(), mInFlightUploads.begin() + finished);
+    }
+
+    DeviceInstanceBufferStatistics DeviceInstanceBuffer::GetStatistics() const
+    {
+        DeviceInstanceBufferStatistics outStats = mStats;
+        outStats.RingSize = mStagingRing.Size;
+        outStats.RingUsedBytes = mRingUsed;
+        return outStats;
+    }
+
+} // namespace vr
@@ -0,0 +1,141 @@
+#include "Vulray/GPUInstances/InstanceGenerator.h"
+
+#include "Vulray/VulrayDevice.h"
+
+#include "InstanceGenerator.spv.h"
+
+namespace vr
+{
+    static constexpr uint32_t GROUP_SIZE = 64;
+
+    // Must match the shader
+    static constexpr uint32_t CULL_FRUSTUM = 0x1;
+    static constexpr uint32_t CULL_DISTANCE = 0x2;
+
+    InstanceGenerator::InstanceGenerator(vr::VulrayDevice* device, uint32_t setCount) : mDevice(device)
+    {
+        Init(std::max(setCount, 1u));
+    }
+
+    InstanceGenerator::~InstanceGenerator()
+    {
+        mDevice->GetDevice().destroyDescriptorSetLayout(mDescriptorSetLayout);
+        mDevice->DestroyBuffer(mDescriptorBuffer.Buffer);
+
+        mDevice->GetDevice().destroyPipeline(mPipeline);
+        mDevice->GetDevice().destroyPipelineLayout(mPipelineLayout);
+
+        mDevice->GetDevice().destroyShaderModule(mShaderModule);
+    }
+
+    void InstanceGenerator::Init(uint32_t setCount)
+    {
+        // Instances, transforms, BLAS table and output instances
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            mDescriptorItems.push_back(vr::DescriptorItem(i, vk::DescriptorType::eStorageBuffer,
+                                                          vk::ShaderStageFlagBits::eCompute, 1, &mBuffers[i]));
+        }
+
+        mDescriptorSetLayout = mDevice->CreateDescriptorSetLayout(mDescriptorItems);
+        mDescriptorBuffer = mDevice->CreateDescriptorBuffer(mDescriptorSetLayout, mDescriptorItems,
+                                                            vr::DescriptorBufferType::Resource, setCount);
+
+        auto pushConstantRange = vk::PushConstantRange()
+                                     .setStageFlags(vk::ShaderStageFlagBits::eCompute)
+                                     .setOffset(0)
+                                     .setSize(sizeof(PushConstantData));
+        auto pipelineLayoutInfo = vk::PipelineLayoutCreateInfo()
+                                      .setSetLayoutCount(1)
+                                      .setPSetLayouts(&mDescriptorSetLayout)
+                                      .setPPushConstantRanges(&pushConstantRange)
+                                      .setPushConstantRangeCount(1);
+
+        mPipelineLayout = mDevice->GetDevice().createPipelineLayout(pipelineLayoutInfo);
+
+        // Spirv always has a size that is a multiple of 4
+        auto shaderModuleInfo = vk::ShaderModuleCreateInfo()
+                                    .setCodeSize(sizeof(g_InstanceGenerator_main))
+                                    .setPCode((uint32_t*)&g_InstanceGenerator_main);
+        mShaderModule = mDevice->GetDevice().createShaderModule(shaderModuleInfo);
+
+        auto pipelineInfo = vk::ComputePipelineCreateInfo()
+                                .setFlags(vk::PipelineCreateFlagBits::eDescriptorBufferEXT)
+                                .setLayout(mPipelineLayout)
+                                .setStage(vk::PipelineShaderStageCreateInfo()
+                                              .setStage(vk::ShaderStageFlagBits::eCompute)
+                                              .setModule(mShaderModule)
+                                              .setPName("InstanceGenerator_main"));
+
+        auto res = mDevice->GetDevice().createComputePipeline(nullptr, pipelineInfo);
+
+        if (res.result != vk::Result::eSuccess)
+            VULRAY_LOG_ERROR("Failed to create instance generator pipeline");
+        mPipeline = res.value;
+    }
+
+    AllocatedBuffer InstanceGenerator::CreateOutputBuffer(uint32_t instanceCount)
+    {
+        return mDevice->CreateBuffer((vk::DeviceSize)instanceCount * sizeof(vk::AccelerationStructureInstanceKHR),
+                                     vk::BufferUsageFlagBits::eStorageBuffer |
+                                         vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR,
+                                     0, 16);
+    }
+
+    void InstanceGenerator::SetBuffers(const AllocatedBuffer& instances, const AllocatedBuffer& transforms,
+                                       const AllocatedBuffer& blasTable, const AllocatedBuffer& outInstances,
+                                       uint32_t setIndex)
+    {
+        if (setIndex >= mDescriptorBuffer.SetCount)
+        {
+            VULRAY_FLOG_ERROR("InstanceGenerator::SetBuffers: Set index %u is out of range of %u sets", setIndex,
+                              mDescriptorBuffer.SetCount);
+            return;
+        }
+
+        mBuffers[0] = instances;
+        mBuffers[1] = transforms;
+        mBuffers[2] = blasTable;
+        mBuffers[3] = outInstances;
+
+        mDevice->UpdateDescriptorBuffer(mDescriptorBuffer, mDescriptorItems, vr::DescriptorBufferType::Resource,
+                                        setIndex);
+    }
+
+    void InstanceGenerator::Generate(uint32_t instanceCount, const InstanceGenerateSettings& settings,
+                                     vk::CommandBuffer cmdBuf, uint32_t setIndex)
+    {
+        if (instanceCount == 0)
+            return;
+
+        PushConstantData pushData = {};
+        memcpy(pushData.FrustumPlanes, settings.FrustumPlanes, sizeof(pushData.FrustumPlanes));
+        memcpy(pushData.CameraPositionAndMaxDistance, settings.CameraPosition, 3 * sizeof(float));
+        pushData.CameraPositionAndMaxDistance[3] = settings.MaxDistance;
+        pushData.InstanceCount = instanceCount;
+        pushData.CullFlags =
+            (settings.FrustumCulling ? CULL_FRUSTUM : 0) | (settings.DistanceCulling ? CULL_DISTANCE : 0);
+        pushData.FarMask = settings.FarMask;
+        pushData.MaskDistance = settings.MaskDistance;
+
+        cmdBuf.bindPipeline(vk::PipelineBindPoint::eCompute, mPipeline);
+        mDevice->BindDescriptorBuffer({mDescriptorBuffer}, cmdBuf);
+        mDevice->BindDescriptorSet(mPipelineLayout, 0, 0, mDescriptorBuffer.GetOffsetToSet(setIndex), cmdBuf,
+                                   vk::PipelineBindPoint::eCompute);
+
+        cmdBuf.pushConstants(mPipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(PushConstantData),
+                             &pushData);
+
+        cmdBuf.dispatch((instanceCount + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+
+        // The TLAS build reads the instances as an acceleration structure build input
+        auto barrier = vk::MemoryBarrier()
+                           .setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+                           .setDstAccessMask(vk::AccessFlagBits::eShaderRead);
+
+        cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+                               vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR, (vk::DependencyFlagBits)0, 1,
+                               &barrier, 0, nullptr, 0, nullptr);
+    }
+
+} // namespace vr
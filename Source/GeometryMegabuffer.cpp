@@ -0,0 +1,262 @@
+#include "Vulray/GeometryMegabuffer.h"
+
+#include "Vulray/VulrayDevice.h"
+
+namespace vr
+{
+
+    // The vertex stride doesn't have to be a power of two, so AlignUp(...) can't be used
+    static vk::DeviceSize RoundUpToMultiple(vk::DeviceSize value, vk::DeviceSize multiple)
+    {
+        return (value + multiple - 1) / multiple * multiple;
+    }
+
+    static uint32_t GetIndexSize(vk::IndexType indexType)
+    {
+        return indexType == vk::IndexType::eUint16 ? 2 : 4;
+    }
+
+    // GeometryData::PrimitiveOffset is 32-bit, so no offset inside a block may reach 4 GiB
+    static constexpr vk::DeviceSize MaxBlockSize = 1ull << 32;
+
+    GeometryMegabuffer::GeometryMegabuffer(vr::VulrayDevice* device, const GeometryMegabufferCreateInfo& info)
+        : mDevice(device), mInfo(info)
+    {
+        if (mInfo.BlockSize > MaxBlockSize)
+        {
+            VULRAY_LOG_WARNING("GeometryMegabuffer: BlockSize is limited to 4 GiB, the offsets are 32-bit");
+            mInfo.BlockSize = MaxBlockSize;
+        }
+    }
+
+    GeometryMegabuffer::~GeometryMegabuffer()
+    {
+        // The GPU is expected to be idle when the megabuffer is destroyed
+        for (auto& staging : mStagingBuffers) mDevice->DestroyBuffer(staging.Buffer);
+        for (auto& block : mBlocks) mDevice->DestroyBuffer(block.Buffer);
+    }
+
+    uint32_t GeometryMegabuffer::CreateBlock(vk::DeviceSize capacity)
+    {
+        Block block = {};
+        block.Buffer = mDevice->CreateBuffer(capacity,
+                                             vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR |
+                                                 vk::BufferUsageFlagBits::eTransferDst | mInfo.ExtraUsage);
+        if (!block.Buffer.Buffer)
+            return ~0U;
+
+        block.Capacity = capacity;
+        mBlocks.push_back(std::move(block));
+        return (uint32_t)mBlocks.size() - 1;
+    }
+
+    GeometryMegabufferAllocation GeometryMegabuffer::Append(const void* vertices, uint32_t vertexCount,
+                                                            uint32_t vertexStride, const void* indices,
+                                                            uint32_t indexCount, vk::IndexType indexFormat)
+    {
+        GeometryMegabufferAllocation outAlloc = {};
+
+        if (!vertices || vertexCount == 0 || vertexStride == 0 || vertexStride % 4 != 0)
+        {
+            VULRAY_LOG_ERROR("GeometryMegabuffer::Append: Vertices are empty or the stride is not a multiple of 4");
+            return outAlloc;
+        }
+
+        const uint32_t indexSize = indices ? GetIndexSize(indexFormat) : 0;
+        const vk::DeviceSize vertexBytes = (vk::DeviceSize)vertexCount * vertexStride;
+        const vk::DeviceSize indexBytes = (vk::DeviceSize)indexCount * indexSize;
+
+        // Vertices start at a multiple of the stride, so the offset can be expressed as FirstVertex.
+        // The indices follow at a multiple of 4, which is valid for both index sizes
+        auto layout = [&](vk::DeviceSize start, vk::DeviceSize& outVertexOffset, vk::DeviceSize& outIndexOffset)
+        {
+            outVertexOffset = RoundUpToMultiple(start, vertexStride);
+            outIndexOffset = RoundUpToMultiple(outVertexOffset + vertexBytes, 4);
+            return outIndexOffset + indexBytes;
+        };
+
+        vk::DeviceSize vertexOffset = 0;
+        vk::DeviceSize indexOffset = 0;
+        uint32_t blockIndex = mCurrentBlock;
+
+        if (blockIndex == ~0U || layout(mBlocks[blockIndex].UsedSize, vertexOffset, indexOffset) >
+                                     mBlocks[blockIndex].Capacity)
+        {
+            const vk::DeviceSize meshSize = layout(0, vertexOffset, indexOffset);
+            if (indexBytes > 0 && indexOffset >= MaxBlockSize)
+            {
+                VULRAY_LOG_ERROR("GeometryMegabuffer::Append: The vertices of the mesh are 4 GiB or more, the index "
+                                 "offset wouldn't fit in GeometryData::PrimitiveOffset");
+                return outAlloc;
+            }
+
+            // Oversized meshes get a block of their own, the current block keeps receiving the small ones
+            if (meshSize > mInfo.BlockSize)
+                blockIndex = CreateBlock(meshSize);
+            else
+                blockIndex = mCurrentBlock = CreateBlock(mInfo.BlockSize);
+
+            if (blockIndex == ~0U)
+            {
+                VULRAY_LOG_ERROR("GeometryMegabuffer::Append: Failed to create a block");
+                return outAlloc;
+            }
+        }
+
+        auto& block = mBlocks[blockIndex];
+        const vk::DeviceSize end = layout(block.UsedSize, vertexOffset, indexOffset);
+
+        // Stage the data with the padding, so the pending range of the block stays contiguous
+        block.PendingData.resize(end - block.FlushedSize, 0);
+        memcpy(block.PendingData.data() + (vertexOffset - block.FlushedSize), vertices, vertexBytes);
+        if (indexBytes > 0)
+            memcpy(block.PendingData.data() + (indexOffset - block.FlushedSize), indices, indexBytes);
+        block.UsedSize = end;
+
+        outAlloc.BlockIndex = blockIndex;
+        outAlloc.VertexOffset = vertexOffset;
+        outAlloc.VertexCount = vertexCount;
+        outAlloc.VertexStride = vertexStride;
+        outAlloc.IndexOffset = indexOffset;
+        outAlloc.IndexCount = indexBytes > 0 ? indexCount : 0;
+        outAlloc.IndexFormat = indexBytes > 0 ? indexFormat : vk::IndexType::eNoneKHR;
+
+        mAllocationCount++;
+        return outAlloc;
+    }
+
+    GeometryData GeometryMegabuffer::GetGeometryData(const GeometryMegabufferAllocation& allocation,
+                                                     vk::Format vertexFormat) const
+    {
+        GeometryData outGeom = {};
+        if (!allocation.IsValid())
+            return outGeom;
+
+        // Append(...) keeps the offsets that are used below 4 GiB, so they fit in 32 bits
+        const bool indexed = allocation.IndexFormat != vk::IndexType::eNoneKHR;
+        if ((indexed ? allocation.IndexOffset : allocation.VertexOffset) >= MaxBlockSize)
+        {
+            VULRAY_LOG_ERROR("GeometryMegabuffer::GetGeometryData: The offsets of the allocation don't fit in 32 bits");
+            return outGeom;
+        }
+
+        const vk::DeviceAddress blockAddress = mBlocks[allocation.BlockIndex].Buffer.DevAddress;
+
+        outGeom.Type = vk::GeometryTypeKHR::eTriangles;
+        outGeom.DataAddresses.VertexDevAddress = blockAddress;
+        outGeom.VertexFormat = vertexFormat;
+        outGeom.Stride = allocation.VertexStride;
+        outGeom.IndexFormat = allocation.IndexFormat;
+
+        if (indexed)
+        {
+            // The indices stay relative to the mesh, FirstVertex moves them to the vertices of the mesh
+            outGeom.DataAddresses.IndexDevAddress = blockAddress;
+            outGeom.PrimitiveOffset = (uint32_t)allocation.IndexOffset;
+            outGeom.FirstVertex = (uint32_t)(allocation.VertexOffset / allocation.VertexStride);
+            outGeom.PrimitiveCount = allocation.IndexCount / 3;
+        }
+        else
+        {
+            outGeom.PrimitiveOffset = (uint32_t)allocation.VertexOffset;
+            outGeom.PrimitiveCount = allocation.VertexCount / 3;
+        }
+        outGeom.MaxVertex = outGeom.FirstVertex + allocation.VertexCount - 1;
+
+        return outGeom;
+    }
+
+    void GeometryMegabuffer::Flush(vk::CommandBuffer cmdBuf)
+    {
+        vk::DeviceSize pendingBytes = 0;
+        for (const auto& block : mBlocks) pendingBytes += block.PendingData.size();
+
+        if (pendingBytes == 0)
+            return;
+
+        StagingBuffer staging = {};
+        staging.Buffer = mDevice->CreateBuffer(pendingBytes, vk::BufferUsageFlagBits::eTransferSrc,
+                                               VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
+        if (!staging.Buffer.Buffer)
+        {
+            VULRAY_LOG_ERROR("GeometryMegabuffer::Flush: Failed to create the staging buffer");
+            return;
+        }
+
+        uint8_t* mapped = (uint8_t*)mDevice->MapBuffer(staging.Buffer);
+        vk::DeviceSize stagingOffset = 0;
+
+        for (auto& block : mBlocks)
+        {
+            if (block.PendingData.empty())
+                continue;
+
+            memcpy(mapped + stagingOffset, block.PendingData.data(), block.PendingData.size());
+
+            // The pending range of a block is contiguous, so every block needs a single region
+            auto region = vk::BufferCopy()
+                              .setSrcOffset(stagingOffset)
+                              .setDstOffset(block.FlushedSize)
+                              .setSize(block.PendingData.size());
+            cmdBuf.copyBuffer(staging.Buffer.Buffer, block.Buffer.Buffer, region);
+
+            stagingOffset += block.PendingData.size();
+            block.FlushedSize = block.UsedSize;
+            block.PendingData.clear();
+            block.PendingData.shrink_to_fit();
+        }
+
+        mDevice->UnmapBuffer(staging.Buffer);
+        mStagingBuffers.push_back(staging);
+
+        auto barrier = vk::MemoryBarrier()
+                           .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+                           .setDstAccessMask(vk::AccessFlagBits::eShaderRead);
+
+        cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                               vk::PipelineStageFlagBits::eAccelerationStructureBuildKHR |
+                                   vk::PipelineStageFlagBits::eRayTracingShaderKHR |
+                                   vk::PipelineStageFlagBits::eComputeShader,
+                               (vk::DependencyFlagBits)0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    void GeometryMegabuffer::Submit(const SyncPoint& syncPoint)
+    {
+        for (auto& staging : mStagingBuffers)
+        {
+            if (staging.Submitted)
+                continue;
+            staging.Sync = syncPoint;
+            staging.Submitted = true;
+        }
+    }
+
+    void GeometryMegabuffer::Update()
+    {
+        std::erase_if(mStagingBuffers,
+                      [&](StagingBuffer& staging)
+                      {
+                          if (!staging.Submitted || !mDevice->IsSyncPointReached(staging.Sync))
+                              return false;
+                          mDevice->DestroyBuffer(staging.Buffer);
+                          return true;
+                      });
+    }
+
+    GeometryMegabufferStatistics GeometryMegabuffer::GetStatistics() const
+    {
+        GeometryMegabufferStatistics outStats = {};
+        outStats.BlockCount = (uint32_t)mBlocks.size();
+        outStats.AllocationCount = mAllocationCount;
+        outStats.StagingBufferCount = (uint32_t)mStagingBuffers.size();
+
+        for (const auto& block : mBlocks)
+        {
+            outStats.BlockBytes += block.Capacity;
+            outStats.UsedBytes += block.UsedSize;
+            outStats.PendingUploadBytes += block.PendingData.size();
+        }
+        return outStats;
+    }
+
+} // namespace vr
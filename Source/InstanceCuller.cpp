@@ -0,0 +1,351 @@
+#include "Vulray/InstanceCuller.h"
+
+#include "Vulray/VulrayDevice.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VULRAY_INSTANCE_CULLER_SSE
+#include <emmintrin.h>
+#endif
+
+namespace vr
+{
+    // Instances per chunk, chunks are the unit of the parallel work and of the compaction
+    static constexpr uint32_t ChunkSize = 2048;
+
+    static constexpr float Pi = 3.14159265f;
+
+    enum class CullResult : uint32_t
+    {
+        Visible,
+        Distance,
+        Frustum,
+        SolidAngle,
+    };
+
+    // The settings in a form that needs no branches in the tests, disabled tests can never fail
+    struct CullConstants
+    {
+        float Camera[3] = {};
+        float MaxDistance = FLT_MAX;
+        float Planes[6][4] = {};
+        uint32_t PlaneCount = 0;
+        float Margin = 0.0f;
+
+        // Sine of the half angle of a cone covering MinSolidAngle, a sphere covers less if radius < SinAngle * distance
+        float SinAngle = 0.0f;
+    };
+
+    static CullConstants MakeCullConstants(const InstanceCullSettings& settings)
+    {
+        CullConstants outConstants = {};
+        memcpy(outConstants.Camera, settings.CameraPosition, sizeof(outConstants.Camera));
+
+        if (settings.DistanceCulling)
+            outConstants.MaxDistance = settings.MaxDistance;
+
+        if (settings.FrustumCulling)
+        {
+            memcpy(outConstants.Planes, settings.FrustumPlanes, sizeof(outConstants.Planes));
+            outConstants.PlaneCount = 6;
+            outConstants.Margin = settings.FrustumMargin;
+        }
+
+        // A cone with the half angle t covers 2 * pi * (1 - cos(t)) steradians, a sphere outside of the camera covers
+        // at most a half space
+        if (settings.SolidAngleCulling)
+        {
+            const float solidAngle = std::clamp(settings.MinSolidAngle, 0.0f, 2.0f * Pi);
+            const float cosAngle = 1.0f - solidAngle / (2.0f * Pi);
+            outConstants.SinAngle = std::sqrt(1.0f - cosAngle * cosAngle);
+        }
+        return outConstants;
+    }
+
+    static void LoadSphere(const InstanceBounds& bounds, uint32_t i, float& x, float& y, float& z, float& r)
+    {
+        if (bounds.Type == InstanceBoundsType::Spheres)
+        {
+            const float* sphere = bounds.Data + (size_t)i * 4;
+            x = sphere[0];
+            y = sphere[1];
+            z = sphere[2];
+            r = sphere[3];
+        }
+        else
+        {
+            const float* box = bounds.Data + (size_t)i * 6;
+            x = 0.5f * (box[0] + box[3]);
+            y = 0.5f * (box[1] + box[4]);
+            z = 0.5f * (box[2] + box[5]);
+
+            const float ex = 0.5f * (box[3] - box[0]);
+            const float ey = 0.5f * (box[4] - box[1]);
+            const float ez = 0.5f * (box[5] - box[2]);
+            r = std::sqrt(ex * ex + ey * ey + ez * ez);
+        }
+    }
+
+    static CullResult CullSphere(const CullConstants& constants, float x, float y, float z, float r)
+    {
+        const float dx = x - constants.Camera[0];
+        const float dy = y - constants.Camera[1];
+        const float dz = z - constants.Camera[2];
+        const float distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+
+        if (distance - r > constants.MaxDistance)
+            return CullResult::Distance;
+
+        for (uint32_t p = 0; p < constants.PlaneCount; p++)
+        {
+            const float* plane = constants.Planes[p];
+            if (plane[0] * x + plane[1] * y + plane[2] * z + plane[3] < -(r + constants.Margin))
+                return CullResult::Frustum;
+        }
+
+        if (r < constants.SinAngle * distance)
+            return CullResult::SolidAngle;
+
+        return CullResult::Visible;
+    }
+
+#ifdef VULRAY_INSTANCE_CULLER_SSE
+
+    // Loads the bounds of the instances [i, i + 4) as 4 spheres in SoA layout
+    static void LoadSpheres4(const InstanceBounds& bounds, uint32_t i, __m128& x, __m128& y, __m128& z, __m128& r)
+    {
+        if (bounds.Type == InstanceBoundsType::Spheres)
+        {
+            const float* spheres = bounds.Data + (size_t)i * 4;
+            x = _mm_loadu_ps(spheres + 0);
+            y = _mm_loadu_ps(spheres + 4);
+            z = _mm_loadu_ps(spheres + 8);
+            r = _mm_loadu_ps(spheres + 12);
+            _MM_TRANSPOSE4_PS(x, y, z, r);
+        }
+        else
+        {
+            const float* b = bounds.Data + (size_t)i * 6;
+            const __m128 half = _mm_set1_ps(0.5f);
+
+            const __m128 minX = _mm_setr_ps(b[0], b[6], b[12], b[18]);
+            const __m128 minY = _mm_setr_ps(b[1], b[7], b[13], b[19]);
+            const __m128 minZ = _mm_setr_ps(b[2], b[8], b[14], b[20]);
+            const __m128 maxX = _mm_setr_ps(b[3], b[9], b[15], b[21]);
+            const __m128 maxY = _mm_setr_ps(b[4], b[10], b[16], b[22]);
+            const __m128 maxZ = _mm_setr_ps(b[5], b[11], b[17], b[23]);
+
+            x = _mm_mul_ps(_mm_add_ps(minX, maxX), half);
+            y = _mm_mul_ps(_mm_add_ps(minY, maxY), half);
+            z = _mm_mul_ps(_mm_add_ps(minZ, maxZ), half);
+
+            const __m128 ex = _mm_mul_ps(_mm_sub_ps(maxX, minX), half);
+            const __m128 ey = _mm_mul_ps(_mm_sub_ps(maxY, minY), half);
+            const __m128 ez = _mm_mul_ps(_mm_sub_ps(maxZ, minZ), half);
+            r = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey)), _mm_mul_ps(ez, ez)));
+        }
+    }
+
+    // Same tests as CullSphere(...) for 4 spheres, returns a lane bit mask of the spheres that failed each test
+    static void CullSpheres4(const CullConstants& constants, __m128 x, __m128 y, __m128 z, __m128 r,
+                             uint32_t& outDistanceMask, uint32_t& outFrustumMask, uint32_t& outSolidAngleMask)
+    {
+        const __m128 dx = _mm_sub_ps(x, _mm_set1_ps(constants.Camera[0]));
+        const __m128 dy = _mm_sub_ps(y, _mm_set1_ps(constants.Camera[1]));
+        const __m128 dz = _mm_sub_ps(z, _mm_set1_ps(constants.Camera[2]));
+        const __m128 distance =
+            _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+
+        const __m128 distanceFail = _mm_cmpgt_ps(_mm_sub_ps(distance, r), _mm_set1_ps(constants.MaxDistance));
+
+        __m128 frustumFail = _mm_setzero_ps();
+        const __m128 minPlaneDistance = _mm_sub_ps(_mm_setzero_ps(), _mm_add_ps(r, _mm_set1_ps(constants.Margin)));
+        for (uint32_t p = 0; p < constants.PlaneCount; p++)
+        {
+            const float* plane = constants.Planes[p];
+            const __m128 planeDistance =
+                _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane[0])), _mm_mul_ps(y, _mm_set1_ps(plane[1]))),
+                           _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane[2])), _mm_set1_ps(plane[3])));
+            frustumFail = _mm_or_ps(frustumFail, _mm_cmplt_ps(planeDistance, minPlaneDistance));
+        }
+
+        const __m128 solidAngleFail = _mm_cmplt_ps(r, _mm_mul_ps(_mm_set1_ps(constants.SinAngle), distance));
+
+        // Every sphere is counted by the first test that rejected it
+        outDistanceMask = (uint32_t)_mm_movemask_ps(distanceFail);
+        outFrustumMask = (uint32_t)_mm_movemask_ps(frustumFail) & ~outDistanceMask;
+        outSolidAngleMask = (uint32_t)_mm_movemask_ps(solidAngleFail) & ~(outDistanceMask | outFrustumMask);
+    }
+
+#endif
+
+    InstanceCuller::InstanceCuller(vr::VulrayDevice* device, ThreadPool* threadPool)
+        : mDevice(device), mThreadPool(threadPool)
+    {
+    }
+
+    uint32_t InstanceCuller::Cull(uint32_t instanceCount, const InstanceBounds& bounds,
+                                  const InstanceCullSettings& settings)
+    {
+        if (!bounds.Data && instanceCount > 0)
+        {
+            VULRAY_LOG_ERROR("InstanceCuller::Cull: Bounds are required");
+            return 0;
+        }
+
+        const uint32_t visibleCount = CullChunks(instanceCount, bounds, settings);
+        CompactIndices();
+        return visibleCount;
+    }
+
+    uint32_t InstanceCuller::CullAndWrite(const TLASInstanceData& data, const InstanceBounds& bounds,
+                                          const InstanceCullSettings& settings, AllocatedBuffer& instanceBuffer,
+                                          uint32_t firstInstance)
+    {
+        const vk::DeviceSize offset = (vk::DeviceSize)firstInstance * sizeof(vk::AccelerationStructureInstanceKHR);
+        const vk::DeviceSize size = (vk::DeviceSize)data.InstanceCount * sizeof(vk::AccelerationStructureInstanceKHR);
+
+        // The visible count is unknown before culling, so the buffer must fit all instances
+        if (offset + size > instanceBuffer.Size)
+        {
+            VULRAY_LOG_ERROR("InstanceCuller::CullAndWrite: Instances don't fit into the instance buffer");
+            return 0;
+        }
+
+        auto mapped = (uint8_t*)mDevice->MapBuffer(instanceBuffer);
+
+        const uint32_t visibleCount =
+            CullAndWrite(data, bounds, settings, (vk::AccelerationStructureInstanceKHR*)(mapped + offset));
+
+        // No-op for host coherent memory
+        vmaFlushAllocation(mDevice->GetAllocator(), instanceBuffer.Allocation, offset,
+                           (vk::DeviceSize)visibleCount * sizeof(vk::AccelerationStructureInstanceKHR));
+        mDevice->UnmapBuffer(instanceBuffer);
+
+        return visibleCount;
+    }
+
+    uint32_t InstanceCuller::CullAndWrite(const TLASInstanceData& data, const InstanceBounds& bounds,
+                                          const InstanceCullSettings& settings,
+                                          vk::AccelerationStructureInstanceKHR* dst)
+    {
+        if (!data.Transforms || !data.BLASAddresses || (!bounds.Data && data.InstanceCount > 0))
+        {
+            VULRAY_LOG_ERROR("InstanceCuller::CullAndWrite: Transforms, BLASAddresses and bounds are required");
+            return 0;
+        }
+
+        const uint32_t visibleCount = CullChunks(data.InstanceCount, bounds, settings);
+
+        // The offsets of the chunks are known, so every chunk writes its visible instances straight to their final
+        // place, before the indices are compacted
+        ParallelFor((uint32_t)mChunks.size(),
+                    [&](uint32_t firstChunk, uint32_t lastChunk)
+                    {
+                        for (uint32_t c = firstChunk; c < lastChunk; c++)
+                        {
+                            const ChunkResult& chunk = mChunks[c];
+                            WriteTLASInstances(data, mVisibleIndices.data() + (size_t)c * ChunkSize,
+                                               chunk.VisibleCount, dst + chunk.OutputOffset);
+                        }
+                    });
+
+        CompactIndices();
+        return visibleCount;
+    }
+
+    uint32_t InstanceCuller::CullChunks(uint32_t instanceCount, const InstanceBounds& bounds,
+                                        const InstanceCullSettings& settings)
+    {
+        const CullConstants constants = MakeCullConstants(settings);
+        const uint32_t chunkCount = (instanceCount + ChunkSize - 1) / ChunkSize;
+
+        mVisibleIndices.resize(instanceCount);
+        mChunks.assign(chunkCount, {});
+
+        auto cullRange = [&](uint32_t firstChunk, uint32_t lastChunk)
+        {
+            for (uint32_t c = firstChunk; c < lastChunk; c++)
+            {
+                const uint32_t begin = c * ChunkSize;
+                const uint32_t end = std::min(begin + ChunkSize, instanceCount);
+
+                uint32_t* visible = mVisibleIndices.data() + begin;
+                ChunkResult result = {};
+
+                uint32_t i = begin;
+#ifdef VULRAY_INSTANCE_CULLER_SSE
+                for (; i + 4 <= end; i += 4)
+                {
+                    __m128 x, y, z, r;
+                    LoadSpheres4(bounds, i, x, y, z, r);
+
+                    uint32_t distanceMask, frustumMask, solidAngleMask;
+                    CullSpheres4(constants, x, y, z, r, distanceMask, frustumMask, solidAngleMask);
+
+                    result.CulledByDistance += std::popcount(distanceMask);
+                    result.CulledByFrustum += std::popcount(frustumMask);
+                    result.CulledBySolidAngle += std::popcount(solidAngleMask);
+
+                    // Branchless compaction, every lane is written but only visible lanes advance the count
+                    const uint32_t visibleMask = ~(distanceMask | frustumMask | solidAngleMask);
+                    for (uint32_t lane = 0; lane < 4; lane++)
+                    {
+                        visible[result.VisibleCount] = i + lane;
+                        result.VisibleCount += (visibleMask >> lane) & 1;
+                    }
+                }
+#endif
+                for (; i < end; i++)
+                {
+                    float x, y, z, r;
+                    LoadSphere(bounds, i, x, y, z, r);
+
+                    switch (CullSphere(constants, x, y, z, r))
+                    {
+                    case CullResult::Visible: visible[result.VisibleCount++] = i; break;
+                    case CullResult::Distance: result.CulledByDistance++; break;
+                    case CullResult::Frustum: result.CulledByFrustum++; break;
+                    case CullResult::SolidAngle: result.CulledBySolidAngle++; break;
+                    }
+                }
+
+                mChunks[c] = result;
+            }
+        };
+
+        ParallelFor(chunkCount, cullRange);
+
+        // Exclusive prefix sum over the chunks, the visible instances of a chunk follow the ones of the chunks before
+        mFrameStats = {};
+        mFrameStats.InstanceCount = instanceCount;
+        for (auto& chunk : mChunks)
+        {
+            chunk.OutputOffset = mFrameStats.VisibleCount;
+            mFrameStats.VisibleCount += chunk.VisibleCount;
+            mFrameStats.CulledByDistance += chunk.CulledByDistance;
+            mFrameStats.CulledByFrustum += chunk.CulledByFrustum;
+            mFrameStats.CulledBySolidAngle += chunk.CulledBySolidAngle;
+        }
+        return mFrameStats.VisibleCount;
+    }
+
+    void InstanceCuller::CompactIndices()
+    {
+        // OutputOffset is never past the start of the chunk, so moving the chunks in order never overwrites unread ones
+        for (size_t c = 0; c < mChunks.size(); c++)
+        {
+            memmove(mVisibleIndices.data() + mChunks[c].OutputOffset, mVisibleIndices.data() + c * ChunkSize,
+                    mChunks[c].VisibleCount * sizeof(uint32_t));
+        }
+        mVisibleIndices.resize(mFrameStats.VisibleCount);
+    }
+
+    void InstanceCuller::ParallelFor(uint32_t count, const std::function<void(uint32_t, uint32_t)>& func)
+    {
+        if (mThreadPool)
+            mThreadPool->ParallelFor(count, 1, func);
+        else
+            func(0, count);
+    }
+
+} // namespace vr
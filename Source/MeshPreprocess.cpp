@@ -0,0 +1,253 @@
+#include "Vulray/MeshPreprocess.h"
+
+#include "Vulray/VulrayDevice.h"
+
+namespace vr
+{
+
+    // Spreads the lower 10 bits of v, so there are 2 zero bits between each bit
+    static uint32_t ExpandBits10(uint32_t v)
+    {
+        v = (v * 0x00010001u) & 0xFF0000FFu;
+        v = (v * 0x00000101u) & 0x0F00F00Fu;
+        v = (v * 0x00000011u) & 0xC30C30C3u;
+        v = (v * 0x00000005u) & 0x49249249u;
+        return v;
+    }
+
+    uint32_t MortonCode3D(float x, float y, float z)
+    {
+        auto quantize = [](float value) { return (uint32_t)std::clamp(value * 1024.0f, 0.0f, 1023.0f); };
+
+        return (ExpandBits10(quantize(x)) << 2) | (ExpandBits10(quantize(y)) << 1) | ExpandBits10(quantize(z));
+    }
+
+    static uint64_t HashVertex(const uint8_t* vertex, uint32_t stride)
+    {
+        // FNV-1a, vertices are only a few dozen bytes
+        uint64_t hash = 0xCBF29CE484222325ull;
+        for (uint32_t i = 0; i < stride; i++) hash = (hash ^ vertex[i]) * 0x100000001B3ull;
+        return hash;
+    }
+
+    static uint32_t ReadIndex(const MeshPreprocessInput& input, uint32_t i)
+    {
+        if (!input.Indices)
+            return i;
+        if (input.IndexFormat == vk::IndexType::eUint16)
+            return ((const uint16_t*)input.Indices)[i];
+        return ((const uint32_t*)input.Indices)[i];
+    }
+
+    GeometryData PreprocessedMesh::GetGeometryData(const GeometryDeviceAddress& addresses,
+                                                   vk::Format vertexFormat) const
+    {
+        GeometryData outGeom = {};
+        outGeom.Type = vk::GeometryTypeKHR::eTriangles;
+        outGeom.DataAddresses = addresses;
+        outGeom.IndexFormat = IndexFormat;
+        outGeom.VertexFormat = vertexFormat;
+        outGeom.Stride = VertexStride;
+        outGeom.PrimitiveCount = TriangleCount;
+        outGeom.MaxVertex = MaxVertex;
+        return outGeom;
+    }
+
+    PreprocessedMesh PreprocessMesh(const MeshPreprocessInput& input, const MeshPreprocessSettings& settings)
+    {
+        PreprocessedMesh outMesh = {};
+        outMesh.VertexStride = input.VertexStride;
+
+        const uint8_t* vertices = (const uint8_t*)input.Vertices;
+        const uint32_t stride = input.VertexStride;
+        const uint32_t vertexCount = input.VertexCount;
+        const uint32_t indexCount = (input.Indices ? input.IndexCount : input.VertexCount) / 3 * 3;
+        const uint32_t inputIndexSize = input.IndexFormat == vk::IndexType::eUint16 ? 2 : 4;
+
+        outMesh.Stats.VertexCountBefore = vertexCount;
+        outMesh.Stats.VertexBytesBefore = (vk::DeviceSize)vertexCount * stride;
+        outMesh.Stats.IndexBytesBefore = input.Indices ? (vk::DeviceSize)input.IndexCount * inputIndexSize : 0;
+
+        if (!vertices || stride < input.PositionOffset + 3 * sizeof(float))
+        {
+            VULRAY_LOG_ERROR("PreprocessMesh: Vertices are null or the stride is too small for the position");
+            return outMesh;
+        }
+
+        // Map every vertex to the first vertex with identical bytes, open addressing with linear probing
+        std::vector<uint32_t> remap(vertexCount);
+        if (settings.DeduplicateVertices)
+        {
+            // Twice the vertex count needs 33 bits for more than 2^31 vertices
+            size_t tableSize = 16;
+            while (tableSize < (size_t)vertexCount * 2) tableSize *= 2;
+
+            std::vector<uint32_t> table(tableSize, ~0U);
+            const size_t tableMask = tableSize - 1;
+
+            for (uint32_t v = 0; v < vertexCount; v++)
+            {
+                const uint8_t* vertex = vertices + (size_t)v * stride;
+                size_t slot = (size_t)HashVertex(vertex, stride) & tableMask;
+
+                while (table[slot] != ~0U && memcmp(vertices + (size_t)table[slot] * stride, vertex, stride) != 0)
+                    slot = (slot + 1) & tableMask;
+
+                if (table[slot] == ~0U)
+                    table[slot] = v;
+                remap[v] = table[slot];
+            }
+        }
+        else
+            std::iota(remap.begin(), remap.end(), 0);
+
+        // Gather the triangles with the remapped indices
+        std::vector<uint32_t> indices;
+        indices.reserve(indexCount);
+
+        std::vector<uint32_t> originalTriangles;
+        originalTriangles.reserve(indexCount / 3);
+
+        for (uint32_t t = 0; t < indexCount / 3; t++)
+        {
+            uint32_t tri[3];
+            for (uint32_t k = 0; k < 3; k++)
+            {
+                const uint32_t index = ReadIndex(input, t * 3 + k);
+                if (index >= vertexCount)
+                {
+                    VULRAY_FLOG_ERROR("PreprocessMesh: Index %u is out of range of %u vertices", index, vertexCount);
+                    return outMesh;
+                }
+                tri[k] = remap[index];
+            }
+
+            if (settings.RemoveDegenerateTriangles && (tri[0] == tri[1] || tri[1] == tri[2] || tri[0] == tri[2]))
+            {
+                outMesh.Stats.RemovedTriangles++;
+                continue;
+            }
+
+            indices.insert(indices.end(), tri, tri + 3);
+            originalTriangles.push_back(t);
+        }
+
+        const uint32_t triangleCount = (uint32_t)originalTriangles.size();
+
+        // Sort the triangles by the Morton code of their centroids
+        if (settings.ReorderTriangles && triangleCount > 1)
+        {
+            auto readPosition = [&](uint32_t v, float* outPos)
+            { memcpy(outPos, vertices + (size_t)v * stride + input.PositionOffset, 3 * sizeof(float)); };
+
+            std::vector<float> centroids((size_t)triangleCount * 3);
+            float boundsMin[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+            float boundsMax[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+
+            for (uint32_t t = 0; t < triangleCount; t++)
+            {
+                float p[3][3];
+                for (uint32_t k = 0; k < 3; k++) readPosition(indices[t * 3 + k], p[k]);
+
+                for (uint32_t axis = 0; axis < 3; axis++)
+                {
+                    const float c = (p[0][axis] + p[1][axis] + p[2][axis]) * (1.0f / 3.0f);
+                    centroids[t * 3 + axis] = c;
+                    boundsMin[axis] = std::min(boundsMin[axis], c);
+                    boundsMax[axis] = std::max(boundsMax[axis], c);
+                }
+            }
+
+            float invExtent[3];
+            for (uint32_t axis = 0; axis < 3; axis++)
+            {
+                const float extent = boundsMax[axis] - boundsMin[axis];
+                invExtent[axis] = extent > 0.0f ? 1.0f / extent : 0.0f;
+            }
+
+            std::vector<std::pair<uint32_t, uint32_t>> keys(triangleCount); // Morton code, triangle
+            for (uint32_t t = 0; t < triangleCount; t++)
+            {
+                const float* c = &centroids[t * 3];
+                keys[t] = {MortonCode3D((c[0] - boundsMin[0]) * invExtent[0], (c[1] - boundsMin[1]) * invExtent[1],
+                                        (c[2] - boundsMin[2]) * invExtent[2]),
+                           t};
+            }
+            std::sort(keys.begin(), keys.end());
+
+            std::vector<uint32_t> sortedIndices(indices.size());
+            std::vector<uint32_t> sortedOriginal(triangleCount);
+            for (uint32_t t = 0; t < triangleCount; t++)
+            {
+                const uint32_t src = keys[t].second;
+                memcpy(&sortedIndices[t * 3], &indices[src * 3], 3 * sizeof(uint32_t));
+                sortedOriginal[t] = originalTriangles[src];
+            }
+            indices.swap(sortedIndices);
+            originalTriangles.swap(sortedOriginal);
+        }
+
+        // Renumber the vertices in the order of first use, this also drops duplicates and unreferenced vertices
+        std::vector<uint32_t> newIndex(vertexCount, ~0U);
+        uint32_t usedVertexCount = 0;
+
+        outMesh.Vertices.reserve((size_t)vertexCount * stride);
+        for (auto& index : indices)
+        {
+            if (newIndex[index] == ~0U)
+            {
+                newIndex[index] = usedVertexCount++;
+                const uint8_t* vertex = vertices + (size_t)index * stride;
+                outMesh.Vertices.insert(outMesh.Vertices.end(), vertex, vertex + stride);
+            }
+            index = newIndex[index];
+        }
+        outMesh.Vertices.shrink_to_fit();
+
+        outMesh.VertexCount = usedVertexCount;
+        outMesh.TriangleCount = triangleCount;
+        outMesh.MaxVertex = usedVertexCount > 0 ? usedVertexCount - 1 : 0;
+        outMesh.OriginalTriangles = std::move(originalTriangles);
+
+        // Narrow the indices if every vertex can be addressed with 16 bits
+        if (settings.AllowUint16Indices && usedVertexCount <= 0x10000)
+        {
+            outMesh.IndexFormat = vk::IndexType::eUint16;
+            outMesh.Indices.resize(indices.size() * sizeof(uint16_t));
+
+            auto dst = (uint16_t*)outMesh.Indices.data();
+            for (size_t i = 0; i < indices.size(); i++) dst[i] = (uint16_t)indices[i];
+        }
+        else
+        {
+            outMesh.IndexFormat = vk::IndexType::eUint32;
+            outMesh.Indices.resize(indices.size() * sizeof(uint32_t));
+            memcpy(outMesh.Indices.data(), indices.data(), outMesh.Indices.size());
+        }
+
+        outMesh.Stats.VertexCountAfter = usedVertexCount;
+        outMesh.Stats.VertexBytesAfter = outMesh.Vertices.size();
+        outMesh.Stats.IndexBytesAfter = outMesh.Indices.size();
+
+        return outMesh;
+    }
+
+    std::vector<PreprocessedMesh> PreprocessMeshes(const std::vector<MeshPreprocessInput>& inputs,
+                                                   const MeshPreprocessSettings& settings, ThreadPool* threadPool)
+    {
+        std::vector<PreprocessedMesh> outMeshes(inputs.size());
+
+        auto processRange = [&](uint32_t begin, uint32_t end)
+        {
+            for (uint32_t i = begin; i < end; i++) outMeshes[i] = PreprocessMesh(inputs[i], settings);
+        };
+
+        if (threadPool)
+            threadPool->ParallelFor((uint32_t)inputs.size(), 1, processRange);
+        else
+            processRange(0, (uint32_t)inputs.size());
+
+        return outMeshes;
+    }
+
+} // namespace vr
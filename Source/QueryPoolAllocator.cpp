@@ -0,0 +1,230 @@
+#include "Vulray/QueryPoolAllocator.h"
+
+#include "Vulray/VulrayDevice.h"
+
+namespace vr
+{
+
+    void VulrayDevice::CreateQueryPoolAllocator(const QueryPoolAllocatorCreateInfo& info)
+    {
+        if (!mQueryPools)
+            mQueryPools = std::make_unique<detail::QueryPoolAllocator>();
+
+        mQueryPools->Info = info;
+        mQueryPools->Info.QueriesPerPool = std::max(info.QueriesPerPool, 1u);
+    }
+
+    void VulrayDevice::DestroyQueryPoolAllocator()
+    {
+        if (!mQueryPools)
+            return;
+
+        for (uint32_t i = 0; i < mQueryPools->Pools.size(); i++)
+        {
+            if (!mQueryPools->Pools[i].VirtualBlock)
+                continue;
+
+            if (!vmaIsVirtualBlockEmpty(mQueryPools->Pools[i].VirtualBlock))
+                VULRAY_LOG_WARNING("DestroyQueryPoolAllocator: Query ranges were not freed");
+
+            DestroyQueryPoolBlock(i);
+        }
+
+        mQueryPools.reset();
+    }
+
+    QueryRange VulrayDevice::AllocateQueries(vk::QueryType type, uint32_t count, vk::CommandBuffer cmdBuf)
+    {
+        QueryRange outRange = {};
+
+        if (count == 0)
+            return outRange;
+
+        // Pipeline statistics pools depend on the statistics flags, they can't be shared
+        if (type == vk::QueryType::ePipelineStatistics)
+        {
+            VULRAY_LOG_ERROR("AllocateQueries: Pipeline statistics queries are not supported");
+            return outRange;
+        }
+
+        if (!mQueryPools)
+            CreateQueryPoolAllocator();
+
+        VmaVirtualAllocationCreateInfo allocInfo = {};
+        allocInfo.size = count;
+        allocInfo.alignment = 1;
+
+        VmaVirtualAllocation allocation = nullptr;
+        vk::DeviceSize offset = 0;
+
+        // Ranges that don't fit into a regular pool get a dedicated one
+        const bool dedicated = count > mQueryPools->Info.QueriesPerPool;
+
+        if (!dedicated)
+        {
+            for (uint32_t i = 0; i < mQueryPools->Pools.size(); i++)
+            {
+                auto& pool = mQueryPools->Pools[i];
+                if (!pool.VirtualBlock || pool.Dedicated || pool.Type != type)
+                    continue;
+
+                if (vmaVirtualAllocate(pool.VirtualBlock, &allocInfo, &allocation, &offset) == VK_SUCCESS)
+                {
+                    outRange.PoolIndex = i;
+                    break;
+                }
+            }
+        }
+
+        if (!outRange.IsValid())
+        {
+            uint32_t poolIndex = CreateQueryPoolBlock(type, dedicated ? count : mQueryPools->Info.QueriesPerPool,
+                                                      dedicated);
+            if (poolIndex == ~0U)
+                return outRange;
+
+            auto result = (vk::Result)vmaVirtualAllocate(mQueryPools->Pools[poolIndex].VirtualBlock, &allocInfo,
+                                                         &allocation, &offset);
+            if (result != vk::Result::eSuccess)
+            {
+                VULRAY_FLOG_ERROR("Failed to allocate queries in the query pool allocator: %s",
+                                  vk::to_string(result).c_str());
+                return outRange;
+            }
+            outRange.PoolIndex = poolIndex;
+        }
+
+        outRange.Pool = mQueryPools->Pools[outRange.PoolIndex].Pool;
+        outRange.Type = type;
+        outRange.FirstQuery = (uint32_t)offset;
+        outRange.QueryCount = count;
+        outRange.Allocation = allocation;
+
+        // Queries have to be reset before they are written, the range may hold results of its previous owner
+        cmdBuf.resetQueryPool(outRange.Pool, outRange.FirstQuery, outRange.QueryCount);
+
+        return outRange;
+    }
+
+    void VulrayDevice::FreeQueries(QueryRange& range)
+    {
+        if (!range.IsValid() || !mQueryPools || range.PoolIndex >= mQueryPools->Pools.size())
+        {
+            range = {};
+            return;
+        }
+
+        auto& pool = mQueryPools->Pools[range.PoolIndex];
+        vmaVirtualFree(pool.VirtualBlock, range.Allocation);
+
+        if (pool.Dedicated)
+            DestroyQueryPoolBlock(range.PoolIndex);
+
+        range = {};
+    }
+
+    std::vector<uint64_t> VulrayDevice::GetQueryResults(const QueryRange& range, uint32_t queryCount)
+    {
+        if (!range.IsValid())
+            return std::vector<uint64_t>();
+
+        queryCount = std::min(queryCount, range.QueryCount);
+        if (queryCount == 0)
+            return std::vector<uint64_t>();
+
+        auto [result, values] = mDevice.getQueryPoolResults<uint64_t>(range.Pool, range.FirstQuery, queryCount,
+                                                                      sizeof(uint64_t) * queryCount, sizeof(uint64_t),
+                                                                      vk::QueryResultFlagBits::e64);
+
+        if (result != vk::Result::eSuccess)
+            return std::vector<uint64_t>();
+
+        return values;
+    }
+
+    void VulrayDevice::TrimQueryPools()
+    {
+        if (!mQueryPools)
+            return;
+
+        for (uint32_t i = 0; i < mQueryPools->Pools.size(); i++)
+        {
+            auto& pool = mQueryPools->Pools[i];
+            if (pool.VirtualBlock && vmaIsVirtualBlockEmpty(pool.VirtualBlock))
+                DestroyQueryPoolBlock(i);
+        }
+
+        // Drop the empty slots at the end, the indices of the remaining pools don't change
+        while (!mQueryPools->Pools.empty() && !mQueryPools->Pools.back().VirtualBlock) mQueryPools->Pools.pop_back();
+    }
+
+    QueryPoolStatistics VulrayDevice::GetQueryPoolStatistics() const
+    {
+        QueryPoolStatistics outStats = {};
+        if (!mQueryPools)
+            return outStats;
+
+        for (const auto& pool : mQueryPools->Pools)
+        {
+            if (!pool.VirtualBlock)
+                continue;
+
+            VmaStatistics stats = {};
+            vmaGetVirtualBlockStatistics(pool.VirtualBlock, &stats);
+
+            outStats.PoolCount++;
+            outStats.TotalQueries += pool.QueryCount;
+            outStats.AllocatedQueries += (uint32_t)stats.allocationBytes;
+        }
+
+        outStats.TotalPoolCreations = mQueryPools->TotalPoolCreations;
+        return outStats;
+    }
+
+    uint32_t VulrayDevice::CreateQueryPoolBlock(vk::QueryType type, uint32_t queryCount, bool dedicated)
+    {
+        detail::QueryPoolBlock block = {};
+        block.Type = type;
+        block.QueryCount = queryCount;
+        block.Dedicated = dedicated;
+
+        VmaVirtualBlockCreateInfo blockInfo = {};
+        blockInfo.size = queryCount;
+
+        auto result = (vk::Result)vmaCreateVirtualBlock(&blockInfo, &block.VirtualBlock);
+        if (result != vk::Result::eSuccess)
+        {
+            VULRAY_FLOG_ERROR("Failed to create a virtual block for a query pool: %s", vk::to_string(result).c_str());
+            return ~0U;
+        }
+
+        block.Pool = mDevice.createQueryPool(vk::QueryPoolCreateInfo().setQueryType(type).setQueryCount(queryCount));
+        mQueryPools->TotalPoolCreations++;
+
+        // Reuse an empty slot, so the indices of the other pools stay valid
+        for (uint32_t i = 0; i < mQueryPools->Pools.size(); i++)
+        {
+            if (!mQueryPools->Pools[i].VirtualBlock)
+            {
+                mQueryPools->Pools[i] = block;
+                return i;
+            }
+        }
+
+        mQueryPools->Pools.push_back(block);
+        return (uint32_t)mQueryPools->Pools.size() - 1;
+    }
+
+    void VulrayDevice::DestroyQueryPoolBlock(uint32_t poolIndex)
+    {
+        auto& pool = mQueryPools->Pools[poolIndex];
+
+        // Ranges that are still allocated are dropped with the pool
+        vmaClearVirtualBlock(pool.VirtualBlock);
+        vmaDestroyVirtualBlock(pool.VirtualBlock);
+        mDevice.destroyQueryPool(pool.Pool);
+
+        pool = {};
+    }
+
+} // namespace vr
@@ -220,6 +220,8 @@ namespace vr
         pipelineInfo.second.MissShaderRecordSize = sbtInfoOld.MissShaderRecordSize;
         pipelineInfo.second.HitGroupRecordSize = sbtInfoOld.HitGroupRecordSize;
         pipelineInfo.second.CallableShaderRecordSize = sbtInfoOld.CallableShaderRecordSize;
+        pipelineInfo.second.PackRegions = sbtInfoOld.PackRegions;
+        pipelineInfo.second.DeviceLocal = sbtInfoOld.DeviceLocal;
 
         return pipelineInfo;
     }
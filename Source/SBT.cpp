@@ -5,6 +5,90 @@
 namespace vr
 {
 
+    static AllocatedBuffer& GetRegionBuffer(SBTBuffer& sbt, ShaderGroup group)
+    {
+        switch (group)
+        {
+        case ShaderGroup::RayGen: return sbt.RayGenBuffer;
+        case ShaderGroup::Miss: return sbt.MissBuffer;
+        case ShaderGroup::HitGroup: return sbt.HitGroupBuffer;
+        default: return sbt.CallableBuffer;
+        }
+    }
+
+    static const AllocatedBuffer& GetRegionBuffer(const SBTBuffer& sbt, ShaderGroup group)
+    {
+        return GetRegionBuffer(const_cast<SBTBuffer&>(sbt), group);
+    }
+
+    static const vk::StridedDeviceAddressRegionKHR& GetAddressRegion(const SBTBuffer& sbt, ShaderGroup group)
+    {
+        switch (group)
+        {
+        case ShaderGroup::RayGen: return sbt.RayGenRegion;
+        case ShaderGroup::Miss: return sbt.MissRegion;
+        case ShaderGroup::HitGroup: return sbt.HitGroupRegion;
+        default: return sbt.CallableRegion;
+        }
+    }
+
+    // Offset of a region buffer in the mapped memory of its SBT, the regions of a packed SBT are views into the packed
+    // buffer, so the offset is the distance of their device addresses
+    static vk::DeviceSize GetRegionOffset(const SBTBuffer& sbt, const AllocatedBuffer& region)
+    {
+        return sbt.IsPacked() ? region.DevAddress - sbt.PackedBuffer.DevAddress : 0;
+    }
+
+    // The buffer the host writes of a packed SBT go to
+    static AllocatedBuffer& GetPackedHostBuffer(SBTBuffer& sbt)
+    {
+        return sbt.IsDeviceLocal() ? sbt.StagingBuffer : sbt.PackedBuffer;
+    }
+
+    static const AllocatedBuffer& GetPackedHostBuffer(const SBTBuffer& sbt)
+    {
+        return sbt.IsDeviceLocal() ? sbt.StagingBuffer : sbt.PackedBuffer;
+    }
+
+    static AllocatedBuffer GetPackedRegionView(const AllocatedBuffer& packed, vk::DeviceSize offset,
+                                               vk::DeviceSize size)
+    {
+        AllocatedBuffer outView = {};
+        if (size == 0 || !packed.Buffer)
+            return outView;
+
+        // The view has no allocation, so it is never mapped or destroyed on its own
+        outView.Buffer = packed.Buffer;
+        outView.DevAddress = packed.DevAddress + offset;
+        outView.Size = size;
+        return outView;
+    }
+
+    static vk::StridedDeviceAddressRegionKHR GetStridedRegion(const AllocatedBuffer& buffer, uint32_t stride,
+                                                              uint32_t count)
+    {
+        // We don't want to set stride when there is no shader of that type, even if space is reserved for it
+        if (count == 0)
+            return vk::StridedDeviceAddressRegionKHR();
+
+        return vk::StridedDeviceAddressRegionKHR()
+            .setDeviceAddress(buffer.DevAddress)
+            .setStride(stride)
+            .setSize(stride * count);
+    }
+
+    // Number of groups the pipeline needs at least for all the indices of the SBT info
+    static uint32_t GetReferencedGroupCount(const SBTInfo& sbt)
+    {
+        uint32_t groupCount = 0;
+        for (const auto* indices : {&sbt.RayGenIndices, &sbt.MissIndices, &sbt.HitGroupIndices, &sbt.CallableIndices})
+        {
+            for (uint32_t index : *indices)
+                groupCount = std::max(groupCount, index + 1);
+        }
+        return groupCount;
+    }
+
     std::vector<uint8_t> VulrayDevice::GetHandlesForSBTBuffer(vk::Pipeline pipeline, uint32_t firstGroup,
                                                               uint32_t groupCount)
     {
@@ -37,36 +121,18 @@ namespace vr
         }
     }
 
-    void VulrayDevice::WriteToSBT(SBTBuffer sbtBuf, ShaderGroup group, uint32_t groupIndex, void* data,
+    void VulrayDevice::WriteToSBT(const SBTBuffer& sbtBuf, ShaderGroup group, uint32_t groupIndex, void* data,
                                   uint32_t dataSize, void* mappedData)
     {
-        AllocatedBuffer* buffer = nullptr;
-        vk::StridedDeviceAddressRegionKHR* addressRegion;
-        switch (group)
-        {
-        case ShaderGroup::RayGen:
-            buffer = &sbtBuf.RayGenBuffer;
-            addressRegion = &sbtBuf.RayGenRegion;
-            break;
-        case ShaderGroup::Miss:
-            buffer = &sbtBuf.MissBuffer;
-            addressRegion = &sbtBuf.MissRegion;
-            break;
-        case ShaderGroup::HitGroup:
-            buffer = &sbtBuf.HitGroupBuffer;
-            addressRegion = &sbtBuf.HitGroupRegion;
-            break;
-        case ShaderGroup::Callable:
-            buffer = &sbtBuf.CallableBuffer;
-            addressRegion = &sbtBuf.CallableRegion;
-            break;
-        }
-        if (!buffer)
+        if ((uint32_t)group > (uint32_t)ShaderGroup::Callable)
         {
             VULRAY_LOG_ERROR("WriteToSBT: Invalid shader group");
             return;
         }
 
+        const AllocatedBuffer* buffer = &GetRegionBuffer(sbtBuf, group);
+        const vk::StridedDeviceAddressRegionKHR* addressRegion = &GetAddressRegion(sbtBuf, group);
+
         // Offset to the start of the requested group and apply the opaque handle size for the SBT
         uint32_t offset = (groupIndex * addressRegion->stride) + mRayTracingProperties.shaderGroupHandleSize;
 
@@ -77,14 +143,19 @@ namespace vr
             return;
         }
 
+        // a packed SBT holds the region somewhere inside of its packed buffer
+        const vk::DeviceSize regionOffset = GetRegionOffset(sbtBuf, *buffer);
+
         if (mappedData)
         {
-            memcpy((uint8_t*)mappedData + offset, data, dataSize); // if we have a mapped buffer, just copy the data
+            // if we have a mapped buffer, just copy the data
+            memcpy((uint8_t*)mappedData + regionOffset + offset, data, dataSize);
         }
         else
         {
             // else we update the buffer with the data
-            UpdateBuffer(*buffer, data, dataSize, offset);
+            UpdateBuffer(sbtBuf.IsPacked() ? GetPackedHostBuffer(sbtBuf) : *buffer, data, dataSize,
+                         regionOffset + offset);
         }
     }
 
@@ -97,117 +168,84 @@ namespace vr
         const uint32_t hitCount = sbt.HitGroupIndices.size();
         const uint32_t callCount = sbt.CallableIndices.size();
 
-        const uint32_t groupsCount = rgenCount + missCount + hitCount + callCount;
+        // handles of all the groups are fetched with a single call and cached for the next SBTs of the pipeline
+        const uint8_t* handles = GetShaderGroupHandles(pipeline, GetReferencedGroupCount(sbt));
 
         const uint32_t handleSize = mRayTracingProperties.shaderGroupHandleSize;
 
-        uint32_t rgenSize =
+        const uint32_t rgenSize =
             AlignUp(sbt.RayGenShaderRecordSize + handleSize, mRayTracingProperties.shaderGroupHandleAlignment);
-        uint32_t missSize =
+        const uint32_t missSize =
             AlignUp(sbt.MissShaderRecordSize + handleSize, mRayTracingProperties.shaderGroupHandleAlignment);
-        uint32_t hitSize =
+        const uint32_t hitSize =
             AlignUp(sbt.HitGroupRecordSize + handleSize, mRayTracingProperties.shaderGroupHandleAlignment);
-        uint32_t callSize =
+        const uint32_t callSize =
             AlignUp(sbt.CallableShaderRecordSize + handleSize, mRayTracingProperties.shaderGroupHandleAlignment);
 
-        // Create all buffers for the SBT
-        if (sbt.RayGenIndices.size() || sbt.ReserveRayGenGroups)
-            outSBT.RayGenBuffer = CreateBuffer(
-                rgenSize * (rgenCount + sbt.ReserveRayGenGroups),
-                vk::BufferUsageFlagBits::eShaderDeviceAddressKHR | vk::BufferUsageFlagBits::eShaderBindingTableKHR,
-                VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT, mRayTracingProperties.shaderGroupBaseAlignment);
-        if (sbt.MissIndices.size() || sbt.ReserveMissGroups)
-            outSBT.MissBuffer = CreateBuffer(
-                missSize * (missCount + sbt.ReserveMissGroups),
-                vk::BufferUsageFlagBits::eShaderDeviceAddressKHR | vk::BufferUsageFlagBits::eShaderBindingTableKHR,
-                VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT, mRayTracingProperties.shaderGroupBaseAlignment);
-        if (sbt.HitGroupIndices.size() || sbt.ReserveHitGroups)
-            outSBT.HitGroupBuffer = CreateBuffer(
-                hitSize * (hitCount + sbt.ReserveHitGroups),
-                vk::BufferUsageFlagBits::eShaderDeviceAddressKHR | vk::BufferUsageFlagBits::eShaderBindingTableKHR,
-                VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT, mRayTracingProperties.shaderGroupBaseAlignment);
-        if (sbt.CallableIndices.size() || sbt.ReserveCallableGroups)
-            outSBT.CallableBuffer = CreateBuffer(
-                callSize * (callCount + sbt.ReserveCallableGroups),
-                vk::BufferUsageFlagBits::eShaderDeviceAddressKHR | vk::BufferUsageFlagBits::eShaderBindingTableKHR,
-                VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT, mRayTracingProperties.shaderGroupBaseAlignment);
-
-        // For filling the stride and size of the regions, we don't want to set stride when there is no shader of that
-        // type. We didn't do this earlier because we needed to know the size of the shader group handles to reserve
-        // space for them.
-        if (rgenCount == 0)
-            rgenSize = 0;
-        if (missCount == 0)
-            missSize = 0;
-        if (hitCount == 0)
-            hitSize = 0;
-        if (callCount == 0)
-            callSize = 0;
+        // reserved groups get space in the buffers, but not in the regions
+        const vk::DeviceSize rgenCapacity = (vk::DeviceSize)rgenSize * (rgenCount + sbt.ReserveRayGenGroups);
+        const vk::DeviceSize missCapacity = (vk::DeviceSize)missSize * (missCount + sbt.ReserveMissGroups);
+        const vk::DeviceSize hitCapacity = (vk::DeviceSize)hitSize * (hitCount + sbt.ReserveHitGroups);
+        const vk::DeviceSize callCapacity = (vk::DeviceSize)callSize * (callCount + sbt.ReserveCallableGroups);
 
-        // fill in offsets for all shader groups
-        if (rgenCount > 0)
-            outSBT.RayGenRegion = vk::StridedDeviceAddressRegionKHR()
-                                      .setDeviceAddress(outSBT.RayGenBuffer.DevAddress)
-                                      .setStride(rgenSize)
-                                      .setSize(rgenSize * rgenCount);
-        if (missCount > 0)
-            outSBT.MissRegion = vk::StridedDeviceAddressRegionKHR()
-                                    .setDeviceAddress(outSBT.MissBuffer.DevAddress)
-                                    .setStride(missSize)
-                                    .setSize(missSize * missCount);
-        if (hitCount > 0)
-            outSBT.HitGroupRegion = vk::StridedDeviceAddressRegionKHR()
-                                        .setDeviceAddress(outSBT.HitGroupBuffer.DevAddress)
-                                        .setStride(hitSize)
-                                        .setSize(hitSize * hitCount);
-        if (callCount > 0)
-            outSBT.CallableRegion = vk::StridedDeviceAddressRegionKHR()
-                                        .setDeviceAddress(outSBT.CallableBuffer.DevAddress)
-                                        .setStride(callSize)
-                                        .setSize(callSize * callCount);
-
-        const uint8_t* opaqueHandle = new uint8_t[handleSize];
-
-        // copy records and shader handles into the SBT buffer
-        uint8_t* rgenData = rgenSize > 0 ? (uint8_t*)MapBuffer(outSBT.RayGenBuffer) : nullptr;
-        for (uint32_t i = 0; rgenData && i < rgenCount; i++)
-        {
-            uint32_t shaderIndex = sbt.RayGenIndices[i];
-            const uint8_t* dest = rgenData + (i * rgenSize);
-            GetHandlesForSBTBuffer(pipeline, shaderIndex, 1, (void*)dest);
-            rgenData += rgenSize; // advance to the next record
-        }
-        uint8_t* missData = missSize > 0 ? (uint8_t*)MapBuffer(outSBT.MissBuffer) : nullptr;
-        for (uint32_t i = 0; missData && i < missCount; i++)
-        {
-            uint32_t shaderIndex = sbt.MissIndices[i];
-            const uint8_t* dest = missData + (i * missSize);
-            GetHandlesForSBTBuffer(pipeline, shaderIndex, 1, (void*)dest);
-        }
-        uint8_t* hitData = hitSize > 0 ? (uint8_t*)MapBuffer(outSBT.HitGroupBuffer) : nullptr;
-        for (uint32_t i = 0; hitData && i < hitCount; i++)
+        const auto usage =
+            vk::BufferUsageFlagBits::eShaderDeviceAddressKHR | vk::BufferUsageFlagBits::eShaderBindingTableKHR;
+        const VmaAllocationCreateFlags hostFlags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+        const uint32_t baseAlignment = mRayTracingProperties.shaderGroupBaseAlignment;
+
+        // A device local SBT is always packed, so it needs a single staging mirror and a single copy
+        if (sbt.PackRegions || sbt.DeviceLocal)
         {
-            uint32_t shaderIndex = sbt.HitGroupIndices[i];
-            const uint8_t* dest = hitData + (i * hitSize);
-            GetHandlesForSBTBuffer(pipeline, shaderIndex, 1, (void*)dest);
+            // Every region starts at a shaderGroupBaseAlignment boundary of the packed buffer, which itself is aligned
+            // to it, so the device addresses of the regions are valid for vkCmdTraceRaysKHR
+            const vk::DeviceSize missOffset = AlignUp(rgenCapacity, (vk::DeviceSize)baseAlignment);
+            const vk::DeviceSize hitOffset = AlignUp(missOffset + missCapacity, (vk::DeviceSize)baseAlignment);
+            const vk::DeviceSize callOffset = AlignUp(hitOffset + hitCapacity, (vk::DeviceSize)baseAlignment);
+            const vk::DeviceSize packedSize = callOffset + callCapacity;
+
+            if (packedSize > 0 && sbt.DeviceLocal)
+            {
+                // the device local buffer is only written by the copies of RecordSBTUpload(...)
+                outSBT.PackedBuffer =
+                    CreateBuffer(packedSize, usage | vk::BufferUsageFlagBits::eTransferDst, 0, baseAlignment);
+                outSBT.StagingBuffer = CreateBuffer(packedSize, vk::BufferUsageFlagBits::eTransferSrc, hostFlags);
+            }
+            else if (packedSize > 0)
+            {
+                outSBT.PackedBuffer = CreateBuffer(packedSize, usage, hostFlags, baseAlignment);
+            }
+
+            outSBT.RayGenBuffer = GetPackedRegionView(outSBT.PackedBuffer, 0, rgenCapacity);
+            outSBT.MissBuffer = GetPackedRegionView(outSBT.PackedBuffer, missOffset, missCapacity);
+            outSBT.HitGroupBuffer = GetPackedRegionView(outSBT.PackedBuffer, hitOffset, hitCapacity);
+            outSBT.CallableBuffer = GetPackedRegionView(outSBT.PackedBuffer, callOffset, callCapacity);
         }
-        uint8_t* callData = callSize > 0 ? (uint8_t*)MapBuffer(outSBT.CallableBuffer) : nullptr;
-        for (uint32_t i = 0; callData && i < callCount; i++)
+        else
         {
-            uint32_t shaderIndex = sbt.CallableIndices[i];
-            const uint8_t* dest = callData + (i * callSize);
-            GetHandlesForSBTBuffer(pipeline, shaderIndex, 1, (void*)dest);
+            // Create all buffers for the SBT
+            if (rgenCapacity > 0)
+                outSBT.RayGenBuffer = CreateBuffer(rgenCapacity, usage, hostFlags, baseAlignment);
+            if (missCapacity > 0)
+                outSBT.MissBuffer = CreateBuffer(missCapacity, usage, hostFlags, baseAlignment);
+            if (hitCapacity > 0)
+                outSBT.HitGroupBuffer = CreateBuffer(hitCapacity, usage, hostFlags, baseAlignment);
+            if (callCapacity > 0)
+                outSBT.CallableBuffer = CreateBuffer(callCapacity, usage, hostFlags, baseAlignment);
         }
 
-        // unmap all the buffers
-        if (rgenData)
-            UnmapBuffer(outSBT.RayGenBuffer);
-        if (missData)
-            UnmapBuffer(outSBT.MissBuffer);
-        if (hitData)
-            UnmapBuffer(outSBT.HitGroupBuffer);
-        if (callData)
-            UnmapBuffer(outSBT.CallableBuffer);
+        // fill in offsets for all shader groups
+        outSBT.RayGenRegion = GetStridedRegion(outSBT.RayGenBuffer, rgenSize, rgenCount);
+        outSBT.MissRegion = GetStridedRegion(outSBT.MissBuffer, missSize, missCount);
+        outSBT.HitGroupRegion = GetStridedRegion(outSBT.HitGroupBuffer, hitSize, hitCount);
+        outSBT.CallableRegion = GetStridedRegion(outSBT.CallableBuffer, callSize, callCount);
+
+        // copy shader handles into the SBT buffer
+        auto regionData = MapSBT(outSBT);
+        WriteSBTHandles(handles, sbt.RayGenIndices, rgenSize, regionData[(uint32_t)ShaderGroup::RayGen]);
+        WriteSBTHandles(handles, sbt.MissIndices, missSize, regionData[(uint32_t)ShaderGroup::Miss]);
+        WriteSBTHandles(handles, sbt.HitGroupIndices, hitSize, regionData[(uint32_t)ShaderGroup::HitGroup]);
+        WriteSBTHandles(handles, sbt.CallableIndices, callSize, regionData[(uint32_t)ShaderGroup::Callable]);
+        UnmapSBT(outSBT);
 
         return outSBT;
     }
@@ -222,10 +260,12 @@ namespace vr
         const uint32_t hitCount = sbt.HitGroupIndices.size();
         const uint32_t callCount = sbt.CallableIndices.size();
 
-        const uint32_t groupsCount = rgenCount + missCount + hitCount + callCount;
+        // handles of all the groups are fetched with a single call and cached for the next SBTs of the pipeline
+        const uint8_t* handles = GetShaderGroupHandles(pipeline, GetReferencedGroupCount(sbt));
 
-        const uint32_t handleSize =
-            AlignUp(mRayTracingProperties.shaderGroupHandleSize, mRayTracingProperties.shaderGroupHandleAlignment);
+        // The strides have to match the ones of CreateSBT(...) and CanSBTFitShaders(...), so the unaligned handle
+        // size is used. Otherwise the records of a packed SBT could spill into the next region
+        const uint32_t handleSize = mRayTracingProperties.shaderGroupHandleSize;
 
         const uint32_t rgenSize =
             AlignUp(sbt.RayGenShaderRecordSize + handleSize, mRayTracingProperties.shaderGroupHandleAlignment);
@@ -239,115 +279,40 @@ namespace vr
         // we have to rewrite opaque handles to all the groups in the SBT, because on some implementations just keeping
         // the old opaque handles and adding new opaque handles to the new added groups doesn't work
 
-        const uint8_t* opaqueHandle = new uint8_t[handleSize];
-
-        // copy records and shader handles into the SBT buffer
-        uint8_t* rgenData = rgenSize > 0 ? (uint8_t*)MapBuffer(buffer.RayGenBuffer) : nullptr;
-        for (uint32_t i = 0; rgenData && i < rgenCount; i++)
-        {
-            uint32_t shaderIndex = sbt.RayGenIndices[i];
-            const uint8_t* dest = rgenData + (i * rgenSize);
-            GetHandlesForSBTBuffer(pipeline, shaderIndex, 1, (void*)dest);
-            rgenData += rgenSize; // advance to the next record
-        }
-        uint8_t* missData = missSize > 0 ? (uint8_t*)MapBuffer(buffer.MissBuffer) : nullptr;
-        for (uint32_t i = 0; missData && i < missCount; i++)
-        {
-            uint32_t shaderIndex = sbt.MissIndices[i];
-            const uint8_t* dest = missData + (i * missSize);
-            GetHandlesForSBTBuffer(pipeline, shaderIndex, 1, (void*)dest);
-        }
-        uint8_t* hitData = hitSize > 0 ? (uint8_t*)MapBuffer(buffer.HitGroupBuffer) : nullptr;
-        for (uint32_t i = 0; hitData && i < hitCount; i++)
-        {
-            uint32_t shaderIndex = sbt.HitGroupIndices[i];
-            const uint8_t* dest = hitData + (i * hitSize);
-            GetHandlesForSBTBuffer(pipeline, shaderIndex, 1, (void*)dest);
-        }
-        uint8_t* callData = callSize > 0 ? (uint8_t*)MapBuffer(buffer.CallableBuffer) : nullptr;
-        for (uint32_t i = 0; callData && i < callCount; i++)
-        {
-            uint32_t shaderIndex = sbt.CallableIndices[i];
-            const uint8_t* dest = callData + (i * callSize);
-            GetHandlesForSBTBuffer(pipeline, shaderIndex, 1, (void*)dest);
-        }
-
-        // unmap all the buffers
-        if (rgenData)
-            UnmapBuffer(buffer.RayGenBuffer);
-        if (missData)
-            UnmapBuffer(buffer.MissBuffer);
-        if (hitData)
-            UnmapBuffer(buffer.HitGroupBuffer);
-        if (callData)
-            UnmapBuffer(buffer.CallableBuffer);
+        // copy shader handles into the SBT buffer, a packed SBT is mapped only once
+        auto regionData = MapSBT(buffer);
+        WriteSBTHandles(handles, sbt.RayGenIndices, rgenSize, regionData[(uint32_t)ShaderGroup::RayGen]);
+        WriteSBTHandles(handles, sbt.MissIndices, missSize, regionData[(uint32_t)ShaderGroup::Miss]);
+        WriteSBTHandles(handles, sbt.HitGroupIndices, hitSize, regionData[(uint32_t)ShaderGroup::HitGroup]);
+        WriteSBTHandles(handles, sbt.CallableIndices, callSize, regionData[(uint32_t)ShaderGroup::Callable]);
+        UnmapSBT(buffer);
 
         // Some groups may have gotten additional shaders, so we need to update the stride and size of the regions
         // We don't have to worry about the buffer sizes if they don't fit as it is already checked at the beginning of
-        // this function
-
-        if (rgenCount > 0)
-            buffer.RayGenRegion = vk::StridedDeviceAddressRegionKHR()
-                                      .setDeviceAddress(buffer.RayGenBuffer.DevAddress)
-                                      .setStride(rgenSize)
-                                      .setSize(rgenSize * rgenCount);
-        if (missCount > 0)
-            buffer.MissRegion = vk::StridedDeviceAddressRegionKHR()
-                                    .setDeviceAddress(buffer.MissBuffer.DevAddress)
-                                    .setStride(missSize)
-                                    .setSize(missSize * missCount);
-        if (hitCount > 0)
-            buffer.HitGroupRegion = vk::StridedDeviceAddressRegionKHR()
-                                        .setDeviceAddress(buffer.HitGroupBuffer.DevAddress)
-                                        .setStride(hitSize)
-                                        .setSize(hitSize * hitCount);
-        if (callCount > 0)
-            buffer.CallableRegion = vk::StridedDeviceAddressRegionKHR()
-                                        .setDeviceAddress(buffer.CallableBuffer.DevAddress)
-                                        .setStride(callSize)
-                                        .setSize(callSize * callCount);
+        // this function. The region buffers of a packed SBT are views, so this works for both layouts
+        buffer.RayGenRegion = GetStridedRegion(buffer.RayGenBuffer, rgenSize, rgenCount);
+        buffer.MissRegion = GetStridedRegion(buffer.MissBuffer, missSize, missCount);
+        buffer.HitGroupRegion = GetStridedRegion(buffer.HitGroupBuffer, hitSize, hitCount);
+        buffer.CallableRegion = GetStridedRegion(buffer.CallableBuffer, callSize, callCount);
 
         return true;
     }
 
     void VulrayDevice::CopySBT(SBTBuffer& src, SBTBuffer& dst)
     {
-        uint8_t* dstRgenData = dst.RayGenRegion.size > 0 ? (uint8_t*)MapBuffer(dst.RayGenBuffer) : nullptr;
-        uint8_t* dstMissData = dst.MissRegion.size > 0 ? (uint8_t*)MapBuffer(dst.MissBuffer) : nullptr;
-        uint8_t* dstHitData = dst.HitGroupRegion.size > 0 ? (uint8_t*)MapBuffer(dst.HitGroupBuffer) : nullptr;
-        uint8_t* dstCallData = dst.CallableRegion.size > 0 ? (uint8_t*)MapBuffer(dst.CallableBuffer) : nullptr;
-
-        uint8_t* srcRgenData = src.RayGenRegion.size > 0 ? (uint8_t*)MapBuffer(src.RayGenBuffer) : nullptr;
-        uint8_t* srcMissData = src.MissRegion.size > 0 ? (uint8_t*)MapBuffer(src.MissBuffer) : nullptr;
-        uint8_t* srcHitData = src.HitGroupRegion.size > 0 ? (uint8_t*)MapBuffer(src.HitGroupBuffer) : nullptr;
-        uint8_t* srcCallData = src.CallableRegion.size > 0 ? (uint8_t*)MapBuffer(src.CallableBuffer) : nullptr;
-
-        if (dstRgenData && srcRgenData)
-            memcpy(dstRgenData, srcRgenData, src.RayGenRegion.size);
-        if (dstMissData && srcMissData)
-            memcpy(dstMissData, srcMissData, src.MissRegion.size);
-        if (dstHitData && srcHitData)
-            memcpy(dstHitData, srcHitData, src.HitGroupRegion.size);
-        if (dstCallData && srcCallData)
-            memcpy(dstCallData, srcCallData, src.CallableRegion.size);
-
-        if (dstRgenData)
-            UnmapBuffer(dst.RayGenBuffer);
-        if (dstMissData)
-            UnmapBuffer(dst.MissBuffer);
-        if (dstHitData)
-            UnmapBuffer(dst.HitGroupBuffer);
-        if (dstCallData)
-            UnmapBuffer(dst.CallableBuffer);
-
-        if (srcRgenData)
-            UnmapBuffer(src.RayGenBuffer);
-        if (srcMissData)
-            UnmapBuffer(src.MissBuffer);
-        if (srcHitData)
-            UnmapBuffer(src.HitGroupBuffer);
-        if (srcCallData)
-            UnmapBuffer(src.CallableBuffer);
+        // Packed SBTs are mapped once, so copying between two of them maps only two buffers
+        auto dstData = MapSBT(dst);
+        auto srcData = MapSBT(src);
+
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            const auto size = GetAddressRegion(src, (ShaderGroup)i).size;
+            if (size > 0 && dstData[i] && srcData[i])
+                memcpy(dstData[i], srcData[i], size);
+        }
+
+        UnmapSBT(dst);
+        UnmapSBT(src);
     }
 
     bool VulrayDevice::CanSBTFitShaders(SBTBuffer& buffer, const SBTInfo& sbtInfo)
@@ -369,6 +334,8 @@ namespace vr
         const uint32_t hitBytesNeeded = sbtInfo.HitGroupIndices.size() * hitSize;
         const uint32_t callBytesNeeded = sbtInfo.CallableIndices.size() * callSize;
 
+        // The region buffers of a packed SBT are views sized to the space reserved for the region, a region can't grow
+        // into the next one, so the check is the same for both layouts
         if (rgenBytesNeeded > buffer.RayGenBuffer.Size)
             return false;
         if (missBytesNeeded > buffer.MissBuffer.Size)
@@ -383,6 +350,20 @@ namespace vr
 
     void VulrayDevice::DestroySBTBuffer(SBTBuffer& buffer)
     {
+        if (buffer.IsPacked())
+        {
+            // the region buffers are views into the packed buffer, they don't own memory
+            DestroyBuffer(buffer.PackedBuffer);
+            if (buffer.IsDeviceLocal())
+                DestroyBuffer(buffer.StagingBuffer);
+            buffer.StagingBuffer = AllocatedBuffer();
+            buffer.PackedBuffer = AllocatedBuffer();
+            buffer.RayGenBuffer = AllocatedBuffer();
+            buffer.MissBuffer = AllocatedBuffer();
+            buffer.HitGroupBuffer = AllocatedBuffer();
+            buffer.CallableBuffer = AllocatedBuffer();
+        }
+
         // destroy all the buffers if they were created
         if (buffer.RayGenBuffer.Buffer)
             DestroyBuffer(buffer.RayGenBuffer);
@@ -397,4 +378,142 @@ namespace vr
         buffer.HitGroupRegion = vk::StridedDeviceAddressRegionKHR();
         buffer.CallableRegion = vk::StridedDeviceAddressRegionKHR();
     }
+
+    std::array<uint8_t*, 4> VulrayDevice::MapSBT(SBTBuffer& buffer)
+    {
+        std::array<uint8_t*, 4> outData = {};
+
+        if (buffer.IsPacked())
+        {
+            // A single map covers all the regions
+            uint8_t* packedData = (uint8_t*)MapBuffer(GetPackedHostBuffer(buffer));
+            for (uint32_t i = 0; i < 4; i++)
+            {
+                const auto& region = GetRegionBuffer(buffer, (ShaderGroup)i);
+                if (region.Buffer)
+                    outData[i] = packedData + GetRegionOffset(buffer, region);
+            }
+            return outData;
+        }
+
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            auto& region = GetRegionBuffer(buffer, (ShaderGroup)i);
+            if (region.Buffer)
+                outData[i] = (uint8_t*)MapBuffer(region);
+        }
+        return outData;
+    }
+
+    void VulrayDevice::UnmapSBT(SBTBuffer& buffer)
+    {
+        if (buffer.IsPacked())
+        {
+            UnmapBuffer(GetPackedHostBuffer(buffer));
+            return;
+        }
+
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            auto& region = GetRegionBuffer(buffer, (ShaderGroup)i);
+            if (region.Buffer)
+                UnmapBuffer(region);
+        }
+    }
+
+    void VulrayDevice::RecordSBTUpload(const SBTBuffer& buffer, vk::CommandBuffer cmdBuf)
+    {
+        if (!buffer.IsDeviceLocal())
+            return;
+
+        // Only the records in use are copied, the padding between the regions and the reserved records are skipped
+        std::vector<vk::BufferCopy> regions;
+        for (const auto* region : {&buffer.RayGenRegion, &buffer.MissRegion, &buffer.HitGroupRegion,
+                                   &buffer.CallableRegion})
+        {
+            if (region->size == 0)
+                continue;
+
+            const vk::DeviceSize offset = region->deviceAddress - buffer.PackedBuffer.DevAddress;
+            regions.push_back(vk::BufferCopy().setSrcOffset(offset).setDstOffset(offset).setSize(region->size));
+        }
+
+        if (regions.empty())
+            return;
+
+        // No-op for host coherent memory
+        for (const auto& region : regions)
+            vmaFlushAllocation(mVMAllocator, buffer.StagingBuffer.Allocation, region.srcOffset, region.size);
+
+        // Ray tracing shaders of earlier dispatches may still read the records that are overwritten
+        cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eRayTracingShaderKHR, vk::PipelineStageFlagBits::eTransfer,
+                               (vk::DependencyFlagBits)0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+        cmdBuf.copyBuffer(buffer.StagingBuffer.Buffer, buffer.PackedBuffer.Buffer, regions);
+
+        auto barrier = vk::MemoryBarrier()
+                           .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+                           .setDstAccessMask(vk::AccessFlagBits::eShaderRead);
+
+        cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eRayTracingShaderKHR,
+                               (vk::DependencyFlagBits)0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    void VulrayDevice::SetShaderGroupHandleCaching(bool enable)
+    {
+        mCacheShaderGroupHandles = enable;
+        if (!enable)
+            mShaderGroupHandles.clear();
+    }
+
+    void VulrayDevice::InvalidateShaderGroupHandles(vk::Pipeline pipeline)
+    {
+        mShaderGroupHandles.erase((VkPipeline)pipeline);
+    }
+
+    void VulrayDevice::DestroyRayTracingPipeline(vk::Pipeline pipeline)
+    {
+        // the handle value may be reused by a new pipeline, so its cached handles must not outlive it
+        InvalidateShaderGroupHandles(pipeline);
+        mDevice.destroyPipeline(pipeline);
+    }
+
+    const uint8_t* VulrayDevice::GetShaderGroupHandles(vk::Pipeline pipeline, uint32_t groupCount)
+    {
+        // vkGetRayTracingShaderGroupHandlesKHR doesn't allow a dataSize of 0, and there is nothing to fetch anyway
+        if (groupCount == 0)
+            return nullptr;
+
+        const uint32_t handleSize = mRayTracingProperties.shaderGroupHandleSize;
+
+        // Without the cache, a pipeline destroyed with vkDestroyPipeline can never leave stale handles behind
+        auto& handles =
+            mCacheShaderGroupHandles ? mShaderGroupHandles[(VkPipeline)pipeline] : mFetchedShaderGroupHandles;
+        if (mCacheShaderGroupHandles && handles.size() >= (size_t)groupCount * handleSize)
+            return handles.data();
+
+        // The handles are tightly packed at shaderGroupHandleSize, that is how the driver returns them
+        handles.resize((size_t)groupCount * handleSize);
+        auto result = mDevice.getRayTracingShaderGroupHandlesKHR(pipeline, 0, groupCount, handles.size(),
+                                                                 handles.data(), mDynLoader);
+        if (result != vk::Result::eSuccess)
+        {
+            VULRAY_LOG_ERROR("GetShaderGroupHandles: Failed to get ray tracing shader group handles");
+            if (mCacheShaderGroupHandles)
+                mShaderGroupHandles.erase((VkPipeline)pipeline);
+            return nullptr;
+        }
+        return handles.data();
+    }
+
+    void VulrayDevice::WriteSBTHandles(const uint8_t* handles, const std::vector<uint32_t>& groupIndices,
+                                       uint32_t stride, uint8_t* data)
+    {
+        if (!handles || !data)
+            return;
+
+        const uint32_t handleSize = mRayTracingProperties.shaderGroupHandleSize;
+        for (uint32_t i = 0; i < groupIndices.size(); i++)
+            memcpy(data + (i * stride), handles + ((size_t)groupIndices[i] * handleSize), handleSize);
+    }
 } // namespace vr
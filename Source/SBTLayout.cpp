@@ -0,0 +1,189 @@
+#include "Vulray/SBTLayout.h"
+
+#include "Vulray/Buffer.h"
+
+namespace vr
+{
+
+    // Records of one stride, the strides are sorted and the sub-tables are contiguous ranges of them
+    struct SBTStrideBucket
+    {
+        uint32_t Stride = 0;
+        vk::DeviceSize RecordCount = 0;
+    };
+
+    // Bytes of a hit table holding the buckets [first, last), every table starts at a shaderGroupBaseAlignment boundary
+    static vk::DeviceSize GetHitTableSize(const std::vector<SBTStrideBucket>& buckets, uint32_t first, uint32_t last,
+                                          uint32_t baseAlignment)
+    {
+        vk::DeviceSize recordCount = 0;
+        for (uint32_t i = first; i < last; i++) recordCount += buckets[i].RecordCount;
+
+        // The buckets are sorted, so the last one has the largest stride
+        return AlignUp((uint64_t)(recordCount * buckets[last - 1].Stride), (uint64_t)baseAlignment);
+    }
+
+    // Splits the sorted buckets into at most maxTables contiguous ranges with the smallest total size.
+    // Returns the end of every range
+    static std::vector<uint32_t> PartitionStrideBuckets(const std::vector<SBTStrideBucket>& buckets, uint32_t maxTables,
+                                                        uint32_t baseAlignment)
+    {
+        const uint32_t bucketCount = (uint32_t)buckets.size();
+        const uint32_t tableCount = std::min(std::max(maxTables, 1U), bucketCount);
+        constexpr vk::DeviceSize NO_SPLIT = ~0ULL;
+
+        // cost[t][j] is the smallest size of the first j buckets in t + 1 tables, start[t][j] the first bucket of the
+        // last of those tables. There are only as many buckets as distinct strides, so this stays tiny
+        std::vector<std::vector<vk::DeviceSize>> cost(tableCount,
+                                                      std::vector<vk::DeviceSize>(bucketCount + 1, NO_SPLIT));
+        std::vector<std::vector<uint32_t>> start(tableCount, std::vector<uint32_t>(bucketCount + 1, 0));
+
+        for (uint32_t j = 1; j <= bucketCount; j++) cost[0][j] = GetHitTableSize(buckets, 0, j, baseAlignment);
+
+        for (uint32_t t = 1; t < tableCount; t++)
+        {
+            for (uint32_t j = t + 1; j <= bucketCount; j++)
+            {
+                for (uint32_t i = t; i < j; i++)
+                {
+                    if (cost[t - 1][i] == NO_SPLIT)
+                        continue;
+
+                    const vk::DeviceSize size = cost[t - 1][i] + GetHitTableSize(buckets, i, j, baseAlignment);
+                    if (size < cost[t][j])
+                    {
+                        cost[t][j] = size;
+                        start[t][j] = i;
+                    }
+                }
+            }
+        }
+
+        // More tables are only used if they are smaller
+        uint32_t bestTables = 0;
+        for (uint32_t t = 1; t < tableCount; t++)
+        {
+            if (cost[t][bucketCount] < cost[bestTables][bucketCount])
+                bestTables = t;
+        }
+
+        std::vector<uint32_t> outEnds(bestTables + 1);
+        uint32_t end = bucketCount;
+        for (uint32_t t = bestTables + 1; t-- > 0;)
+        {
+            outEnds[t] = end;
+            end = start[t][end];
+        }
+        return outEnds;
+    }
+
+    SBTLayout CompileSBTLayout(const SBTInfo& info, const std::vector<SBTHitRecordBlock>& blocks,
+                               const vk::PhysicalDeviceRayTracingPipelinePropertiesKHR& properties,
+                               const SBTLayoutSettings& settings)
+    {
+        SBTLayout outLayout = {};
+
+        const uint32_t handleSize = properties.shaderGroupHandleSize;
+        const uint32_t handleAlignment = properties.shaderGroupHandleAlignment;
+        const uint32_t baseAlignment = properties.shaderGroupBaseAlignment;
+
+        // The stride of a block is the stride of its largest record, so its records stay at a fixed distance from
+        // each other, which is what the geometry index of the SBT indexing formula needs
+        std::vector<uint32_t> blockStrides(blocks.size());
+        for (size_t b = 0; b < blocks.size(); b++)
+        {
+            const auto& block = blocks[b];
+            if (block.GroupIndices.size() != block.RecordSizes.size())
+            {
+                VULRAY_FLOG_ERROR("CompileSBTLayout: Block %zu has %zu groups but %zu record sizes", b,
+                                  block.GroupIndices.size(), block.RecordSizes.size());
+                return outLayout;
+            }
+
+            uint32_t maxRecordSize = 0;
+            for (uint32_t size : block.RecordSizes) maxRecordSize = std::max(maxRecordSize, size);
+
+            blockStrides[b] = AlignUp(handleSize + maxRecordSize, handleAlignment);
+            if (blockStrides[b] > properties.maxShaderGroupStride)
+            {
+                VULRAY_FLOG_ERROR("CompileSBTLayout: Block %zu needs a stride of %u bytes, the device allows %u", b,
+                                  blockStrides[b], properties.maxShaderGroupStride);
+                return outLayout;
+            }
+        }
+
+        std::vector<SBTStrideBucket> buckets;
+        for (size_t b = 0; b < blocks.size(); b++)
+        {
+            auto it = std::find_if(buckets.begin(), buckets.end(),
+                                   [&](const SBTStrideBucket& bucket) { return bucket.Stride == blockStrides[b]; });
+            if (it == buckets.end())
+                it = buckets.insert(buckets.end(), SBTStrideBucket{blockStrides[b], 0});
+            it->RecordCount += blocks[b].GroupIndices.size();
+        }
+        std::sort(buckets.begin(), buckets.end(),
+                  [](const SBTStrideBucket& a, const SBTStrideBucket& b) { return a.Stride < b.Stride; });
+
+        // End of the buckets of every sub-table, a single table if there are no blocks at all
+        std::vector<uint32_t> tableEnds = {(uint32_t)buckets.size()};
+        if (!buckets.empty())
+        {
+            outLayout.SharedStrideHitTableSize = GetHitTableSize(buckets, 0, (uint32_t)buckets.size(), baseAlignment);
+            outLayout.HitTableSize = outLayout.SharedStrideHitTableSize;
+
+            if (settings.Mode != SBTLayoutMode::SharedStride)
+            {
+                auto ends = PartitionStrideBuckets(buckets, settings.MaxSubTables, baseAlignment);
+
+                vk::DeviceSize partitionedSize = 0;
+                uint32_t first = 0;
+                for (uint32_t end : ends)
+                {
+                    partitionedSize += GetHitTableSize(buckets, first, end, baseAlignment);
+                    first = end;
+                }
+
+                const double sharedSize = (double)outLayout.SharedStrideHitTableSize;
+                const double savings = sharedSize - (double)partitionedSize;
+                const bool worthIt = ends.size() > 1 && savings >= (double)settings.MinSavings * sharedSize;
+                if (settings.Mode == SBTLayoutMode::Partitioned || worthIt)
+                {
+                    tableEnds = std::move(ends);
+                    outLayout.HitTableSize = partitionedSize;
+                }
+            }
+        }
+        // A single table is a shared stride layout, even if partitioning was requested
+        outLayout.Mode = tableEnds.size() > 1 ? SBTLayoutMode::Partitioned : SBTLayoutMode::SharedStride;
+
+        outLayout.SubTables.resize(tableEnds.size(), info);
+        for (uint32_t t = 0; t < tableEnds.size(); t++)
+        {
+            auto& subTable = outLayout.SubTables[t];
+            subTable.HitGroupIndices.clear();
+
+            // The stride of a sub-table is the largest stride of its buckets
+            const uint32_t stride = tableEnds[t] > 0 ? buckets[tableEnds[t] - 1].Stride : handleSize;
+            subTable.HitGroupRecordSize = stride - handleSize;
+        }
+
+        // Blocks keep their input order inside their sub-table
+        outLayout.BlockSubTables.resize(blocks.size());
+        outLayout.InstanceSBTOffsets.resize(blocks.size());
+        for (size_t b = 0; b < blocks.size(); b++)
+        {
+            uint32_t table = 0;
+            while (buckets[tableEnds[table] - 1].Stride < blockStrides[b]) table++;
+
+            auto& subTable = outLayout.SubTables[table];
+            outLayout.BlockSubTables[b] = table;
+            outLayout.InstanceSBTOffsets[b] = (uint32_t)subTable.HitGroupIndices.size();
+            subTable.HitGroupIndices.insert(subTable.HitGroupIndices.end(), blocks[b].GroupIndices.begin(),
+                                            blocks[b].GroupIndices.end());
+        }
+
+        outLayout.Valid = true;
+        return outLayout;
+    }
+
+} // namespace vr
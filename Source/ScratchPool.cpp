@@ -0,0 +1,220 @@
+#include "Vulray/ScratchPool.h"
+
+#include "Vulray/VulrayDevice.h"
+
+namespace vr
+{
+
+    void VulrayDevice::CreateScratchPool(const ScratchPoolCreateInfo& info)
+    {
+        if (mScratchPool)
+            DestroyScratchPool();
+
+        mScratchPool = std::make_unique<detail::ScratchPool>();
+        mScratchPool->Info = info;
+        mScratchPool->Info.FramesInFlight = std::max(info.FramesInFlight, 1u);
+        mScratchPool->Frames.resize(mScratchPool->Info.FramesInFlight);
+
+        // Allocate a block for every frame in flight up front, so the first frames don't have to allocate
+        for (uint32_t i = 0; i < mScratchPool->Info.FramesInFlight; i++)
+        {
+            detail::ScratchBlock block = {};
+            block.Buffer = CreateScratchBuffer(mScratchPool->Info.BlockSize);
+            mScratchPool->Blocks.push_back(block);
+            mScratchPool->FreeBlocks.push_back(i);
+            mScratchPool->TotalBlockAllocations++;
+        }
+    }
+
+    void VulrayDevice::DestroyScratchPool()
+    {
+        if (!mScratchPool)
+            return;
+
+        for (auto& block : mScratchPool->Blocks) DestroyBuffer(block.Buffer);
+
+        mScratchPool.reset();
+    }
+
+    AllocatedBuffer VulrayDevice::AllocateScratch(vk::DeviceSize size)
+    {
+        if (!mScratchPool)
+        {
+            VULRAY_LOG_WARNING("AllocateScratch: Scratch pool was not created, creating it with default settings");
+            CreateScratchPool();
+        }
+
+        const vk::DeviceSize alignment = mAccelProperties.minAccelerationStructureScratchOffsetAlignment;
+        const vk::DeviceSize alignedSize = AlignUp(size, alignment);
+
+        auto& frame = mScratchPool->Frames[mScratchPool->FrameIndex];
+
+        // Try to fit the allocation in the last block of the frame, otherwise get a new block for the frame
+        uint32_t blockIndex = frame.Blocks.empty() ? ~0U : frame.Blocks.back();
+        if (blockIndex == ~0U ||
+            mScratchPool->Blocks[blockIndex].Head + alignedSize > mScratchPool->Blocks[blockIndex].Buffer.Size)
+        {
+            blockIndex = AcquireScratchBlock(alignedSize);
+            frame.Blocks.push_back(blockIndex);
+        }
+
+        auto& block = mScratchPool->Blocks[blockIndex];
+
+        AllocatedBuffer outScratch = {};
+        outScratch.Buffer = block.Buffer.Buffer;
+        outScratch.DevAddress = block.Buffer.DevAddress + block.Head;
+        outScratch.Size = alignedSize;
+
+        block.Head += alignedSize;
+
+        return outScratch;
+    }
+
+    AllocatedBuffer VulrayDevice::AllocateScratchFromBuildInfos(std::vector<BLASBuildInfo>& buildInfos)
+    {
+        const vk::DeviceSize scratchSize = GetScratchBufferSize(buildInfos);
+        if (scratchSize > mMaintenance4Properties.maxBufferSize)
+        {
+            VULRAY_LOG_ERROR("AllocateScratchFromBuildInfos: The scratch size is too big, no scratch was allocated");
+            return {};
+        }
+
+        auto outScratch = AllocateScratch(scratchSize);
+
+        BindScratchBufferToBuildInfos(outScratch, buildInfos);
+
+        return outScratch;
+    }
+
+    AllocatedBuffer VulrayDevice::AllocateScratchFromBuildInfo(BLASBuildInfo& buildInfo)
+    {
+        vk::DeviceSize scratchSize =
+            GetAlignedScratchSize(buildInfo.BuildGeometryInfo, buildInfo.BuildSizes,
+                                  mAccelProperties.minAccelerationStructureScratchOffsetAlignment);
+
+        auto outScratch = AllocateScratch(scratchSize);
+
+        BindScratchAdressToBuildInfo(outScratch.DevAddress, buildInfo);
+
+        return outScratch;
+    }
+
+    AllocatedBuffer VulrayDevice::AllocateScratchFromBuildInfos(std::vector<TLASBuildInfo>& buildInfos)
+    {
+        const vk::DeviceSize scratchSize = GetScratchBufferSize(buildInfos);
+        if (scratchSize > mMaintenance4Properties.maxBufferSize)
+        {
+            VULRAY_LOG_ERROR("AllocateScratchFromBuildInfos: The scratch size is too big, no scratch was allocated");
+            return {};
+        }
+
+        auto outScratch = AllocateScratch(scratchSize);
+
+        BindScratchBufferToBuildInfos(outScratch, buildInfos);
+
+        return outScratch;
+    }
+
+    AllocatedBuffer VulrayDevice::AllocateScratchFromBuildInfo(TLASBuildInfo& buildInfo)
+    {
+        vk::DeviceSize scratchSize =
+            GetAlignedScratchSize(buildInfo.BuildGeometryInfo, buildInfo.BuildSizes,
+                                  mAccelProperties.minAccelerationStructureScratchOffsetAlignment);
+
+        auto outScratch = AllocateScratch(scratchSize);
+
+        BindScratchAdressToBuildInfo(outScratch.DevAddress, buildInfo);
+
+        return outScratch;
+    }
+
+    void VulrayDevice::AdvanceScratchPool(const SyncPoint& frameSync)
+    {
+        if (!mScratchPool)
+            return;
+
+        mScratchPool->Frames[mScratchPool->FrameIndex].Sync = frameSync;
+        mScratchPool->FrameIndex = (mScratchPool->FrameIndex + 1) % mScratchPool->Frames.size();
+
+        RecycleScratchPool();
+
+        // If the GPU is still using the blocks of the frame we are moving to, keep them aside until it is done
+        auto& nextFrame = mScratchPool->Frames[mScratchPool->FrameIndex];
+        if (!nextFrame.Blocks.empty())
+        {
+            mScratchPool->RetiredFrames.push_back(std::move(nextFrame));
+            nextFrame = detail::ScratchFrame();
+        }
+    }
+
+    ScratchPoolStatistics VulrayDevice::GetScratchPoolStatistics() const
+    {
+        ScratchPoolStatistics outStats = {};
+        if (!mScratchPool)
+            return outStats;
+
+        outStats.BlockCount = mScratchPool->Blocks.size();
+        outStats.TotalBlockAllocations = mScratchPool->TotalBlockAllocations;
+
+        for (auto& block : mScratchPool->Blocks) outStats.BlockBytes += block.Buffer.Size;
+
+        for (auto blockIndex : mScratchPool->Frames[mScratchPool->FrameIndex].Blocks)
+            outStats.CurrentFrameBytes += mScratchPool->Blocks[blockIndex].Head;
+
+        return outStats;
+    }
+
+    void VulrayDevice::RecycleScratchPool()
+    {
+        auto releaseFrame = [this](detail::ScratchFrame& frame) {
+            for (auto blockIndex : frame.Blocks)
+            {
+                mScratchPool->Blocks[blockIndex].Head = 0;
+                mScratchPool->FreeBlocks.push_back(blockIndex);
+            }
+            frame.Blocks.clear();
+        };
+
+        for (uint32_t i = 0; i < mScratchPool->Frames.size(); i++)
+        {
+            auto& frame = mScratchPool->Frames[i];
+            if (i != mScratchPool->FrameIndex && !frame.Blocks.empty() && IsSyncPointReached(frame.Sync))
+                releaseFrame(frame);
+        }
+
+        for (auto it = mScratchPool->RetiredFrames.begin(); it != mScratchPool->RetiredFrames.end();)
+        {
+            if (IsSyncPointReached(it->Sync))
+            {
+                releaseFrame(*it);
+                it = mScratchPool->RetiredFrames.erase(it);
+            }
+            else
+                it++;
+        }
+    }
+
+    uint32_t VulrayDevice::AcquireScratchBlock(vk::DeviceSize size)
+    {
+        auto& freeBlocks = mScratchPool->FreeBlocks;
+
+        for (auto it = freeBlocks.begin(); it != freeBlocks.end(); it++)
+        {
+            uint32_t blockIndex = *it;
+            if (mScratchPool->Blocks[blockIndex].Buffer.Size >= size)
+            {
+                freeBlocks.erase(it);
+                return blockIndex;
+            }
+        }
+
+        // No free block is big enough, so the pool grows
+        detail::ScratchBlock block = {};
+        block.Buffer = CreateScratchBuffer(std::max(size, mScratchPool->Info.BlockSize));
+        mScratchPool->Blocks.push_back(block);
+        mScratchPool->TotalBlockAllocations++;
+
+        return mScratchPool->Blocks.size() - 1;
+    }
+
+} // namespace vr
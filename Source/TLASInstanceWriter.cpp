@@ -0,0 +1,188 @@
+#include "Vulray/TLASInstanceWriter.h"
+
+#include "Vulray/VulrayDevice.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VULRAY_INSTANCE_WRITER_SSE
+#include <emmintrin.h>
+#endif
+
+namespace vr
+{
+    // The SSE path writes the instance as 4 x 16 bytes
+    static_assert(sizeof(vk::AccelerationStructureInstanceKHR) == 64);
+
+    // Number of instances a thread writes at least, smaller ranges cost more in scheduling than they save
+    static constexpr uint32_t MinInstancesPerRange = 4096;
+
+    static constexpr uint32_t GetTransformStride(TransformLayout layout)
+    {
+        return layout == TransformLayout::RowMajor3x4 ? 12 : 16;
+    }
+
+#ifdef VULRAY_INSTANCE_WRITER_SSE
+
+    template <TransformLayout Layout>
+    static void WriteInstancesLayout(const TLASInstanceData& data, const uint32_t* indices, uint32_t begin,
+                                     uint32_t end, vk::AccelerationStructureInstanceKHR* dst)
+    {
+        constexpr uint32_t stride = GetTransformStride(Layout);
+
+        // Stream stores need 16 byte alignment, instances are 64 bytes so checking the first one is enough
+        const bool streamable = ((uintptr_t)(dst + begin) & 15) == 0;
+
+        for (uint32_t j = begin; j < end; j++)
+        {
+            // Source instance, instances are gathered when an index list is given
+            const uint32_t i = indices ? indices[j] : j;
+            const float* src = data.Transforms + (size_t)i * stride;
+
+            __m128 row0 = _mm_loadu_ps(src + 0);
+            __m128 row1 = _mm_loadu_ps(src + 4);
+            __m128 row2 = _mm_loadu_ps(src + 8);
+
+            if constexpr (Layout == TransformLayout::ColumnMajor4x4)
+            {
+                __m128 row3 = _mm_loadu_ps(src + 12);
+                _MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+            }
+
+            const uint32_t customIndex = data.CustomIndices ? data.CustomIndices[i] : i;
+            const uint32_t mask = data.Masks ? data.Masks[i] : 0xFF;
+            const uint32_t sbtOffset = data.SBTOffsets ? data.SBTOffsets[i] : 0;
+            const uint32_t flags = data.Flags ? data.Flags[i] : 0;
+            const uint64_t address = data.BLASAddresses[i];
+
+            // Same bit layout as the bitfields of vk::AccelerationStructureInstanceKHR
+            __m128i tail = _mm_set_epi32((int)(address >> 32), (int)(address & 0xFFFFFFFF),
+                                         (int)((sbtOffset & 0xFFFFFF) | (flags << 24)),
+                                         (int)((customIndex & 0xFFFFFF) | (mask << 24)));
+
+            float* out = (float*)(dst + j);
+            if (streamable)
+            {
+                _mm_stream_ps(out + 0, row0);
+                _mm_stream_ps(out + 4, row1);
+                _mm_stream_ps(out + 8, row2);
+                _mm_stream_ps(out + 12, _mm_castsi128_ps(tail));
+            }
+            else
+            {
+                _mm_storeu_ps(out + 0, row0);
+                _mm_storeu_ps(out + 4, row1);
+                _mm_storeu_ps(out + 8, row2);
+                _mm_storeu_ps(out + 12, _mm_castsi128_ps(tail));
+            }
+        }
+
+        // Make the stream stores visible before the buffer is unmapped or submitted
+        _mm_sfence();
+    }
+
+#else
+
+    // Fallback for targets without SSE2
+    template <TransformLayout Layout>
+    static void WriteInstancesLayout(const TLASInstanceData& data, const uint32_t* indices, uint32_t begin,
+                                     uint32_t end, vk::AccelerationStructureInstanceKHR* dst)
+    {
+        constexpr uint32_t stride = GetTransformStride(Layout);
+
+        for (uint32_t j = begin; j < end; j++)
+        {
+            // Source instance, instances are gathered when an index list is given
+            const uint32_t i = indices ? indices[j] : j;
+            const float* src = data.Transforms + (size_t)i * stride;
+
+            vk::AccelerationStructureInstanceKHR instance = {};
+            for (uint32_t row = 0; row < 3; row++)
+            {
+                for (uint32_t col = 0; col < 4; col++)
+                {
+                    if constexpr (Layout == TransformLayout::ColumnMajor4x4)
+                        instance.transform.matrix[row][col] = src[col * 4 + row];
+                    else
+                        instance.transform.matrix[row][col] = src[row * 4 + col];
+                }
+            }
+
+            instance.setInstanceCustomIndex(data.CustomIndices ? data.CustomIndices[i] : i)
+                .setMask(data.Masks ? data.Masks[i] : 0xFF)
+                .setInstanceShaderBindingTableRecordOffset(data.SBTOffsets ? data.SBTOffsets[i] : 0)
+                .setFlags((VkGeometryInstanceFlagsKHR)(data.Flags ? data.Flags[i] : 0))
+                .setAccelerationStructureReference(data.BLASAddresses[i]);
+
+            dst[j] = instance;
+        }
+    }
+
+#endif
+
+    static void WriteInstances(const TLASInstanceData& data, const uint32_t* indices, uint32_t begin, uint32_t end,
+                               vk::AccelerationStructureInstanceKHR* dst)
+    {
+        switch (data.Layout)
+        {
+        case TransformLayout::RowMajor3x4:
+            WriteInstancesLayout<TransformLayout::RowMajor3x4>(data, indices, begin, end, dst);
+            break;
+        case TransformLayout::RowMajor4x4:
+            WriteInstancesLayout<TransformLayout::RowMajor4x4>(data, indices, begin, end, dst);
+            break;
+        case TransformLayout::ColumnMajor4x4:
+            WriteInstancesLayout<TransformLayout::ColumnMajor4x4>(data, indices, begin, end, dst);
+            break;
+        }
+    }
+
+    void WriteTLASInstances(const TLASInstanceData& data, uint32_t begin, uint32_t end,
+                            vk::AccelerationStructureInstanceKHR* dst)
+    {
+        WriteInstances(data, nullptr, begin, end, dst);
+    }
+
+    void WriteTLASInstances(const TLASInstanceData& data, const uint32_t* indices, uint32_t count,
+                            vk::AccelerationStructureInstanceKHR* dst)
+    {
+        WriteInstances(data, indices, 0, count, dst);
+    }
+
+    TLASInstanceWriter::TLASInstanceWriter(vr::VulrayDevice* device, uint32_t threadCount)
+        : mDevice(device), mThreadPool(threadCount)
+    {
+    }
+
+    void TLASInstanceWriter::Write(const TLASInstanceData& data, AllocatedBuffer& instanceBuffer,
+                                   uint32_t firstInstance)
+    {
+        const vk::DeviceSize offset = (vk::DeviceSize)firstInstance * sizeof(vk::AccelerationStructureInstanceKHR);
+        const vk::DeviceSize size = (vk::DeviceSize)data.InstanceCount * sizeof(vk::AccelerationStructureInstanceKHR);
+
+        if (offset + size > instanceBuffer.Size)
+        {
+            VULRAY_LOG_ERROR("TLASInstanceWriter::Write: Instances don't fit into the instance buffer");
+            return;
+        }
+
+        auto mapped = (uint8_t*)mDevice->MapBuffer(instanceBuffer);
+
+        Write(data, (vk::AccelerationStructureInstanceKHR*)(mapped + offset));
+
+        // No-op for host coherent memory
+        vmaFlushAllocation(mDevice->GetAllocator(), instanceBuffer.Allocation, offset, size);
+        mDevice->UnmapBuffer(instanceBuffer);
+    }
+
+    void TLASInstanceWriter::Write(const TLASInstanceData& data, vk::AccelerationStructureInstanceKHR* dst)
+    {
+        if (!data.Transforms || !data.BLASAddresses)
+        {
+            VULRAY_LOG_ERROR("TLASInstanceWriter::Write: Transforms and BLASAddresses are required");
+            return;
+        }
+
+        mThreadPool.ParallelFor(data.InstanceCount, MinInstancesPerRange,
+                                [&](uint32_t begin, uint32_t end) { WriteTLASInstances(data, begin, end, dst); });
+    }
+
+} // namespace vr
@@ -0,0 +1,119 @@
+#include "Vulray/ThreadPool.h"
+
+#include "Vulray/VulrayDevice.h"
+
+namespace vr
+{
+
+    ThreadPool::ThreadPool(uint32_t threadCount)
+    {
+        if (threadCount == 0)
+            threadCount = std::max(std::thread::hardware_concurrency(), 1u) - 1;
+
+        mThreads.reserve(threadCount);
+        for (uint32_t i = 0; i < threadCount; i++) mThreads.emplace_back(&ThreadPool::WorkerLoop, this);
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStop = true;
+        }
+        mWorkCondition.notify_all();
+
+        for (auto& thread : mThreads) thread.join();
+    }
+
+    void ThreadPool::ParallelFor(uint32_t count, uint32_t minRangeSize,
+                                 const std::function<void(uint32_t, uint32_t)>& func)
+    {
+        if (count == 0)
+            return;
+
+        // A few ranges per thread, so threads that finish early can help the others
+        const uint32_t targetRanges = ((uint32_t)mThreads.size() + 1) * 4;
+        const uint32_t rangeSize = std::max({minRangeSize, (count + targetRanges - 1) / targetRanges, 1u});
+        const uint32_t rangeCount = (count + rangeSize - 1) / rangeSize;
+
+        if (mThreads.empty() || rangeCount == 1)
+        {
+            func(0, count);
+            return;
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+
+            // Workers that woke up late for the previous job may still be inside RunRanges(...)
+            mDoneCondition.wait(lock, [this] { return mActiveWorkers == 0; });
+
+            mJobFunc = &func;
+            mJobCount = count;
+            mJobRangeSize = rangeSize;
+            mJobRangeCount = rangeCount;
+            mNextRange = 0;
+            mFinishedRanges = 0;
+            mJobGeneration++;
+        }
+        mWorkCondition.notify_all();
+
+        RunRanges(func, count, rangeSize, rangeCount);
+
+        std::unique_lock<std::mutex> lock(mMutex);
+        mDoneCondition.wait(lock, [this, rangeCount] { return mFinishedRanges == rangeCount && mActiveWorkers == 0; });
+        mJobFunc = nullptr;
+    }
+
+    void ThreadPool::WorkerLoop()
+    {
+        uint64_t seenGeneration = 0;
+
+        while (true)
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mWorkCondition.wait(lock, [this, seenGeneration] { return mStop || mJobGeneration != seenGeneration; });
+
+            if (mStop)
+                return;
+
+            seenGeneration = mJobGeneration;
+
+            // Copy the job, the caller may change it as soon as the job is finished
+            const auto* func = mJobFunc;
+            const uint32_t count = mJobCount;
+            const uint32_t rangeSize = mJobRangeSize;
+            const uint32_t rangeCount = mJobRangeCount;
+
+            if (!func)
+                continue;
+
+            mActiveWorkers++;
+            lock.unlock();
+
+            RunRanges(*func, count, rangeSize, rangeCount);
+
+            lock.lock();
+            mActiveWorkers--;
+            if (mActiveWorkers == 0)
+                mDoneCondition.notify_all();
+        }
+    }
+
+    void ThreadPool::RunRanges(const std::function<void(uint32_t, uint32_t)>& func, uint32_t count, uint32_t rangeSize,
+                               uint32_t rangeCount)
+    {
+        while (true)
+        {
+            const uint32_t range = mNextRange.fetch_add(1);
+            if (range >= rangeCount)
+                return;
+
+            const uint32_t begin = range * rangeSize;
+            func(begin, std::min(begin + rangeSize, count));
+
+            mFinishedRanges.fetch_add(1);
+        }
+    }
+
+} // namespace vr
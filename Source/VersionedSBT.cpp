@@ -0,0 +1,337 @@
+#include "Vulray/VersionedSBT.h"
+
+#include "Vulray/VulrayDevice.h"
+
+namespace vr
+{
+    static const std::vector<uint32_t>& GetGroupIndices(const SBTInfo& info, uint32_t group)
+    {
+        switch ((ShaderGroup)group)
+        {
+        case ShaderGroup::RayGen: return info.RayGenIndices;
+        case ShaderGroup::Miss: return info.MissIndices;
+        case ShaderGroup::HitGroup: return info.HitGroupIndices;
+        default: return info.CallableIndices;
+        }
+    }
+
+    static uint32_t GetRecordSize(const SBTInfo& info, uint32_t group)
+    {
+        switch ((ShaderGroup)group)
+        {
+        case ShaderGroup::RayGen: return info.RayGenShaderRecordSize;
+        case ShaderGroup::Miss: return info.MissShaderRecordSize;
+        case ShaderGroup::HitGroup: return info.HitGroupRecordSize;
+        default: return info.CallableShaderRecordSize;
+        }
+    }
+
+    static vk::StridedDeviceAddressRegionKHR& GetAddressRegion(SBTBuffer& sbt, uint32_t group)
+    {
+        switch ((ShaderGroup)group)
+        {
+        case ShaderGroup::RayGen: return sbt.RayGenRegion;
+        case ShaderGroup::Miss: return sbt.MissRegion;
+        case ShaderGroup::HitGroup: return sbt.HitGroupRegion;
+        default: return sbt.CallableRegion;
+        }
+    }
+
+    static const AllocatedBuffer& GetRegionBuffer(const SBTBuffer& sbt, uint32_t group)
+    {
+        switch ((ShaderGroup)group)
+        {
+        case ShaderGroup::RayGen: return sbt.RayGenBuffer;
+        case ShaderGroup::Miss: return sbt.MissBuffer;
+        case ShaderGroup::HitGroup: return sbt.HitGroupBuffer;
+        default: return sbt.CallableBuffer;
+        }
+    }
+
+    VersionedSBT::VersionedSBT(vr::VulrayDevice* device, vk::Pipeline pipeline, const SBTInfo& info,
+                               const VersionedSBTCreateInfo& createInfo)
+        : mDevice(device), mInfo(createInfo), mSBTInfo(info)
+    {
+        // One bit per version in the dirty masks
+        mInfo.FramesInFlight = std::clamp(mInfo.FramesInFlight, 1u, 32u);
+
+        // Packed versions are mapped once each and share the offsets of their regions with the CPU copy
+        mSBTInfo.PackRegions = true;
+
+        mVersions.resize(mInfo.FramesInFlight);
+        for (auto& version : mVersions)
+        {
+            version.Buffer = mDevice->CreateSBT(pipeline, mSBTInfo);
+            if (!version.Buffer.IsPacked())
+            {
+                VULRAY_LOG_ERROR("VersionedSBT: Failed to create the SBT, or the SBT info has no records");
+                return;
+            }
+
+            // Mapped for the lifetime of the version
+            auto& hostBuffer =
+                version.Buffer.IsDeviceLocal() ? version.Buffer.StagingBuffer : version.Buffer.PackedBuffer;
+            version.MappedData = (uint8_t*)mDevice->MapBuffer(hostBuffer);
+        }
+
+        const auto& properties = mDevice->GetRayTracingProperties();
+        const SBTBuffer& sbt = mVersions[0].Buffer;
+
+        uint32_t recordCount = 0;
+        for (uint32_t g = 0; g < 4; g++)
+        {
+            const AllocatedBuffer& regionBuffer = GetRegionBuffer(sbt, g);
+
+            // The strides have to match the ones of CreateSBT(...)
+            Region& region = mRegions[g];
+            region.Stride = AlignUp(GetRecordSize(mSBTInfo, g) + properties.shaderGroupHandleSize,
+                                    properties.shaderGroupHandleAlignment);
+            region.Offset = regionBuffer.Buffer ? regionBuffer.DevAddress - sbt.PackedBuffer.DevAddress : 0;
+            region.RecordCapacity = (uint32_t)(regionBuffer.Size / region.Stride);
+            region.RecordCount = (uint32_t)GetGroupIndices(mSBTInfo, g).size();
+            region.FirstRecord = recordCount;
+            recordCount += region.RecordCapacity;
+        }
+
+        mRecords.assign(sbt.PackedBuffer.Size, 0);
+        mDirtyMasks.assign(recordCount, 0);
+
+        // Every record is dirty at first, so the first flush of a device local version uploads its handles
+        WriteHandles(pipeline, mSBTInfo);
+    }
+
+    VersionedSBT::~VersionedSBT()
+    {
+        // The GPU is expected to be idle when the SBT is destroyed
+        for (auto& version : mVersions)
+        {
+            if (version.MappedData)
+                mDevice->UnmapBuffer(version.Buffer.IsDeviceLocal() ? version.Buffer.StagingBuffer
+                                                                    : version.Buffer.PackedBuffer);
+            mDevice->DestroySBTBuffer(version.Buffer);
+        }
+    }
+
+    bool VersionedSBT::Write(ShaderGroup group, uint32_t groupIndex, const void* data, uint32_t dataSize,
+                             uint32_t offset)
+    {
+        if ((uint32_t)group > (uint32_t)ShaderGroup::Callable || mRecords.empty())
+        {
+            VULRAY_LOG_ERROR("VersionedSBT::Write: Invalid shader group");
+            return false;
+        }
+
+        const Region& region = mRegions[(uint32_t)group];
+        const uint32_t handleSize = mDevice->GetRayTracingProperties().shaderGroupHandleSize;
+
+        if (groupIndex >= region.RecordCount || (uint64_t)handleSize + offset + dataSize > region.Stride)
+        {
+            VULRAY_LOG_ERROR("VersionedSBT::Write: The record or the data is out of bounds");
+            return false;
+        }
+
+        const vk::DeviceSize recordOffset = region.Offset + (vk::DeviceSize)groupIndex * region.Stride;
+        memcpy(mRecords.data() + recordOffset + handleSize + offset, data, dataSize);
+
+        MarkDirty(region.FirstRecord + groupIndex);
+        return true;
+    }
+
+    const SBTBuffer* VersionedSBT::Flush(vk::CommandBuffer cmdBuf)
+    {
+        if (mRecords.empty())
+            return nullptr;
+
+        Version& version = mVersions[mNextVersion];
+        if (version.InFlight)
+        {
+            VULRAY_LOG_WARNING("VersionedSBT::Flush: The next version is still in use by the GPU, call Update() every "
+                               "frame or use more frames in flight");
+            mStats.BusyVersionCount++;
+            return nullptr;
+        }
+
+        const uint32_t versionBit = 1u << mNextVersion;
+
+        mStats.FlushedRecords = 0;
+        mStats.FlushedBytes = 0;
+
+        // Record indices grow with the offsets, so the writes are sequential and adjacent records merge into one copy
+        std::sort(mDirtyRecords.begin(), mDirtyRecords.end());
+
+        std::vector<vk::BufferCopy> copyRegions;
+        uint32_t region = 0;
+        size_t kept = 0;
+        for (uint32_t record : mDirtyRecords)
+        {
+            if (mDirtyMasks[record] & versionBit)
+            {
+                while (record >= mRegions[region].FirstRecord + mRegions[region].RecordCapacity) region++;
+
+                const uint32_t stride = mRegions[region].Stride;
+                const vk::DeviceSize offset =
+                    mRegions[region].Offset + (vk::DeviceSize)(record - mRegions[region].FirstRecord) * stride;
+
+                memcpy(version.MappedData + offset, mRecords.data() + offset, stride);
+                mDirtyMasks[record] &= ~versionBit;
+
+                if (!copyRegions.empty() && copyRegions.back().srcOffset + copyRegions.back().size == offset)
+                    copyRegions.back().size += stride;
+                else
+                    copyRegions.push_back(vk::BufferCopy().setSrcOffset(offset).setDstOffset(offset).setSize(stride));
+
+                mStats.FlushedRecords++;
+                mStats.FlushedBytes += stride;
+            }
+
+            // Records that are clean in every version leave the list
+            if (mDirtyMasks[record] != 0)
+                mDirtyRecords[kept++] = record;
+        }
+        mDirtyRecords.resize(kept);
+        mStats.CopyRegionCount = 0;
+
+        const SBTBuffer& sbt = version.Buffer;
+        const AllocatedBuffer& hostBuffer = sbt.IsDeviceLocal() ? sbt.StagingBuffer : sbt.PackedBuffer;
+
+        // No-op for host coherent memory
+        for (const auto& copyRegion : copyRegions)
+            vmaFlushAllocation(mDevice->GetAllocator(), hostBuffer.Allocation, copyRegion.srcOffset, copyRegion.size);
+
+        // The version isn't read by the GPU anymore, so only the copy has to be made visible to the dispatch
+        if (sbt.IsDeviceLocal() && !copyRegions.empty())
+        {
+            cmdBuf.copyBuffer(sbt.StagingBuffer.Buffer, sbt.PackedBuffer.Buffer, copyRegions);
+
+            auto barrier = vk::MemoryBarrier()
+                               .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+                               .setDstAccessMask(vk::AccessFlagBits::eShaderRead);
+
+            cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                                   vk::PipelineStageFlagBits::eRayTracingShaderKHR, (vk::DependencyFlagBits)0, 1,
+                                   &barrier, 0, nullptr, 0, nullptr);
+
+            mStats.CopyRegionCount = (uint32_t)copyRegions.size();
+        }
+
+        version.InFlight = true;
+        version.Submitted = false;
+        mNextVersion = (mNextVersion + 1) % mInfo.FramesInFlight;
+
+        return &version.Buffer;
+    }
+
+    void VersionedSBT::Submit(const SyncPoint& syncPoint)
+    {
+        for (auto& version : mVersions)
+        {
+            if (!version.InFlight || version.Submitted)
+                continue;
+            version.Sync = syncPoint;
+            version.Submitted = true;
+        }
+    }
+
+    void VersionedSBT::Update()
+    {
+        for (auto& version : mVersions)
+        {
+            if (version.InFlight && version.Submitted && mDevice->IsSyncPointReached(version.Sync))
+                version.InFlight = false;
+        }
+    }
+
+    bool VersionedSBT::Rebuild(vk::Pipeline pipeline, const SBTInfo& info)
+    {
+        if (mRecords.empty())
+            return false;
+
+        for (uint32_t g = 0; g < 4; g++)
+        {
+            // The strides and the offsets of the regions are fixed by the versions
+            if (GetRecordSize(info, g) != GetRecordSize(mSBTInfo, g))
+            {
+                VULRAY_LOG_ERROR("VersionedSBT::Rebuild: The shader record sizes must not change");
+                return false;
+            }
+            if (GetGroupIndices(info, g).size() > mRegions[g].RecordCapacity)
+                return false;
+        }
+
+        for (uint32_t g = 0; g < 4; g++)
+        {
+            Region& region = mRegions[g];
+            region.RecordCount = (uint32_t)GetGroupIndices(info, g).size();
+
+            // Only the regions change, the memory of versions in flight is rewritten by their next flush
+            for (auto& version : mVersions)
+            {
+                auto& addressRegion = GetAddressRegion(version.Buffer, g);
+                if (region.RecordCount == 0)
+                {
+                    addressRegion = vk::StridedDeviceAddressRegionKHR();
+                    continue;
+                }
+                addressRegion = vk::StridedDeviceAddressRegionKHR()
+                                    .setDeviceAddress(version.Buffer.PackedBuffer.DevAddress + region.Offset)
+                                    .setStride(region.Stride)
+                                    .setSize((vk::DeviceSize)region.Stride * region.RecordCount);
+            }
+        }
+
+        mSBTInfo.RayGenIndices = info.RayGenIndices;
+        mSBTInfo.MissIndices = info.MissIndices;
+        mSBTInfo.HitGroupIndices = info.HitGroupIndices;
+        mSBTInfo.CallableIndices = info.CallableIndices;
+
+        return WriteHandles(pipeline, mSBTInfo);
+    }
+
+    VersionedSBTStatistics VersionedSBT::GetStatistics() const
+    {
+        VersionedSBTStatistics outStats = mStats;
+        outStats.DirtyRecords = (uint32_t)mDirtyRecords.size();
+        return outStats;
+    }
+
+    bool VersionedSBT::WriteHandles(vk::Pipeline pipeline, const SBTInfo& info)
+    {
+        uint32_t groupCount = 0;
+        for (uint32_t g = 0; g < 4; g++)
+        {
+            for (uint32_t index : GetGroupIndices(info, g)) groupCount = std::max(groupCount, index + 1);
+        }
+
+        // No records, so no handles to write
+        if (groupCount == 0)
+            return true;
+
+        // A single call for all the groups, free if the device caches the handles of the pipeline
+        const uint8_t* handles = mDevice->GetShaderGroupHandles(pipeline, groupCount);
+        if (!handles)
+            return false;
+
+        const uint32_t handleSize = mDevice->GetRayTracingProperties().shaderGroupHandleSize;
+        for (uint32_t g = 0; g < 4; g++)
+        {
+            const Region& region = mRegions[g];
+            const auto& indices = GetGroupIndices(info, g);
+            for (uint32_t i = 0; i < region.RecordCount; i++)
+            {
+                const vk::DeviceSize recordOffset = region.Offset + (vk::DeviceSize)i * region.Stride;
+                memcpy(mRecords.data() + recordOffset, handles + (size_t)indices[i] * handleSize, handleSize);
+                MarkDirty(region.FirstRecord + i);
+            }
+        }
+        return true;
+    }
+
+    void VersionedSBT::MarkDirty(uint32_t record)
+    {
+        if (mDirtyMasks[record] == 0)
+            mDirtyRecords.push_back(record);
+
+        mDirtyMasks[record] = mInfo.FramesInFlight == 32 ? ~0u : (1u << mInfo.FramesInFlight) - 1;
+    }
+
+} // namespace vr
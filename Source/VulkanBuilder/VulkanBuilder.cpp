@@ -50,6 +50,9 @@ namespace vr
         // required extensions by Vulray
         instBuilder.enable_extension(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
 
+        if (Headless)
+            instBuilder.set_headless();
+
         if (EnableDebug)
         {
             instBuilder.request_validation_layers()
@@ -88,8 +91,10 @@ namespace vr
                                 .add_required_extensions(DeviceExtensions)
                                 .add_required_extensions(RayTracingExtensions)
                                 .prefer_gpu_device_type(vkb::PreferredDeviceType::discrete)
-                                .set_surface(surface)
-                                .require_present();
+                                .require_present(!Headless);
+
+        if (!Headless)
+            physSelector.set_surface(surface);
 
         // Enable needed features
         auto raytracingFeatures = vk::PhysicalDeviceRayTracingPipelineFeaturesKHR().setRayTracingPipeline(true);
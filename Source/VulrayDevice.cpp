@@ -16,7 +16,9 @@ namespace vr
         deviceProperties.pNext = &mRayTracingProperties;
         mRayTracingProperties.pNext = &mAccelProperties;
         mAccelProperties.pNext = &mDescriptorBufferProperties;
-        mDescriptorBufferProperties.pNext = nullptr;
+        mDescriptorBufferProperties.pNext = &mMaintenance4Properties;
+        mMaintenance4Properties.pNext = &mIDProperties;
+        mIDProperties.pNext = nullptr;
 
         mPhysicalDevice.getProperties2KHR(&deviceProperties, mDynLoader);
 
@@ -42,7 +44,22 @@ namespace vr
 
     VulrayDevice::~VulrayDevice()
     {
+        DestroyScratchPool();
+        DestroyASArena();
+        DestroyQueryPoolAllocator();
+
         if (!mUserSuppliedAllocator)
             vmaDestroyAllocator(mVMAllocator);
     }
+
+    bool VulrayDevice::IsSyncPointReached(const SyncPoint& syncPoint)
+    {
+        if (syncPoint.Fence)
+            return mDevice.getFenceStatus(syncPoint.Fence) == vk::Result::eSuccess;
+
+        if (syncPoint.TimelineSemaphore)
+            return mDevice.getSemaphoreCounterValue(syncPoint.TimelineSemaphore) >= syncPoint.TimelineValue;
+
+        return true;
+    }
 } // namespace vr